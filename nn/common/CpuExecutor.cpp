@@ -18,6 +18,7 @@
 
 #include "CpuExecutor.h"
 
+#include "MemoryAccounting.h"
 #include "NeuralNetworks.h"
 #include "OperationResolver.h"
 #include "Operations.h"
@@ -32,6 +33,12 @@
 #include <android/hardware_buffer.h>
 #include <sys/mman.h>
 
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
 namespace android {
 namespace nn {
 
@@ -466,6 +473,7 @@ static bool convertToNhwc(RunTimeOperandInfo& to, const RunTimeOperandInfo& from
             return false;
         }
         ptr_guard.reset(to.buffer);
+        chargeOperationScratch(MemoryCategory::KERNEL_SCRATCH, to.length);
         // convert value
         if (from.type == OperandType::TENSOR_FLOAT32) {
             return convertToNhwcImpl<float>(reinterpret_cast<float*>(to.buffer),
@@ -503,6 +511,8 @@ static bool convertFromNhwc(RunTimeOperandInfo& to, const RunTimeOperandInfo& fr
         if (!setInfoAndAllocateIfNeeded(&to, outShape, result)) {
             return false;
         }
+        // The NHWC result the operation computed into.
+        chargeOperationScratch(MemoryCategory::KERNEL_SCRATCH, from.length);
         // convert value
         if (from.type == OperandType::TENSOR_FLOAT32) {
             return convertFromNhwcImpl<float>(reinterpret_cast<float*>(to.buffer),
@@ -530,51 +540,16 @@ static bool convertFromNhwc(RunTimeOperandInfo& to, const RunTimeOperandInfo& fr
     return true;
 }
 
-// Ignore the .pools entry in model and request.  This will have been taken care of
-// by the caller.
-int CpuExecutor::run(const Model& model, const Request& request,
-                     const std::vector<RunTimePoolInfo>& modelPoolInfos,
-                     const std::vector<RunTimePoolInfo>& requestPoolInfos) {
-    NNTRACE_CPU(NNTRACE_PHASE_EXECUTION, "run");
-    VLOG(CPUEXE) << "CpuExecutor::run() with request(" << SHOW_IF_DEBUG(toString(request)) << ")";
-
-    // b/109953668, disable OpenMP
-#ifdef NNAPI_OPENMP
-    ScopedOpenmpSettings openMpSettings;
-#endif  // NNAPI_OPENMP
-
-    mModel = &model;
-    mRequest = &request;  // TODO check if mRequest is needed
-    initializeRunTimeInfo(modelPoolInfos, requestPoolInfos);
-    // The model has serialized the operation in execution order.
-    for (const auto& operation : model.operations) {
-        int n = executeOperation(operation);
-        if (n != ANEURALNETWORKS_NO_ERROR) {
-            finish(n);
-            return n;
-        }
-    }
-    for (auto& runtimeInfo : modelPoolInfos) {
-        runtimeInfo.update();
-    }
-    for (auto& runtimeInfo : requestPoolInfos) {
-        runtimeInfo.update();
-    }
-    finish(ANEURALNETWORKS_NO_ERROR);
-    VLOG(CPUEXE) << "Completed run normally";
-    return ANEURALNETWORKS_NO_ERROR;
-}
-
-bool CpuExecutor::initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& modelPoolInfos,
-                                        const std::vector<RunTimePoolInfo>& requestPoolInfos) {
-    VLOG(CPUEXE) << "CpuExecutor::initializeRunTimeInfo";
-    const size_t count = mModel->operands.size();
-    mOperands.resize(count);
-
-    // Start by setting the runtime info to what's in the model.
+// Sets operands to the runtime information of the operands of model before a
+// request is applied.
+static void initializeModelOperands(const Model& model,
+                                    const std::vector<RunTimePoolInfo>& modelPoolInfos,
+                                    std::vector<RunTimeOperandInfo>* operands) {
+    const size_t count = model.operands.size();
+    operands->resize(count);
     for (size_t i = 0; i < count; i++) {
-        const Operand& from = mModel->operands[i];
-        RunTimeOperandInfo& to = mOperands[i];
+        const Operand& from = model.operands[i];
+        RunTimeOperandInfo& to = (*operands)[i];
         to.type = from.type;
         to.dimensions = from.dimensions;
         to.scale = from.scale;
@@ -588,7 +563,7 @@ bool CpuExecutor::initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& mode
                 to.numberOfUsesLeft = from.numberOfConsumers;
                 break;
             case OperandLifeTime::CONSTANT_COPY:
-                to.buffer = const_cast<uint8_t*>(&mModel->operandValues[from.location.offset]);
+                to.buffer = const_cast<uint8_t*>(&model.operandValues[from.location.offset]);
                 to.numberOfUsesLeft = 0;
                 break;
             case OperandLifeTime::CONSTANT_REFERENCE: {
@@ -610,6 +585,121 @@ bool CpuExecutor::initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& mode
                 break;
         }
     }
+}
+
+CpuExecutorModel::CpuExecutorModel(const Model& model,
+                                   const std::vector<RunTimePoolInfo>& modelPoolInfos)
+    : mModel(model), mModelPoolInfos(modelPoolInfos) {
+    NNTRACE_CPU(NNTRACE_PHASE_COMPILATION, "CpuExecutorModel");
+    initializeModelOperands(model, modelPoolInfos, &mOperands);
+    for (uint32_t i = 0; i < model.operands.size(); i++) {
+        const OperandLifeTime lifetime = model.operands[i].lifetime;
+        if (lifetime != OperandLifeTime::CONSTANT_COPY &&
+            lifetime != OperandLifeTime::CONSTANT_REFERENCE) {
+            mRunTimeOperandIndexes.push_back(i);
+        }
+    }
+}
+
+std::vector<RunTimeOperandInfo> CpuExecutorModel::borrowOperands() const {
+    std::vector<RunTimeOperandInfo> operands;
+    {
+        std::lock_guard<std::mutex> lock(mReturnedOperandsMutex);
+        if (mReturnedOperands.empty()) {
+            return mOperands;
+        }
+        operands = std::move(mReturnedOperands.back());
+        mReturnedOperands.pop_back();
+    }
+    // Assigning an operand reuses the storage of its dimensions.
+    for (uint32_t i : mRunTimeOperandIndexes) {
+        operands[i] = mOperands[i];
+    }
+    return operands;
+}
+
+void CpuExecutorModel::returnOperands(std::vector<RunTimeOperandInfo> operands) const {
+    std::lock_guard<std::mutex> lock(mReturnedOperandsMutex);
+    if (mReturnedOperands.size() < kMaxReturnedOperands) {
+        mReturnedOperands.push_back(std::move(operands));
+    }
+}
+
+// Ignore the .pools entry in model and request.  This will have been taken care of
+// by the caller.
+int CpuExecutor::run(const Model& model, const Request& request,
+                     const std::vector<RunTimePoolInfo>& modelPoolInfos,
+                     const std::vector<RunTimePoolInfo>& requestPoolInfos) {
+    mModel = &model;
+    mRequest = &request;  // TODO check if mRequest is needed
+    return execute(nullptr, modelPoolInfos, requestPoolInfos);
+}
+
+int CpuExecutor::run(const CpuExecutorModel& preparedModel, const Request& request,
+                     const std::vector<RunTimePoolInfo>& requestPoolInfos) {
+    mModel = &preparedModel.getModel();
+    mRequest = &request;
+    return execute(&preparedModel, preparedModel.getModelPoolInfos(), requestPoolInfos);
+}
+
+int CpuExecutor::execute(const CpuExecutorModel* preparedModel,
+                         const std::vector<RunTimePoolInfo>& modelPoolInfos,
+                         const std::vector<RunTimePoolInfo>& requestPoolInfos) {
+    NNTRACE_CPU(NNTRACE_PHASE_EXECUTION, "run");
+    VLOG(CPUEXE) << "CpuExecutor::run() with request(" << SHOW_IF_DEBUG(toString(*mRequest))
+                 << ")";
+
+    // b/109953668, disable OpenMP
+#ifdef NNAPI_OPENMP
+    ScopedOpenmpSettings openMpSettings;
+#endif  // NNAPI_OPENMP
+
+    const Model& model = *mModel;
+    initializeRunTimeInfo(preparedModel, modelPoolInfos, requestPoolInfos);
+    mProfile.clear();
+    mMemoryAccount = gCurrentMemoryAccount;
+    if (mMemoryAccount != nullptr) {
+        mAccountedTemporaries.assign(mOperands.size(), false);
+    }
+    // The model has serialized the operation in execution order.
+    for (uint32_t operationIndex = 0; operationIndex < model.operations.size(); operationIndex++) {
+        const Operation& operation = model.operations[operationIndex];
+        int n = mProfiling ? executeAndProfileOperation(operationIndex)
+                           : executeOperation(operation);
+        if (mMemoryAccount != nullptr) {
+            if (n == ANEURALNETWORKS_NO_ERROR) {
+                n = accountOperation(operation);
+            }
+            mMemoryAccount->releaseOperationScratch();
+        }
+        if (n != ANEURALNETWORKS_NO_ERROR) {
+            finish(n);
+            return n;
+        }
+        freeNoLongerUsedOperands(operation.inputs);
+    }
+    for (auto& runtimeInfo : modelPoolInfos) {
+        runtimeInfo.update();
+    }
+    for (auto& runtimeInfo : requestPoolInfos) {
+        runtimeInfo.update();
+    }
+    finish(ANEURALNETWORKS_NO_ERROR);
+    VLOG(CPUEXE) << "Completed run normally";
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
+bool CpuExecutor::initializeRunTimeInfo(const CpuExecutorModel* preparedModel,
+                                        const std::vector<RunTimePoolInfo>& modelPoolInfos,
+                                        const std::vector<RunTimePoolInfo>& requestPoolInfos) {
+    VLOG(CPUEXE) << "CpuExecutor::initializeRunTimeInfo";
+    // Start by setting the runtime info to what's in the model.
+    if (preparedModel != nullptr) {
+        mOperands = preparedModel->borrowOperands();
+    } else {
+        initializeModelOperands(*mModel, modelPoolInfos, &mOperands);
+    }
+    mPreparedModel = preparedModel;
 
     // Adjust the runtime info for the arguments passed to the model,
     // modifying the buffer location, and possibly the dimensions.
@@ -657,12 +747,37 @@ void CpuExecutor::freeNoLongerUsedOperands(const std::vector<uint32_t>& inputs)
         }
         info.numberOfUsesLeft--;
         if (info.numberOfUsesLeft == 0 && info.buffer != nullptr) {
+            releaseTemporaryAccounting(i);
             delete[] info.buffer;
             info.buffer = nullptr;
         }
     }
 }
 
+int CpuExecutor::accountOperation(const Operation& operation) {
+    for (uint32_t i : operation.outputs) {
+        const RunTimeOperandInfo& info = mOperands[i];
+        if (info.lifetime == OperandLifeTime::TEMPORARY_VARIABLE && info.buffer != nullptr &&
+            !mAccountedTemporaries[i]) {
+            mAccountedTemporaries[i] = true;
+            mMemoryAccount->allocate(MemoryCategory::CPU_TEMPORARIES, info.length);
+        }
+    }
+    // The kernel's scratch memory has been charged while it ran.
+    if (mMemoryAccount->isOverBudget()) {
+        LOG(ERROR) << getOperationName(operation.type) << " exceeded the memory budget.";
+        return ANEURALNETWORKS_OUT_OF_MEMORY;
+    }
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
+void CpuExecutor::releaseTemporaryAccounting(uint32_t operandIndex) {
+    if (mMemoryAccount != nullptr && mAccountedTemporaries[operandIndex]) {
+        mAccountedTemporaries[operandIndex] = false;
+        mMemoryAccount->release(MemoryCategory::CPU_TEMPORARIES, mOperands[operandIndex].length);
+    }
+}
+
 int CpuExecutor::executeOperation(const Operation& operation) {
     // VLOG(CPUEXE) << "CpuExecutor::executeOperation(" << toString(operation) << ")";
     const hidl_vec<uint32_t>& ins = operation.inputs;
@@ -1755,18 +1870,57 @@ int CpuExecutor::executeOperation(const Operation& operation) {
         return result;
     }
 
-    freeNoLongerUsedOperands(ins);
     return ANEURALNETWORKS_NO_ERROR;
 }
 
+int CpuExecutor::executeAndProfileOperation(uint32_t operationIndex) {
+    const Operation& operation = mModel->operations[operationIndex];
+    // Temporaries that have no buffer yet are allocated by this operation.
+    std::vector<bool> hadBuffer(operation.outputs.size());
+    for (size_t i = 0; i < operation.outputs.size(); i++) {
+        hadBuffer[i] = mOperands[operation.outputs[i]].buffer != nullptr;
+    }
+
+    gLastComputationTrace = nullptr;
+    const auto start = std::chrono::steady_clock::now();
+    const int n = executeOperation(operation);
+    const auto end = std::chrono::steady_clock::now();
+
+    CpuOperationProfile profile;
+    profile.operationIndex = operationIndex;
+    profile.type = operation.type;
+    profile.startNs = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch())
+                              .count();
+    profile.durationNs =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    profile.outputBytes = 0;
+    profile.temporaryBytes = 0;
+    profile.kernel = gLastComputationTrace;
+    for (size_t i = 0; i < operation.outputs.size(); i++) {
+        const RunTimeOperandInfo& info = mOperands[operation.outputs[i]];
+        if (!isExtensionOperandType(info.type)) {
+            profile.outputBytes += nonExtensionOperandSizeOfData(info.type, info.dimensions);
+        }
+        if (info.lifetime == OperandLifeTime::TEMPORARY_VARIABLE && !hadBuffer[i] &&
+            info.buffer != nullptr) {
+            profile.temporaryBytes += info.length;
+        }
+    }
+    mProfile.push_back(profile);
+    return n;
+}
+
 void CpuExecutor::finish(int result) {
     // Free allocated temporary operands.
-    for (auto& info : mOperands) {
+    for (uint32_t i = 0; i < mOperands.size(); i++) {
+        auto& info = mOperands[i];
         if (info.lifetime == OperandLifeTime::TEMPORARY_VARIABLE && info.buffer != nullptr) {
+            releaseTemporaryAccounting(i);
             delete[] info.buffer;
             info.buffer = nullptr;
         }
     }
+    mMemoryAccount = nullptr;
 
     // Only report the output shapes when the result code is NO_ERROR or
     // OUTPUT_INSUFFICIENT_SIZE.
@@ -1783,11 +1937,128 @@ void CpuExecutor::finish(int result) {
         mOutputShapes.clear();
     }
 
+    if (mPreparedModel != nullptr) {
+        mPreparedModel->returnOperands(std::move(mOperands));
+        mOperands.clear();
+        mPreparedModel = nullptr;
+    }
     mModel = nullptr;
     mRequest = nullptr;
     mFinished = true;
 }
 
+MemoryUsage estimateCpuMemoryUsage(const Model& model) {
+    auto sizeOfData = [&model](uint32_t operandIndex) -> uint64_t {
+        const Operand& operand = model.operands[operandIndex];
+        if (isExtensionOperandType(operand.type)) {
+            return 0;
+        }
+        return nonExtensionOperandSizeOfData(operand.type, operand.dimensions);
+    };
+
+    MemoryUsage usage;
+    uint64_t liveTemporaries = 0;
+    std::vector<uint32_t> numberOfUsesLeft(model.operands.size());
+    for (uint32_t i = 0; i < model.operands.size(); i++) {
+        numberOfUsesLeft[i] = model.operands[i].numberOfConsumers;
+    }
+    for (const Operation& operation : model.operations) {
+        uint64_t fp16Conversion = 0;
+        for (uint32_t i : operation.inputs) {
+            if (model.operands[i].type == OperandType::TENSOR_FLOAT16) {
+                fp16Conversion += 2 * sizeOfData(i);
+            }
+        }
+        for (uint32_t i : operation.outputs) {
+            if (model.operands[i].lifetime == OperandLifeTime::TEMPORARY_VARIABLE) {
+                liveTemporaries += sizeOfData(i);
+            }
+            if (model.operands[i].type == OperandType::TENSOR_FLOAT16) {
+                fp16Conversion += 2 * sizeOfData(i);
+            }
+        }
+        usage[MemoryCategory::CPU_TEMPORARIES] =
+                std::max(usage[MemoryCategory::CPU_TEMPORARIES], liveTemporaries);
+        usage[MemoryCategory::FP16_CONVERSION] =
+                std::max(usage[MemoryCategory::FP16_CONVERSION], fp16Conversion);
+
+        if (operation.type == OperationType::CONV_2D) {
+            // The im2col buffer has a row of filterHeight * filterWidth * inputDepth
+            // elements for each output pixel. Both the filter and the output hold
+            // outputDepth times that many elements.
+            const Operand& filter = model.operands[operation.inputs[1]];
+            const Operand& output = model.operands[operation.outputs[0]];
+            if (!tensorHasUnspecifiedDimensions(filter) && !tensorHasUnspecifiedDimensions(output)) {
+                auto numberOfElements = [](const hidl_vec<uint32_t>& dimensions) {
+                    return std::accumulate(dimensions.begin(), dimensions.end(), uint64_t(1),
+                                           std::multiplies<uint64_t>());
+                };
+                const uint64_t outputDepth = filter.dimensions[0];
+                const uint64_t elementSize = filter.type == OperandType::TENSOR_QUANT8_ASYMM
+                                                     ? sizeof(uint8_t)
+                                                     : sizeof(float);
+                const uint64_t im2col = numberOfElements(filter.dimensions) / outputDepth *
+                                        (numberOfElements(output.dimensions) / outputDepth) *
+                                        elementSize;
+                usage[MemoryCategory::KERNEL_SCRATCH] =
+                        std::max(usage[MemoryCategory::KERNEL_SCRATCH], im2col);
+            }
+        }
+
+        for (uint32_t i : operation.inputs) {
+            if (model.operands[i].lifetime == OperandLifeTime::TEMPORARY_VARIABLE &&
+                numberOfUsesLeft[i] > 0 && --numberOfUsesLeft[i] == 0) {
+                liveTemporaries -= sizeOfData(i);
+            }
+        }
+    }
+    return usage;
+}
+
+// Writes value as a JSON string literal.
+static void writeJsonString(std::ostream& out, const std::string& value) {
+    out << '"';
+    for (const char c : value) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            const char* const kHexDigits = "0123456789abcdef";
+            out << "\\u00" << kHexDigits[c >> 4] << kHexDigits[c & 0xf];
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+std::string cpuProfileToChromeTrace(const std::vector<CpuOperationProfile>& profile) {
+    // Timestamps are relative to the first operation, in microseconds.
+    uint64_t originNs = 0;
+    if (!profile.empty()) {
+        originNs = std::min_element(profile.begin(), profile.end(),
+                                    [](const CpuOperationProfile& a, const CpuOperationProfile& b) {
+                                        return a.startNs < b.startNs;
+                                    })
+                           ->startNs;
+    }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    for (size_t i = 0; i < profile.size(); i++) {
+        const CpuOperationProfile& entry = profile[i];
+        out << (i == 0 ? "\n" : ",\n") << "{\"name\":";
+        writeJsonString(out, getOperationName(entry.type));
+        out << ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":0,\"tid\":0"
+            << ",\"ts\":" << (entry.startNs - originNs) / 1000.0
+            << ",\"dur\":" << entry.durationNs / 1000.0 << ",\"args\":{\"operation\":"
+            << entry.operationIndex << ",\"kernel\":";
+        writeJsonString(out, entry.kernel ? entry.kernel : "");
+        out << ",\"outputBytes\":" << entry.outputBytes
+            << ",\"temporaryBytes\":" << entry.temporaryBytes << "}}";
+    }
+    out << "\n]}\n";
+    return out.str();
+}
+
 // b/109953668, disable OpenMP
 #ifdef NNAPI_OPENMP
 ScopedOpenmpSettings::ScopedOpenmpSettings() {
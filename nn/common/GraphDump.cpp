@@ -19,8 +19,11 @@
 #include "GraphDump.h"
 
 #include "HalInterfaces.h"
+#include "Utils.h"
 
 #include <android-base/logging.h>
+#include <algorithm>
+#include <iomanip>
 #include <set>
 #include <iostream>
 #include <sstream>
@@ -122,13 +125,116 @@ void tryValueDump(Dumper& dump, const Model& model, const Operand& opnd) {
 }
 }
 
+namespace {
+
+// The size of the operand's data, or 0 if it is not known.
+uint32_t operandBytes(const Operand& operand) {
+    return isExtensionOperandType(operand.type) ? 0 : nonExtensionOperandSizeOfData(operand);
+}
+
+// How data flows between the steps of the plan described by annotations.
+class StepFlow {
+   public:
+    StepFlow(const Model& model, const GraphDumpAnnotations& annotations)
+        : mAnnotations(annotations),
+          mProducerSteps(model.operands.size(), GraphDumpAnnotations::kNoStep),
+          mStepInputBytes(annotations.stepDevices.size(), 0) {
+        for (uint32_t i = 0; i < model.operations.size(); i++) {
+            for (uint32_t operand : model.operations[i].outputs) {
+                mProducerSteps[operand] = getStep(i);
+            }
+        }
+        // A step receives each operand once, however many of its operations
+        // read it.
+        std::set<std::pair<uint32_t, uint32_t>> received;
+        for (uint32_t i = 0; i < model.operations.size(); i++) {
+            for (uint32_t operand : model.operations[i].inputs) {
+                const uint32_t step = getStep(i);
+                if (crossesSteps(operand, i) && step < mStepInputBytes.size() &&
+                    received.insert({step, operand}).second) {
+                    mStepInputBytes[step] += operandBytes(model.operands[operand]);
+                }
+            }
+        }
+    }
+
+    uint32_t getStep(uint32_t operation) const {
+        return operation < mAnnotations.operationSteps.size()
+                       ? mAnnotations.operationSteps[operation]
+                       : GraphDumpAnnotations::kNoStep;
+    }
+
+    // Whether the operand is produced by a step other than the one of the
+    // operation reading it.
+    bool crossesSteps(uint32_t operand, uint32_t consumerOperation) const {
+        const uint32_t producer = mProducerSteps[operand];
+        const uint32_t consumer = getStep(consumerOperation);
+        return producer != GraphDumpAnnotations::kNoStep &&
+               consumer != GraphDumpAnnotations::kNoStep && producer != consumer;
+    }
+
+    uint64_t getStepInputBytes(uint32_t step) const { return mStepInputBytes[step]; }
+
+   private:
+    const GraphDumpAnnotations& mAnnotations;
+    std::vector<uint32_t> mProducerSteps;
+    std::vector<uint64_t> mStepInputBytes;
+};
+
+uint64_t getOperationTimeNs(const GraphDumpAnnotations& annotations, uint32_t operation) {
+    return operation < annotations.operationTimesNs.size()
+                   ? annotations.operationTimesNs[operation]
+                   : 0;
+}
+
+std::string jsonString(const std::string& value) {
+    std::ostringstream out;
+    out << '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+template <typename T>
+std::string jsonArray(const T& values) {
+    std::ostringstream out;
+    out << '[';
+    for (size_t i = 0; i < values.size(); i++) {
+        out << (i > 0 ? ", " : "") << values[i];
+    }
+    out << ']';
+    return out.str();
+}
+
+}  // namespace
+
 void graphDump(const char* name, const Model& model, std::ostream* outStream) {
+    graphDump(name, model, GraphDumpAnnotations(), outStream);
+}
+
+void graphDump(const char* name, const Model& model, const GraphDumpAnnotations& annotations,
+               std::ostream* outStream) {
     // Operand nodes are named "d" (operanD) followed by operand index.
     // Operation nodes are named "n" (operatioN) followed by operation index.
     // (These names are not the names that are actually displayed -- those
     //  names are given by the "label" attribute.)
 
     Dumper dump(outStream);
+    const bool annotated =
+            !annotations.operationSteps.empty() || !annotations.operationTimesNs.empty();
+    const StepFlow flow(model, annotations);
+    uint64_t maxTimeNs = 0;
+    for (uint64_t timeNs : annotations.operationTimesNs) {
+        maxTimeNs = std::max(maxTimeNs, timeNs);
+    }
 
     dump << "// " << name << Dumper::endl;
     dump << "digraph {" << Dumper::endl;
@@ -182,6 +288,9 @@ void graphDump(const char* name, const Model& model, std::ostream* outStream) {
             }
             dump << ")";
         }
+        if (annotated) {
+            dump << "\\n" << operandBytes(opnd) << "B";
+        }
         dump << "\"]" << Dumper::endl;
     }
 
@@ -197,13 +306,35 @@ void graphDump(const char* name, const Model& model, std::ostream* outStream) {
                 dump << " ordering=out";
             }
         }
-        dump << " label=\"" << i << ": "
-             << toString(operation.type) << "\"]" << Dumper::endl;
+        const uint64_t timeNs = getOperationTimeNs(annotations, i);
+        if (timeNs > 0) {
+            // HSV: a pure red hue, saturated in proportion to the time.
+            std::ostringstream color;
+            color << std::fixed << std::setprecision(3)
+                  << static_cast<double>(timeNs) / maxTimeNs;
+            dump << " style=filled fillcolor=\"0.000 " << color.str() << " 1.000\"";
+        }
+        dump << " label=\"" << i << ": " << toString(operation.type);
+        if (timeNs > 0) {
+            dump << "\\n" << timeNs / 1000 << "us";
+        }
+        dump << "\"]" << Dumper::endl;
         {
             // operation inputs
             for (unsigned in = 0, inE = operation.inputs.size(); in < inE; in++) {
-                dump << "    d" << operation.inputs[in] << " -> n" << i;
-                if (inE > 1) {
+                const uint32_t operand = operation.inputs[in];
+                dump << "    d" << operand << " -> n" << i;
+                if (annotated) {
+                    dump << " [label=\"";
+                    if (inE > 1) {
+                        dump << in << ": ";
+                    }
+                    dump << operandBytes(model.operands[operand]) << "B\"";
+                    if (flow.crossesSteps(operand, i)) {
+                        dump << " color=red penwidth=3";
+                    }
+                    dump << "]";
+                } else if (inE > 1) {
                     dump << " [label=" << in << "]";
                 }
                 dump << Dumper::endl;
@@ -213,14 +344,81 @@ void graphDump(const char* name, const Model& model, std::ostream* outStream) {
         {
             // operation outputs
             for (unsigned out = 0, outE = operation.outputs.size(); out < outE; out++) {
-                dump << "    n" << i << " -> d" << operation.outputs[out];
-                if (outE > 1) {
+                const uint32_t operand = operation.outputs[out];
+                dump << "    n" << i << " -> d" << operand;
+                if (annotated) {
+                    dump << " [label=\"";
+                    if (outE > 1) {
+                        dump << out << ": ";
+                    }
+                    dump << operandBytes(model.operands[operand]) << "B\"]";
+                } else if (outE > 1) {
                     dump << " [label=" << out << "]";
                 }
                 dump << Dumper::endl;
             }
         }
     }
+
+    // plan steps
+    for (uint32_t step = 0; step < annotations.stepDevices.size(); step++) {
+        dump << "    subgraph cluster_step" << step << " {" << Dumper::endl;
+        dump << "        label=\"step " << step << ": " << annotations.stepDevices[step]
+             << "\\nreceives " << flow.getStepInputBytes(step) << "B\" style=dashed"
+             << Dumper::endl;
+        for (uint32_t i = 0; i < model.operations.size(); i++) {
+            if (flow.getStep(i) == step) {
+                dump << "        n" << i << Dumper::endl;
+            }
+        }
+        dump << "    }" << Dumper::endl;
+    }
+    dump << "}" << Dumper::endl;
+}
+
+void graphDumpJson(const char* name, const Model& model, const GraphDumpAnnotations& annotations,
+                   std::ostream* outStream) {
+    Dumper dump(outStream);
+    const StepFlow flow(model, annotations);
+
+    dump << "{" << Dumper::endl;
+    dump << "  \"name\": " << jsonString(name) << "," << Dumper::endl;
+
+    dump << "  \"operands\": [" << Dumper::endl;
+    for (uint32_t i = 0; i < model.operands.size(); i++) {
+        const Operand& operand = model.operands[i];
+        dump << "    {\"index\": " << i << ", \"type\": " << jsonString(toString(operand.type))
+             << ", \"lifetime\": " << jsonString(toString(operand.lifetime))
+             << ", \"dimensions\": " << jsonArray(operand.dimensions)
+             << ", \"bytes\": " << operandBytes(operand) << "}"
+             << (i + 1 < model.operands.size() ? "," : "") << Dumper::endl;
+    }
+    dump << "  ]," << Dumper::endl;
+
+    dump << "  \"operations\": [" << Dumper::endl;
+    for (uint32_t i = 0; i < model.operations.size(); i++) {
+        const Operation& operation = model.operations[i];
+        dump << "    {\"index\": " << i << ", \"type\": " << jsonString(toString(operation.type))
+             << ", \"inputs\": " << jsonArray(operation.inputs)
+             << ", \"outputs\": " << jsonArray(operation.outputs);
+        if (flow.getStep(i) != GraphDumpAnnotations::kNoStep) {
+            dump << ", \"step\": " << flow.getStep(i);
+        }
+        if (i < annotations.operationTimesNs.size()) {
+            dump << ", \"timeNs\": " << annotations.operationTimesNs[i];
+        }
+        dump << "}" << (i + 1 < model.operations.size() ? "," : "") << Dumper::endl;
+    }
+    dump << "  ]," << Dumper::endl;
+
+    dump << "  \"steps\": [" << Dumper::endl;
+    for (uint32_t step = 0; step < annotations.stepDevices.size(); step++) {
+        dump << "    {\"index\": " << step
+             << ", \"device\": " << jsonString(annotations.stepDevices[step])
+             << ", \"inputBytesFromOtherSteps\": " << flow.getStepInputBytes(step) << "}"
+             << (step + 1 < annotations.stepDevices.size() ? "," : "") << Dumper::endl;
+    }
+    dump << "  ]" << Dumper::endl;
     dump << "}" << Dumper::endl;
 }
 
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "MemoryAccounting"
+
+#include "MemoryAccounting.h"
+
+#include <android-base/logging.h>
+#include <algorithm>
+#include <numeric>
+
+namespace android {
+namespace nn {
+
+// Defined here rather than with the CpuExecutor because the operations are
+// also linked into libneuralnetworks_utils, which does not contain the executor.
+thread_local MemoryAccount* gCurrentMemoryAccount = nullptr;
+
+const char* toString(MemoryCategory category) {
+    switch (category) {
+        case MemoryCategory::CPU_TEMPORARIES:
+            return "CPU_TEMPORARIES";
+        case MemoryCategory::KERNEL_SCRATCH:
+            return "KERNEL_SCRATCH";
+        case MemoryCategory::FP16_CONVERSION:
+            return "FP16_CONVERSION";
+        case MemoryCategory::POINTER_ARGUMENTS:
+            return "POINTER_ARGUMENTS";
+        case MemoryCategory::PARTITION_TEMPORARIES:
+            return "PARTITION_TEMPORARIES";
+    }
+    return "UNKNOWN";
+}
+
+uint64_t MemoryUsage::total() const {
+    return std::accumulate(bytes.begin(), bytes.end(), uint64_t(0));
+}
+
+bool MemoryAccount::allocateLocked(MemoryCategory category, uint64_t bytes) {
+    uint64_t& current = mCurrent[category];
+    current += bytes;
+    mPeak[category] = std::max(mPeak[category], current);
+    mCurrentTotal += bytes;
+    mPeakTotal = std::max(mPeakTotal, mCurrentTotal);
+    if (mBudget != 0 && mCurrentTotal > mBudget && !mOverBudget) {
+        LOG(ERROR) << "Execution exceeds its memory budget of " << mBudget << " bytes allocating "
+                   << bytes << " bytes of " << toString(category);
+        mOverBudget = true;
+    }
+    return !mOverBudget;
+}
+
+bool MemoryAccount::allocate(MemoryCategory category, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return allocateLocked(category, bytes);
+}
+
+void MemoryAccount::release(MemoryCategory category, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    uint64_t& current = mCurrent[category];
+    CHECK_GE(current, bytes) << "Releasing more " << toString(category) << " than allocated";
+    current -= bytes;
+    mCurrentTotal -= bytes;
+}
+
+bool MemoryAccount::allocateOperationScratch(MemoryCategory category, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mOperationScratch[category] += bytes;
+    return allocateLocked(category, bytes);
+}
+
+void MemoryAccount::releaseOperationScratch() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (uint32_t i = 0; i < kNumberOfMemoryCategories; i++) {
+        mCurrent.bytes[i] -= mOperationScratch.bytes[i];
+        mCurrentTotal -= mOperationScratch.bytes[i];
+    }
+    mOperationScratch = {};
+}
+
+MemoryUsage MemoryAccount::getPeakUsage() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mPeak;
+}
+
+uint64_t MemoryAccount::getPeakTotal() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mPeakTotal;
+}
+
+bool MemoryAccount::isOverBudget() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mOverBudget;
+}
+
+}  // namespace nn
+}  // namespace android
@@ -0,0 +1,408 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ModelCache"
+
+#include "ModelCache.h"
+
+#include "CpuExecutor.h"
+#include "Tracing.h"
+#include "Utils.h"
+#include "ValidateHal.h"
+
+#include <cutils/native_handle.h>
+#include <openssl/sha.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+namespace android {
+namespace nn {
+
+namespace {
+
+constexpr uint32_t kModelCacheMagic = 0x434d4e4e;  // "NNMC"
+// Bump whenever the layout written by ModelWriter changes.
+constexpr uint32_t kModelCacheVersion = 2;
+
+struct ModelCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint8_t token[ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN];
+    // Size in bytes of the data cache file, used to detect a stale or truncated data cache.
+    uint64_t dataCacheSize;
+    // SHA-256 of the rest of the model cache file, which holds the graph and the small constants,
+    // so that a corrupted file that still parses is not run with the wrong values.
+    uint8_t bodyDigest[SHA256_DIGEST_LENGTH];
+};
+
+size_t alignToPage(size_t size) {
+    const size_t pageSize = getpagesize();
+    return (size + pageSize - 1) / pageSize * pageSize;
+}
+
+// Returns the single fd held by a cache handle, or -1.
+int getCacheFd(const hidl_handle& handle) {
+    const native_handle_t* nativeHandle = handle.getNativeHandle();
+    if (nativeHandle == nullptr || nativeHandle->numFds != 1) {
+        LOG(ERROR) << "Cache handle must hold exactly one fd";
+        return -1;
+    }
+    return nativeHandle->data[0];
+}
+
+bool writeAll(int fd, const void* data, size_t length) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (length > 0) {
+        const ssize_t written = write(fd, bytes, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            PLOG(ERROR) << "Failed to write cache file";
+            return false;
+        }
+        bytes += written;
+        length -= written;
+    }
+    return true;
+}
+
+bool readAll(int fd, void* data, size_t length) {
+    uint8_t* bytes = static_cast<uint8_t*>(data);
+    while (length > 0) {
+        const ssize_t bytesRead = read(fd, bytes, length);
+        if (bytesRead < 0 && errno == EINTR) continue;
+        if (bytesRead <= 0) {
+            PLOG(ERROR) << "Failed to read cache file";
+            return false;
+        }
+        bytes += bytesRead;
+        length -= bytesRead;
+    }
+    return true;
+}
+
+// Serializes the graph part of a Model into a flat byte buffer.
+class ModelWriter {
+   public:
+    template <typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "must be trivially copyable");
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        mBuffer.insert(mBuffer.end(), bytes, bytes + sizeof(T));
+    }
+    template <typename T>
+    void writeVec(const hidl_vec<T>& vec) {
+        static_assert(std::is_trivially_copyable<T>::value, "must be trivially copyable");
+        write<uint32_t>(vec.size());
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(vec.data());
+        mBuffer.insert(mBuffer.end(), bytes, bytes + vec.size() * sizeof(T));
+    }
+    void writeString(const hidl_string& str) {
+        write<uint32_t>(str.size());
+        mBuffer.insert(mBuffer.end(), str.c_str(), str.c_str() + str.size());
+    }
+    const std::vector<uint8_t>& buffer() const { return mBuffer; }
+
+   private:
+    std::vector<uint8_t> mBuffer;
+};
+
+// Deserializes what ModelWriter produced. All reads are bounds checked; once a read fails
+// every subsequent read fails as well, so callers only need to check ok() at the end.
+class ModelReader {
+   public:
+    ModelReader(const uint8_t* data, size_t size) : mData(data), mSize(size) {}
+
+    template <typename T>
+    T read() {
+        static_assert(std::is_trivially_copyable<T>::value, "must be trivially copyable");
+        T value{};
+        if (take(sizeof(T))) {
+            memcpy(&value, mData + mOffset - sizeof(T), sizeof(T));
+        }
+        return value;
+    }
+    template <typename T>
+    hidl_vec<T> readVec() {
+        static_assert(std::is_trivially_copyable<T>::value, "must be trivially copyable");
+        const uint32_t count = read<uint32_t>();
+        hidl_vec<T> vec;
+        if (mOk && count <= (mSize - mOffset) / sizeof(T)) {
+            vec.resize(count);
+            take(count * sizeof(T));
+            memcpy(vec.data(), mData + mOffset - count * sizeof(T), count * sizeof(T));
+        } else {
+            mOk = false;
+        }
+        return vec;
+    }
+    hidl_string readString() {
+        const uint32_t length = read<uint32_t>();
+        if (!take(length)) {
+            return hidl_string();
+        }
+        return hidl_string(reinterpret_cast<const char*>(mData + mOffset - length), length);
+    }
+    bool ok() const { return mOk; }
+    bool atEnd() const { return mOffset == mSize; }
+
+   private:
+    bool take(size_t length) {
+        if (!mOk || length > mSize - mOffset) {
+            mOk = false;
+            return false;
+        }
+        mOffset += length;
+        return true;
+    }
+
+    const uint8_t* mData;
+    size_t mSize;
+    size_t mOffset = 0;
+    bool mOk = true;
+};
+
+void writeOperand(const Operand& operand, ModelWriter* writer) {
+    writer->write(operand.type);
+    writer->writeVec(operand.dimensions);
+    writer->write(operand.numberOfConsumers);
+    writer->write(operand.scale);
+    writer->write(operand.zeroPoint);
+    writer->write(operand.lifetime);
+    writer->write(operand.location);
+    const auto discriminator = operand.extraParams.getDiscriminator();
+    writer->write(discriminator);
+    switch (discriminator) {
+        case Operand::ExtraParams::hidl_discriminator::none:
+            break;
+        case Operand::ExtraParams::hidl_discriminator::channelQuant:
+            writer->write(operand.extraParams.channelQuant().channelDim);
+            writer->writeVec(operand.extraParams.channelQuant().scales);
+            break;
+        case Operand::ExtraParams::hidl_discriminator::extension:
+            writer->writeVec(operand.extraParams.extension());
+            break;
+    }
+}
+
+bool readOperand(ModelReader* reader, Operand* operand) {
+    operand->type = reader->read<OperandType>();
+    operand->dimensions = reader->readVec<uint32_t>();
+    operand->numberOfConsumers = reader->read<uint32_t>();
+    operand->scale = reader->read<float>();
+    operand->zeroPoint = reader->read<int32_t>();
+    operand->lifetime = reader->read<OperandLifeTime>();
+    operand->location = reader->read<DataLocation>();
+    const auto discriminator = reader->read<Operand::ExtraParams::hidl_discriminator>();
+    switch (discriminator) {
+        case Operand::ExtraParams::hidl_discriminator::none:
+            break;
+        case Operand::ExtraParams::hidl_discriminator::channelQuant: {
+            SymmPerChannelQuantParams channelQuant;
+            channelQuant.channelDim = reader->read<uint32_t>();
+            channelQuant.scales = reader->readVec<float>();
+            operand->extraParams.channelQuant(std::move(channelQuant));
+            break;
+        }
+        case Operand::ExtraParams::hidl_discriminator::extension:
+            operand->extraParams.extension(reader->readVec<uint8_t>());
+            break;
+        default:
+            LOG(ERROR) << "Unknown operand extraParams discriminator in model cache";
+            return false;
+    }
+    return reader->ok();
+}
+
+// Creates a read-only "mmap_fd" region of fd. The fd is dup'ed so that the region
+// outlives the cache handle it came from.
+std::optional<hidl_memory> createReadOnlyRegion(int fd, size_t offset, size_t size) {
+    const int dupfd = dup(fd);
+    if (dupfd == -1) {
+        PLOG(ERROR) << "Failed to dup the data cache fd";
+        return std::nullopt;
+    }
+    native_handle_t* nativeHandle = native_handle_create(1, 3);
+    if (nativeHandle == nullptr) {
+        close(dupfd);
+        return std::nullopt;
+    }
+    nativeHandle->data[0] = dupfd;
+    nativeHandle->data[1] = PROT_READ;
+    nativeHandle->data[2] = (int32_t)(uint32_t)(offset & 0xffffffff);
+#if defined(__LP64__)
+    nativeHandle->data[3] = (int32_t)(uint32_t)(offset >> 32);
+#else
+    nativeHandle->data[3] = 0;
+#endif
+    hidl_handle handle;
+    handle.setTo(nativeHandle, /*shouldOwn=*/true);
+    return hidl_memory("mmap_fd", std::move(handle), size);
+}
+
+}  // namespace
+
+bool writeModelToCache(const Model& model, const hidl_handle& modelCache,
+                       const hidl_handle& dataCache, const CacheToken& token) {
+    NNTRACE_FULL(NNTRACE_LAYER_UTILITY, NNTRACE_PHASE_COMPILATION, "writeModelToCache");
+    const int modelFd = getCacheFd(modelCache);
+    const int dataFd = getCacheFd(dataCache);
+    NN_RET_CHECK(modelFd >= 0 && dataFd >= 0);
+
+    std::vector<RunTimePoolInfo> poolInfos;
+    NN_RET_CHECK(setRunTimePoolInfosFromHidlMemories(&poolInfos, model.pools));
+
+    // Pools are laid out back to back in the data cache, each starting on a page boundary.
+    hidl_vec<uint64_t> poolOffsets(model.pools.size());
+    hidl_vec<uint64_t> poolSizes(model.pools.size());
+    size_t dataCacheSize = 0;
+    for (size_t i = 0; i < model.pools.size(); i++) {
+        poolOffsets[i] = dataCacheSize;
+        poolSizes[i] = model.pools[i].size();
+        dataCacheSize = alignToPage(dataCacheSize + poolSizes[i]);
+    }
+
+    ModelWriter writer;
+    writer.write<uint32_t>(model.operands.size());
+    for (const Operand& operand : model.operands) {
+        writeOperand(operand, &writer);
+    }
+    writer.write<uint32_t>(model.operations.size());
+    for (const Operation& operation : model.operations) {
+        writer.write(operation.type);
+        writer.writeVec(operation.inputs);
+        writer.writeVec(operation.outputs);
+    }
+    writer.writeVec(model.inputIndexes);
+    writer.writeVec(model.outputIndexes);
+    writer.writeVec(model.operandValues);
+    writer.writeVec(poolOffsets);
+    writer.writeVec(poolSizes);
+    writer.write<uint8_t>(model.relaxComputationFloat32toFloat16);
+    writer.write<uint32_t>(model.extensionNameToPrefix.size());
+    for (const auto& nameAndPrefix : model.extensionNameToPrefix) {
+        writer.writeString(nameAndPrefix.name);
+        writer.write(nameAndPrefix.prefix);
+    }
+
+    ModelCacheHeader header = {.magic = kModelCacheMagic,
+                               .version = kModelCacheVersion,
+                               .dataCacheSize = dataCacheSize};
+    memcpy(header.token, token.data(), sizeof(header.token));
+    SHA256(writer.buffer().data(), writer.buffer().size(), header.bodyDigest);
+
+    // Write the data cache first and the model cache header last, so that an interrupted write
+    // leaves a model cache that readModelFromCache rejects.
+    NN_RET_CHECK_EQ(ftruncate(dataFd, 0), 0);
+    NN_RET_CHECK_EQ(ftruncate(modelFd, 0), 0);
+    NN_RET_CHECK_EQ(lseek(dataFd, 0, SEEK_SET), 0);
+    const std::vector<uint8_t> padding(getpagesize(), 0);
+    for (size_t i = 0; i < poolInfos.size(); i++) {
+        NN_RET_CHECK(writeAll(dataFd, poolInfos[i].getBuffer(), poolSizes[i]));
+        const size_t end = (i + 1 < poolInfos.size()) ? poolOffsets[i + 1] : dataCacheSize;
+        NN_RET_CHECK(writeAll(dataFd, padding.data(), end - poolOffsets[i] - poolSizes[i]));
+    }
+    NN_RET_CHECK_EQ(lseek(modelFd, sizeof(header), SEEK_SET), static_cast<off_t>(sizeof(header)));
+    NN_RET_CHECK(writeAll(modelFd, writer.buffer().data(), writer.buffer().size()));
+    NN_RET_CHECK_EQ(lseek(modelFd, 0, SEEK_SET), 0);
+    NN_RET_CHECK(writeAll(modelFd, &header, sizeof(header)));
+    return true;
+}
+
+bool readModelFromCache(const hidl_handle& modelCache, const hidl_handle& dataCache,
+                        const CacheToken& token, Model* model) {
+    NNTRACE_FULL(NNTRACE_LAYER_UTILITY, NNTRACE_PHASE_COMPILATION, "readModelFromCache");
+    CHECK(model != nullptr);
+    const int modelFd = getCacheFd(modelCache);
+    const int dataFd = getCacheFd(dataCache);
+    NN_RET_CHECK(modelFd >= 0 && dataFd >= 0);
+
+    struct stat modelStat, dataStat;
+    NN_RET_CHECK_EQ(fstat(modelFd, &modelStat), 0);
+    NN_RET_CHECK_EQ(fstat(dataFd, &dataStat), 0);
+    if (static_cast<size_t>(modelStat.st_size) < sizeof(ModelCacheHeader)) {
+        VLOG(COMPILATION) << "Model cache is empty or truncated";
+        return false;
+    }
+
+    ModelCacheHeader header;
+    NN_RET_CHECK_EQ(lseek(modelFd, 0, SEEK_SET), 0);
+    NN_RET_CHECK(readAll(modelFd, &header, sizeof(header)));
+    if (header.magic != kModelCacheMagic || header.version != kModelCacheVersion ||
+        memcmp(header.token, token.data(), sizeof(header.token)) != 0 ||
+        header.dataCacheSize != static_cast<uint64_t>(dataStat.st_size)) {
+        VLOG(COMPILATION) << "Model cache does not match the token or the data cache";
+        return false;
+    }
+
+    std::vector<uint8_t> buffer(modelStat.st_size - sizeof(header));
+    NN_RET_CHECK(readAll(modelFd, buffer.data(), buffer.size()));
+    uint8_t bodyDigest[SHA256_DIGEST_LENGTH];
+    SHA256(buffer.data(), buffer.size(), bodyDigest);
+    if (memcmp(bodyDigest, header.bodyDigest, sizeof(bodyDigest)) != 0) {
+        VLOG(COMPILATION) << "Model cache is corrupted";
+        return false;
+    }
+    ModelReader reader(buffer.data(), buffer.size());
+
+    Model result;
+    result.operands.resize(std::min<uint32_t>(reader.read<uint32_t>(), buffer.size()));
+    for (Operand& operand : result.operands) {
+        NN_RET_CHECK(readOperand(&reader, &operand));
+    }
+    result.operations.resize(std::min<uint32_t>(reader.read<uint32_t>(), buffer.size()));
+    for (Operation& operation : result.operations) {
+        operation.type = reader.read<OperationType>();
+        operation.inputs = reader.readVec<uint32_t>();
+        operation.outputs = reader.readVec<uint32_t>();
+    }
+    result.inputIndexes = reader.readVec<uint32_t>();
+    result.outputIndexes = reader.readVec<uint32_t>();
+    result.operandValues = reader.readVec<uint8_t>();
+    const hidl_vec<uint64_t> poolOffsets = reader.readVec<uint64_t>();
+    const hidl_vec<uint64_t> poolSizes = reader.readVec<uint64_t>();
+    result.relaxComputationFloat32toFloat16 = reader.read<uint8_t>();
+    result.extensionNameToPrefix.resize(std::min<uint32_t>(reader.read<uint32_t>(), buffer.size()));
+    for (auto& nameAndPrefix : result.extensionNameToPrefix) {
+        nameAndPrefix.name = reader.readString();
+        nameAndPrefix.prefix = reader.read<uint16_t>();
+    }
+    NN_RET_CHECK(reader.ok() && reader.atEnd()) << "Malformed model cache";
+    NN_RET_CHECK_EQ(poolOffsets.size(), poolSizes.size());
+
+    result.pools.resize(poolOffsets.size());
+    for (size_t i = 0; i < poolOffsets.size(); i++) {
+        NN_RET_CHECK(poolOffsets[i] % getpagesize() == 0);
+        NN_RET_CHECK(poolSizes[i] <= header.dataCacheSize &&
+                     poolOffsets[i] <= header.dataCacheSize - poolSizes[i]);
+        std::optional<hidl_memory> pool =
+                createReadOnlyRegion(dataFd, poolOffsets[i], poolSizes[i]);
+        NN_RET_CHECK(pool.has_value());
+        result.pools[i] = std::move(*pool);
+    }
+
+    NN_RET_CHECK(validateModel(result)) << "Model restored from cache is invalid";
+    *model = std::move(result);
+    return true;
+}
+
+}  // namespace nn
+}  // namespace android
@@ -19,10 +19,15 @@
 #include "OperationResolver.h"
 
 #include "NeuralNetworks.h"
+#include "Tracing.h"
 
 namespace android {
 namespace nn {
 
+// Defined here rather than in CpuExecutor.cpp because the operations are also
+// linked into libneuralnetworks_utils, which does not contain the executor.
+thread_local const char* gLastComputationTrace = nullptr;
+
 // TODO(b/119608412): Find a way to not reference every operation here.
 const OperationRegistration* register_ABS();
 const OperationRegistration* register_ADD();
@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TraceSink"
+
+#include "TraceSink.h"
+
+#include "Tracing.h"
+
+#include <android-base/logging.h>
+#include <android-base/threads.h>
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+namespace android {
+namespace nn {
+
+std::atomic_bool gTraceSinkEnabled = false;
+
+namespace {
+
+std::atomic<uint64_t> gDroppedTraceEvents = 0;
+
+// Single-producer single-consumer ring of the events of one thread. The owning
+// thread pushes; drains are serialized by TraceState::mutex.
+class TraceBuffer {
+   public:
+    static constexpr uint64_t kCapacity = 1024;
+
+    explicit TraceBuffer(uint64_t tid) : mTid(tid) {}
+
+    bool push(const char* name, uint64_t startNs, uint64_t durationNs) {
+        const uint64_t head = mHead.load(std::memory_order_relaxed);
+        if (head - mTail.load(std::memory_order_acquire) == kCapacity) {
+            return false;
+        }
+        mEvents[head % kCapacity] = {
+                .name = name, .startNs = startNs, .durationNs = durationNs, .tid = mTid};
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    void drain(std::vector<TraceEvent>* events) {
+        const uint64_t tail = mTail.load(std::memory_order_relaxed);
+        const uint64_t head = mHead.load(std::memory_order_acquire);
+        for (uint64_t i = tail; i != head; i++) {
+            events->push_back(mEvents[i % kCapacity]);
+        }
+        mTail.store(head, std::memory_order_release);
+    }
+
+    bool empty() const {
+        return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+    }
+
+    // Set when the owning thread exits; the buffer is discarded once drained.
+    std::atomic_bool threadExited = false;
+
+   private:
+    const uint64_t mTid;
+    std::array<TraceEvent, kCapacity> mEvents;
+    std::atomic<uint64_t> mHead = 0;
+    std::atomic<uint64_t> mTail = 0;
+};
+
+struct TraceState {
+    // Guards buffers.
+    std::mutex bufferMutex;
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+
+    // Serializes setTraceSink().
+    std::mutex setMutex;
+
+    // Guards the rest, and serializes the drains.
+    std::mutex mutex;
+    std::condition_variable drainCondition;
+    std::shared_ptr<TraceSink> sink;
+    std::chrono::milliseconds drainInterval{0};
+    bool stopDrainThread = false;
+    std::thread drainThread;
+
+    ~TraceState() { stopDrainThreadAndWait(); }
+
+    void stopDrainThreadAndWait() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopDrainThread = true;
+        }
+        drainCondition.notify_all();
+        if (drainThread.joinable()) {
+            drainThread.join();
+        }
+        stopDrainThread = false;
+    }
+
+    void drainLocked() {
+        std::vector<std::shared_ptr<TraceBuffer>> toDrain;
+        {
+            std::lock_guard<std::mutex> lock(bufferMutex);
+            toDrain = buffers;
+        }
+        std::vector<TraceEvent> events;
+        for (const auto& buffer : toDrain) {
+            events.clear();
+            buffer->drain(&events);
+            if (!events.empty() && sink != nullptr) {
+                sink->consume(events);
+            }
+        }
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        buffers.erase(std::remove_if(buffers.begin(), buffers.end(),
+                                     [](const std::shared_ptr<TraceBuffer>& buffer) {
+                                         return buffer->threadExited && buffer->empty();
+                                     }),
+                      buffers.end());
+    }
+
+    void drainLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopDrainThread) {
+            drainCondition.wait_for(lock, drainInterval, [this] { return stopDrainThread; });
+            drainLocked();
+        }
+    }
+};
+
+TraceState& getTraceState() {
+    static TraceState state;
+    return state;
+}
+
+struct ThreadTraceBuffer {
+    std::shared_ptr<TraceBuffer> buffer;
+    ~ThreadTraceBuffer() {
+        if (buffer != nullptr) {
+            buffer->threadExited = true;
+        }
+    }
+};
+
+thread_local ThreadTraceBuffer tThreadTraceBuffer;
+
+class FileTraceSink : public TraceSink {
+   public:
+    explicit FileTraceSink(std::ofstream out) : mOut(std::move(out)) {}
+
+    void consume(const std::vector<TraceEvent>& events) override {
+        for (const TraceEvent& event : events) {
+            mOut << event.tid << ' ' << event.startNs << ' ' << event.durationNs << ' '
+                 << event.name << '\n';
+        }
+        mOut.flush();
+    }
+
+   private:
+    std::ofstream mOut;
+};
+
+class CallbackTraceSink : public TraceSink {
+   public:
+    explicit CallbackTraceSink(std::function<void(const std::vector<TraceEvent>&)> callback)
+        : mCallback(std::move(callback)) {}
+
+    void consume(const std::vector<TraceEvent>& events) override { mCallback(events); }
+
+   private:
+    std::function<void(const std::vector<TraceEvent>&)> mCallback;
+};
+
+bool consumePrefix(std::string_view* view, std::string_view prefix) {
+    if (view->substr(0, prefix.size()) != prefix) {
+        return false;
+    }
+    view->remove_prefix(prefix.size());
+    return true;
+}
+
+}  // namespace
+
+uint64_t traceNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+void recordTraceEvent(const char* name, uint64_t startNs, uint64_t endNs) {
+    std::shared_ptr<TraceBuffer>& buffer = tThreadTraceBuffer.buffer;
+    if (buffer == nullptr) {
+        buffer = std::make_shared<TraceBuffer>(base::GetThreadId());
+        TraceState& state = getTraceState();
+        std::lock_guard<std::mutex> lock(state.bufferMutex);
+        state.buffers.push_back(buffer);
+    }
+    if (!buffer->push(name, startNs, endNs - startNs)) {
+        gDroppedTraceEvents.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool parseTraceEventName(const char* name, TraceEventName* parsed) {
+    std::string_view rest(name);
+    TraceEventName result;
+    if (consumePrefix(&rest, "[SW]")) {
+        result.isSwitch = true;
+    } else if (consumePrefix(&rest, "[SUB]")) {
+        result.isSubtract = true;
+    }
+    if (!consumePrefix(&rest, "[NN_")) {
+        return false;
+    }
+    const size_t close = rest.find(']');
+    const std::string_view bucket = rest.substr(0, close);
+    const size_t separator = bucket.find('_');
+    if (close == std::string_view::npos || separator == std::string_view::npos) {
+        return false;
+    }
+    result.layer = bucket.substr(0, separator);
+    result.phase = bucket.substr(separator + 1);
+    result.detail = rest.substr(close + 1);
+    *parsed = std::move(result);
+    return true;
+}
+
+std::shared_ptr<TraceSink> createFileTraceSink(const std::string& path) {
+    std::ofstream out(path, std::ofstream::app);
+    if (!out) {
+        LOG(ERROR) << "Failed to open trace file " << path;
+        return nullptr;
+    }
+    return std::make_shared<FileTraceSink>(std::move(out));
+}
+
+std::shared_ptr<TraceSink> createCallbackTraceSink(
+        std::function<void(const std::vector<TraceEvent>&)> callback) {
+    return std::make_shared<CallbackTraceSink>(std::move(callback));
+}
+
+void setTraceSink(std::shared_ptr<TraceSink> sink, std::chrono::milliseconds drainInterval) {
+    TraceState& state = getTraceState();
+    std::lock_guard<std::mutex> setLock(state.setMutex);
+    state.stopDrainThreadAndWait();
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.drainLocked();
+        state.sink = std::move(sink);
+        state.drainInterval = drainInterval;
+        gTraceSinkEnabled = state.sink != nullptr;
+    }
+    if (gTraceSinkEnabled) {
+        state.drainThread = std::thread([&state] { state.drainLoop(); });
+    }
+}
+
+void drainTraceEvents() {
+    TraceState& state = getTraceState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.drainLocked();
+}
+
+uint64_t getDroppedTraceEventCount() {
+    return gDroppedTraceEvents.load(std::memory_order_relaxed);
+}
+
+}  // namespace nn
+}  // namespace android
@@ -28,6 +28,8 @@
 #include <android-base/strings.h>
 #include <sys/system_properties.h>
 #include <algorithm>
+#include <array>
+#include <initializer_list>
 #include <unordered_map>
 
 using ::android::hidl::allocator::V1_0::IAllocator;
@@ -497,11 +499,81 @@ int validateOperandList(uint32_t count, const uint32_t* list, uint32_t operandCo
     return ANEURALNETWORKS_NO_ERROR;
 }
 
-int validateOperationOperandTypes(const std::vector<Operand>& operands,
-                                  uint32_t inOperandCount, const uint32_t* inOperandIndexes,
-                                  const std::vector<OperandType>& inExpectedTypes,
-                                  uint32_t outOperandCount, const uint32_t* outOperandIndexes,
-                                  const std::vector<OperandType>& outExpectedInTypes) {
+namespace {
+
+// The expected operand types of the inputs or of the outputs of an operation.
+//
+// validateOperation() builds two of these for every operation of every model it
+// validates, so they keep their types inline rather than on the heap. The inline
+// capacity covers the signature of every operation; only a SPLIT with more
+// outputs than that moves the list to the heap.
+class OperandTypeList {
+   public:
+    OperandTypeList() = default;
+    OperandTypeList(std::initializer_list<OperandType> types) { *this = types; }
+    OperandTypeList(size_t count, OperandType type) {
+        for (size_t i = 0; i < count; i++) {
+            push_back(type);
+        }
+    }
+
+    OperandTypeList& operator=(std::initializer_list<OperandType> types) {
+        mSize = 0;
+        mOverflow.clear();
+        for (OperandType type : types) {
+            push_back(type);
+        }
+        return *this;
+    }
+
+    void push_back(OperandType type) {
+        if (mOverflow.empty() && mSize < kInlineCapacity) {
+            mInline[mSize] = type;
+        } else {
+            if (mOverflow.empty()) {
+                mOverflow.assign(mInline.begin(), mInline.begin() + mSize);
+            }
+            mOverflow.push_back(type);
+        }
+        mSize++;
+    }
+
+    // Only appending is supported.
+    template <typename Iterator>
+    void insert(const OperandType* position, Iterator first, Iterator last) {
+        CHECK(position == end());
+        for (; first != last; ++first) {
+            push_back(*first);
+        }
+    }
+
+    size_t size() const { return mSize; }
+    OperandType operator[](size_t i) const { return data()[i]; }
+    const OperandType* begin() const { return data(); }
+    const OperandType* end() const { return data() + mSize; }
+
+   private:
+    // BIDIRECTIONAL_SEQUENCE_LSTM, the operation with the most inputs, has 61.
+    static constexpr size_t kInlineCapacity = 64;
+
+    const OperandType* data() const {
+        return mOverflow.empty() ? mInline.data() : mOverflow.data();
+    }
+
+    std::array<OperandType, kInlineCapacity> mInline;
+    size_t mSize = 0;
+    // Holds all the types once there are more than kInlineCapacity.
+    std::vector<OperandType> mOverflow;
+};
+
+}  // namespace
+
+static int validateOperationOperandTypes(const std::vector<Operand>& operands,
+                                         uint32_t inOperandCount, const uint32_t* inOperandIndexes,
+                                         const OperandTypeList& inExpectedTypes,
+                                         uint32_t outOperandCount,
+                                         const uint32_t* outOperandIndexes,
+                                         const OperandTypeList& outExpectedInTypes) {
     if (inOperandCount != static_cast<uint32_t>(inExpectedTypes.size()) ||
         outOperandCount != static_cast<uint32_t>(outExpectedInTypes.size())) {
         LOG(ERROR) << "Wrong operand count: expected " << inExpectedTypes.size() << " inputs and "
@@ -578,8 +650,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32) {
                 NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_0));
                 inExpectedTypes = {OperandType::TENSOR_FLOAT32};
@@ -610,8 +682,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
             }
             auto inputType = operands[inputIndexes[0]].type;
             auto filterType = operands[inputIndexes[1]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32) {
                 inExpectedTypes = {
                         OperandType::TENSOR_FLOAT32, OperandType::TENSOR_FLOAT32,
@@ -671,7 +743,7 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
             bool withDilation = false;
             if (inputCount >= 9) {
                 if (operands[inputIndexes[8]].type == OperandType::INT32 && inputCount >= 11) {
-                    std::vector<OperandType> explicitScalarTypes(3, OperandType::INT32);
+                    OperandTypeList explicitScalarTypes(3, OperandType::INT32);
                     inExpectedTypes.insert(inExpectedTypes.end(), explicitScalarTypes.begin(),
                                            explicitScalarTypes.end());
                     withExplicitPadding = true;
@@ -715,8 +787,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32) {
                 NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_0));
                 inExpectedTypes = {
@@ -754,8 +826,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32) {
                 NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_0));
                 inExpectedTypes = {OperandType::TENSOR_FLOAT32,
@@ -789,8 +861,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32) {
                 NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_0));
                 inExpectedTypes = {OperandType::TENSOR_FLOAT32,
@@ -830,8 +902,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32) {
                 NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_0));
                 inExpectedTypes = {OperandType::TENSOR_FLOAT32,
@@ -876,9 +948,9 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                            << getOperationName(opType);
                 return ANEURALNETWORKS_BAD_DATA;
             }
-            std::vector<OperandType> inExpectedTypes = {OperandType::TENSOR_INT32,
-                                                        inputType};
-            std::vector<OperandType> outExpectedTypes = {inputType};
+            OperandTypeList inExpectedTypes = {OperandType::TENSOR_INT32,
+                                               inputType};
+            OperandTypeList outExpectedTypes = {inputType};
             NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_0));
             return validateOperationOperandTypes(operands,
                                                  inputCount, inputIndexes,
@@ -899,11 +971,11 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                            << getOperationName(opType);
                 return ANEURALNETWORKS_BAD_DATA;
             }
-            std::vector<OperandType> inExpectedTypes = {OperandType::TENSOR_INT32,
-                                                        OperandType::TENSOR_INT32,
-                                                        inputType};
-            std::vector<OperandType> outExpectedTypes = {inputType,
-                                                         OperandType::TENSOR_QUANT8_ASYMM};
+            OperandTypeList inExpectedTypes = {OperandType::TENSOR_INT32,
+                                               OperandType::TENSOR_INT32,
+                                               inputType};
+            OperandTypeList outExpectedTypes = {inputType,
+                                                OperandType::TENSOR_QUANT8_ASYMM};
             NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_0));
             return validateOperationOperandTypes(operands,
                                                  inputCount, inputIndexes,
@@ -926,7 +998,7 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto hashType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
+            OperandTypeList inExpectedTypes;
             if (hashType == OperandType::TENSOR_FLOAT16) {
                 NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_2));
                 inExpectedTypes = {
@@ -948,16 +1020,16 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                            << getOperationName(opType);
                 return ANEURALNETWORKS_BAD_DATA;
             }
-            std::vector<OperandType> outExpectedTypes = {OperandType::TENSOR_INT32};
+            OperandTypeList outExpectedTypes = {OperandType::TENSOR_INT32};
             return validateOperationOperandTypes(operands, inputCount, inputIndexes,
                                                  inExpectedTypes, outputCount, outputIndexes,
                                                  outExpectedTypes);
         }
         case ANEURALNETWORKS_BIDIRECTIONAL_SEQUENCE_LSTM: {
-            std::vector<OperandType> inExpectedTypes;
+            OperandTypeList inExpectedTypes;
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> outExpectedTypes{inputType, inputType};
-            std::vector<OperandType> outExpectedTypesMerged{inputType};
+            OperandTypeList outExpectedTypes{inputType, inputType};
+            OperandTypeList outExpectedTypesMerged{inputType};
             if (inputType != OperandType::TENSOR_FLOAT32 &&
                 inputType != OperandType::TENSOR_FLOAT16) {
                 LOG(ERROR) << "Unsupported input tensor type for operation "
@@ -1000,8 +1072,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
             return status;
         }
         case ANEURALNETWORKS_LSTM: {
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             auto inputType = operands[inputIndexes[0]].type;
             if (inputType != OperandType::TENSOR_FLOAT32 &&
                 inputType != OperandType::TENSOR_FLOAT16) {
@@ -1048,7 +1120,7 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_2));
-            std::vector<OperandType> inExpectedTypes = {
+            OperandTypeList inExpectedTypes = {
                     OperandType::TENSOR_QUANT8_ASYMM, OperandType::TENSOR_QUANT8_ASYMM,
                     OperandType::TENSOR_QUANT8_ASYMM, OperandType::TENSOR_QUANT8_ASYMM,
                     OperandType::TENSOR_QUANT8_ASYMM, OperandType::TENSOR_QUANT8_ASYMM,
@@ -1057,8 +1129,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                     OperandType::TENSOR_INT32,        OperandType::TENSOR_INT32,
                     OperandType::TENSOR_INT32,        OperandType::TENSOR_QUANT16_SYMM,
                     OperandType::TENSOR_QUANT8_ASYMM};
-            std::vector<OperandType> outExpectedTypes = {OperandType::TENSOR_QUANT16_SYMM,
-                                                         OperandType::TENSOR_QUANT8_ASYMM};
+            OperandTypeList outExpectedTypes = {OperandType::TENSOR_QUANT16_SYMM,
+                                                OperandType::TENSOR_QUANT8_ASYMM};
             return validateOperationOperandTypes(operands, inputCount, inputIndexes,
                                                  inExpectedTypes, outputCount, outputIndexes,
                                                  outExpectedTypes);
@@ -1069,7 +1141,7 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             OperandType inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
+            OperandTypeList inExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32 ||
                 inputType == OperandType::TENSOR_FLOAT16) {
                 NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_2));
@@ -1083,7 +1155,7 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                            << getOperationName(opType);
                 return ANEURALNETWORKS_BAD_DATA;
             }
-            std::vector<OperandType> outExpectedTypes = {OperandType::TENSOR_INT32};
+            OperandTypeList outExpectedTypes = {OperandType::TENSOR_INT32};
             return validateOperationOperandTypes(operands, inputCount, inputIndexes,
                                                  inExpectedTypes, outputCount, outputIndexes,
                                                  outExpectedTypes);
@@ -1094,8 +1166,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             OperandType inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32) {
                 NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_0));
                 inExpectedTypes = {
@@ -1143,11 +1215,11 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                            << getOperationName(opType);
                 return ANEURALNETWORKS_BAD_DATA;
             }
-            std::vector<OperandType> inExpectedTypes = {
+            OperandTypeList inExpectedTypes = {
                     inputType, inputType,          inputType,          inputType,
                     inputType, OperandType::INT32, OperandType::INT32,
             };
-            std::vector<OperandType> outExpectedTypes = {inputType, inputType};
+            OperandTypeList outExpectedTypes = {inputType, inputType};
             return validateOperationOperandTypes(operands, inputCount, inputIndexes,
                                                  inExpectedTypes, outputCount, outputIndexes,
                                                  outExpectedTypes);
@@ -1160,8 +1232,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32) {
                 inExpectedTypes = {
                         OperandType::TENSOR_FLOAT32,
@@ -1206,8 +1278,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32) {
                 inExpectedTypes = {
                         OperandType::TENSOR_FLOAT32,
@@ -1256,8 +1328,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32) {
                 NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_1));
                 inExpectedTypes = {
@@ -1298,8 +1370,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32) {
                 NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_2));
                 inExpectedTypes = {
@@ -1340,7 +1412,7 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
             }
             auto inputType = operands[inputIndexes[0]].type;
             auto outputType = operands[outputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
+            OperandTypeList inExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT16 ||
                 inputType == OperandType::TENSOR_FLOAT32 ||
                 inputType == OperandType::TENSOR_INT32 ||
@@ -1351,7 +1423,7 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                            << getOperationName(opType);
                 return ANEURALNETWORKS_BAD_DATA;
             }
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (outputType == OperandType::TENSOR_FLOAT16 ||
                 outputType == OperandType::TENSOR_FLOAT32 ||
                 outputType == OperandType::TENSOR_INT32 ||
@@ -1373,8 +1445,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32) {
                 NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_1));
                 inExpectedTypes = {OperandType::TENSOR_FLOAT32,
@@ -1406,8 +1478,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32) {
                 NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_1));
                 inExpectedTypes = {
@@ -1453,8 +1525,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32) {
                 NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_1));
                 inExpectedTypes = {OperandType::TENSOR_FLOAT32,
@@ -1490,8 +1562,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT16 ||
                 inputType == OperandType::TENSOR_FLOAT32 ||
                 inputType == OperandType::TENSOR_INT32 ||
@@ -1514,8 +1586,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT16 ||
                 inputType == OperandType::TENSOR_FLOAT32 ||
                 inputType == OperandType::TENSOR_INT32 ||
@@ -1547,9 +1619,9 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                            << getOperationName(opType);
                 return ANEURALNETWORKS_BAD_DATA;
             }
-            std::vector<OperandType> inExpectedTypes = {inputType, OperandType::INT32,
-                                                        OperandType::INT32};
-            std::vector<OperandType> outExpectedTypes(outputCount, inputType);
+            OperandTypeList inExpectedTypes = {inputType, OperandType::INT32,
+                                               OperandType::INT32};
+            OperandTypeList outExpectedTypes(outputCount, inputType);
             NN_RETURN_IF_ERROR(validateHalVersion(opType, halVersion, HalVersion::V1_2));
             return validateOperationOperandTypes(operands, inputCount, inputIndexes,
                                                  inExpectedTypes, outputCount, outputIndexes,
@@ -1561,8 +1633,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 logInvalidInOutNumber(2, 1);
                 return ANEURALNETWORKS_BAD_DATA;
             }
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             OperandType inputType = operands[inputIndexes[0]].type;
             if (inputType == OperandType::TENSOR_FLOAT16 ||
                 inputType == OperandType::TENSOR_FLOAT32 ||
@@ -1589,8 +1661,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
             }
             auto inputType = operands[inputIndexes[0]].type;
             auto filterType = operands[inputIndexes[1]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT32) {
                 inExpectedTypes = {OperandType::TENSOR_FLOAT32, OperandType::TENSOR_FLOAT32,
                                    OperandType::TENSOR_FLOAT32, OperandType::INT32,
@@ -1634,7 +1706,7 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
             }
 
             if (inputCount == 12) {
-                std::vector<OperandType> explicitScalarTypes(3, OperandType::INT32);
+                OperandTypeList explicitScalarTypes(3, OperandType::INT32);
                 inExpectedTypes.insert(inExpectedTypes.end(), explicitScalarTypes.begin(),
                                        explicitScalarTypes.end());
             }
@@ -1650,8 +1722,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT16 ||
                 inputType == OperandType::TENSOR_FLOAT32 ||
                 inputType == OperandType::TENSOR_INT32 ||
@@ -1674,8 +1746,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 return ANEURALNETWORKS_BAD_DATA;
             }
             auto inputType = operands[inputIndexes[0]].type;
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             if (inputType == OperandType::TENSOR_FLOAT16 ||
                 inputType == OperandType::TENSOR_FLOAT32) {
                 inExpectedTypes = {inputType, inputType};
@@ -1695,8 +1767,8 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                 logInvalidInOutNumber(2, 1);
                 return ANEURALNETWORKS_BAD_DATA;
             }
-            std::vector<OperandType> inExpectedTypes;
-            std::vector<OperandType> outExpectedTypes;
+            OperandTypeList inExpectedTypes;
+            OperandTypeList outExpectedTypes;
             OperandType inputType = operands[inputIndexes[0]].type;
             if (inputType == OperandType::TENSOR_FLOAT16 ||
                 inputType == OperandType::TENSOR_FLOAT32 ||
@@ -1742,6 +1814,19 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
     }
 }
 
+bool validateOperationWithRegistration(const OperationRegistration& registration,
+                                       const Operation& operation, const Operand* operands,
+                                       HalVersion halVersion) {
+    if (registration.validate == nullptr) {
+        LOG(ERROR) << "Incomplete operation registration: " << registration.name;
+        return false;
+    }
+    OperationValidationContext context(operation.inputs.size(), operation.inputs.data(),
+                                       operation.outputs.size(), operation.outputs.data(),
+                                       operands, halVersion);
+    return registration.validate(&context);
+}
+
 ErrorStatus convertResultCodeToErrorStatus(int resultCode) {
     switch (resultCode) {
         case ANEURALNETWORKS_NO_ERROR:
@@ -1933,15 +2018,17 @@ bool compliantWithV1_0(const V1_1::Model& model) {
     // V1_0::Model because all 1.0 drivers require strict calculation by default
     // in the P NN runtime. Even if fp16 calculations are allowed, they can
     // still be computed by a strict fp32 driver.
-    return std::all_of(
-            model.operations.begin(), model.operations.end(), [&model](const V1_1::Operation& op) {
-                int error = validateOperation(static_cast<int32_t>(op.type), op.inputs.size(),
-                                              op.inputs.size() > 0 ? op.inputs.data() : nullptr,
-                                              op.outputs.size(),
-                                              op.outputs.size() > 0 ? op.outputs.data() : nullptr,
-                                              convertToV1_2(model.operands), HalVersion::V1_0);
-                return error == ANEURALNETWORKS_NO_ERROR;
-            });
+    const std::vector<Operand> operands = convertToV1_2(model.operands);
+    return std::all_of(model.operations.begin(), model.operations.end(),
+                       [&operands](const V1_1::Operation& op) {
+                           int error = validateOperation(
+                                   static_cast<int32_t>(op.type), op.inputs.size(),
+                                   op.inputs.size() > 0 ? op.inputs.data() : nullptr,
+                                   op.outputs.size(),
+                                   op.outputs.size() > 0 ? op.outputs.data() : nullptr, operands,
+                                   HalVersion::V1_0);
+                           return error == ANEURALNETWORKS_NO_ERROR;
+                       });
 }
 
 bool compliantWithV1_1(const V1_0::Model&) {
@@ -2149,13 +2236,15 @@ static bool compliantWith(HalVersion version, const V1_2::Model& model,
                 [&isOperandCompliant](const uint32_t ind) { return isOperandCompliant[ind]; });
     };
 
-    auto localValidateOperation = [&model, version,
+    // Converted once, rather than by each call to validateOperation().
+    const std::vector<Operand> operands = model.operands;
+    auto localValidateOperation = [&operands, version,
                                    &allOperandsCompliant](const V1_2::Operation& op) {
         if (!allOperandsCompliant(op.inputs) || !allOperandsCompliant(op.outputs)) return false;
         int error = validateOperation(
                 static_cast<int32_t>(op.type), op.inputs.size(),
                 op.inputs.size() > 0 ? op.inputs.data() : nullptr, op.outputs.size(),
-                op.outputs.size() > 0 ? op.outputs.data() : nullptr, model.operands, version);
+                op.outputs.size() > 0 ? op.outputs.data() : nullptr, operands, version);
         return error == ANEURALNETWORKS_NO_ERROR;
     };
 
@@ -381,7 +381,7 @@ static HalVersion getHalVersion(const V1_2::Operation&) {
 
 template <typename VersionedOperation>
 static bool validateOperations(const hidl_vec<VersionedOperation>& operations,
-                               const hidl_vec<Operand>& operands) {
+                               const std::vector<Operand>& operands) {
     const size_t operandCount = operands.size();
     // This vector keeps track of whether there's an operation that writes to
     // each operand. It is used to validate that temporary variables and
@@ -453,8 +453,9 @@ static bool validatePools(const hidl_vec<hidl_memory>& pools, HalVersion ver) {
                        [ver](const hidl_memory& pool) { return validatePool(pool, ver); });
 }
 
-static bool validateModelInputOutputs(const hidl_vec<uint32_t> indexes,
-                                      const hidl_vec<Operand>& operands, OperandLifeTime lifetime) {
+static bool validateModelInputOutputs(const hidl_vec<uint32_t>& indexes,
+                                      const std::vector<Operand>& operands,
+                                      OperandLifeTime lifetime) {
     const size_t operandCount = operands.size();
     for (uint32_t i : indexes) {
         if (i >= operandCount) {
@@ -488,8 +489,10 @@ bool validateModel(const T_Model& model) {
         return false;
     }
     // We only need versioned operands for their validation. For all the other
-    // validations we can use operands upcasted to the latest version.
-    const hidl_vec<Operand> latestVersionOperands = convertToV1_2(model.operands);
+    // validations we can use operands upcasted to the latest version. They are
+    // converted to a std::vector once here: validateOperation() takes one, and
+    // passing it a hidl_vec would copy every operand for every operation.
+    const std::vector<Operand> latestVersionOperands = convertToV1_2(model.operands);
     return (validateOperands(model.operands, model.operandValues, model.pools,
                              /*allowUnspecifiedRank=*/version >= HalVersion::V1_2) &&
             validateOperations(model.operations, latestVersionOperands) &&
@@ -507,9 +510,10 @@ template bool validateModel<V1_2::Model>(const V1_2::Model& model);
 // Validates the arguments of a request. type is either "input" or "output" and is used
 // for printing error messages. The operandIndexes is the appropriate array of input
 // or output operand indexes that was passed to the ANeuralNetworksModel_identifyInputsAndOutputs.
+template <class T_Operand>
 static bool validateRequestArguments(const hidl_vec<RequestArgument>& requestArguments,
                                      const hidl_vec<uint32_t>& operandIndexes,
-                                     const hidl_vec<Operand>& operands,
+                                     const hidl_vec<T_Operand>& operands,
                                      const hidl_vec<hidl_memory>& pools, bool allowUnspecified,
                                      const char* type) {
     MemoryAccessVerifier poolVerifier(pools);
@@ -528,7 +532,7 @@ static bool validateRequestArguments(const hidl_vec<RequestArgument>& requestArg
         // that was provided in the call to ANeuralNetworksModel_identifyInputsAndOutputs.
         // We assume in this function that the model has been validated already.
         const uint32_t operandIndex = operandIndexes[requestArgumentIndex];
-        const Operand& operand = operands[operandIndex];
+        const T_Operand& operand = operands[operandIndex];
         if (requestArgument.hasNoValue) {
             if (location.poolIndex != 0 || location.offset != 0 || location.length != 0 ||
                 requestArgument.dimensions.size() != 0) {
@@ -586,11 +590,11 @@ static bool validateRequestArguments(const hidl_vec<RequestArgument>& requestArg
 template <class T_Model>
 bool validateRequest(const Request& request, const T_Model& model) {
     HalVersion version = ModelToHalVersion<T_Model>::version;
-    return (validateRequestArguments(request.inputs, model.inputIndexes,
-                                     convertToV1_2(model.operands), request.pools,
-                                     /*allowUnspecified=*/false, "input") &&
-            validateRequestArguments(request.outputs, model.outputIndexes,
-                                     convertToV1_2(model.operands), request.pools,
+    // Only the dimensions of the operands are read, so they are not converted.
+    return (validateRequestArguments(request.inputs, model.inputIndexes, model.operands,
+                                     request.pools, /*allowUnspecified=*/false, "input") &&
+            validateRequestArguments(request.outputs, model.outputIndexes, model.operands,
+                                     request.pools,
                                      /*allowUnspecified=*/version >= HalVersion::V1_2, "output") &&
             validatePools(request.pools, version));
 }
@@ -599,6 +603,42 @@ template bool validateRequest<V1_0::Model>(const Request& request, const V1_0::M
 template bool validateRequest<V1_1::Model>(const Request& request, const V1_1::Model& model);
 template bool validateRequest<V1_2::Model>(const Request& request, const V1_2::Model& model);
 
+bool RequestValidationCache::matchesLocked(const Request& request) const {
+    if (!mHasValidRequest || request.inputs != mInputs || request.outputs != mOutputs ||
+        request.pools.size() != mPools.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < mPools.size(); i++) {
+        const hidl_memory& pool = request.pools[i];
+        if (pool.handle() == nullptr || pool.size() != mPools[i].size ||
+            pool.name() != mPools[i].name) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RequestValidationCache::validate(const Request& request, const Model& model) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (matchesLocked(request)) {
+            return true;
+        }
+    }
+    if (!validateRequest(request, model)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    mHasValidRequest = true;
+    mInputs = request.inputs;
+    mOutputs = request.outputs;
+    mPools.resize(request.pools.size());
+    for (size_t i = 0; i < mPools.size(); i++) {
+        mPools[i] = {.name = request.pools[i].name(), .size = request.pools[i].size()};
+    }
+    return true;
+}
+
 bool validateExecutionPreference(ExecutionPreference preference) {
     return preference == ExecutionPreference::LOW_POWER ||
            preference == ExecutionPreference::FAST_SINGLE_ANSWER ||
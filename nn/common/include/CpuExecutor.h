@@ -18,6 +18,7 @@
 #define ANDROID_ML_NN_COMMON_CPU_EXECUTOR_H
 
 #include "HalInterfaces.h"
+#include "MemoryAccounting.h"
 #include "OperationResolver.h"
 #include "OperationsUtils.h"
 #include "Utils.h"
@@ -25,7 +26,9 @@
 #include <android-base/macros.h>
 #include <ui/GraphicBuffer.h>
 #include <algorithm>
+#include <mutex>
 #include <optional>
+#include <string>
 #include <vector>
 
 namespace android {
@@ -120,7 +123,77 @@ class RunTimePoolInfo {
 bool setRunTimePoolInfosFromHidlMemories(std::vector<RunTimePoolInfo>* poolInfos,
                                          const hidl_vec<hidl_memory>& pools);
 
+// What the CpuExecutor measured while running one operation, see
+// CpuExecutor::setProfiling().
+struct CpuOperationProfile {
+    // Index of the operation in the model that was executed.
+    uint32_t operationIndex;
+    OperationType type;
+    // Start of the operation on the steady clock, and its wall time.
+    uint64_t startNs;
+    uint64_t durationNs;
+    // Total size of the operation's outputs.
+    uint64_t outputBytes;
+    // Bytes the executor allocated for temporary outputs of the operation.
+    uint64_t temporaryBytes;
+    // The kernel variant the operation chose, as named by its NNTRACE_COMP,
+    // or nullptr if the operation does not name one.
+    const char* kernel;
+};
+
+// Formats a profile in the Chrome trace event format, for chrome://tracing
+// or Perfetto. Each operation becomes a complete event on a single track.
+std::string cpuProfileToChromeTrace(const std::vector<CpuOperationProfile>& profile);
+
+// Estimates the memory a CpuExecutor allocates to run the model: the peak of
+// the temporaries as they are allocated and freed in execution order, and the
+// largest scratch memory of any one operation. Temporaries whose size is not
+// known until execution are not counted.
+MemoryUsage estimateCpuMemoryUsage(const Model& model);
+
+// What CpuExecutor::run() derives from a model and its pools alone: the
+// runtime information of every operand before a request is applied, with the
+// constants pointing into the model and its pools, and the temporaries counting
+// their consumers. A driver that runs a model many times builds it once when
+// it prepares the model and passes it to every run(). The operand table is not
+// modified after construction, so concurrent runs may share it.
+class CpuExecutorModel {
+   public:
+    // The model and the pools must outlive the prepared model.
+    CpuExecutorModel(const Model& model, const std::vector<RunTimePoolInfo>& modelPoolInfos);
+    DISALLOW_COPY_AND_ASSIGN(CpuExecutorModel);
+
+    const Model& getModel() const { return mModel; }
+    const std::vector<RunTimePoolInfo>& getModelPoolInfos() const { return mModelPoolInfos; }
+    const std::vector<RunTimeOperandInfo>& getOperands() const { return mOperands; }
+
+    // Returns a copy of getOperands() for one run to modify. A copy given
+    // back by a previous run is reused if there is one. Runs never modify
+    // constants, so only the other operands are then reset.
+    std::vector<RunTimeOperandInfo> borrowOperands() const;
+    // Gives back the operands borrowed by a run that has freed its
+    // temporaries.
+    void returnOperands(std::vector<RunTimeOperandInfo> operands) const;
+
+   private:
+    // Enough for the runs of a prepared model that overlap in practice.
+    static constexpr size_t kMaxReturnedOperands = 4;
+
+    const Model& mModel;
+    const std::vector<RunTimePoolInfo>& mModelPoolInfos;
+    std::vector<RunTimeOperandInfo> mOperands;
+    // The operands that are not constants.
+    std::vector<uint32_t> mRunTimeOperandIndexes;
+    mutable std::mutex mReturnedOperandsMutex;
+    mutable std::vector<std::vector<RunTimeOperandInfo>> mReturnedOperands;
+};
+
 // This class is used to execute a model on the CPU.
+//
+// If gCurrentMemoryAccount is set on the thread that calls run(), the
+// temporaries and the scratch memory of the kernels are charged to that
+// account, and run() fails with ANEURALNETWORKS_OUT_OF_MEMORY after the first
+// operation that takes the account over its budget.
 class CpuExecutor {
    public:
     // This constructor allows clients of CpuExecutor to provide custom CPU
@@ -140,20 +213,44 @@ class CpuExecutor {
     // specified in the constructor.
     // The model must outlive the executor.  We prevent it from being modified
     // while this is executing.
+    // The operand table is built for this run only; a caller that runs the
+    // model many times should prepare a CpuExecutorModel instead.
     int run(const Model& model, const Request& request,
             const std::vector<RunTimePoolInfo>& modelPoolInfos,
             const std::vector<RunTimePoolInfo>& requestPoolInfos);
 
+    // Executes a model prepared ahead of time, which must outlive the executor.
+    int run(const CpuExecutorModel& preparedModel, const Request& request,
+            const std::vector<RunTimePoolInfo>& requestPoolInfos);
+
     const std::vector<OutputShape>& getOutputShapes() const {
         CHECK(mFinished) << "getOutputShapes() called by an unfinished CpuExecutor.";
         return mOutputShapes;
     }
 
+    // Profiling is off by default. When it is on, run() records a
+    // CpuOperationProfile for each operation it executes, including the one
+    // that failed if any. Each run() replaces the profile of the previous one.
+    void setProfiling(bool profiling) { mProfiling = profiling; }
+    const std::vector<CpuOperationProfile>& getProfile() const { return mProfile; }
+
    private:
-    bool initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& modelPoolInfos,
+    // Runs mModel with mRequest. Borrows the operand table of preparedModel,
+    // or builds it from modelPoolInfos if preparedModel is nullptr.
+    int execute(const CpuExecutorModel* preparedModel,
+                const std::vector<RunTimePoolInfo>& modelPoolInfos,
+                const std::vector<RunTimePoolInfo>& requestPoolInfos);
+    bool initializeRunTimeInfo(const CpuExecutorModel* preparedModel,
+                               const std::vector<RunTimePoolInfo>& modelPoolInfos,
                                const std::vector<RunTimePoolInfo>& requestPoolInfos);
     // Runs one operation of the graph.
     int executeOperation(const Operation& entry);
+    // Runs the given operation of the graph and appends its profile.
+    int executeAndProfileOperation(uint32_t operationIndex);
+    // Charges the temporaries the operation allocated to mMemoryAccount.
+    int accountOperation(const Operation& operation);
+    // Releases the charge for a temporary that is being freed, if any.
+    void releaseTemporaryAccounting(uint32_t operandIndex);
     // Decrement the usage count for the operands listed.  Frees the memory
     // allocated for any temporary variable with a count of zero.
     void freeNoLongerUsedOperands(const std::vector<uint32_t>& inputs);
@@ -166,6 +263,9 @@ class CpuExecutor {
     // is being executed.
     const Model* mModel = nullptr;
     const Request* mRequest = nullptr;
+    // The prepared model whose operands mOperands borrows while run() is
+    // being executed.
+    const CpuExecutorModel* mPreparedModel = nullptr;
 
     // We're copying the list of all the dimensions from the model, as
     // these may be modified when we run the operations.  Since we're
@@ -182,6 +282,13 @@ class CpuExecutor {
     bool mFinished = false;
 
     const IOperationResolver* mOperationResolver;
+
+    bool mProfiling = false;
+    std::vector<CpuOperationProfile> mProfile;
+
+    // The account charged by run(), and which temporaries have been charged.
+    MemoryAccount* mMemoryAccount = nullptr;
+    std::vector<bool> mAccountedTemporaries;
 };
 
 // Class for setting reasonable OpenMP threading settings. (OpenMP is used by
@@ -17,6 +17,7 @@
 #ifndef ANDROID_ML_NN_COMMON_CPU_OPERATION_UTILS_H
 #define ANDROID_ML_NN_COMMON_CPU_OPERATION_UTILS_H
 
+#include "MemoryAccounting.h"
 #include "OperationsUtils.h"
 
 #include <algorithm>
@@ -58,9 +59,12 @@ inline tflite::RuntimeShape convertShapeToTflshape(const Shape& shape) {
     return tflite::RuntimeShape(tflShapeDim.size(), tflShapeDim.data());
 }
 
+// The float32 vectors of these conversions are charged to the current memory
+// account as scratch of the running operation.
 inline void convertFloat16ToFloat32(const _Float16* input, std::vector<float>* output) {
     CHECK(input != nullptr);
     CHECK(output != nullptr);
+    chargeOperationScratch(MemoryCategory::FP16_CONVERSION, output->size() * sizeof(float));
     for (int i = 0; i < output->size(); ++i) {
         (*output)[i] = static_cast<float>(input[i]);
     }
@@ -68,6 +72,7 @@ inline void convertFloat16ToFloat32(const _Float16* input, std::vector<float>* o
 
 inline void convertFloat32ToFloat16(const std::vector<float>& input, _Float16* output) {
     CHECK(output != nullptr);
+    chargeOperationScratch(MemoryCategory::FP16_CONVERSION, input.size() * sizeof(float));
     for (int i = 0; i < input.size(); ++i) {
         output[i] = input[i];
     }
@@ -19,11 +19,32 @@
 
 #include <android/hardware/neuralnetworks/1.2/types.h>
 
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
 
 namespace android {
 namespace nn {
 
+// Optional extra information to render on the graph, e.g. gathered from an
+// ExecutionPlan and the CPU profile of an execution (see
+// ExecutionPlan::getGraphDumpAnnotations()). Operation indexes refer to the
+// operations of the dumped Model.
+struct GraphDumpAnnotations {
+    static constexpr uint32_t kNoStep = std::numeric_limits<uint32_t>::max();
+
+    // The device of each step of the plan, in execution order.
+    std::vector<std::string> stepDevices;
+    // For each operation, the index of the step it was assigned to, or
+    // kNoStep. Empty if the model was not partitioned.
+    std::vector<uint32_t> operationSteps;
+    // For each operation, its measured time, or 0 if it was not measured.
+    // Empty if no time was measured.
+    std::vector<uint64_t> operationTimesNs;
+};
+
 // Write a representation of the model in Graphviz (.dot) format to
 // the specified stream (if provided) or to the logcat (if no stream
 // is provided).  (See http://www.graphviz.org.)
@@ -49,6 +70,26 @@ void graphDump(const char* name,
                const ::android::hardware::neuralnetworks::V1_2::Model& model,
                std::ostream* outStream = nullptr);
 
+// As above, additionally rendering the annotations:
+// - each step of the plan becomes a cluster labeled with its device and
+//   the bytes of temporaries it receives from other steps;
+// - operand labels include the size of the operand;
+// - edges are labeled with the size of the operand they carry, and those
+//   crossing a step boundary are drawn in bold red;
+// - operations are labeled with their measured time, and filled in a shade
+//   of red proportional to it (the slowest operation is pure red).
+void graphDump(const char* name,
+               const ::android::hardware::neuralnetworks::V1_2::Model& model,
+               const GraphDumpAnnotations& annotations, std::ostream* outStream = nullptr);
+
+// Write the same information in JSON, for scripts: an object with the
+// "name", the "operands" (index, type, lifetime, dimensions, bytes), the
+// "operations" (index, type, inputs, outputs and, if annotated, step and
+// timeNs) and the "steps" (index, device, bytes received from other steps).
+void graphDumpJson(const char* name,
+                   const ::android::hardware::neuralnetworks::V1_2::Model& model,
+                   const GraphDumpAnnotations& annotations, std::ostream* outStream = nullptr);
+
 }  // namespace nn
 }  // namespace android
 
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_COMMON_MEMORY_ACCOUNTING_H
+#define ANDROID_ML_NN_COMMON_MEMORY_ACCOUNTING_H
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+
+namespace android {
+namespace nn {
+
+// The kinds of memory an execution allocates on top of the buffers the
+// application passes in.
+enum class MemoryCategory : uint32_t {
+    // Temporary operands allocated by the CpuExecutor.
+    CPU_TEMPORARIES = 0,
+    // Scratch buffers of CPU kernels, such as the im2col buffer of CONV_2D or
+    // the NHWC copies of NCHW operands.
+    KERNEL_SCRATCH,
+    // float32 copies of TENSOR_FLOAT16 operands made by CPU kernels that only
+    // compute in float32.
+    FP16_CONVERSION,
+    // Shared memory the runtime allocates to pass arguments that the
+    // application specified by pointer to a driver.
+    POINTER_ARGUMENTS,
+    // Shared memory holding the temporaries that flow between the steps of a
+    // partitioned execution.
+    PARTITION_TEMPORARIES,
+};
+
+constexpr uint32_t kNumberOfMemoryCategories =
+        static_cast<uint32_t>(MemoryCategory::PARTITION_TEMPORARIES) + 1;
+
+const char* toString(MemoryCategory category);
+
+// Bytes per MemoryCategory.
+struct MemoryUsage {
+    std::array<uint64_t, kNumberOfMemoryCategories> bytes = {};
+
+    uint64_t& operator[](MemoryCategory category) {
+        return bytes[static_cast<uint32_t>(category)];
+    }
+    uint64_t operator[](MemoryCategory category) const {
+        return bytes[static_cast<uint32_t>(category)];
+    }
+    uint64_t total() const;
+};
+
+// Tracks the memory allocated on behalf of one execution, and its high-water
+// mark. The steps of a partitioned execution may charge the same account from
+// different threads.
+//
+// An account may have a budget. Allocations are recorded even when they take
+// the account over its budget, but the account then stays over budget, and
+// the execution fails as soon as it notices.
+class MemoryAccount {
+   public:
+    // A budget of 0 means that the account is unlimited.
+    explicit MemoryAccount(uint64_t budget = 0) : mBudget(budget) {}
+
+    // Records an allocation. Returns false if the account is over budget.
+    bool allocate(MemoryCategory category, uint64_t bytes);
+    void release(MemoryCategory category, uint64_t bytes);
+
+    // Records an allocation that is freed by the time the current operation
+    // completes, such as a kernel's scratch buffer. The CpuExecutor releases
+    // all of them with releaseOperationScratch() after each operation, so the
+    // kernels do not need to report the deallocation.
+    bool allocateOperationScratch(MemoryCategory category, uint64_t bytes);
+    void releaseOperationScratch();
+
+    // The high-water mark of each category. Categories may have peaked at
+    // different times, so the sum can exceed getPeakTotal().
+    MemoryUsage getPeakUsage() const;
+    // The high-water mark of all categories together.
+    uint64_t getPeakTotal() const;
+
+    uint64_t getBudget() const { return mBudget; }
+    bool isOverBudget() const;
+
+   private:
+    bool allocateLocked(MemoryCategory category, uint64_t bytes);
+
+    const uint64_t mBudget;
+    mutable std::mutex mMutex;
+    MemoryUsage mCurrent;
+    MemoryUsage mPeak;
+    MemoryUsage mOperationScratch;
+    uint64_t mCurrentTotal = 0;
+    uint64_t mPeakTotal = 0;
+    bool mOverBudget = false;
+};
+
+// The account that the CpuExecutor and the CPU kernels running on this thread
+// charge, or nullptr if nothing is being accounted. Set it with
+// ScopedMemoryAccount.
+extern thread_local MemoryAccount* gCurrentMemoryAccount;
+
+class ScopedMemoryAccount {
+   public:
+    explicit ScopedMemoryAccount(MemoryAccount* account) : mPrevious(gCurrentMemoryAccount) {
+        gCurrentMemoryAccount = account;
+    }
+    ~ScopedMemoryAccount() { gCurrentMemoryAccount = mPrevious; }
+    ScopedMemoryAccount(const ScopedMemoryAccount&) = delete;
+    ScopedMemoryAccount& operator=(const ScopedMemoryAccount&) = delete;
+
+   private:
+    MemoryAccount* mPrevious;
+};
+
+// Charges an allocation to an account, if not nullptr, for the lifetime of
+// this object.
+class ScopedMemoryCharge {
+   public:
+    ScopedMemoryCharge(MemoryAccount* account, MemoryCategory category, uint64_t bytes)
+        : mAccount(account), mCategory(category), mBytes(bytes) {
+        mWithinBudget = mAccount == nullptr || mAccount->allocate(mCategory, mBytes);
+    }
+    ~ScopedMemoryCharge() {
+        if (mAccount != nullptr) mAccount->release(mCategory, mBytes);
+    }
+    ScopedMemoryCharge(const ScopedMemoryCharge&) = delete;
+    ScopedMemoryCharge& operator=(const ScopedMemoryCharge&) = delete;
+
+    bool isWithinBudget() const { return mWithinBudget; }
+
+   private:
+    MemoryAccount* mAccount;
+    MemoryCategory mCategory;
+    uint64_t mBytes;
+    bool mWithinBudget;
+};
+
+// Hook for CPU kernels, see MemoryAccount::allocateOperationScratch().
+inline void chargeOperationScratch(MemoryCategory category, uint64_t bytes) {
+    if (gCurrentMemoryAccount != nullptr) {
+        gCurrentMemoryAccount->allocateOperationScratch(category, bytes);
+    }
+}
+
+}  // namespace nn
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_COMMON_MEMORY_ACCOUNTING_H
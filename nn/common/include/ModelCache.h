@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_COMMON_MODEL_CACHE_H
+#define ANDROID_ML_NN_COMMON_MODEL_CACHE_H
+
+#include "HalInterfaces.h"
+#include "NeuralNetworks.h"
+
+namespace android {
+namespace nn {
+
+using CacheToken = hidl_array<uint8_t, ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN>;
+
+// Helpers to persist a HIDL model into a pair of compilation cache files, for
+// devices that execute the HIDL model directly (the CPU reference device and
+// the sample driver).
+//
+// The model cache file holds a small header (magic, format version, the cache
+// token and a SHA-256 digest of the rest of the file) followed by the graph:
+// operands, operations, input and output indexes and the small constant
+// values. The data cache file holds the contents of the model's memory pools,
+// each one starting on a page boundary so that it can be mmap'ed in place when
+// the model is restored.
+
+// Writes model into the given cache files, replacing any previous contents.
+// Both handles must hold exactly one file descriptor opened for writing.
+// Returns false on failure; the cache files may then be partially written, but
+// will fail the checks in readModelFromCache.
+bool writeModelToCache(const Model& model, const hidl_handle& modelCache,
+                       const hidl_handle& dataCache, const CacheToken& token);
+
+// Restores a model written by writeModelToCache. The memory pools of the
+// restored model are "mmap_fd" regions of the data cache file rather than
+// copies, so the cost of restoring is independent of the size of the constant
+// data. Returns false if the cache files are missing, stale, were written for a
+// different token, fail the digest check, or do not hold a valid model.
+bool readModelFromCache(const hidl_handle& modelCache, const hidl_handle& dataCache,
+                        const CacheToken& token, Model* model);
+
+}  // namespace nn
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_COMMON_MODEL_CACHE_H
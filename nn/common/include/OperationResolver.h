@@ -96,6 +96,29 @@ class BuiltinOperationResolver : public IOperationResolver {
     const OperationRegistration* mRegistrations[kNumberOfOperationTypes] = {};
 };
 
+// CPU implementations of the operations of an extension, which let the runtime
+// run them when no driver does, for example when falling back to the CPU after
+// a driver fails.
+//
+// A vendor provides them in a shared library exporting an extern "C" function
+// named kGetExtensionCpuKernelsSymbol, of type GetExtensionCpuKernelsFn. The
+// runtime loads the libraries listed in a system property, see TypeManager.
+struct ExtensionCpuKernels {
+    // The extension and its operand types, as a driver supporting it reports
+    // them from IDevice::getSupportedExtensions.
+    Extension extension;
+
+    // Finds the implementations of the operations of the extension. As with
+    // the resolver of a SampleDriver, operation types are those of the model,
+    // which include the prefix the runtime assigned to the extension.
+    //
+    // Must remain valid as long as the library is loaded.
+    const IOperationResolver* resolver;
+};
+
+typedef const ExtensionCpuKernels* (*GetExtensionCpuKernelsFn)();
+constexpr char kGetExtensionCpuKernelsSymbol[] = "ANeuralNetworksExtension_getCpuKernels";
+
 // NN_REGISTER_OPERATION creates OperationRegistration for consumption by
 // OperationResolver.
 //
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_COMMON_TRACE_SINK_H
+#define ANDROID_ML_NN_COMMON_TRACE_SINK_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// In-process collection of the NNTRACE tracepoints.
+//
+// Systrace only sees the tracepoints while a capture is running. A TraceSink
+// receives them continuously instead, from inside the process: while a sink is
+// installed, every NNTRACE scope that completes is appended, with its start
+// time, duration and thread, to a lock-free ring buffer owned by the thread.
+// A background thread periodically drains the buffers of all threads into the
+// sink. When a buffer is full, further events of its thread are dropped until
+// it is drained, and counted by getDroppedTraceEventCount().
+//
+// Example, for a breakdown of the time spent per phase:
+//   setTraceSink(createCallbackTraceSink([](const std::vector<TraceEvent>& events) {
+//       for (const TraceEvent& event : events) {
+//           TraceEventName name;
+//           if (parseTraceEventName(event.name, &name)) {
+//               ... accumulate event.durationNs for name.phase ...
+//           }
+//       }
+//   }));
+
+namespace android {
+namespace nn {
+
+// A completed NNTRACE scope.
+struct TraceEvent {
+    // The tracepoint, e.g. "[NN_LR_PE]ANeuralNetworksExecution_compute" or
+    // "[SW][NN_LC_PCO]optimized_ops::Add". Points to a string literal.
+    const char* name;
+    // Start of the scope on the steady clock, and its duration.
+    uint64_t startNs;
+    uint64_t durationNs;
+    // The thread that ran the scope.
+    uint64_t tid;
+};
+
+// The parts of a tracepoint name, see the NNTRACE_* macros in Tracing.h.
+struct TraceEventName {
+    std::string layer;   // an NNTRACE_LAYER_* value, e.g. "LR"
+    std::string phase;   // an NNTRACE_PHASE_* value, e.g. "PE"
+    std::string detail;  // e.g. "ANeuralNetworksExecution_compute"
+    bool isSwitch = false;
+    bool isSubtract = false;
+};
+
+// Returns false if name does not follow the NNTRACE naming convention.
+bool parseTraceEventName(const char* name, TraceEventName* parsed);
+
+class TraceSink {
+   public:
+    virtual ~TraceSink() {}
+
+    // Receives the events drained from one thread's buffer, in the order they
+    // completed. Calls are serialized, but may come from different threads.
+    virtual void consume(const std::vector<TraceEvent>& events) = 0;
+};
+
+// Appends one line per event to the file: "<tid> <startNs> <durationNs> <name>".
+// Returns nullptr if the file cannot be opened.
+std::shared_ptr<TraceSink> createFileTraceSink(const std::string& path);
+
+std::shared_ptr<TraceSink> createCallbackTraceSink(
+        std::function<void(const std::vector<TraceEvent>&)> callback);
+
+// Installs the sink, or uninstalls the current one if sink is nullptr. The
+// events buffered for the previous sink are drained to it first. The installed
+// sink is drained every drainInterval.
+void setTraceSink(std::shared_ptr<TraceSink> sink,
+                  std::chrono::milliseconds drainInterval = std::chrono::milliseconds(100));
+
+// Drains the buffered events of all threads into the installed sink now.
+void drainTraceEvents();
+
+// The number of events dropped because a thread's buffer was full.
+uint64_t getDroppedTraceEventCount();
+
+}  // namespace nn
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_COMMON_TRACE_SINK_H
@@ -20,6 +20,9 @@
 #define ATRACE_TAG ATRACE_TAG_NNAPI
 #include "utils/Trace.h"
 
+#include <atomic>
+#include <cstdint>
+
 // Neural Networks API (NNAPI) systracing
 //
 // Primary goal of the tracing is to capture and present timings for NNAPI.
@@ -33,6 +36,9 @@
 //  2 Android systrace (atrace) on-device capture and host-based analysis.
 //  3 A systrace parser (TODO) to summarize the timings.
 //
+// The same tracepoints can also be collected inside the process, without a
+// systrace capture, by installing a TraceSink (see TraceSink.h).
+//
 // For an overview and introduction, please refer to the "NNAPI Systrace design
 // and HOWTO" (internal Docs for now). This header doesn't try to replicate all
 // the information in that document. For the contract between traces in code and
@@ -106,10 +112,14 @@
 #define NNTRACE_RT_SWITCH(phase, detail) NNTRACE_FULL_SWITCH(NNTRACE_LAYER_RUNTIME, phase, detail)
 // Layer CPU - CPU executor
 #define NNTRACE_CPU(phase, detail) NNTRACE_FULL(NNTRACE_LAYER_CPU, phase, detail)
-#define NNTRACE_COMP(detail) NNTRACE_FULL(NNTRACE_LAYER_CPU, \
-                                          NNTRACE_PHASE_COMPUTATION, detail)
-#define NNTRACE_COMP_SWITCH(detail) NNTRACE_FULL_SWITCH(NNTRACE_LAYER_CPU, \
-                                                        NNTRACE_PHASE_COMPUTATION, detail)
+// The computation macros also record the kernel variant for the CpuExecutor
+// profiler, see android::nn::gLastComputationTrace.
+#define NNTRACE_COMP(detail) \
+        NNTRACE_COMP_NAME_1(("[NN_" NNTRACE_LAYER_CPU "_" NNTRACE_PHASE_COMPUTATION "]" detail), \
+                            detail)
+#define NNTRACE_COMP_SWITCH(detail) \
+        NNTRACE_COMP_NAME_SWITCH( \
+                ("[SW][NN_" NNTRACE_LAYER_CPU "_" NNTRACE_PHASE_COMPUTATION "]" detail), detail)
 #define NNTRACE_TRANS(detail) NNTRACE_FULL(NNTRACE_LAYER_CPU, \
                                            NNTRACE_PHASE_TRANSFORMATION, detail)
 
@@ -121,8 +131,17 @@
 #define NNTRACE_FULL_SUBTRACT(layer, phase, detail) \
         NNTRACE_NAME_1(("[SUB][NN_" layer "_" phase "]" detail))
 // Raw macro without scoping requirements, for special cases
-#define NNTRACE_FULL_RAW(layer, phase, detail) android::ScopedTrace PASTE(___tracer, __LINE__) \
-        (ATRACE_TAG, ("[NN_" layer "_" phase "]" detail))
+#define NNTRACE_FULL_RAW(layer, phase, detail) \
+        ::android::nn::NnScopedTrace PASTE(___tracer, __LINE__)(("[NN_" layer "_" phase "]" detail))
+// The hand-off of work to another thread, see NnTraceHandOff:
+//   const auto handOff =
+//           NNTRACE_HAND_OFF(NNTRACE_LAYER_RUNTIME, NNTRACE_PHASE_EXECUTION, "compute thread");
+//   std::thread thread([handOff, ...] {
+//       handOff.finish();
+//       ...
+//   });
+#define NNTRACE_HAND_OFF(layer, phase, detail) \
+        ::android::nn::NnTraceHandOff(("[NN_" layer "_" phase "]" detail))
 
 // Tracing buckets - for calculating timing summaries over.
 //
@@ -151,6 +170,79 @@
 #define NNTRACE_LAYER_OTHER "LO"
 #define NNTRACE_LAYER_UTILITY "LU"              // Code used from multiple layers
 
+namespace android {
+namespace nn {
+
+// The detail of the last NNTRACE_COMP or NNTRACE_COMP_SWITCH on this thread,
+// i.e. the kernel variant most recently chosen by an operation.
+extern thread_local const char* gLastComputationTrace;
+
+// Whether a TraceSink is installed. Only then do the tracepoints read the clock
+// and record a TraceEvent.
+extern std::atomic_bool gTraceSinkEnabled;
+
+uint64_t traceNowNs();
+// Appends a completed tracepoint to the calling thread's trace buffer. name
+// must be a string literal.
+void recordTraceEvent(const char* name, uint64_t startNs, uint64_t endNs);
+
+// An atrace scope that is also reported to the installed TraceSink, if any.
+class NnScopedTrace {
+   public:
+    explicit NnScopedTrace(const char* name) : mTrace(ATRACE_TAG, name) {
+        if (gTraceSinkEnabled.load(std::memory_order_relaxed)) {
+            mName = name;
+            mStartNs = traceNowNs();
+        }
+    }
+    ~NnScopedTrace() {
+        if (mName != nullptr) {
+            recordTraceEvent(mName, mStartNs, traceNowNs());
+        }
+    }
+    NnScopedTrace(const NnScopedTrace&) = delete;
+    NnScopedTrace& operator=(const NnScopedTrace&) = delete;
+
+   private:
+    android::ScopedTrace mTrace;
+    const char* mName = nullptr;
+    uint64_t mStartNs = 0;
+};
+
+// An NnScopedTrace for the NNTRACE_COMP macros, which also records detail as the
+// kernel variant in gLastComputationTrace.
+class NnComputationTrace : public NnScopedTrace {
+   public:
+    NnComputationTrace(const char* name, const char* detail) : NnScopedTrace(name) {
+        gLastComputationTrace = detail;
+    }
+};
+
+// The time from the construction of the object, on the thread handing off some
+// work, until finish() is called on the thread picking it up. As the interval
+// spans two threads, it is only reported to the installed TraceSink, if any,
+// and not to atrace.
+class NnTraceHandOff {
+   public:
+    explicit NnTraceHandOff(const char* name) {
+        if (gTraceSinkEnabled.load(std::memory_order_relaxed)) {
+            mName = name;
+            mStartNs = traceNowNs();
+        }
+    }
+    void finish() const {
+        if (mName != nullptr) {
+            recordTraceEvent(mName, mStartNs, traceNowNs());
+        }
+    }
+
+   private:
+    const char* mName = nullptr;
+    uint64_t mStartNs = 0;
+};
+
+}  // namespace nn
+}  // namespace android
 
 // Implementation
 //
@@ -158,13 +250,20 @@
 // phase-per-scope and switching phases.
 //
 // Basic trace, one per scope allowed to enforce disjointness
-#define NNTRACE_NAME_1(name) android::ScopedTrace ___tracer_1(ATRACE_TAG, name)
+#define NNTRACE_NAME_1(name) ::android::nn::NnScopedTrace ___tracer_1(name)
 // Switching trace, more than one per scope allowed, translated by
 // systrace_parser.py. This is mainly useful for tracing multiple phases through
 // one function / scope.
-#define NNTRACE_NAME_SWITCH(name) android::ScopedTrace PASTE(___tracer, __LINE__) \
-        (ATRACE_TAG, name); \
+#define NNTRACE_NAME_SWITCH(name) ::android::nn::NnScopedTrace PASTE(___tracer, __LINE__) \
+        (name); \
         (void)___tracer_1  // ensure switch is only used after a basic trace
+// The same for the computation traces, as single statements. The switching trace
+// names ___tracer_1 in its argument instead of in a separate statement.
+#define NNTRACE_COMP_NAME_1(name, detail) \
+        ::android::nn::NnComputationTrace ___tracer_1(name, detail)
+#define NNTRACE_COMP_NAME_SWITCH(name, detail) \
+        ::android::nn::NnComputationTrace PASTE(___tracer, __LINE__)( \
+                ((void)___tracer_1, name), detail)
 
 
 // Disallow use of raw ATRACE macros
@@ -291,6 +291,15 @@ int validateOperation(ANeuralNetworksOperationType opType, uint32_t inputCount,
                       const uint32_t* outputIndexes, const std::vector<Operand>& operands,
                       HalVersion halVersion);
 
+struct OperationRegistration;
+
+// Returns true if the validate function of registration accepts operation, whose operand indexes
+// refer to operands. Used for operations validateOperation can't check, such as an extension
+// operation with a CPU implementation. Returns false if registration has no validate function.
+bool validateOperationWithRegistration(const OperationRegistration& registration,
+                                       const Operation& operation, const Operand* operands,
+                                       HalVersion halVersion);
+
 inline size_t getSizeFromInts(int lower, int higher) {
     return (uint32_t)(lower) + ((uint64_t)(uint32_t)(higher) << 32);
 }
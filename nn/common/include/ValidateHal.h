@@ -19,6 +19,9 @@
 
 #include "HalInterfaces.h"
 
+#include <mutex>
+#include <vector>
+
 namespace android {
 namespace nn {
 
@@ -46,6 +49,35 @@ bool validateModel(const T_Model& model);
 template <class T_Model>
 bool validateRequest(const Request& request, const T_Model& model);
 
+// Validates the requests for one model, skipping the full validation of a
+// request whose bindings are those of the last request it accepted.
+//
+// validateRequest() depends only on the location and dimensions of every
+// argument and on the type, size and presence of every pool. The cache keeps
+// these for the last valid request and compares them with each new request,
+// which is cheaper than the validation. A request that differs in any of
+// them is validated in full. The pools are compared by their description, not
+// their contents, so a request may bind new memory of the same size.
+//
+// The cache is thread-safe.
+class RequestValidationCache {
+   public:
+    bool validate(const Request& request, const Model& model);
+
+   private:
+    struct PoolSignature {
+        hidl_string name;
+        size_t size;
+    };
+    bool matchesLocked(const Request& request) const;
+
+    std::mutex mMutex;
+    bool mHasValidRequest = false;
+    hidl_vec<RequestArgument> mInputs;
+    hidl_vec<RequestArgument> mOutputs;
+    std::vector<PoolSignature> mPools;
+};
+
 // Verfies that the execution preference is valid.
 bool validateExecutionPreference(ExecutionPreference preference);
 
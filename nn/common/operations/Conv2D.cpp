@@ -159,6 +159,7 @@ struct Conv2dParam {
             return false;                                                       \
         }                                                                       \
         im2colGuard.reset(im2colData);                                          \
+        chargeOperationScratch(MemoryCategory::KERNEL_SCRATCH, im2colByteSize); \
     }
 
 bool convNhwc(const float* inputData, const Shape& inputShape, const float* filterData,
@@ -0,0 +1,623 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Microbenchmarks for the CPU kernels, one benchmark per operation
+// configuration of a parameter sweep (shapes, data types, layouts, strides).
+//
+// Operations registered with the OperationResolver are prepared once and then
+// executed directly through a minimal IOperationExecutionContext. Operations
+// still implemented in the switch of CpuExecutor::executeOperation() are run
+// as single-operation models on a CpuExecutor, which adds a small constant
+// cost per iteration.
+//
+// Every benchmark reports the bytes of its input and output tensors as
+// bytes_per_second, and the compute-bound kernels also report a FLOPS
+// counter.
+
+#include "CpuExecutor.h"
+#include "OperationResolver.h"
+#include "OperationsUtils.h"
+#include "Utils.h"
+
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace nn {
+namespace {
+
+struct BenchmarkOperand {
+    OperandType type;
+    std::vector<uint32_t> dimensions;
+    float scale = 0.0f;
+    int32_t zeroPoint = 0;
+    // Set for scalars and for tensors whose values matter to the operation
+    // (e.g. permutations). Other tensors are filled with synthetic data.
+    std::vector<uint8_t> value;
+};
+
+struct BenchmarkCase {
+    OperationType type;
+    std::string label;
+    std::vector<BenchmarkOperand> inputs;
+    // Output shapes must be given in full for operations run on the CpuExecutor.
+    std::vector<BenchmarkOperand> outputs;
+    // Floating point (or fixed point) operations per execution, or 0 if the
+    // kernel is memory bound.
+    double flops = 0;
+};
+
+BenchmarkOperand tensor(OperandType type, std::vector<uint32_t> dimensions) {
+    BenchmarkOperand operand = {.type = type, .dimensions = std::move(dimensions)};
+    if (type == OperandType::TENSOR_QUANT8_ASYMM) {
+        operand.scale = 0.5f;
+        operand.zeroPoint = 128;
+    }
+    return operand;
+}
+
+template <typename T>
+BenchmarkOperand scalar(OperandType type, T value) {
+    BenchmarkOperand operand = {.type = type};
+    operand.value.resize(sizeof(T));
+    memcpy(operand.value.data(), &value, sizeof(T));
+    return operand;
+}
+
+BenchmarkOperand int32Scalar(int32_t value) {
+    return scalar(OperandType::INT32, value);
+}
+
+BenchmarkOperand boolScalar(bool value) {
+    return scalar(OperandType::BOOL, static_cast<uint8_t>(value));
+}
+
+// A FLOAT16 scalar for TENSOR_FLOAT16 operations, FLOAT32 otherwise.
+BenchmarkOperand floatScalar(OperandType tensorType, float value) {
+    if (tensorType == OperandType::TENSOR_FLOAT16) {
+        return scalar(OperandType::FLOAT16, static_cast<_Float16>(value));
+    }
+    return scalar(OperandType::FLOAT32, value);
+}
+
+BenchmarkOperand int32Tensor(const std::vector<int32_t>& values) {
+    BenchmarkOperand operand = tensor(OperandType::TENSOR_INT32,
+                                      {static_cast<uint32_t>(values.size())});
+    operand.value.resize(values.size() * sizeof(int32_t));
+    memcpy(operand.value.data(), values.data(), operand.value.size());
+    return operand;
+}
+
+// The bias of a convolution: INT32 with the product of the input and filter
+// scales for quantized operations.
+BenchmarkOperand bias(OperandType tensorType, uint32_t size, const BenchmarkOperand& input,
+                      const BenchmarkOperand& filter) {
+    if (tensorType == OperandType::TENSOR_QUANT8_ASYMM) {
+        BenchmarkOperand operand = tensor(OperandType::TENSOR_INT32, {size});
+        operand.scale = input.scale * filter.scale;
+        return operand;
+    }
+    return tensor(tensorType, {size});
+}
+
+// The output of a quantized convolution or fully connected layer needs a
+// scale larger than the product of the input and filter scales.
+BenchmarkOperand accumulatorOutput(OperandType type, std::vector<uint32_t> dimensions) {
+    BenchmarkOperand operand = tensor(type, std::move(dimensions));
+    if (type == OperandType::TENSOR_QUANT8_ASYMM) {
+        operand.scale = 1.0f;
+    }
+    return operand;
+}
+
+std::string shapeToString(const std::vector<uint32_t>& dimensions) {
+    std::ostringstream out;
+    for (size_t i = 0; i < dimensions.size(); i++) {
+        out << (i == 0 ? "" : "x") << dimensions[i];
+    }
+    return out.str();
+}
+
+uint32_t product(const std::vector<uint32_t>& dimensions) {
+    uint32_t count = 1;
+    for (uint32_t dimension : dimensions) {
+        count *= dimension;
+    }
+    return count;
+}
+
+// Returns {N, H, W, C} or {N, C, H, W}.
+std::vector<uint32_t> imageShape(bool nchw, uint32_t n, uint32_t h, uint32_t w, uint32_t c) {
+    return nchw ? std::vector<uint32_t>{n, c, h, w} : std::vector<uint32_t>{n, h, w, c};
+}
+
+// Output size of an implicit SAME padding window.
+uint32_t samePaddingOutputSize(uint32_t size, uint32_t stride) {
+    return (size + stride - 1) / stride;
+}
+
+const OperandType kAllTypes[] = {OperandType::TENSOR_FLOAT32, OperandType::TENSOR_FLOAT16,
+                                 OperandType::TENSOR_QUANT8_ASYMM};
+const OperandType kFloatTypes[] = {OperandType::TENSOR_FLOAT32, OperandType::TENSOR_FLOAT16};
+
+std::string prefix(OperationType operation, OperandType type) {
+    return getOperationName(operation) + "/" + getOperandTypeName(type) + "/";
+}
+
+void addUnaryCases(std::vector<BenchmarkCase>* cases) {
+    const std::vector<std::vector<uint32_t>> kShapes = {{1, 64, 64, 32}, {1, 256, 256, 32}};
+    for (OperationType operation :
+         {OperationType::ABS, OperationType::EXP, OperationType::LOG, OperationType::RSQRT,
+          OperationType::SQRT, OperationType::SIN, OperationType::NEG, OperationType::FLOOR,
+          OperationType::LOGISTIC, OperationType::TANH, OperationType::RELU,
+          OperationType::RELU1, OperationType::RELU6}) {
+        const bool quantized = operation == OperationType::RELU ||
+                               operation == OperationType::RELU1 ||
+                               operation == OperationType::RELU6;
+        for (OperandType type : kAllTypes) {
+            if (type == OperandType::TENSOR_QUANT8_ASYMM && !quantized) {
+                continue;
+            }
+            for (const auto& shape : kShapes) {
+                cases->push_back({.type = operation,
+                                  .label = prefix(operation, type) + shapeToString(shape),
+                                  .inputs = {tensor(type, shape)},
+                                  .outputs = {tensor(type, shape)},
+                                  .flops = static_cast<double>(product(shape))});
+            }
+        }
+    }
+}
+
+void addBinaryCases(std::vector<BenchmarkCase>* cases) {
+    const std::vector<uint32_t> kShape = {1, 128, 128, 64};
+    // The same shape on both sides, then a broadcast of the last dimension.
+    const std::vector<std::vector<uint32_t>> kOtherShapes = {kShape, {64}};
+    for (OperationType operation :
+         {OperationType::ADD, OperationType::SUB, OperationType::MUL, OperationType::DIV,
+          OperationType::MAXIMUM, OperationType::MINIMUM}) {
+        const bool hasActivation = operation != OperationType::MAXIMUM &&
+                                   operation != OperationType::MINIMUM;
+        for (OperandType type : kAllTypes) {
+            if (type == OperandType::TENSOR_QUANT8_ASYMM && operation == OperationType::DIV) {
+                continue;
+            }
+            for (const auto& otherShape : kOtherShapes) {
+                BenchmarkCase benchmarkCase = {
+                        .type = operation,
+                        .label = prefix(operation, type) + shapeToString(kShape) + "_" +
+                                 shapeToString(otherShape),
+                        .inputs = {tensor(type, kShape), tensor(type, otherShape)},
+                        .outputs = {tensor(type, kShape)},
+                        .flops = static_cast<double>(product(kShape))};
+                if (hasActivation) {
+                    benchmarkCase.inputs.push_back(int32Scalar(ANEURALNETWORKS_FUSED_NONE));
+                }
+                cases->push_back(benchmarkCase);
+            }
+        }
+    }
+}
+
+struct ConvConfig {
+    uint32_t size;
+    uint32_t inputChannels;
+    uint32_t outputChannels;  // the depth multiplier for depthwise convolutions
+    uint32_t kernel;
+    uint32_t stride;
+};
+
+void addConvCases(std::vector<BenchmarkCase>* cases) {
+    const ConvConfig kConfigs[] = {
+            {56, 64, 64, 1, 1}, {56, 64, 64, 3, 1}, {112, 32, 64, 3, 2}, {14, 256, 256, 3, 1}};
+    for (OperandType type : kAllTypes) {
+        for (bool nchw : {false, true}) {
+            for (const ConvConfig& c : kConfigs) {
+                const uint32_t outSize = samePaddingOutputSize(c.size, c.stride);
+                BenchmarkOperand input =
+                        tensor(type, imageShape(nchw, 1, c.size, c.size, c.inputChannels));
+                BenchmarkOperand filter =
+                        tensor(type, {c.outputChannels, c.kernel, c.kernel, c.inputChannels});
+                std::ostringstream label;
+                label << prefix(OperationType::CONV_2D, type) << (nchw ? "NCHW/" : "NHWC/")
+                      << c.size << "x" << c.size << "x" << c.inputChannels << "/k" << c.kernel
+                      << "s" << c.stride << "/o" << c.outputChannels;
+                cases->push_back(
+                        {.type = OperationType::CONV_2D,
+                         .label = label.str(),
+                         .inputs = {input, filter, bias(type, c.outputChannels, input, filter),
+                                    int32Scalar(ANEURALNETWORKS_PADDING_SAME),
+                                    int32Scalar(c.stride), int32Scalar(c.stride),
+                                    int32Scalar(ANEURALNETWORKS_FUSED_RELU), boolScalar(nchw)},
+                         .outputs = {accumulatorOutput(
+                                 type, imageShape(nchw, 1, outSize, outSize, c.outputChannels))},
+                         .flops = 2.0 * outSize * outSize * c.outputChannels * c.kernel *
+                                  c.kernel * c.inputChannels});
+            }
+        }
+    }
+
+    const ConvConfig kDepthwiseConfigs[] = {{112, 32, 1, 3, 1}, {56, 128, 1, 3, 2}};
+    for (OperandType type : kAllTypes) {
+        for (bool nchw : {false, true}) {
+            for (const ConvConfig& c : kDepthwiseConfigs) {
+                const uint32_t outSize = samePaddingOutputSize(c.size, c.stride);
+                const uint32_t outputChannels = c.inputChannels * c.outputChannels;
+                BenchmarkOperand input =
+                        tensor(type, imageShape(nchw, 1, c.size, c.size, c.inputChannels));
+                BenchmarkOperand filter = tensor(type, {1, c.kernel, c.kernel, outputChannels});
+                std::ostringstream label;
+                label << prefix(OperationType::DEPTHWISE_CONV_2D, type)
+                      << (nchw ? "NCHW/" : "NHWC/") << c.size << "x" << c.size << "x"
+                      << c.inputChannels << "/k" << c.kernel << "s" << c.stride;
+                cases->push_back(
+                        {.type = OperationType::DEPTHWISE_CONV_2D,
+                         .label = label.str(),
+                         .inputs = {input, filter, bias(type, outputChannels, input, filter),
+                                    int32Scalar(ANEURALNETWORKS_PADDING_SAME),
+                                    int32Scalar(c.stride), int32Scalar(c.stride),
+                                    int32Scalar(c.outputChannels),
+                                    int32Scalar(ANEURALNETWORKS_FUSED_RELU), boolScalar(nchw)},
+                         .outputs = {accumulatorOutput(
+                                 type, imageShape(nchw, 1, outSize, outSize, outputChannels))},
+                         .flops = 2.0 * outSize * outSize * outputChannels * c.kernel *
+                                  c.kernel});
+            }
+        }
+    }
+
+    // {batches, inputSize, outputSize}
+    const uint32_t kFullyConnectedConfigs[][3] = {{1, 1024, 1000}, {32, 512, 512}};
+    for (OperandType type : kAllTypes) {
+        for (const auto& c : kFullyConnectedConfigs) {
+            BenchmarkOperand input = tensor(type, {c[0], c[1]});
+            BenchmarkOperand weights = tensor(type, {c[2], c[1]});
+            std::ostringstream label;
+            label << prefix(OperationType::FULLY_CONNECTED, type) << c[0] << "x" << c[1] << "/o"
+                  << c[2];
+            cases->push_back({.type = OperationType::FULLY_CONNECTED,
+                              .label = label.str(),
+                              .inputs = {input, weights, bias(type, c[2], input, weights),
+                                         int32Scalar(ANEURALNETWORKS_FUSED_NONE)},
+                              .outputs = {accumulatorOutput(type, {c[0], c[2]})},
+                              .flops = 2.0 * c[0] * c[1] * c[2]});
+        }
+    }
+}
+
+void addPoolingCases(std::vector<BenchmarkCase>* cases) {
+    // {size, channels, kernel, stride}
+    const uint32_t kConfigs[][4] = {{112, 64, 2, 2}, {56, 128, 3, 1}};
+    for (OperationType operation : {OperationType::AVERAGE_POOL_2D, OperationType::MAX_POOL_2D,
+                                    OperationType::L2_POOL_2D}) {
+        for (OperandType type : kAllTypes) {
+            if (type == OperandType::TENSOR_QUANT8_ASYMM &&
+                operation == OperationType::L2_POOL_2D) {
+                continue;
+            }
+            for (bool nchw : {false, true}) {
+                for (const auto& c : kConfigs) {
+                    const uint32_t outSize = samePaddingOutputSize(c[0], c[3]);
+                    std::ostringstream label;
+                    label << prefix(operation, type) << (nchw ? "NCHW/" : "NHWC/") << c[0] << "x"
+                          << c[0] << "x" << c[1] << "/k" << c[2] << "s" << c[3];
+                    cases->push_back(
+                            {.type = operation,
+                             .label = label.str(),
+                             .inputs = {tensor(type, imageShape(nchw, 1, c[0], c[0], c[1])),
+                                        int32Scalar(ANEURALNETWORKS_PADDING_SAME),
+                                        int32Scalar(c[3]), int32Scalar(c[3]), int32Scalar(c[2]),
+                                        int32Scalar(c[2]), int32Scalar(ANEURALNETWORKS_FUSED_NONE),
+                                        boolScalar(nchw)},
+                             .outputs = {tensor(type, imageShape(nchw, 1, outSize, outSize, c[1]))},
+                             .flops = static_cast<double>(outSize) * outSize * c[1] * c[2] * c[2]});
+                }
+            }
+        }
+    }
+}
+
+void addMemoryBoundCases(std::vector<BenchmarkCase>* cases) {
+    const std::vector<uint32_t> kImage = {1, 56, 56, 64};
+
+    for (OperandType type : kAllTypes) {
+        for (const std::vector<uint32_t>& shape :
+             std::vector<std::vector<uint32_t>>{{1, 1000}, {64, 1000}, kImage}) {
+            BenchmarkOperand output = tensor(type, shape);
+            if (type == OperandType::TENSOR_QUANT8_ASYMM) {
+                output.scale = 1.0f / 256;
+                output.zeroPoint = 0;
+            }
+            cases->push_back({.type = OperationType::SOFTMAX,
+                              .label = prefix(OperationType::SOFTMAX, type) + shapeToString(shape),
+                              .inputs = {tensor(type, shape), floatScalar(type, 1.0f)},
+                              .outputs = {output}});
+        }
+
+        for (bool nchw : {false, true}) {
+            cases->push_back(
+                    {.type = OperationType::RESIZE_BILINEAR,
+                     .label = prefix(OperationType::RESIZE_BILINEAR, type) +
+                              (nchw ? "NCHW/" : "NHWC/") + "56x56x64/112x112",
+                     .inputs = {tensor(type, imageShape(nchw, 1, 56, 56, 64)), int32Scalar(112),
+                                int32Scalar(112), boolScalar(nchw)},
+                     .outputs = {tensor(type, imageShape(nchw, 1, 112, 112, 64))}});
+        }
+
+        cases->push_back({.type = OperationType::TRANSPOSE,
+                          .label = prefix(OperationType::TRANSPOSE, type) + "56x56x64/0312",
+                          .inputs = {tensor(type, kImage), int32Tensor({0, 3, 1, 2})},
+                          .outputs = {tensor(type, {1, 64, 56, 56})}});
+
+        for (int32_t axis : {1, 3}) {
+            std::vector<uint32_t> outputShape = kImage;
+            outputShape[axis] *= 2;
+            cases->push_back({.type = OperationType::CONCATENATION,
+                              .label = prefix(OperationType::CONCATENATION, type) +
+                                       "2x56x56x64/axis" + std::to_string(axis),
+                              .inputs = {tensor(type, kImage), tensor(type, kImage),
+                                         int32Scalar(axis)},
+                              .outputs = {tensor(type, outputShape)}});
+        }
+
+        cases->push_back({.type = OperationType::PAD,
+                          .label = prefix(OperationType::PAD, type) + "56x56x64/hw1",
+                          .inputs = {tensor(type, kImage), int32Tensor({0, 0, 1, 1, 1, 1, 0, 0})},
+                          .outputs = {tensor(type, {1, 58, 58, 64})}});
+        cases->back().inputs[1].dimensions = {4, 2};
+
+        cases->push_back({.type = OperationType::MEAN,
+                          .label = prefix(OperationType::MEAN, type) + "56x56x64/axes12",
+                          .inputs = {tensor(type, kImage), int32Tensor({1, 2}), int32Scalar(1)},
+                          .outputs = {tensor(type, {1, 1, 1, 64})}});
+    }
+
+    for (OperandType type : kFloatTypes) {
+        cases->push_back({.type = OperationType::L2_NORMALIZATION,
+                          .label = prefix(OperationType::L2_NORMALIZATION, type) + "56x56x64",
+                          .inputs = {tensor(type, kImage)},
+                          .outputs = {tensor(type, kImage)}});
+    }
+}
+
+std::vector<BenchmarkCase> allCases() {
+    std::vector<BenchmarkCase> cases;
+    addUnaryCases(&cases);
+    addBinaryCases(&cases);
+    addConvCases(&cases);
+    addPoolingCases(&cases);
+    addMemoryBoundCases(&cases);
+    return cases;
+}
+
+// Allocates the buffer of an operand, with either its value or synthetic
+// data: small positive numbers, so that LOG, SQRT and friends stay finite.
+std::vector<uint8_t> makeBuffer(const BenchmarkOperand& operand) {
+    if (!operand.value.empty()) {
+        return operand.value;
+    }
+    std::vector<uint8_t> buffer(nonExtensionOperandSizeOfData(operand.type, operand.dimensions));
+    const uint32_t count = product(operand.dimensions);
+    auto fill = [count](auto* data, auto value) {
+        for (uint32_t i = 0; i < count; i++) {
+            data[i] = value(i);
+        }
+    };
+    switch (operand.type) {
+        case OperandType::TENSOR_FLOAT32:
+            fill(reinterpret_cast<float*>(buffer.data()),
+                 [](uint32_t i) { return 0.1f + (i % 100) / 100.0f; });
+            break;
+        case OperandType::TENSOR_FLOAT16:
+            fill(reinterpret_cast<_Float16*>(buffer.data()),
+                 [](uint32_t i) { return static_cast<_Float16>(0.1f + (i % 100) / 100.0f); });
+            break;
+        case OperandType::TENSOR_INT32:
+            fill(reinterpret_cast<int32_t*>(buffer.data()),
+                 [](uint32_t i) { return static_cast<int32_t>(i % 16); });
+            break;
+        default:
+            fill(buffer.data(), [](uint32_t i) { return static_cast<uint8_t>(i * 7); });
+            break;
+    }
+    return buffer;
+}
+
+// Bytes moved by one execution: the tensor inputs and outputs.
+double tensorBytes(const BenchmarkCase& benchmarkCase) {
+    double bytes = 0;
+    for (const auto* operands : {&benchmarkCase.inputs, &benchmarkCase.outputs}) {
+        for (const BenchmarkOperand& operand : *operands) {
+            if (!operand.dimensions.empty()) {
+                bytes += nonExtensionOperandSizeOfData(operand.type, operand.dimensions);
+            }
+        }
+    }
+    return bytes;
+}
+
+struct BenchmarkTensor {
+    Shape shape;
+    std::vector<uint8_t> buffer;
+};
+
+BenchmarkTensor makeTensor(const BenchmarkOperand& operand) {
+    return {.shape = {.type = operand.type,
+                      .dimensions = operand.dimensions,
+                      .scale = operand.scale,
+                      .offset = operand.zeroPoint},
+            .buffer = makeBuffer(operand)};
+}
+
+// Just enough of an execution context to run a kernel on synthetic operands,
+// without the operand bookkeeping of the CpuExecutor.
+class BenchmarkExecutionContext : public IOperationExecutionContext {
+   public:
+    explicit BenchmarkExecutionContext(const BenchmarkCase& benchmarkCase) {
+        for (const BenchmarkOperand& operand : benchmarkCase.inputs) {
+            mInputs.push_back(makeTensor(operand));
+        }
+        for (const BenchmarkOperand& operand : benchmarkCase.outputs) {
+            mOutputs.push_back(makeTensor(operand));
+        }
+    }
+
+    uint32_t getNumInputs() const override { return mInputs.size(); }
+    OperandType getInputType(uint32_t index) const override {
+        return mInputs[index].shape.type;
+    }
+    Shape getInputShape(uint32_t index) const override { return mInputs[index].shape; }
+    const void* getInputBuffer(uint32_t index) const override {
+        return mInputs[index].buffer.data();
+    }
+    const Operand::ExtraParams getInputExtraParams(uint32_t index) const override {
+        return mInputs[index].shape.extraParams;
+    }
+
+    uint32_t getNumOutputs() const override { return mOutputs.size(); }
+    OperandType getOutputType(uint32_t index) const override {
+        return mOutputs[index].shape.type;
+    }
+    Shape getOutputShape(uint32_t index) const override { return mOutputs[index].shape; }
+    void* getOutputBuffer(uint32_t index) override { return mOutputs[index].buffer.data(); }
+
+    bool setOutputShape(uint32_t index, const Shape& shape) override {
+        BenchmarkTensor& output = mOutputs[index];
+        output.shape.dimensions = shape.dimensions;
+        output.buffer.resize(nonExtensionOperandSizeOfData(output.shape.type, shape.dimensions));
+        return true;
+    }
+
+    bool isOmittedInput(uint32_t) const override { return false; }
+    bool isOmittedOutput(uint32_t) const override { return false; }
+
+   private:
+    std::vector<BenchmarkTensor> mInputs;
+    std::vector<BenchmarkTensor> mOutputs;
+};
+
+void runWithResolver(benchmark::State& state, const OperationRegistration* registration,
+                     const BenchmarkCase& benchmarkCase) {
+    BenchmarkExecutionContext context(benchmarkCase);
+    if (!registration->prepare(&context)) {
+        state.SkipWithError("prepare failed");
+        return;
+    }
+    for (auto _ : state) {
+        if (!registration->execute(&context)) {
+            state.SkipWithError("execute failed");
+            return;
+        }
+    }
+}
+
+// Runs the operation as the only operation of a model, with every operand a
+// model input or output backed by its own request pool.
+void runWithCpuExecutor(benchmark::State& state, const BenchmarkCase& benchmarkCase) {
+    Model model;
+    Request request;
+    std::vector<Operand> operands;
+    std::vector<std::vector<uint8_t>> buffers;
+    std::vector<RunTimePoolInfo> requestPoolInfos;
+    // Reserve up front so that the buffers do not move once they are pooled.
+    buffers.reserve(benchmarkCase.inputs.size() + benchmarkCase.outputs.size());
+    auto addOperands = [&](const std::vector<BenchmarkOperand>& benchmarkOperands,
+                           OperandLifeTime lifetime, hidl_vec<RequestArgument>* arguments) {
+        std::vector<uint32_t> indexes;
+        std::vector<RequestArgument> args;
+        for (const BenchmarkOperand& benchmarkOperand : benchmarkOperands) {
+            buffers.push_back(makeBuffer(benchmarkOperand));
+            const uint32_t poolIndex = requestPoolInfos.size();
+            requestPoolInfos.push_back(
+                    RunTimePoolInfo::createFromExistingBuffer(buffers.back().data()));
+
+            Operand operand;
+            operand.type = benchmarkOperand.type;
+            operand.dimensions = benchmarkOperand.dimensions;
+            operand.numberOfConsumers = lifetime == OperandLifeTime::MODEL_INPUT ? 1 : 0;
+            operand.scale = benchmarkOperand.scale;
+            operand.zeroPoint = benchmarkOperand.zeroPoint;
+            operand.lifetime = lifetime;
+            operand.location = {.poolIndex = 0, .offset = 0, .length = 0};
+            indexes.push_back(operands.size());
+            operands.push_back(operand);
+
+            RequestArgument argument;
+            argument.hasNoValue = false;
+            argument.location = {.poolIndex = poolIndex,
+                                 .offset = 0,
+                                 .length = static_cast<uint32_t>(buffers.back().size())};
+            args.push_back(argument);
+        }
+        *arguments = args;
+        return indexes;
+    };
+    model.inputIndexes =
+            addOperands(benchmarkCase.inputs, OperandLifeTime::MODEL_INPUT, &request.inputs);
+    model.outputIndexes =
+            addOperands(benchmarkCase.outputs, OperandLifeTime::MODEL_OUTPUT, &request.outputs);
+    model.operands = operands;
+    Operation operation;
+    operation.type = benchmarkCase.type;
+    operation.inputs = model.inputIndexes;
+    operation.outputs = model.outputIndexes;
+    model.operations = {operation};
+
+    CpuExecutor executor;
+    for (auto _ : state) {
+        if (executor.run(model, request, {}, requestPoolInfos) != ANEURALNETWORKS_NO_ERROR) {
+            state.SkipWithError("execution failed");
+            return;
+        }
+    }
+}
+
+void runBenchmark(benchmark::State& state, const BenchmarkCase& benchmarkCase) {
+    const OperationRegistration* registration =
+            BuiltinOperationResolver::get()->findOperation(benchmarkCase.type);
+    if (registration != nullptr) {
+        runWithResolver(state, registration, benchmarkCase);
+    } else {
+        runWithCpuExecutor(state, benchmarkCase);
+    }
+    state.SetBytesProcessed(state.iterations() * tensorBytes(benchmarkCase));
+    if (benchmarkCase.flops > 0) {
+        state.counters["FLOPS"] = benchmark::Counter(
+                benchmarkCase.flops, benchmark::Counter::kIsIterationInvariantRate);
+    }
+}
+
+}  // namespace
+}  // namespace nn
+}  // namespace android
+
+int main(int argc, char** argv) {
+    using namespace android::nn;
+    static const std::vector<BenchmarkCase> cases = allCases();
+    for (const BenchmarkCase& benchmarkCase : cases) {
+        benchmark::RegisterBenchmark(benchmarkCase.label.c_str(), runBenchmark, benchmarkCase);
+    }
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -79,6 +79,8 @@ bool meanGeneric(T* inputData, const Shape& inputShape, const int32_t* axis, con
         LOG(ERROR) << "Failed to allocate tempSumBuffer for MEAN";
         result = false;
     } else {
+        chargeOperationScratch(MemoryCategory::KERNEL_SCRATCH,
+                               getNumberOfElements(outputShape) * sizeof(U));
         NNTRACE_COMP_SWITCH("optimized_ops::Mean");
         tflite::reference_ops::Mean<T, U>(
                 inputData, reinterpret_cast<const int*>(inputShape.dimensions.data()),
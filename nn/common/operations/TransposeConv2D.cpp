@@ -187,6 +187,7 @@ bool transposeConvNhwc(const uint8_t* inputData, const Shape& inputShape, const
             return false;
         }
         bufferGuard.reset(tempBuffer);
+        chargeOperationScratch(MemoryCategory::KERNEL_SCRATCH, tempBufferByteSize);
     }
 
     int32_t inputOffset = -inputShape.offset;
@@ -322,6 +323,7 @@ bool transposeConvQuant8PerChannelNhwc(const uint8_t* inputData, const Shape& in
             return false;
         }
         bufferGuard.reset(tempBuffer);
+        chargeOperationScratch(MemoryCategory::KERNEL_SCRATCH, tempBufferByteSize);
     }
 
     int32_t inputOffset = -inputShape.offset;
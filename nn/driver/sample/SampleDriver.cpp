@@ -21,10 +21,13 @@
 #include "CpuExecutor.h"
 #include "ExecutionBurstServer.h"
 #include "HalInterfaces.h"
+#include "ModelCache.h"
 #include "Tracing.h"
+#include "Utils.h"
 #include "ValidateHal.h"
 
 #include <android-base/logging.h>
+#include <android-base/properties.h>
 #include <hidl/LegacySupport.h>
 #include <chrono>
 #include <optional>
@@ -46,6 +49,11 @@ auto microsecondsDuration(decltype(now()) end, decltype(now()) start) {
     return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
 };
 
+// The prepared model is cached as its HIDL model in one file and its constant pools in another;
+// see ModelCache.h.
+constexpr uint32_t kNumModelCache = 1;
+constexpr uint32_t kNumDataCache = 1;
+
 }  // namespace
 
 static const Timing kNoTiming = {.timeOnDevice = UINT64_MAX, .timeInDriver = UINT64_MAX};
@@ -117,8 +125,7 @@ Return<void> SampleDriver::getSupportedOperations_1_1(const V1_1::Model& model,
 Return<void> SampleDriver::getNumberOfCacheFilesNeeded(getNumberOfCacheFilesNeeded_cb cb) {
     NNTRACE_FULL(NNTRACE_LAYER_DRIVER, NNTRACE_PHASE_INITIALIZATION,
                  "SampleDriver::getNumberOfCacheFilesNeeded");
-    // Set both numbers to be 0 for cache not supported.
-    cb(ErrorStatus::NONE, /*numModelCache=*/0, /*numDataCache=*/0);
+    cb(ErrorStatus::NONE, kNumModelCache, kNumDataCache);
     return Void();
 }
 
@@ -132,10 +139,15 @@ static void notify(const sp<V1_2::IPreparedModelCallback>& callback, const Error
     callback->notify_1_2(status, preparedModel);
 }
 
+// If modelCache and dataCache hold the number of files the driver asked for, the prepared model
+// is also saved into them. Failing to do so does not fail the preparation.
 template <typename T_Model, typename T_IPreparedModelCallback>
 Return<ErrorStatus> prepareModelBase(const T_Model& model, const SampleDriver* driver,
                                      ExecutionPreference preference,
-                                     const sp<T_IPreparedModelCallback>& callback) {
+                                     const sp<T_IPreparedModelCallback>& callback,
+                                     const hidl_vec<hidl_handle>& modelCache = {},
+                                     const hidl_vec<hidl_handle>& dataCache = {},
+                                     const HidlToken& token = {}) {
     if (callback.get() == nullptr) {
         LOG(ERROR) << "invalid callback passed to prepareModelBase";
         return ErrorStatus::INVALID_ARGUMENT;
@@ -150,11 +162,16 @@ Return<ErrorStatus> prepareModelBase(const T_Model& model, const SampleDriver* d
     }
 
     // TODO: make asynchronous later
-    sp<SamplePreparedModel> preparedModel = new SamplePreparedModel(convertToV1_2(model), driver);
+    const Model modelV1_2 = convertToV1_2(model);
+    sp<SamplePreparedModel> preparedModel = new SamplePreparedModel(modelV1_2, driver, preference);
     if (!preparedModel->initialize()) {
         notify(callback, ErrorStatus::INVALID_ARGUMENT, nullptr);
         return ErrorStatus::INVALID_ARGUMENT;
     }
+    if (modelCache.size() == kNumModelCache && dataCache.size() == kNumDataCache &&
+        !writeModelToCache(modelV1_2, modelCache[0], dataCache[0], token)) {
+        LOG(WARNING) << "prepareModelBase failed to save the compilation cache";
+    }
     notify(callback, ErrorStatus::NONE, preparedModel);
     return ErrorStatus::NONE;
 }
@@ -173,20 +190,41 @@ Return<ErrorStatus> SampleDriver::prepareModel_1_1(
 }
 
 Return<ErrorStatus> SampleDriver::prepareModel_1_2(
-        const V1_2::Model& model, ExecutionPreference preference, const hidl_vec<hidl_handle>&,
-        const hidl_vec<hidl_handle>&, const HidlToken&,
-        const sp<V1_2::IPreparedModelCallback>& callback) {
+        const V1_2::Model& model, ExecutionPreference preference,
+        const hidl_vec<hidl_handle>& modelCache, const hidl_vec<hidl_handle>& dataCache,
+        const HidlToken& token, const sp<V1_2::IPreparedModelCallback>& callback) {
     NNTRACE_FULL(NNTRACE_LAYER_DRIVER, NNTRACE_PHASE_COMPILATION, "SampleDriver::prepareModel_1_2");
-    return prepareModelBase(model, this, preference, callback);
+    return prepareModelBase(model, this, preference, callback, modelCache, dataCache, token);
 }
 
 Return<ErrorStatus> SampleDriver::prepareModelFromCache(
-        const hidl_vec<hidl_handle>&, const hidl_vec<hidl_handle>&, const HidlToken&,
-        const sp<V1_2::IPreparedModelCallback>& callback) {
+        const hidl_vec<hidl_handle>& modelCache, const hidl_vec<hidl_handle>& dataCache,
+        const HidlToken& token, const sp<V1_2::IPreparedModelCallback>& callback) {
     NNTRACE_FULL(NNTRACE_LAYER_DRIVER, NNTRACE_PHASE_COMPILATION,
                  "SampleDriver::prepareModelFromCache");
-    callback->notify_1_2(ErrorStatus::GENERAL_FAILURE, nullptr);
-    return ErrorStatus::GENERAL_FAILURE;
+    if (callback.get() == nullptr) {
+        LOG(ERROR) << "invalid callback passed to prepareModelFromCache";
+        return ErrorStatus::INVALID_ARGUMENT;
+    }
+    if (modelCache.size() != kNumModelCache || dataCache.size() != kNumDataCache) {
+        callback->notify_1_2(ErrorStatus::INVALID_ARGUMENT, nullptr);
+        return ErrorStatus::INVALID_ARGUMENT;
+    }
+
+    // Restoring only reads the graph description; the constant pools are mmap'ed from the data
+    // cache rather than copied.
+    Model model;
+    if (!readModelFromCache(modelCache[0], dataCache[0], token, &model)) {
+        callback->notify_1_2(ErrorStatus::GENERAL_FAILURE, nullptr);
+        return ErrorStatus::GENERAL_FAILURE;
+    }
+    sp<SamplePreparedModel> preparedModel = new SamplePreparedModel(model, this);
+    if (!preparedModel->initialize()) {
+        callback->notify_1_2(ErrorStatus::GENERAL_FAILURE, nullptr);
+        return ErrorStatus::GENERAL_FAILURE;
+    }
+    callback->notify_1_2(ErrorStatus::NONE, preparedModel);
+    return ErrorStatus::NONE;
 }
 
 Return<DeviceStatus> SampleDriver::getStatus() {
@@ -196,7 +234,68 @@ Return<DeviceStatus> SampleDriver::getStatus() {
     return DeviceStatus::AVAILABLE;
 }
 
+void SampleDriver::calibrate(const std::string& cacheDir) {
+    NNTRACE_FULL(NNTRACE_LAYER_DRIVER, NNTRACE_PHASE_INITIALIZATION, "SampleDriver::calibrate");
+    // Each driver measures its own execution path, so each has its own file.
+    const std::string cacheFile = cacheDir.empty() ? "" : cacheDir + "/" + mName + ".calibration";
+    if (!cacheFile.empty()) {
+        mCalibration = Calibration::load(cacheFile);
+        if (mCalibration) {
+            VLOG(DRIVER) << "Loaded calibration from " << cacheFile;
+            return;
+        }
+    }
+    mCalibration = Calibration::measure(*this);
+    if (!cacheFile.empty()) {
+        mCalibration->save(cacheFile);
+    }
+}
+
+Capabilities SampleDriver::calibrated(Capabilities capabilities) const {
+    if (mCalibration) {
+        mCalibration->apply(&capabilities);
+    }
+    return capabilities;
+}
+
+void SampleDriver::setParallelism(uint32_t workers, uint32_t workersPerPreparedModel) {
+    CHECK_GT(workers, 0u);
+    mWorkers = workers;
+    mWorkersPerPreparedModel = workersPerPreparedModel;
+}
+
+WorkerPool* SampleDriver::getWorkerPool() const {
+    std::call_once(mWorkerPoolCreated, [this] {
+        VLOG(DRIVER) << mName << " starts " << mWorkers << " execution threads";
+        mWorkerPool = std::make_unique<WorkerPool>(mWorkers);
+    });
+    return mWorkerPool.get();
+}
+
+WorkerPool::Statistics SampleDriver::getWorkerPoolStatistics() const {
+    return getWorkerPool()->getStatistics();
+}
+
+void SampleDriver::enqueueExecution(std::function<void()> task, int32_t priority,
+                                    const std::shared_ptr<WorkerPool::Group>& group) const {
+    getWorkerPool()->enqueue(std::move(task), priority, group);
+}
+
+std::shared_ptr<WorkerPool::Group> SampleDriver::makeWorkerGroup() const {
+    if (mWorkersPerPreparedModel == 0) {
+        return nullptr;
+    }
+    return std::make_shared<WorkerPool::Group>(mWorkersPerPreparedModel);
+}
+
 int SampleDriver::run() {
+#ifdef NN_DEBUGGABLE
+    if (getProp("debug.nn.sample.calibrate") != 0) {
+        calibrate(android::base::GetProperty("debug.nn.sample.calibration-dir", ""));
+    }
+    setParallelism(std::max(1u, getProp("debug.nn.sample.workers", mWorkers)),
+                   getProp("debug.nn.sample.workers-per-model", mWorkersPerPreparedModel));
+#endif  // NN_DEBUGGABLE
     android::hardware::configureRpcThreadpool(4, true);
     if (registerAsService(mName) != android::OK) {
         LOG(ERROR) << "Could not register service";
@@ -208,7 +307,11 @@ int SampleDriver::run() {
 }
 
 bool SamplePreparedModel::initialize() {
-    return setRunTimePoolInfosFromHidlMemories(&mPoolInfos, mModel.pools);
+    if (!setRunTimePoolInfosFromHidlMemories(&mPoolInfos, mModel.pools)) {
+        return false;
+    }
+    mCpuExecutorModel = std::make_unique<const CpuExecutorModel>(mModel, mPoolInfos);
+    return true;
 }
 
 static Return<void> notify(const sp<V1_0::IExecutionCallback>& callback, const ErrorStatus& status,
@@ -225,8 +328,7 @@ static Return<void> notify(const sp<V1_2::IExecutionCallback>& callback, const E
 //                is supported in CpuExecutor.
 template <typename T_IExecutionCallback>
 void asyncExecute(const Request& request, MeasureTiming measure, time_point driverStart,
-                  const Model& model, const SampleDriver& driver,
-                  const std::vector<RunTimePoolInfo>& poolInfos,
+                  const CpuExecutorModel& cpuExecutorModel, const SampleDriver& driver,
                   const sp<T_IExecutionCallback>& callback) {
     NNTRACE_FULL(NNTRACE_LAYER_DRIVER, NNTRACE_PHASE_INPUTS_AND_OUTPUTS,
                  "SampleDriver::asyncExecute");
@@ -241,7 +343,7 @@ void asyncExecute(const Request& request, MeasureTiming measure, time_point driv
     CpuExecutor executor = driver.getExecutor();
     time_point driverEnd, deviceStart, deviceEnd;
     if (measure == MeasureTiming::YES) deviceStart = now();
-    int n = executor.run(model, request, poolInfos, requestPoolInfos);
+    int n = executor.run(cpuExecutorModel, request, requestPoolInfos);
     if (measure == MeasureTiming::YES) deviceEnd = now();
     VLOG(DRIVER) << "executor.run returned " << n;
     ErrorStatus executionStatus = convertResultCodeToErrorStatus(n);
@@ -261,11 +363,23 @@ void asyncExecute(const Request& request, MeasureTiming measure, time_point driv
     }
 }
 
+// Executions of prepared models that asked for a fast single answer go first
+// in the queue of the driver, and those that asked for low power last.
+static int32_t getExecutionPriority(ExecutionPreference preference) {
+    switch (preference) {
+        case ExecutionPreference::FAST_SINGLE_ANSWER:
+            return 2;
+        case ExecutionPreference::SUSTAINED_SPEED:
+            return 1;
+        case ExecutionPreference::LOW_POWER:
+            return 0;
+    }
+    return 0;
+}
+
 template <typename T_IExecutionCallback>
-Return<ErrorStatus> executeBase(const Request& request, MeasureTiming measure, const Model& model,
-                                const SampleDriver& driver,
-                                const std::vector<RunTimePoolInfo>& poolInfos,
-                                const sp<T_IExecutionCallback>& callback) {
+Return<ErrorStatus> SamplePreparedModel::executeBase(const Request& request, MeasureTiming measure,
+                                                     const sp<T_IExecutionCallback>& callback) {
     NNTRACE_FULL(NNTRACE_LAYER_DRIVER, NNTRACE_PHASE_EXECUTION, "SampleDriver::executeBase");
     VLOG(DRIVER) << "executeBase(" << SHOW_IF_DEBUG(toString(request)) << ")";
 
@@ -276,29 +390,35 @@ Return<ErrorStatus> executeBase(const Request& request, MeasureTiming measure, c
         LOG(ERROR) << "invalid callback passed to executeBase";
         return ErrorStatus::INVALID_ARGUMENT;
     }
-    if (!validateRequest(request, model)) {
+    if (!mRequestValidation.validate(request, mModel)) {
         notify(callback, ErrorStatus::INVALID_ARGUMENT, {}, kNoTiming);
         return ErrorStatus::INVALID_ARGUMENT;
     }
 
-    // This thread is intentionally detached because the sample driver service
-    // is expected to live forever.
-    std::thread([&model, &driver, &poolInfos, request, measure, driverStart, callback] {
-        asyncExecute(request, measure, driverStart, model, driver, poolInfos, callback);
-    })
-            .detach();
+    // The task holds a reference to the prepared model, so that the model and
+    // its pools outlive the execution even if the client releases it.
+    const auto handOff = NNTRACE_HAND_OFF(NNTRACE_LAYER_DRIVER, NNTRACE_PHASE_EXECUTION,
+                                          "SampleDriver::executeBase thread");
+    sp<SamplePreparedModel> self = this;
+    mDriver->enqueueExecution(
+            [self, request, measure, driverStart, callback, handOff] {
+                handOff.finish();
+                asyncExecute(request, measure, driverStart, *self->mCpuExecutorModel,
+                             *self->mDriver, callback);
+            },
+            getExecutionPriority(mPreference), mWorkerGroup);
 
     return ErrorStatus::NONE;
 }
 
 Return<ErrorStatus> SamplePreparedModel::execute(const Request& request,
                                                  const sp<V1_0::IExecutionCallback>& callback) {
-    return executeBase(request, MeasureTiming::NO, mModel, *mDriver, mPoolInfos, callback);
+    return executeBase(request, MeasureTiming::NO, callback);
 }
 
 Return<ErrorStatus> SamplePreparedModel::execute_1_2(const Request& request, MeasureTiming measure,
                                                      const sp<V1_2::IExecutionCallback>& callback) {
-    return executeBase(request, measure, mModel, *mDriver, mPoolInfos, callback);
+    return executeBase(request, measure, callback);
 }
 
 Return<void> SamplePreparedModel::executeSynchronously(const Request& request,
@@ -311,7 +431,7 @@ Return<void> SamplePreparedModel::executeSynchronously(const Request& request,
     time_point driverStart, driverEnd, deviceStart, deviceEnd;
     if (measure == MeasureTiming::YES) driverStart = now();
 
-    if (!validateRequest(request, mModel)) {
+    if (!mRequestValidation.validate(request, mModel)) {
         cb(ErrorStatus::INVALID_ARGUMENT, {}, kNoTiming);
         return Void();
     }
@@ -328,7 +448,7 @@ Return<void> SamplePreparedModel::executeSynchronously(const Request& request,
                         "SampleDriver::executeSynchronously");
     CpuExecutor executor = mDriver->getExecutor();
     if (measure == MeasureTiming::YES) deviceStart = now();
-    int n = executor.run(mModel, request, mPoolInfos, requestPoolInfos);
+    int n = executor.run(*mCpuExecutorModel, request, requestPoolInfos);
     if (measure == MeasureTiming::YES) deviceEnd = now();
     VLOG(DRIVER) << "executor.run returned " << n;
     ErrorStatus executionStatus = convertResultCodeToErrorStatus(n);
@@ -352,9 +472,11 @@ Return<void> SamplePreparedModel::executeSynchronously(const Request& request,
 // unmapping the memory on each execution.
 class BurstExecutorWithCache : public ExecutionBurstServer::IBurstExecutorWithCache {
    public:
-    BurstExecutorWithCache(const Model& model, const SampleDriver* driver,
-                           const std::vector<RunTimePoolInfo>& poolInfos)
-        : mModel(model), mDriver(driver), mModelPoolInfos(poolInfos) {}
+    // preparedModel owns cpuExecutorModel, and is held so that it outlives
+    // the burst.
+    BurstExecutorWithCache(const sp<IPreparedModel>& preparedModel,
+                           const CpuExecutorModel& cpuExecutorModel, const SampleDriver* driver)
+        : mPreparedModel(preparedModel), mCpuExecutorModel(cpuExecutorModel), mDriver(driver) {}
 
     bool isCacheEntryPresent(int32_t slot) const override {
         const auto it = mMemoryCache.find(slot);
@@ -390,7 +512,7 @@ class BurstExecutorWithCache : public ExecutionBurstServer::IBurstExecutorWithCa
         fullRequest.pools = std::move(pools);
 
         // validate request object against the model
-        if (!validateRequest(fullRequest, mModel)) {
+        if (!mRequestValidation.validate(fullRequest, mCpuExecutorModel.getModel())) {
             return {ErrorStatus::INVALID_ARGUMENT, {}, kNoTiming};
         }
 
@@ -403,7 +525,7 @@ class BurstExecutorWithCache : public ExecutionBurstServer::IBurstExecutorWithCa
         // execution
         CpuExecutor executor = mDriver->getExecutor();
         if (measure == MeasureTiming::YES) deviceStart = now();
-        int n = executor.run(mModel, request, mModelPoolInfos, requestPoolInfos);
+        int n = executor.run(mCpuExecutorModel, request, requestPoolInfos);
         if (measure == MeasureTiming::YES) deviceEnd = now();
         VLOG(DRIVER) << "executor.run returned " << n;
         ErrorStatus executionStatus = convertResultCodeToErrorStatus(n);
@@ -421,9 +543,10 @@ class BurstExecutorWithCache : public ExecutionBurstServer::IBurstExecutorWithCa
     }
 
    private:
-    const Model mModel;
+    const sp<IPreparedModel> mPreparedModel;
+    const CpuExecutorModel& mCpuExecutorModel;
     const SampleDriver* const mDriver;
-    const std::vector<RunTimePoolInfo> mModelPoolInfos;
+    RequestValidationCache mRequestValidation;
     std::map<int32_t, std::optional<RunTimePoolInfo>> mMemoryCache;  // cached requestPoolInfos
 };
 
@@ -443,7 +566,7 @@ Return<void> SamplePreparedModel::configureExecutionBurst(
     // However, this alternative representation does not include a memory map
     // caching optimization, and adds overhead.
     const std::shared_ptr<BurstExecutorWithCache> executorWithCache =
-            std::make_shared<BurstExecutorWithCache>(mModel, mDriver, mPoolInfos);
+            std::make_shared<BurstExecutorWithCache>(this, *mCpuExecutorModel, mDriver);
     const sp<V1_2::IBurstContext> burst = ExecutionBurstServer::create(
             callback, requestChannel, resultChannel, executorWithCache);
 
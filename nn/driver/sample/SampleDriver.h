@@ -20,8 +20,17 @@
 #include "CpuExecutor.h"
 #include "HalInterfaces.h"
 #include "NeuralNetworks.h"
+#include "SampleDriverCalibration.h"
+#include "SampleDriverWorkerPool.h"
+#include "ValidateHal.h"
 
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
 
 namespace android {
 namespace nn {
@@ -39,7 +48,9 @@ class SampleDriver : public IDevice {
    public:
     SampleDriver(const char* name,
                  const IOperationResolver* operationResolver = BuiltinOperationResolver::get())
-        : mName(name), mOperationResolver(operationResolver) {
+        : mName(name),
+          mOperationResolver(operationResolver),
+          mWorkers(std::max(1u, std::thread::hardware_concurrency())) {
         android::nn::initVLogMask();
     }
     ~SampleDriver() override {}
@@ -73,15 +84,63 @@ class SampleDriver : public IDevice {
 
     CpuExecutor getExecutor() const { return CpuExecutor(mOperationResolver); }
 
+    // Scales the nominal capabilities of the driver for the operand types
+    // that a Calibration measures, see SampleDriverCalibration.h. Unless
+    // cacheDir is empty, the calibration is read from the file named after
+    // the driver in cacheDir if it holds one; otherwise it is measured and
+    // written there. run() calls this before registering the service if the
+    // debug.nn.sample.calibrate property is set, with the directory named by
+    // debug.nn.sample.calibration-dir.
+    void calibrate(const std::string& cacheDir);
+
+   protected:
+    // Sets how many threads run the asynchronous executions of the driver,
+    // and how many of them the executions of one prepared model may use at
+    // once; 0 leaves the latter unbounded. The threads are started by the
+    // first asynchronous execution, after which the number of threads no
+    // longer changes. The bound of a prepared model is the one set when it
+    // was prepared. run() takes these from the debug.nn.sample.workers and
+    // debug.nn.sample.workers-per-model properties, if set. By default there
+    // is one thread per core and no bound per prepared model.
+    void setParallelism(uint32_t workers, uint32_t workersPerPreparedModel);
+
+    // Queue depth and wait times of the asynchronous executions so far.
+    WorkerPool::Statistics getWorkerPoolStatistics() const;
+
+    // Queues an asynchronous execution; see WorkerPool::enqueue().
+    void enqueueExecution(std::function<void()> task, int32_t priority,
+                          const std::shared_ptr<WorkerPool::Group>& group) const;
+
+    // The group that bounds the executions of a new prepared model, or
+    // nullptr if they are unbounded.
+    std::shared_ptr<WorkerPool::Group> makeWorkerGroup() const;
+
    protected:
+    // Returns the nominal capabilities of the driver scaled by the
+    // calibration, if any. getCapabilities_1_2() implementations report this.
+    Capabilities calibrated(Capabilities capabilities) const;
+
     std::string mName;
     const IOperationResolver* mOperationResolver;
+    std::optional<Calibration> mCalibration;
+
+   private:
+    WorkerPool* getWorkerPool() const;
+
+    uint32_t mWorkers;
+    uint32_t mWorkersPerPreparedModel = 0;
+    mutable std::once_flag mWorkerPoolCreated;
+    mutable std::unique_ptr<WorkerPool> mWorkerPool;
 };
 
 class SamplePreparedModel : public IPreparedModel {
    public:
-    SamplePreparedModel(const Model& model, const SampleDriver* driver)
-        : mModel(model), mDriver(driver) {}
+    SamplePreparedModel(const Model& model, const SampleDriver* driver,
+                        ExecutionPreference preference = ExecutionPreference::FAST_SINGLE_ANSWER)
+        : mModel(model),
+          mDriver(driver),
+          mPreference(preference),
+          mWorkerGroup(driver->makeWorkerGroup()) {}
     ~SamplePreparedModel() override {}
     bool initialize();
     Return<ErrorStatus> execute(const Request& request,
@@ -97,9 +156,24 @@ class SamplePreparedModel : public IPreparedModel {
             configureExecutionBurst_cb cb) override;
 
    private:
+    template <typename T_IExecutionCallback>
+    Return<ErrorStatus> executeBase(const Request& request, MeasureTiming measure,
+                                    const sp<T_IExecutionCallback>& callback);
+
     Model mModel;
     const SampleDriver* mDriver;
+    // Orders the asynchronous executions of different prepared models in the
+    // queue of the driver.
+    const ExecutionPreference mPreference;
+    const std::shared_ptr<WorkerPool::Group> mWorkerGroup;
     std::vector<RunTimePoolInfo> mPoolInfos;
+    // What every execution derives from mModel and mPoolInfos, built by
+    // initialize() and shared by the synchronous, asynchronous and burst
+    // executions.
+    std::unique_ptr<const CpuExecutorModel> mCpuExecutorModel;
+    // Executions that repeat the bindings of the previous one skip the full
+    // validation of their request.
+    RequestValidationCache mRequestValidation;
 };
 
 }  // namespace sample_driver
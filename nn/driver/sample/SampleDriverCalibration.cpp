@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SampleDriverCalibration"
+
+#include "SampleDriverCalibration.h"
+
+#include "CpuExecutor.h"
+#include "HalInterfaces.h"
+#include "SampleDriver.h"
+#include "Utils.h"
+#include "ValidateHal.h"
+
+#include <android-base/logging.h>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+namespace android {
+namespace nn {
+namespace sample_driver {
+
+namespace {
+
+constexpr char kFileHeader[] = "nn-sample-calibration 2";
+
+// Each model runs once to warm up, then kRepetitions times on the driver and
+// on the CPU reference, alternating between the two so that both see the same
+// frequency changes. The fastest run of each is kept.
+constexpr int kRepetitions = 5;
+
+// Bounds on the measured ratios, so that a disturbed measurement cannot make
+// the partitioner shun or favour the driver altogether.
+constexpr float kMinRatio = 0.01f;
+constexpr float kMaxRatio = 100.0f;
+
+// Shape of the representative CONV_2D: a 3x3 convolution with SAME padding of
+// a kSize x kSize image of kDepth channels into kDepth channels.
+constexpr uint32_t kSize = 32;
+constexpr uint32_t kDepth = 32;
+
+// The model and request of a representative CONV_2D on tensorType, with the
+// buffers of its input and output.
+struct ConvWorkload {
+    Model model;
+    Request request;
+    std::vector<uint8_t> input;
+    std::vector<uint8_t> output;
+};
+
+ConvWorkload makeConvWorkload(OperandType tensorType) {
+    const bool quant = tensorType == OperandType::TENSOR_QUANT8_ASYMM;
+    ConvWorkload workload;
+    std::vector<Operand> operands;
+    std::vector<uint8_t> values;
+
+    auto addOperand = [&operands](OperandType type, std::vector<uint32_t> dimensions,
+                                  OperandLifeTime lifetime, float scale = 0.0f,
+                                  int32_t zeroPoint = 0) {
+        operands.push_back({.type = type,
+                            .dimensions = std::move(dimensions),
+                            .numberOfConsumers = 1,
+                            .scale = scale,
+                            .zeroPoint = zeroPoint,
+                            .lifetime = lifetime});
+        return static_cast<uint32_t>(operands.size() - 1);
+    };
+    // Constants are copied into operandValues, 4-byte aligned, zero unless
+    // data is given.
+    auto addConstant = [&addOperand, &operands, &values](
+                               OperandType type, std::vector<uint32_t> dimensions,
+                               float scale = 0.0f, const void* data = nullptr) {
+        const uint32_t index = addOperand(type, std::move(dimensions),
+                                          OperandLifeTime::CONSTANT_COPY, scale);
+        Operand& operand = operands[index];
+        const uint32_t length = nonExtensionOperandSizeOfData(operand);
+        const uint32_t offset = (values.size() + 3) & ~3u;
+        values.resize(offset + length);
+        if (data != nullptr) {
+            memcpy(values.data() + offset, data, length);
+        }
+        operand.location = {.poolIndex = 0, .offset = offset, .length = length};
+        return index;
+    };
+
+    const OperandType biasType = quant ? OperandType::TENSOR_INT32 : tensorType;
+    const uint32_t input = addOperand(tensorType, {1, kSize, kSize, kDepth},
+                                      OperandLifeTime::MODEL_INPUT, quant ? 0.5f : 0.0f,
+                                      quant ? 128 : 0);
+    const uint32_t filter = addConstant(tensorType, {kDepth, 3, 3, kDepth}, quant ? 0.5f : 0.0f);
+    const uint32_t bias = addConstant(biasType, {kDepth}, quant ? 0.25f : 0.0f);
+    const int32_t paddingValue = ANEURALNETWORKS_PADDING_SAME;
+    const int32_t strideValue = 1;
+    const int32_t activationValue = ANEURALNETWORKS_FUSED_NONE;
+    const uint32_t padding = addConstant(OperandType::INT32, {}, 0.0f, &paddingValue);
+    const uint32_t strideWidth = addConstant(OperandType::INT32, {}, 0.0f, &strideValue);
+    const uint32_t strideHeight = addConstant(OperandType::INT32, {}, 0.0f, &strideValue);
+    const uint32_t activation = addConstant(OperandType::INT32, {}, 0.0f, &activationValue);
+    const uint32_t output = addOperand(tensorType, {1, kSize, kSize, kDepth},
+                                       OperandLifeTime::MODEL_OUTPUT, quant ? 1.0f : 0.0f,
+                                       quant ? 128 : 0);
+    operands[output].numberOfConsumers = 0;
+    if (quant) {
+        operands[filter].zeroPoint = 128;
+    }
+
+    workload.input.resize(nonExtensionOperandSizeOfData(operands[input]));
+    workload.output.resize(nonExtensionOperandSizeOfData(operands[output]));
+
+    workload.model.operands = operands;
+    workload.model.operations = {{.type = OperationType::CONV_2D,
+                                  .inputs = {input, filter, bias, padding, strideWidth,
+                                             strideHeight, activation},
+                                  .outputs = {output}}};
+    workload.model.inputIndexes = {input};
+    workload.model.outputIndexes = {output};
+    workload.model.operandValues = values;
+    workload.request.inputs = {
+            {.location = {.poolIndex = 0, .offset = 0,
+                          .length = static_cast<uint32_t>(workload.input.size())}}};
+    workload.request.outputs = {
+            {.location = {.poolIndex = 1, .offset = 0,
+                          .length = static_cast<uint32_t>(workload.output.size())}}};
+    return workload;
+}
+
+// Receives the model prepared by IDevice::prepareModel_1_2. The sample
+// drivers prepare models synchronously, so it is available as soon as
+// prepareModel_1_2 returns.
+class PreparedModelReceiver : public IPreparedModelCallback {
+   public:
+    Return<void> notify(ErrorStatus, const sp<V1_0::IPreparedModel>&) override { return Void(); }
+    Return<void> notify_1_2(ErrorStatus status,
+                            const sp<V1_2::IPreparedModel>& preparedModel) override {
+        if (status == ErrorStatus::NONE) {
+            mPreparedModel = preparedModel;
+        }
+        return Void();
+    }
+    sp<V1_2::IPreparedModel> getPreparedModel() const { return mPreparedModel; }
+
+   private:
+    sp<V1_2::IPreparedModel> mPreparedModel;
+};
+
+// Returns the ratio of the time driver takes to run the workload to the time
+// the CPU reference takes, or std::nullopt if the driver does not support the
+// workload or either fails to run it.
+std::optional<float> measureRatio(V1_2::IDevice& driver, ConvWorkload* workload) {
+    bool supported = false;
+    const Return<void> ret = driver.getSupportedOperations_1_2(
+            workload->model, [&supported](ErrorStatus status, const hidl_vec<bool>& operations) {
+                supported = status == ErrorStatus::NONE &&
+                            std::all_of(operations.begin(), operations.end(),
+                                        [](bool operation) { return operation; });
+            });
+    if (!ret.isOk() || !supported) {
+        return std::nullopt;
+    }
+    sp<PreparedModelReceiver> receiver = new PreparedModelReceiver;
+    const Return<ErrorStatus> prepareStatus = driver.prepareModel_1_2(
+            workload->model, ExecutionPreference::FAST_SINGLE_ANSWER, {}, {}, HidlToken(),
+            receiver);
+    const sp<V1_2::IPreparedModel> preparedModel = receiver->getPreparedModel();
+    if (!prepareStatus.isOk() || prepareStatus != ErrorStatus::NONE || preparedModel == nullptr) {
+        return std::nullopt;
+    }
+
+    // The driver receives its arguments in shared memory, as it would from the
+    // runtime; the CPU reference reads and writes them in place.
+    Request driverRequest = workload->request;
+    driverRequest.pools = {allocateSharedMemory(workload->input.size()),
+                           allocateSharedMemory(workload->output.size())};
+    if (driverRequest.pools[0].size() == 0 || driverRequest.pools[1].size() == 0) {
+        return std::nullopt;
+    }
+    const std::vector<RunTimePoolInfo> requestPoolInfos = {
+            RunTimePoolInfo::createFromExistingBuffer(workload->input.data()),
+            RunTimePoolInfo::createFromExistingBuffer(workload->output.data())};
+
+    // Each returns the time of one run in seconds.
+    auto driverTime = [&preparedModel, &driverRequest]() -> std::optional<double> {
+        ErrorStatus executionStatus = ErrorStatus::GENERAL_FAILURE;
+        const auto start = std::chrono::steady_clock::now();
+        const Return<void> ret = preparedModel->executeSynchronously(
+                driverRequest, MeasureTiming::NO,
+                [&executionStatus](ErrorStatus status, const hidl_vec<OutputShape>&,
+                                   const Timing&) { executionStatus = status; });
+        const auto end = std::chrono::steady_clock::now();
+        if (!ret.isOk() || executionStatus != ErrorStatus::NONE) {
+            return std::nullopt;
+        }
+        return std::chrono::duration<double>(end - start).count();
+    };
+    auto referenceTime = [workload, &requestPoolInfos]() -> std::optional<double> {
+        CpuExecutor executor(BuiltinOperationResolver::get());
+        const auto start = std::chrono::steady_clock::now();
+        const int n = executor.run(workload->model, workload->request, {}, requestPoolInfos);
+        const auto end = std::chrono::steady_clock::now();
+        if (n != ANEURALNETWORKS_NO_ERROR) {
+            return std::nullopt;
+        }
+        return std::chrono::duration<double>(end - start).count();
+    };
+
+    if (!driverTime() || !referenceTime()) {
+        return std::nullopt;
+    }
+    double bestDriverTime = std::numeric_limits<double>::max();
+    double bestReferenceTime = std::numeric_limits<double>::max();
+    for (int i = 0; i < kRepetitions; i++) {
+        const auto driverRun = driverTime();
+        const auto referenceRun = referenceTime();
+        if (!driverRun || !referenceRun) {
+            return std::nullopt;
+        }
+        bestDriverTime = std::min(bestDriverTime, *driverRun);
+        bestReferenceTime = std::min(bestReferenceTime, *referenceRun);
+    }
+    if (bestReferenceTime <= 0.0) {
+        return std::nullopt;
+    }
+    return std::clamp(static_cast<float>(bestDriverTime / bestReferenceTime), kMinRatio,
+                      kMaxRatio);
+}
+
+// Scales a nominal performance number, which may be FLT_MAX for "unsupported".
+float scale(float nominal, float ratio) {
+    return nominal >= FLT_MAX / ratio ? FLT_MAX : nominal * ratio;
+}
+
+PerformanceInfo scale(const PerformanceInfo& nominal, float ratio) {
+    return {.execTime = scale(nominal.execTime, ratio),
+            .powerUsage = scale(nominal.powerUsage, ratio)};
+}
+
+}  // namespace
+
+Calibration Calibration::measure(V1_2::IDevice& driver) {
+    Calibration calibration;
+    // Each representative model stands for the operand types listed with it.
+    const std::pair<OperandType, std::vector<OperandType>> kRepresentatives[] = {
+            {OperandType::TENSOR_FLOAT32, {OperandType::TENSOR_FLOAT32, OperandType::FLOAT32}},
+            {OperandType::TENSOR_FLOAT16, {OperandType::TENSOR_FLOAT16, OperandType::FLOAT16}},
+            {OperandType::TENSOR_QUANT8_ASYMM, {OperandType::TENSOR_QUANT8_ASYMM}},
+    };
+    for (const auto& [tensorType, operandTypes] : kRepresentatives) {
+        ConvWorkload workload = makeConvWorkload(tensorType);
+        const std::optional<float> ratio = measureRatio(driver, &workload);
+        if (!ratio) {
+            VLOG(DRIVER) << "Not calibrating " << toString(tensorType);
+            continue;
+        }
+        VLOG(DRIVER) << "Calibrated " << toString(tensorType) << ": " << *ratio;
+        for (OperandType type : operandTypes) {
+            calibration.mOperandRatio[type] = *ratio;
+        }
+        // The CPU runs relaxed models in float32.
+        if (tensorType == OperandType::TENSOR_FLOAT32) {
+            calibration.mRelaxedRatio = *ratio;
+        }
+    }
+    return calibration;
+}
+
+std::optional<Calibration> Calibration::load(const std::string& path) {
+    std::ifstream in(path);
+    std::string line;
+    if (!in || !std::getline(in, line) || line != kFileHeader) {
+        return std::nullopt;
+    }
+    Calibration calibration;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string kind;
+        float ratio;
+        if (!(fields >> kind)) {
+            continue;
+        }
+        if (kind == "relaxed" && fields >> ratio && ratio > 0.0f) {
+            calibration.mRelaxedRatio = ratio;
+            continue;
+        }
+        int32_t value;
+        if (kind == "type" && fields >> value >> ratio && ratio > 0.0f) {
+            const OperandType type = static_cast<OperandType>(value);
+            if (validOperandType(type) && !isExtensionOperandType(type)) {
+                calibration.mOperandRatio[type] = ratio;
+                continue;
+            }
+        }
+        LOG(ERROR) << "Malformed calibration file " << path << ": " << line;
+        return std::nullopt;
+    }
+    return calibration;
+}
+
+bool Calibration::save(const std::string& path) const {
+    std::ofstream out(path);
+    out << kFileHeader << "\n";
+    for (const auto& [type, ratio] : mOperandRatio) {
+        out << "type " << static_cast<int32_t>(type) << " " << ratio << "\n";
+    }
+    if (mRelaxedRatio) {
+        out << "relaxed " << *mRelaxedRatio << "\n";
+    }
+    out.close();
+    if (!out) {
+        LOG(ERROR) << "Could not write calibration file " << path;
+        return false;
+    }
+    return true;
+}
+
+void Calibration::apply(Capabilities* capabilities) const {
+    for (const auto& [type, ratio] : mOperandRatio) {
+        update(&capabilities->operandPerformance, type,
+               scale(lookup(capabilities->operandPerformance, type), ratio));
+    }
+    if (mRelaxedRatio) {
+        capabilities->relaxedFloat32toFloat16PerformanceScalar =
+                scale(capabilities->relaxedFloat32toFloat16PerformanceScalar, *mRelaxedRatio);
+        capabilities->relaxedFloat32toFloat16PerformanceTensor =
+                scale(capabilities->relaxedFloat32toFloat16PerformanceTensor, *mRelaxedRatio);
+    }
+}
+
+std::optional<float> Calibration::getRatio(OperandType type) const {
+    const auto it = mOperandRatio.find(type);
+    if (it == mOperandRatio.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+}  // namespace sample_driver
+}  // namespace nn
+}  // namespace android
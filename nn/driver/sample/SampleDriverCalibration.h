@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_SAMPLE_DRIVER_SAMPLE_DRIVER_CALIBRATION_H
+#define ANDROID_ML_NN_SAMPLE_DRIVER_SAMPLE_DRIVER_CALIBRATION_H
+
+#include "HalInterfaces.h"
+
+#include <map>
+#include <optional>
+#include <string>
+
+namespace android {
+namespace nn {
+namespace sample_driver {
+
+// Measured performance of a sample driver.
+//
+// The sample drivers run the runtime's own CPU kernels, so their nominal
+// capabilities are made up to exercise the partitioner. A calibration keeps
+// those numbers, but scales them by what the driver's execution path costs on
+// this device. measure() prepares and executes a representative model per
+// operand type family (a CONV_2D on TENSOR_FLOAT32, TENSOR_FLOAT16 and
+// TENSOR_QUANT8_ASYMM) through the driver's IDevice interface. It times that
+// against the same model on a CpuExecutor with the builtin operation resolver,
+// which serves as a fixed CPU reference, and keeps the ratio. The sample
+// drivers run on the same cores as the runtime, so the power usage is scaled
+// by the same ratio.
+//
+// measure() calls the driver directly. When that is the driver object in the
+// same process, as with SampleDriver::calibrate(), no IPC is involved: the
+// ratio only covers the driver's own overhead over the CPU reference, and is
+// close to 1. Passing a proxy for the driver's service includes the IPC cost.
+//
+// Only the operand types of the representative models that the driver
+// supports are measured. The others keep the nominal capabilities of the
+// driver; see apply().
+class Calibration {
+   public:
+    // Times the representative models that driver supports.
+    static Calibration measure(V1_2::IDevice& driver);
+
+    // Reads a calibration written by save(). Returns std::nullopt if the file
+    // does not exist or does not hold a calibration.
+    static std::optional<Calibration> load(const std::string& path);
+
+    // Writes the calibration as text. Returns false on failure.
+    bool save(const std::string& path) const;
+
+    // Scales the entries of capabilities for the operand types this
+    // calibration measured.
+    void apply(Capabilities* capabilities) const;
+
+    // The measured ratio of the driver's time to the CPU reference's for
+    // type, or std::nullopt if type was not measured.
+    std::optional<float> getRatio(OperandType type) const;
+
+   private:
+    std::map<OperandType, float> mOperandRatio;
+    std::optional<float> mRelaxedRatio;
+};
+
+}  // namespace sample_driver
+}  // namespace nn
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_SAMPLE_DRIVER_SAMPLE_DRIVER_CALIBRATION_H
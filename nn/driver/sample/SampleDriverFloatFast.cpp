@@ -51,7 +51,7 @@ Return<void> SampleDriverFloatFast::getCapabilities_1_2(getCapabilities_1_2_cb c
     update(&capabilities.operandPerformance, OperandType::FLOAT32,
            {.execTime = 0.8f, .powerUsage = 1.2f});
 
-    cb(ErrorStatus::NONE, capabilities);
+    cb(ErrorStatus::NONE, calibrated(capabilities));
     return Void();
 }
 
@@ -51,7 +51,7 @@ Return<void> SampleDriverFloatSlow::getCapabilities_1_2(getCapabilities_1_2_cb c
     update(&capabilities.operandPerformance, OperandType::FLOAT32,
            {.execTime = 1.3f, .powerUsage = 0.7f});
 
-    cb(ErrorStatus::NONE, capabilities);
+    cb(ErrorStatus::NONE, calibrated(capabilities));
     return Void();
 }
 
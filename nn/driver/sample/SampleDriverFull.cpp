@@ -32,7 +32,7 @@ Return<void> SampleDriverFull::getCapabilities_1_2(getCapabilities_1_2_cb cb) {
     Capabilities capabilities = {.relaxedFloat32toFloat16PerformanceScalar = mPerf,
                                  .relaxedFloat32toFloat16PerformanceTensor = mPerf,
                                  .operandPerformance = nonExtensionOperandPerformance(mPerf)};
-    cb(ErrorStatus::NONE, capabilities);
+    cb(ErrorStatus::NONE, calibrated(capabilities));
     return Void();
 }
 
@@ -52,7 +52,7 @@ Return<void> SampleDriverMinimal::getCapabilities_1_2(getCapabilities_1_2_cb cb)
     update(&capabilities.operandPerformance, OperandType::FLOAT32,
            {.execTime = 0.4f, .powerUsage = 0.5f});
 
-    cb(ErrorStatus::NONE, capabilities);
+    cb(ErrorStatus::NONE, calibrated(capabilities));
     return Void();
 }
 
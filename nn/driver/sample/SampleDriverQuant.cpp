@@ -47,7 +47,7 @@ Return<void> SampleDriverQuant::getCapabilities_1_2(getCapabilities_1_2_cb cb) {
             .relaxedFloat32toFloat16PerformanceTensor = {.execTime = 50.0f, .powerUsage = 1.0f},
             .operandPerformance = nonExtensionOperandPerformance({50.0f, 1.0f})};
 
-    cb(ErrorStatus::NONE, capabilities);
+    cb(ErrorStatus::NONE, calibrated(capabilities));
     return Void();
 }
 
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SampleDriverWorkerPool"
+
+#include "SampleDriverWorkerPool.h"
+
+#include <android-base/logging.h>
+#include <algorithm>
+
+namespace android {
+namespace nn {
+namespace sample_driver {
+
+WorkerPool::WorkerPool(uint32_t threadCount) {
+    CHECK_GT(threadCount, 0u);
+    mStatistics.threadCount = threadCount;
+    mThreads.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++) {
+        mThreads.emplace_back([this] { workerLoop(); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mCondition.notify_all();
+    for (std::thread& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::enqueue(std::function<void()> task, int32_t priority,
+                         const std::shared_ptr<Group>& group) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        CHECK(!mStopping);
+        const auto position = std::find_if(mQueue.begin(), mQueue.end(), [priority](const Task& t) {
+            return t.priority < priority;
+        });
+        mQueue.insert(position, {.run = std::move(task),
+                                 .priority = priority,
+                                 .group = group,
+                                 .enqueueTime = std::chrono::steady_clock::now()});
+        mStatistics.maxQueueDepth = std::max(mStatistics.maxQueueDepth, mQueue.size());
+    }
+    mCondition.notify_one();
+}
+
+WorkerPool::Statistics WorkerPool::getStatistics() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Statistics statistics = mStatistics;
+    statistics.queueDepth = mQueue.size();
+    return statistics;
+}
+
+std::list<WorkerPool::Task>::iterator WorkerPool::findRunnable() {
+    return std::find_if(mQueue.begin(), mQueue.end(), [](const Task& task) {
+        return task.group == nullptr || task.group->mRunning < task.group->mMaxRunning;
+    });
+}
+
+void WorkerPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        auto it = mQueue.end();
+        mCondition.wait(lock, [this, &it] {
+            it = findRunnable();
+            return it != mQueue.end() || (mStopping && mQueue.empty());
+        });
+        if (it == mQueue.end()) {
+            return;
+        }
+        std::function<void()> run = std::move(it->run);
+        const std::shared_ptr<Group> group = std::move(it->group);
+        const uint64_t waitNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::steady_clock::now() - it->enqueueTime)
+                                        .count();
+        mQueue.erase(it);
+        mStatistics.totalWaitNs += waitNs;
+        mStatistics.maxWaitNs = std::max(mStatistics.maxWaitNs, waitNs);
+        if (group != nullptr) {
+            group->mRunning++;
+        }
+
+        lock.unlock();
+        run();
+        // Release what the task holds before taking the lock again.
+        run = nullptr;
+        lock.lock();
+
+        mStatistics.executedTasks++;
+        if (group != nullptr) {
+            group->mRunning--;
+            // A task of the same group may have been waiting for this one.
+            mCondition.notify_all();
+        }
+    }
+}
+
+}  // namespace sample_driver
+}  // namespace nn
+}  // namespace android
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_SAMPLE_DRIVER_SAMPLE_DRIVER_WORKER_POOL_H
+#define ANDROID_ML_NN_SAMPLE_DRIVER_SAMPLE_DRIVER_WORKER_POOL_H
+
+#include <android-base/macros.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace nn {
+namespace sample_driver {
+
+// A fixed set of threads that run the asynchronous executions of a sample
+// driver, taken from a queue in order of decreasing priority, then in the
+// order they were enqueued.
+//
+// Tasks may belong to a Group, which bounds how many of its tasks run at
+// once; a task whose group is at its bound waits in the queue, and the
+// workers run the next task that can run.
+//
+// The destructor runs the tasks still queued, then joins the workers.
+class WorkerPool {
+   public:
+    class Group {
+       public:
+        explicit Group(uint32_t maxRunning) : mMaxRunning(maxRunning) {}
+
+       private:
+        friend class WorkerPool;
+        const uint32_t mMaxRunning;
+        // Guarded by the mutex of the pool.
+        uint32_t mRunning = 0;
+    };
+
+    struct Statistics {
+        uint32_t threadCount = 0;
+        uint64_t executedTasks = 0;
+        // Number of tasks waiting in the queue, now and at most.
+        size_t queueDepth = 0;
+        size_t maxQueueDepth = 0;
+        // Time the executed tasks spent in the queue.
+        uint64_t totalWaitNs = 0;
+        uint64_t maxWaitNs = 0;
+    };
+
+    explicit WorkerPool(uint32_t threadCount);
+    ~WorkerPool();
+
+    // group may be nullptr, for a task with no bound other than the number
+    // of threads.
+    void enqueue(std::function<void()> task, int32_t priority,
+                 const std::shared_ptr<Group>& group);
+
+    Statistics getStatistics() const;
+
+   private:
+    struct Task {
+        std::function<void()> run;
+        int32_t priority;
+        std::shared_ptr<Group> group;
+        std::chrono::steady_clock::time_point enqueueTime;
+    };
+
+    void workerLoop();
+    // Returns the first task of mQueue that can run now, or mQueue.end().
+    std::list<Task>::iterator findRunnable();
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+    // Sorted by decreasing priority, then by enqueue order.
+    std::list<Task> mQueue;
+    bool mStopping = false;
+    Statistics mStatistics;
+    std::vector<std::thread> mThreads;
+
+    DISALLOW_COPY_AND_ASSIGN(WorkerPool);
+};
+
+}  // namespace sample_driver
+}  // namespace nn
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_SAMPLE_DRIVER_SAMPLE_DRIVER_WORKER_POOL_H
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ArgumentTransform"
+
+#include "ArgumentTransform.h"
+
+#include "Utils.h"
+
+#include <algorithm>
+
+namespace android {
+namespace nn {
+
+namespace {
+
+bool isSupportedType(OperandType type) {
+    return type == OperandType::TENSOR_FLOAT32 || type == OperandType::TENSOR_QUANT8_ASYMM;
+}
+
+// The operand as batches of channels of spatial elements each.
+struct Geometry {
+    uint32_t batches;
+    uint32_t channels;
+    uint32_t spatial;
+    uint32_t bufferChannels;
+    bool nchw;
+};
+
+Geometry getGeometry(const ArgumentTransform& transform, const std::vector<uint32_t>& dimensions) {
+    Geometry geometry = {.batches = 1, .spatial = 1, .nchw = transform.nchw};
+    if (transform.nchw) {
+        geometry.batches = dimensions[0];
+        geometry.channels = dimensions[1];
+        geometry.spatial = dimensions[2] * dimensions[3];
+    } else {
+        geometry.channels = dimensions.back();
+        for (size_t i = 0; i + 1 < dimensions.size(); i++) {
+            geometry.spatial *= dimensions[i];
+        }
+    }
+    geometry.bufferChannels =
+            transform.bufferChannels != 0 ? transform.bufferChannels : geometry.channels;
+    return geometry;
+}
+
+// Per operand channel, the buffer channel, and the multiply-add that converts
+// a value on the way, normalization and quantization included.
+struct Coefficients {
+    std::vector<uint32_t> channelMap;
+    std::vector<float> mul;
+    std::vector<float> add;
+};
+
+float channelValue(const std::vector<float>& values, uint32_t channel, float defaultValue) {
+    if (values.empty()) {
+        return defaultValue;
+    }
+    return values[values.size() == 1 ? 0 : channel];
+}
+
+Coefficients getCoefficients(const ArgumentTransform& transform, const Operand& operand,
+                             const Geometry& geometry, bool toOperand) {
+    const bool quantized = operand.type == OperandType::TENSOR_QUANT8_ASYMM;
+    const float scale = quantized ? operand.scale : 1.0f;
+    const float zeroPoint = quantized ? operand.zeroPoint : 0.0f;
+    Coefficients coefficients;
+    coefficients.channelMap.resize(geometry.channels);
+    coefficients.mul.resize(geometry.channels);
+    coefficients.add.resize(geometry.channels);
+    for (uint32_t c = 0; c < geometry.channels; c++) {
+        coefficients.channelMap[c] = transform.channelMap.empty() ? c : transform.channelMap[c];
+        const float mean = channelValue(transform.mean, c, 0.0f);
+        const float stddev = channelValue(transform.stddev, c, 1.0f);
+        if (toOperand) {
+            // (value - mean) / stddev / scale + zeroPoint
+            coefficients.mul[c] = 1.0f / (stddev * scale);
+            coefficients.add[c] = zeroPoint - mean / (stddev * scale);
+        } else {
+            // (value - zeroPoint) * scale * stddev + mean
+            coefficients.mul[c] = scale * stddev;
+            coefficients.add[c] = mean - zeroPoint * scale * stddev;
+        }
+    }
+    return coefficients;
+}
+
+template <typename T>
+T convertTo(float value);
+
+template <>
+float convertTo<float>(float value) {
+    return value;
+}
+
+// Saturates, and converts NaN to 0: converting a float outside the range of
+// uint8_t is undefined.
+template <>
+uint8_t convertTo<uint8_t>(float value) {
+    if (!(value > 0.0f)) {
+        return 0;
+    }
+    if (value >= 255.0f) {
+        return 255;
+    }
+    return static_cast<uint8_t>(value + 0.5f);
+}
+
+// Each channel is converted by a loop with constant strides and one
+// multiply-add per element.
+template <typename From, typename To>
+void convert(const Geometry& geometry, const Coefficients& coefficients, bool toOperand,
+             const void* fromData, void* toData) {
+    const From* from = static_cast<const From*>(fromData);
+    To* to = static_cast<To*>(toData);
+    const uint32_t operandStride = geometry.nchw ? 1 : geometry.channels;
+    const uint32_t fromStride = toOperand ? geometry.bufferChannels : operandStride;
+    const uint32_t toStride = toOperand ? operandStride : geometry.bufferChannels;
+    for (uint32_t b = 0; b < geometry.batches; b++) {
+        for (uint32_t c = 0; c < geometry.channels; c++) {
+            const size_t bufferOffset = size_t{b} * geometry.spatial * geometry.bufferChannels +
+                                        coefficients.channelMap[c];
+            const size_t operandOffset = size_t{b} * geometry.spatial * geometry.channels +
+                                         (geometry.nchw ? size_t{c} * geometry.spatial : c);
+            const From* src = from + (toOperand ? bufferOffset : operandOffset);
+            To* dst = to + (toOperand ? operandOffset : bufferOffset);
+            const float mul = coefficients.mul[c];
+            const float add = coefficients.add[c];
+            for (uint32_t s = 0; s < geometry.spatial; s++) {
+                const float value = static_cast<float>(src[s * fromStride]);
+                dst[s * toStride] = convertTo<To>(value * mul + add);
+            }
+        }
+    }
+}
+
+void transform(const ArgumentTransform& transform, const Operand& operand,
+               const std::vector<uint32_t>& dimensions, bool toOperand, const void* from,
+               void* to) {
+    const Geometry geometry = getGeometry(transform, dimensions);
+    const Coefficients coefficients = getCoefficients(transform, operand, geometry, toOperand);
+    const bool floatBuffer = transform.bufferType == OperandType::TENSOR_FLOAT32;
+    const bool floatOperand = operand.type == OperandType::TENSOR_FLOAT32;
+    if (floatBuffer && floatOperand) {
+        convert<float, float>(geometry, coefficients, toOperand, from, to);
+    } else if (floatBuffer == toOperand && floatOperand != toOperand) {
+        // Either float buffer to uint8 operand, or float operand to uint8 buffer.
+        convert<float, uint8_t>(geometry, coefficients, toOperand, from, to);
+    } else if (floatBuffer != toOperand && floatOperand == toOperand) {
+        convert<uint8_t, float>(geometry, coefficients, toOperand, from, to);
+    } else {
+        convert<uint8_t, uint8_t>(geometry, coefficients, toOperand, from, to);
+    }
+}
+
+}  // namespace
+
+bool validateArgumentTransform(const ArgumentTransform& transform, const Operand& operand,
+                               const std::vector<uint32_t>& dimensions, uint32_t* bufferLength) {
+    NN_RET_CHECK(isSupportedType(operand.type))
+            << "Can't transform an operand of type " << toString(operand.type);
+    NN_RET_CHECK(isSupportedType(transform.bufferType))
+            << "Can't transform a buffer of type " << toString(transform.bufferType);
+    NN_RET_CHECK(!dimensions.empty()) << "Can't transform an operand of unknown rank";
+    NN_RET_CHECK(std::find(dimensions.begin(), dimensions.end(), 0) == dimensions.end())
+            << "Can't transform an operand of unspecified dimensions";
+    NN_RET_CHECK(!transform.nchw || dimensions.size() == 4)
+            << "NCHW transform of an operand of rank " << dimensions.size();
+
+    const Geometry geometry = getGeometry(transform, dimensions);
+    if (transform.channelMap.empty()) {
+        NN_RET_CHECK_GE(geometry.bufferChannels, geometry.channels);
+    } else {
+        NN_RET_CHECK_EQ(transform.channelMap.size(), geometry.channels);
+        for (uint32_t channel : transform.channelMap) {
+            NN_RET_CHECK_LT(channel, geometry.bufferChannels);
+        }
+    }
+    for (const std::vector<float>* values : {&transform.mean, &transform.stddev}) {
+        NN_RET_CHECK(values->size() <= 1 || values->size() == geometry.channels)
+                << "Expected 1 or " << geometry.channels << " normalization values, got "
+                << values->size();
+    }
+    for (float stddev : transform.stddev) {
+        NN_RET_CHECK(stddev != 0.0f) << "Normalization with a standard deviation of 0";
+    }
+
+    const uint64_t length = uint64_t{geometry.batches} * geometry.spatial *
+                            geometry.bufferChannels *
+                            (transform.bufferType == OperandType::TENSOR_FLOAT32 ? sizeof(float)
+                                                                                 : sizeof(uint8_t));
+    NN_RET_CHECK_LE(length, uint64_t{0xFFFFFFFF}) << "Transformed buffer exceeds 2^32 bytes";
+    *bufferLength = static_cast<uint32_t>(length);
+    return true;
+}
+
+void transformInput(const ArgumentTransform& argumentTransform, const Operand& operand,
+                    const std::vector<uint32_t>& dimensions, const void* buffer, uint8_t* data) {
+    transform(argumentTransform, operand, dimensions, /*toOperand=*/true, buffer, data);
+}
+
+void transformOutput(const ArgumentTransform& argumentTransform, const Operand& operand,
+                     const std::vector<uint32_t>& dimensions, const uint8_t* data, void* buffer) {
+    transform(argumentTransform, operand, dimensions, /*toOperand=*/false, data, buffer);
+}
+
+}  // namespace nn
+}  // namespace android
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_RUNTIME_ARGUMENT_TRANSFORM_H
+#define ANDROID_ML_NN_RUNTIME_ARGUMENT_TRANSFORM_H
+
+#include "HalInterfaces.h"
+
+#include <vector>
+
+namespace android {
+namespace nn {
+
+// Describes how the application's buffer for an input or output of a model
+// differs from the operand, so that the runtime converts between the two while
+// it copies the argument, instead of the application making a pass of its own
+// over the data before or after each execution. For example, an input can be
+// an RGBA uint8 camera frame while the operand is a normalized float32 NCHW
+// RGB tensor.
+//
+// The channels of the operand are its last dimension, or its second one with
+// nchw. The buffer holds the same elements with bufferChannels channels, the
+// channels always last. From buffer to operand, each element of channel c:
+// 1. is read from channel channelMap[c] of the buffer;
+// 2. is normalized to (value - mean[c]) / stddev[c];
+// 3. is quantized with the scale and zero point of the operand, if the
+//    operand is a TENSOR_QUANT8_ASYMM;
+// 4. is stored in the order of the operand.
+// Outputs go the other way, and leave the buffer channels that channelMap
+// doesn't mention as they are.
+//
+// There is no NDK API for transforms: they are set through
+// ExecutionBuilder::setInputTransform and setOutputTransform, which only the
+// runtime's own tests call.
+struct ArgumentTransform {
+    // The type of the buffer elements: TENSOR_FLOAT32, or TENSOR_QUANT8_ASYMM
+    // for plain uint8 values, such as pixels, that have no scale or zero point.
+    OperandType bufferType = OperandType::TENSOR_FLOAT32;
+
+    // The number of channels of the buffer; 0 means as many as the operand.
+    uint32_t bufferChannels = 0;
+
+    // The buffer channel of each operand channel; empty means the same one.
+    std::vector<uint32_t> channelMap;
+
+    // Either empty, for no normalization, or one value for all the channels,
+    // or one value per operand channel.
+    std::vector<float> mean;
+    std::vector<float> stddev;
+
+    // Whether the operand, of rank 4, is in NCHW order while the buffer is in
+    // NHWC order.
+    bool nchw = false;
+};
+
+// Checks that transform applies to an operand of the given type and fully
+// specified dimensions, and sets *bufferLength to the length of the buffer.
+bool validateArgumentTransform(const ArgumentTransform& transform, const Operand& operand,
+                               const std::vector<uint32_t>& dimensions, uint32_t* bufferLength);
+
+// Converts the buffer of a validated input transform to the operand data, and
+// the operand data of a validated output transform to the buffer.
+void transformInput(const ArgumentTransform& transform, const Operand& operand,
+                    const std::vector<uint32_t>& dimensions, const void* buffer, uint8_t* data);
+void transformOutput(const ArgumentTransform& transform, const Operand& operand,
+                     const std::vector<uint32_t>& dimensions, const uint8_t* data, void* buffer);
+
+}  // namespace nn
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_RUNTIME_ARGUMENT_TRANSFORM_H
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CachePrefetcher"
+
+#include "CachePrefetcher.h"
+
+#include "Manager.h"
+#include "Tracing.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+
+namespace android {
+namespace nn {
+
+namespace {
+
+using HidlToken = hidl_array<uint8_t, ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN>;
+
+// Requests are served in order by a single background thread, which only runs while there is
+// work queued. A prepared model is handed out once, to the first compilation looking for the same
+// device and cache entry; past kMaxPreparedModels, the oldest unclaimed models are released.
+//
+// The prefetcher is created on first use and never destroyed, and its worker is detached: a
+// process exiting while a request is served doesn't wait for it, and the worker never outlives
+// the queue it serves. Each request keeps its devices alive while the worker serves it.
+class CachePrefetcher {
+   public:
+    static CachePrefetcher* get() {
+        static CachePrefetcher* prefetcher = new CachePrefetcher;
+        return prefetcher;
+    }
+
+    void enqueue(std::vector<std::shared_ptr<Device>> devices, int32_t preference,
+                 const std::string& cacheDir, const uint8_t* token);
+    void waitFor(const std::string& cacheDir, const uint8_t* token,
+                 const uint8_t* modelFingerprint);
+    bool take(const std::shared_ptr<Device>& device, const std::string& cacheDir,
+              const uint8_t* deviceToken, std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+              std::shared_ptr<CpuPreparedModel>* cpuPreparedModel);
+
+   private:
+    static constexpr size_t kMaxPreparedModels = 16;
+
+    struct Request {
+        std::vector<std::shared_ptr<Device>> devices;
+        int32_t preference;
+        std::string cacheDir;
+        HidlToken token;
+    };
+    struct Entry {
+        // The cache directory and token of the request that prefetched the model.
+        std::string cacheDir;
+        HidlToken token;
+        PrefetchedModel model;
+    };
+
+    CachePrefetcher() = default;
+    void run();
+
+    std::mutex mMutex;
+    std::condition_variable mRequestDone;
+    // Requests not yet completed, including the one being served at the front.
+    std::deque<Request> mRequests;
+    bool mIsWorkerRunning = false;
+    std::list<Entry> mEntries;
+};
+
+void CachePrefetcher::enqueue(std::vector<std::shared_ptr<Device>> devices, int32_t preference,
+                              const std::string& cacheDir, const uint8_t* token) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRequests.push_back({std::move(devices), preference, cacheDir, HidlToken(token)});
+    if (!mIsWorkerRunning) {
+        mIsWorkerRunning = true;
+        std::thread([this] { run(); }).detach();
+    }
+}
+
+void CachePrefetcher::waitFor(const std::string& cacheDir, const uint8_t* token,
+                              const uint8_t* modelFingerprint) {
+    const HidlToken cacheToken(token);
+    std::unique_lock<std::mutex> lock(mMutex);
+    mRequestDone.wait(lock, [this, &cacheDir, &cacheToken] {
+        return std::none_of(mRequests.begin(), mRequests.end(),
+                            [&cacheDir, &cacheToken](const Request& request) {
+                                return request.cacheDir == cacheDir && request.token == cacheToken;
+                            });
+    });
+    // The prefetcher had no model to check a recorded partitioning against, so it may have
+    // prepared the steps of a partitioning of another model.
+    mEntries.remove_if([&cacheDir, &cacheToken, modelFingerprint](const Entry& entry) {
+        const std::vector<uint8_t>& fingerprint = entry.model.modelFingerprint;
+        const bool stale = entry.cacheDir == cacheDir && entry.token == cacheToken &&
+                           !fingerprint.empty() &&
+                           (modelFingerprint == nullptr ||
+                            memcmp(fingerprint.data(), modelFingerprint, fingerprint.size()) != 0);
+        if (stale) {
+            VLOG(COMPILATION) << "Releasing model prefetched on " << entry.model.deviceName
+                              << " for another model";
+        }
+        return stale;
+    });
+}
+
+bool CachePrefetcher::take(const std::shared_ptr<Device>& device, const std::string& cacheDir,
+                           const uint8_t* deviceToken,
+                           std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                           std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) {
+    const HidlToken cacheToken(deviceToken);
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto it = mEntries.begin(); it != mEntries.end(); ++it) {
+        PrefetchedModel& model = it->model;
+        if (it->cacheDir == cacheDir && model.deviceToken == cacheToken &&
+            model.device.lock() == device && model.deviceName == device->getName() &&
+            model.deviceVersion == device->getVersionString()) {
+            VLOG(COMPILATION) << "Using model prefetched on " << model.deviceName;
+            *preparedModel = std::move(model.preparedModel);
+            *cpuPreparedModel = std::move(model.cpuPreparedModel);
+            mEntries.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+void CachePrefetcher::run() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mRequests.empty()) {
+        const Request request = mRequests.front();
+        lock.unlock();
+        std::vector<PrefetchedModel> models = prepareModelsFromCache(
+                request.devices, request.preference, request.cacheDir, request.token.data());
+        lock.lock();
+        for (auto& model : models) {
+            mEntries.push_back({request.cacheDir, request.token, std::move(model)});
+            if (mEntries.size() > kMaxPreparedModels) {
+                mEntries.pop_front();
+            }
+        }
+        mRequests.pop_front();
+        mRequestDone.notify_all();
+    }
+    mIsWorkerRunning = false;
+}
+
+}  // namespace
+
+void prefetchCompilationCache(std::vector<std::shared_ptr<Device>> devices, int32_t preference,
+                              const std::string& cacheDir, const uint8_t* token) {
+    CachePrefetcher::get()->enqueue(std::move(devices), preference, cacheDir, token);
+}
+
+void waitForCompilationCachePrefetch(const std::string& cacheDir, const uint8_t* token,
+                                     const uint8_t* modelFingerprint) {
+    NNTRACE_RT(NNTRACE_PHASE_COMPILATION, "waitForCompilationCachePrefetch");
+    CachePrefetcher::get()->waitFor(cacheDir, token, modelFingerprint);
+}
+
+bool takePrefetchedModel(const std::shared_ptr<Device>& device, const std::string& cacheDir,
+                         const uint8_t* deviceToken,
+                         std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                         std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) {
+    return CachePrefetcher::get()->take(device, cacheDir, deviceToken, preparedModel,
+                                        cpuPreparedModel);
+}
+
+}  // namespace nn
+}  // namespace android
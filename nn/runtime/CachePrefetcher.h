@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Preparation of models from the compilation cache ahead of
+// ANeuralNetworksCompilation_finish, see ANeuralNetworks_prefetchCompilationCache.
+
+#ifndef ANDROID_ML_NN_RUNTIME_CACHE_PREFETCHER_H
+#define ANDROID_ML_NN_RUNTIME_CACHE_PREFETCHER_H
+
+#include "HalInterfaces.h"
+#include "NeuralNetworks.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace nn {
+
+class CpuPreparedModel;
+class Device;
+class VersionedIPreparedModel;
+
+// A model prepared from the compilation cache for a compilation that has not
+// asked for it yet.
+struct PrefetchedModel {
+    // The device is not kept alive by an unclaimed model. Its name and version
+    // guard against a device list reinitialized with different drivers.
+    std::weak_ptr<Device> device;
+    std::string deviceName;
+    std::string deviceVersion;
+    // The device cache token of the entry the model was prepared from.
+    hidl_array<uint8_t, ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN> deviceToken;
+    // The fingerprint of the model recorded with the partitioning the entry was
+    // derived from, or empty if no partitioning was recorded.
+    std::vector<uint8_t> modelFingerprint;
+    std::shared_ptr<VersionedIPreparedModel> preparedModel;
+    std::shared_ptr<CpuPreparedModel> cpuPreparedModel;
+};
+
+// Prepares the models that a compilation for devices with the given execution
+// preference, cache directory and token would restore from the compilation
+// cache. Defined in ExecutionPlan.cpp, which derives the device cache tokens of
+// a compilation.
+std::vector<PrefetchedModel> prepareModelsFromCache(
+        const std::vector<std::shared_ptr<Device>>& devices, int32_t preference,
+        const std::string& cacheDir, const uint8_t* token);
+
+// Starts preparing, on a background thread, the models that
+// prepareModelsFromCache would return. cacheDir must end with '/'. A later
+// compilation with the same caching information picks up the prepared models
+// instead of calling prepareModelFromCache itself.
+void prefetchCompilationCache(std::vector<std::shared_ptr<Device>> devices, int32_t preference,
+                              const std::string& cacheDir, const uint8_t* token);
+
+// Waits until all prefetchCompilationCache requests for cacheDir and token have
+// completed, then releases the models they prepared from a partitioning
+// recorded for a model other than the one with modelFingerprint (which may be
+// nullptr if the model has none).
+void waitForCompilationCachePrefetch(const std::string& cacheDir, const uint8_t* token,
+                                     const uint8_t* modelFingerprint);
+
+// Hands out the model prefetched on device from the cache entry of deviceToken
+// in cacheDir. Each prefetched model is handed out at most once. Returns false
+// if there is none.
+bool takePrefetchedModel(const std::shared_ptr<Device>& device, const std::string& cacheDir,
+                         const uint8_t* deviceToken,
+                         std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                         std::shared_ptr<CpuPreparedModel>* cpuPreparedModel);
+
+}  // namespace nn
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_RUNTIME_CACHE_PREFETCHER_H
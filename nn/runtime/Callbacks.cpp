@@ -16,6 +16,9 @@
 
 #include "Callbacks.h"
 
+#include "Tracing.h"
+#include "Utils.h"
+
 #include <android-base/logging.h>
 
 #include <limits>
@@ -122,6 +125,11 @@ ErrorStatus ExecutionCallback::getStatus() const {
     return mErrorStatus;
 }
 
+int ExecutionCallback::getResultCode() const {
+    wait();
+    return mResultCode;
+}
+
 const std::vector<OutputShape>& ExecutionCallback::getOutputShapes() const {
     wait();
     return mOutputShapes;
@@ -180,6 +188,7 @@ void ExecutionCallback::setOnFinish(const ExecutionFinish& finish) {
 void ExecutionCallback::notifyInternal(ErrorStatus errorStatus,
                                        const hidl_vec<OutputShape>& outputShapes,
                                        const Timing& timing) {
+    NNTRACE_RT(NNTRACE_PHASE_RESULTS, "ExecutionCallback::notify");
     {
         std::lock_guard<std::mutex> hold(mMutex);
 
@@ -189,15 +198,17 @@ void ExecutionCallback::notifyInternal(ErrorStatus errorStatus,
         }
 
         mErrorStatus = errorStatus;
+        mResultCode = android::nn::convertErrorStatusToResultCode(errorStatus);
         mOutputShapes = outputShapes;
         mTiming = timing;
         mNotified = true;
 
         if (mOnFinish != nullptr) {
-            ErrorStatus status = mOnFinish(mErrorStatus, mOutputShapes);
+            const int resultCode = mOnFinish(mErrorStatus, mOutputShapes);
             mOnFinish = nullptr;
-            if (status != ErrorStatus::NONE) {
-                mErrorStatus = status;
+            if (resultCode != ANEURALNETWORKS_NO_ERROR) {
+                mErrorStatus = android::nn::convertResultCodeToErrorStatus(resultCode);
+                mResultCode = resultCode;
             }
         }
     }
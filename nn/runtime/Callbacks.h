@@ -17,6 +17,8 @@
 #ifndef ANDROID_ML_NN_RUNTIME_CALLBACKS_H
 #define ANDROID_ML_NN_RUNTIME_CALLBACKS_H
 
+#include "NeuralNetworks.h"
+
 #include <android-base/thread_annotations.h>
 #include <android/hardware/neuralnetworks/1.0/IExecutionCallback.h>
 #include <android/hardware/neuralnetworks/1.0/IPreparedModelCallback.h>
@@ -174,8 +176,7 @@ class PreparedModelCallback : public IPreparedModelCallback {
  * This callback object is passed as an argument to IPreparedModel::execute*.
  */
 class ExecutionCallback : public IExecutionCallback {
-    using ExecutionFinish =
-            std::function<ErrorStatus(ErrorStatus, const std::vector<OutputShape>&)>;
+    using ExecutionFinish = std::function<int(ErrorStatus, const std::vector<OutputShape>&)>;
 
    public:
     /**
@@ -272,6 +273,17 @@ class ExecutionCallback : public IExecutionCallback {
      */
     ErrorStatus getStatus() const;
 
+    /**
+     * Retrieves the ANEURALNETWORKS_* result code of the asynchronous task,
+     * blocking like ExecutionCallback::getStatus. This is the status converted
+     * to a result code, unless the callback bound by
+     * ExecutionCallback::setOnFinish returned a more specific failure, such as
+     * ANEURALNETWORKS_OUT_OF_MEMORY, which has no ErrorStatus equivalent.
+     *
+     * @return resultCode The result code of the asynchronous execution.
+     */
+    int getResultCode() const;
+
     /**
      * Retrieves the output shapes returned from the asynchronous task launched
      * by IPreparedModel::execute_1_2. If IPreparedModel::execute_1_2 has not
@@ -336,7 +348,9 @@ class ExecutionCallback : public IExecutionCallback {
      * object that will be executed during one of the ExecutionCallback::notify*
      * calls but before any calls to wait or get* return. This provided callback
      * is provided with both the ErrorStatus and the output shapes from
-     * ExecutionCallback::notify*.
+     * ExecutionCallback::notify*. It returns an ANEURALNETWORKS_* result code;
+     * any code other than ANEURALNETWORKS_NO_ERROR replaces the results of the
+     * execution.
      *
      * The bound function must not synchronize with or otherwise access the
      * callback object it is bound to, as this could cause a deadlock.
@@ -370,6 +384,7 @@ class ExecutionCallback : public IExecutionCallback {
     ExecutionFinish mOnFinish GUARDED_BY(mMutex);
     bool mNotified GUARDED_BY(mMutex) = false;
     ErrorStatus mErrorStatus = ErrorStatus::GENERAL_FAILURE;
+    int mResultCode = ANEURALNETWORKS_OP_FAILED;
     std::vector<OutputShape> mOutputShapes = {};
     Timing mTiming = {};
 };
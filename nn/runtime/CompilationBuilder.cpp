@@ -19,11 +19,16 @@
 #include "CompilationBuilder.h"
 
 #include "BurstBuilder.h"
+#include "CachePrefetcher.h"
 #include "ExecutionBuilder.h"
 #include "ExecutionBurstController.h"
 #include "ExecutionPlan.h"
+#include "GraphDump.h"
 #include "Manager.h"
+#include "Memory.h"
 #include "ModelBuilder.h"
+#include "StateBuilder.h"
+#include "TypeManager.h"
 #include "Utils.h"
 
 namespace android {
@@ -38,6 +43,7 @@ CompilationBuilder::CompilationBuilder(const ModelBuilder* model,
       mDevices(devices),
       mExplicitDeviceList(explicitDeviceList) {
     VLOG(COMPILATION) << "CompilationBuilder::CompilationBuilder";
+    mPlan.setStatistics(&mStatistics);
 }
 
 int CompilationBuilder::finish() {
@@ -50,6 +56,8 @@ int CompilationBuilder::finish() {
     mFinished = true;
     if (mIsCacheInfoProvided) {
         mPlan.setCaching(&mCacheDir, mToken);
+        // Pick up any models being prepared ahead of time for this cache entry.
+        waitForCompilationCachePrefetch(mCacheDir, mToken, mModel->getFingerprint());
     }
     if (mPartitioning) {
         int n = mModel->partitionTheWork(mDevices, mPreference, &mPlan);
@@ -73,8 +81,9 @@ int CompilationBuilder::finish() {
                     LOG(ERROR) << "Cannot fall back to CPU because of an OEM operation";
                     return n;
                 }
-                if (mModel->hasExtensionOperation()) {
-                    LOG(ERROR) << "Cannot fall back to CPU because of an extension operation";
+                if (mModel->hasExtensionOperation() && !mModel->extensionOperationsRunOnCpu()) {
+                    LOG(ERROR) << "Cannot fall back to CPU because of an extension operation "
+                                  "with no CPU implementation";
                     return n;
                 }
                 break;
@@ -130,6 +139,43 @@ int CompilationBuilder::setPartitioning(uint32_t partitioning) {
     return ANEURALNETWORKS_NO_ERROR;
 }
 
+int CompilationBuilder::setMemoryBudget(uint64_t bytes) {
+    if (mFinished) {
+        LOG(ERROR) << "setMemoryBudget can't modify after compilation finished";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    mMemoryBudget = bytes;
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
+int CompilationBuilder::getMemoryEstimate(MemoryUsage* estimate) const {
+    if (!mFinished || !mPlan.isValid()) {
+        LOG(ERROR) << "getMemoryEstimate passed an unfinished or invalid compilation";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    std::call_once(mMemoryEstimateOnce,
+                   [this] { mMemoryEstimate = mPlan.estimateMemoryUsage(mModel); });
+    *estimate = mMemoryEstimate;
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
+int CompilationBuilder::dumpAnnotatedGraph(const std::vector<CpuOperationProfile>& profile,
+                                           bool json, std::ostream* outStream) const {
+    if (!mFinished || !mPlan.isValid()) {
+        LOG(ERROR) << "dumpAnnotatedGraph passed an unfinished or invalid compilation";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    Model model;
+    mModel->setHidlModel(&model);
+    const GraphDumpAnnotations annotations = mPlan.getGraphDumpAnnotations(mModel, profile);
+    if (json) {
+        graphDumpJson("CompilationBuilder", model, annotations, outStream);
+    } else {
+        graphDump("CompilationBuilder", model, annotations, outStream);
+    }
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
 int CompilationBuilder::createExecution(ExecutionBuilder **execution) {
     if (!mFinished) {
         LOG(ERROR) << "ANeuralNetworksExecution_create passed an unfinished compilation";
@@ -161,5 +207,76 @@ int CompilationBuilder::createBurst(BurstBuilder** burst) {
     return (*burst ? ANEURALNETWORKS_NO_ERROR : ANEURALNETWORKS_OUT_OF_MEMORY);
 }
 
+int CompilationBuilder::createState(StateBuilder** state) {
+    if (!mFinished) {
+        LOG(ERROR) << "ANeuralNetworksState_create passed an unfinished compilation";
+        *state = nullptr;
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    if (!mPlan.isValid()) {
+        LOG(ERROR) << "ANeuralNetworksState_create passed an invalid compilation";
+        *state = nullptr;
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    *state = new (std::nothrow) StateBuilder(this, mModel);
+    return (*state ? ANEURALNETWORKS_NO_ERROR : ANEURALNETWORKS_OUT_OF_MEMORY);
+}
+
+// Allocates the memory for the model input or output at operandIndex.
+static int createArgumentMemory(const char* tag, const ExecutionPlan& plan,
+                                const ModelBuilder* model, uint32_t operandIndex,
+                                Memory** memory) {
+    const uint32_t size = TypeManager::get()->getSizeOfData(model->getOperand(operandIndex));
+    if (size == 0) {
+        LOG(ERROR) << tag << " passed an operand of unspecified dimensions";
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    std::shared_ptr<Device> device = plan.getArgumentDevice(operandIndex);
+    if (device == nullptr) {
+        device = DeviceManager::getCpuDevice();
+    }
+    std::unique_ptr<Memory> m;
+    const int n = device->allocateMemory(size, &m);
+    if (n != ANEURALNETWORKS_NO_ERROR) {
+        return n;
+    }
+    VLOG(COMPILATION) << tag << ": " << size << " bytes for " << device->getName() << ", "
+                      << m->getHidlMemory().name();
+    *memory = m.release();
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
+int CompilationBuilder::createMemoryForInput(uint32_t index, Memory** memory) const {
+    *memory = nullptr;
+    if (!mFinished || !mPlan.isValid()) {
+        LOG(ERROR) << "ANeuralNetworksMemory_createForCompilationInput passed an unfinished or "
+                      "invalid compilation";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    if (index >= mModel->inputCount()) {
+        LOG(ERROR) << "ANeuralNetworksMemory_createForCompilationInput bad index " << index << " "
+                   << mModel->inputCount();
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    return createArgumentMemory("ANeuralNetworksMemory_createForCompilationInput", mPlan, mModel,
+                                mModel->getInputOperandIndex(index), memory);
+}
+
+int CompilationBuilder::createMemoryForOutput(uint32_t index, Memory** memory) const {
+    *memory = nullptr;
+    if (!mFinished || !mPlan.isValid()) {
+        LOG(ERROR) << "ANeuralNetworksMemory_createForCompilationOutput passed an unfinished or "
+                      "invalid compilation";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    if (index >= mModel->outputCount()) {
+        LOG(ERROR) << "ANeuralNetworksMemory_createForCompilationOutput bad index " << index << " "
+                   << mModel->outputCount();
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    return createArgumentMemory("ANeuralNetworksMemory_createForCompilationOutput", mPlan, mModel,
+                                mModel->getOutputOperandIndex(index), memory);
+}
+
 }  // namespace nn
 }  // namespace android
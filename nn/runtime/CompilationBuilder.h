@@ -17,10 +17,14 @@
 #ifndef ANDROID_ML_NN_RUNTIME_COMPILATION_BUILDER_H
 #define ANDROID_ML_NN_RUNTIME_COMPILATION_BUILDER_H
 
+#include "CompilationStatistics.h"
 #include "ExecutionPlan.h"
+#include "MemoryAccounting.h"
 #include "NeuralNetworks.h"
 
+#include <iostream>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 namespace android {
@@ -29,7 +33,9 @@ namespace nn {
 class BurstBuilder;
 class Device;
 class ExecutionBuilder;
+class Memory;
 class ModelBuilder;
+class StateBuilder;
 
 class CompilationBuilder {
 public:
@@ -48,6 +54,32 @@ public:
 
     int setCaching(const std::string& cacheDir, const uint8_t* token);
 
+    // Limits the memory each execution of this compilation may allocate in
+    // the runtime and in the CpuExecutor, see ExecutionBuilder::getMemoryUsage.
+    // An execution whose estimate already exceeds the budget fails before it
+    // starts, and one that goes over budget while running fails with
+    // ANEURALNETWORKS_OUT_OF_MEMORY. 0, the default, means no limit.
+    int setMemoryBudget(uint64_t bytes);
+
+    // Estimates, per MemoryCategory, the peak memory an execution of this
+    // compilation allocates in the runtime and in the CpuExecutor. Temporaries
+    // of unknown size are not counted, and pointer arguments are assumed to
+    // cover all the model inputs and outputs. Only available once the
+    // compilation has finished.
+    int getMemoryEstimate(MemoryUsage* estimate) const;
+
+    // Latencies, fallbacks, copies and cache lookups of this compilation and
+    // of all its executions so far. Use getSnapshot() to query them, or
+    // dump() to log a summary.
+    const CompilationStatistics& getStatistics() const { return mStatistics; }
+
+    // Writes the model in Graphviz (.dot) format, or in JSON, annotated with
+    // the devices and steps this compilation assigned its operations to, and
+    // with the operation times in profile (see ExecutionBuilder::getCpuProfile()),
+    // which may be empty. See graphDump() and graphDumpJson().
+    int dumpAnnotatedGraph(const std::vector<CpuOperationProfile>& profile, bool json,
+                           std::ostream* outStream = nullptr) const;
+
     /// M: Partition Extension @{
     virtual int finish();
     /// @}
@@ -58,6 +90,18 @@ public:
 
     int createBurst(BurstBuilder** burst);
 
+    // Creates an unfinished state for the sequences of executions of this
+    // compilation, see StateBuilder.
+    int createState(StateBuilder** state);
+
+    // Allocates memory for the input (or output) at index of the model, to be
+    // passed to ExecutionBuilder::setInputFromMemory (or setOutputFromMemory)
+    // of this or another compilation. The memory is allocated by the device
+    // the input (or output) is used on, see Device::allocateMemory, or as
+    // shared memory if it is used on several devices.
+    int createMemoryForInput(uint32_t index, Memory** memory) const;
+    int createMemoryForOutput(uint32_t index, Memory** memory) const;
+
     const ExecutionPlan& forTest_getExecutionPlan() const { return mPlan; }
 
     /// M: NeuroPilot add on @{
@@ -97,6 +141,15 @@ protected:
     std::string mCacheDir;
     uint8_t mToken[ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN];
     bool mIsCacheInfoProvided = false;
+
+    uint64_t mMemoryBudget = 0;
+
+    // Computed by the first getMemoryEstimate().
+    mutable std::once_flag mMemoryEstimateOnce;
+    mutable MemoryUsage mMemoryEstimate;
+
+    // Updated by the executions, hence mutable.
+    mutable CompilationStatistics mStatistics;
 };
 
 } // namespace nn
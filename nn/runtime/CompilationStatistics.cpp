@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CompilationStatistics"
+
+#include "CompilationStatistics.h"
+
+#include "Utils.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace android {
+namespace nn {
+
+namespace {
+
+size_t getBucketIndex(uint64_t latencyNs) {
+    const uint64_t latencyUs = latencyNs / 1000;
+    if (latencyUs == 0) {
+        return 0;
+    }
+    const size_t index = 64 - __builtin_clzll(latencyUs);
+    return std::min(index, LatencyHistogram::kNumberOfBuckets - 1);
+}
+
+void dumpHistogram(const char* name, const LatencyHistogram::Snapshot& histogram,
+                   std::ostream& out) {
+    out << name << ": count " << histogram.count;
+    if (histogram.count == 0) {
+        out << "\n";
+        return;
+    }
+    out << ", mean " << histogram.getMeanNs() / 1000 << "us, p50 "
+        << histogram.getPercentileNs(50) / 1000 << "us, p90 "
+        << histogram.getPercentileNs(90) / 1000 << "us, p99 "
+        << histogram.getPercentileNs(99) / 1000 << "us, max " << histogram.maxNs / 1000
+        << "us\n";
+    for (size_t i = 0; i < LatencyHistogram::kNumberOfBuckets; i++) {
+        if (histogram.buckets[i] != 0) {
+            out << "  >= " << LatencyHistogram::getBucketLowerBoundNs(i) / 1000
+                << "us: " << histogram.buckets[i] << "\n";
+        }
+    }
+}
+
+}  // namespace
+
+uint64_t LatencyHistogram::getBucketLowerBoundNs(size_t index) {
+    return index == 0 ? 0 : (uint64_t(1) << (index - 1)) * 1000;
+}
+
+uint64_t LatencyHistogram::Snapshot::getPercentileNs(double percentile) const {
+    if (count == 0) {
+        return 0;
+    }
+    const double rank = std::clamp(percentile, 0.0, 100.0) / 100.0 * count;
+    uint64_t seen = 0;
+    for (size_t i = 0; i + 1 < kNumberOfBuckets; i++) {
+        seen += buckets[i];
+        if (seen > 0 && seen >= rank) {
+            return std::min(getBucketLowerBoundNs(i + 1), maxNs);
+        }
+    }
+    return maxNs;
+}
+
+void LatencyHistogram::record(uint64_t latencyNs) {
+    mBuckets[getBucketIndex(latencyNs)].fetch_add(1, std::memory_order_relaxed);
+    mTotalNs.fetch_add(latencyNs, std::memory_order_relaxed);
+    uint64_t max = mMaxNs.load(std::memory_order_relaxed);
+    while (latencyNs > max &&
+           !mMaxNs.compare_exchange_weak(max, latencyNs, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::getSnapshot() const {
+    Snapshot snapshot;
+    for (size_t i = 0; i < kNumberOfBuckets; i++) {
+        snapshot.buckets[i] = mBuckets[i].load(std::memory_order_relaxed);
+        snapshot.count += snapshot.buckets[i];
+    }
+    snapshot.totalNs = mTotalNs.load(std::memory_order_relaxed);
+    snapshot.maxNs = mMaxNs.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+CompilationStatistics::Snapshot CompilationStatistics::getSnapshot() const {
+    Snapshot snapshot;
+    for (size_t i = 0; i < kNumberOfCounters; i++) {
+        snapshot.counters[i] = mCounters[i].load(std::memory_order_relaxed);
+    }
+    snapshot.executionLatency = mExecutionLatency.getSnapshot();
+    snapshot.stepLatency = mStepLatency.getSnapshot();
+    return snapshot;
+}
+
+void CompilationStatistics::dump(std::ostream* outStream) const {
+    const Snapshot snapshot = getSnapshot();
+    std::ostringstream out;
+    for (size_t i = 0; i < kNumberOfCounters; i++) {
+        out << toString(static_cast<Counter>(i)) << ": " << snapshot.counters[i] << "\n";
+    }
+    dumpHistogram("execution latency", snapshot.executionLatency, out);
+    dumpHistogram("step latency", snapshot.stepLatency, out);
+    if (outStream != nullptr) {
+        *outStream << out.str();
+    } else {
+        LOG(INFO) << "CompilationStatistics:\n" << out.str();
+    }
+}
+
+const char* toString(CompilationStatistics::Counter counter) {
+    switch (counter) {
+        case CompilationStatistics::Counter::EXECUTIONS:
+            return "executions";
+        case CompilationStatistics::Counter::FAILED_EXECUTIONS:
+            return "failed executions";
+        case CompilationStatistics::Counter::STEPS:
+            return "steps";
+        case CompilationStatistics::Counter::CPU_FALLBACK_FULL:
+            return "full CPU fallbacks";
+        case CompilationStatistics::Counter::CPU_FALLBACK_PARTIAL:
+            return "partial CPU fallbacks";
+        case CompilationStatistics::Counter::DEMOTED_STEPS:
+            return "steps demoted to the CPU";
+        case CompilationStatistics::Counter::BURST_EXECUTIONS:
+            return "burst executions";
+        case CompilationStatistics::Counter::BURST_FALLBACKS:
+            return "burst fallbacks";
+        case CompilationStatistics::Counter::POINTER_ARGUMENT_BYTES_COPIED:
+            return "pointer argument bytes copied";
+        case CompilationStatistics::Counter::CACHE_HITS:
+            return "cache hits";
+        case CompilationStatistics::Counter::CACHE_MISSES:
+            return "cache misses";
+        case CompilationStatistics::Counter::PARTITIONING_CACHE_HITS:
+            return "partitioning cache hits";
+        case CompilationStatistics::Counter::PARTITIONING_CACHE_MISSES:
+            return "partitioning cache misses";
+    }
+    return "unknown";
+}
+
+}  // namespace nn
+}  // namespace android
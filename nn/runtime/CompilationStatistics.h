@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_RUNTIME_COMPILATION_STATISTICS_H
+#define ANDROID_ML_NN_RUNTIME_COMPILATION_STATISTICS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+
+namespace android {
+namespace nn {
+
+// A histogram of latencies with logarithmic buckets: bucket 0 counts the
+// latencies under 1us, and bucket i > 0 those in [2^(i-1), 2^i) us. The last
+// bucket also counts everything longer. Recording is lock-free, so any number
+// of threads may record concurrently with each other and with getSnapshot().
+class LatencyHistogram {
+   public:
+    static constexpr size_t kNumberOfBuckets = 32;
+
+    struct Snapshot {
+        std::array<uint64_t, kNumberOfBuckets> buckets = {};
+        uint64_t count = 0;
+        uint64_t totalNs = 0;
+        uint64_t maxNs = 0;
+
+        // Estimates the given percentile (in [0, 100]) as the upper bound of
+        // the bucket holding it, capped by the maximum latency recorded.
+        // Returns 0 if nothing was recorded.
+        uint64_t getPercentileNs(double percentile) const;
+        uint64_t getMeanNs() const { return count == 0 ? 0 : totalNs / count; }
+    };
+
+    // The lower bound of the latencies counted by bucket index.
+    static uint64_t getBucketLowerBoundNs(size_t index);
+
+    void record(uint64_t latencyNs);
+
+    Snapshot getSnapshot() const;
+
+   private:
+    std::array<std::atomic<uint64_t>, kNumberOfBuckets> mBuckets = {};
+    std::atomic<uint64_t> mTotalNs = 0;
+    std::atomic<uint64_t> mMaxNs = 0;
+};
+
+// Statistics of all the executions of one compilation, maintained by the
+// runtime. See CompilationBuilder::getStatistics().
+//
+// The counters are only ever incremented, with relaxed atomics; a snapshot
+// taken while executions are running is consistent per counter, but not
+// necessarily across counters.
+class CompilationStatistics {
+   public:
+    enum class Counter {
+        // Executions that finished, and those of them that failed.
+        EXECUTIONS,
+        FAILED_EXECUTIONS,
+        // Steps of the execution plan started, on any device.
+        STEPS,
+        // Whole executions rerun on the CPU (cpuFallbackFull), and single steps
+        // rerun on the CPU (cpuFallbackPartial).
+        CPU_FALLBACK_FULL,
+        CPU_FALLBACK_PARTIAL,
+        // Steps that failed on their device often enough to run on the CPU
+        // from then on (see CpuFallbackState).
+        DEMOTED_STEPS,
+        // Steps run through a burst, and those the burst handed back to the
+        // regular execution path.
+        BURST_EXECUTIONS,
+        BURST_FALLBACKS,
+        // Bytes of pointer arguments copied into and out of shared memory for a
+        // driver.
+        POINTER_ARGUMENT_BYTES_COPIED,
+        // Compilation cache lookups for a device (including the models
+        // prefetched for it), and partitioning cache lookups.
+        CACHE_HITS,
+        CACHE_MISSES,
+        PARTITIONING_CACHE_HITS,
+        PARTITIONING_CACHE_MISSES,
+    };
+    static constexpr size_t kNumberOfCounters =
+            static_cast<size_t>(Counter::PARTITIONING_CACHE_MISSES) + 1;
+
+    struct Snapshot {
+        std::array<uint64_t, kNumberOfCounters> counters = {};
+        // From the start of ANeuralNetworksExecution_compute (or its variants)
+        // until the execution finishes.
+        LatencyHistogram::Snapshot executionLatency;
+        // From the start of a step until its results are available, excluding
+        // any CPU fallback.
+        LatencyHistogram::Snapshot stepLatency;
+
+        uint64_t operator[](Counter counter) const {
+            return counters[static_cast<size_t>(counter)];
+        }
+    };
+
+    void increment(Counter counter, uint64_t amount = 1) {
+        mCounters[static_cast<size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+    }
+    void recordExecutionLatency(uint64_t latencyNs) { mExecutionLatency.record(latencyNs); }
+    void recordStepLatency(uint64_t latencyNs) { mStepLatency.record(latencyNs); }
+
+    Snapshot getSnapshot() const;
+
+    // Writes a human-readable summary to the specified stream (if provided)
+    // or to the logcat (if no stream is provided).
+    void dump(std::ostream* outStream = nullptr) const;
+
+   private:
+    std::array<std::atomic<uint64_t>, kNumberOfCounters> mCounters = {};
+    LatencyHistogram mExecutionLatency;
+    LatencyHistogram mStepLatency;
+};
+
+const char* toString(CompilationStatistics::Counter counter);
+
+}  // namespace nn
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_RUNTIME_COMPILATION_STATISTICS_H
@@ -19,15 +19,18 @@
 #include "ExecutionBuilder.h"
 
 #include "CompilationBuilder.h"
+#include "CompilationStatistics.h"
 #include "CpuExecutor.h"
 #include "ExecutionBurstController.h"
 #include "HalInterfaces.h"
 #include "Manager.h"
 #include "ModelBuilder.h"
+#include "StateBuilder.h"
 #include "Tracing.h"
 #include "TypeManager.h"
 #include "Utils.h"
 
+#include <chrono>
 #include <mutex>
 #include <optional>
 #include <thread>
@@ -163,13 +166,39 @@ int ModelArgumentInfo::updateDimensionInfo(const Operand& operand,
     return ANEURALNETWORKS_NO_ERROR;
 }
 
+// For an argument with a transform, checks that length is that of the buffer
+// in the application's format, and replaces it with the length of the operand.
+static int checkTransformedLength(const char* tag, const ArgumentTransform& transform,
+                                  const Operand& operand, const ANeuralNetworksOperandType* type,
+                                  uint32_t* length) {
+    std::vector<uint32_t> dimensions = operand.dimensions;
+    if (type != nullptr) {
+        dimensions.assign(type->dimensions, type->dimensions + type->dimensionCount);
+    }
+    uint32_t bufferLength = 0;
+    if (!validateArgumentTransform(transform, operand, dimensions, &bufferLength)) {
+        LOG(ERROR) << tag << ": the transform doesn't apply to the argument";
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    if (*length != bufferLength) {
+        LOG(ERROR) << tag << ": transformed argument with invalid length: " << *length
+                   << ", expected length: " << bufferLength;
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    *length = TypeManager::get()->getSizeOfData(operand.type, dimensions);
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
 ExecutionBuilder::ExecutionBuilder(const CompilationBuilder* compilation)
     : mCompilation(compilation),
       mModel(compilation->mModel),
       mPlan(&compilation->mPlan),
       mPartitioning(compilation->mPartitioning),
       mInputs(mModel->inputCount()),
-      mOutputs(mModel->outputCount()) {
+      mOutputs(mModel->outputCount()),
+      mInputTransforms(mModel->inputCount()),
+      mOutputTransforms(mModel->outputCount()),
+      mMemoryAccount(compilation->mMemoryBudget) {
     VLOG(EXECUTION) << "ExecutionBuilder::ExecutionBuilder";
 }
 
@@ -185,6 +214,10 @@ int ExecutionBuilder::setInput(uint32_t index, const ANeuralNetworksOperandType*
         LOG(ERROR) << "ANeuralNetworksExecution_setInput bad index " << index << " " << count;
         return ANEURALNETWORKS_BAD_DATA;
     }
+    if (mState != nullptr && mState->isBoundInput(index)) {
+        LOG(ERROR) << "ANeuralNetworksExecution_setInput called on an input bound to a state";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
     if (!checkDimensionInfo(mModel->getInputOperand(index), type,
                             "ANeuralNetworksExecution_setInput", buffer == nullptr)) {
         return ANEURALNETWORKS_BAD_DATA;
@@ -194,6 +227,11 @@ int ExecutionBuilder::setInput(uint32_t index, const ANeuralNetworksOperandType*
         return ANEURALNETWORKS_BAD_DATA;
     }
     uint32_t l = static_cast<uint32_t>(length);
+    if (mInputTransforms[index].has_value() && buffer != nullptr) {
+        NN_RETURN_IF_ERROR(checkTransformedLength("ANeuralNetworksExecution_setInput",
+                                                  *mInputTransforms[index],
+                                                  mModel->getInputOperand(index), type, &l));
+    }
     return mInputs[index].setFromPointer(mModel->getInputOperand(index), type,
                                          const_cast<void*>(buffer), l);
 }
@@ -213,10 +251,20 @@ int ExecutionBuilder::setInputFromMemory(uint32_t index, const ANeuralNetworksOp
                    << count;
         return ANEURALNETWORKS_BAD_DATA;
     }
+    if (mState != nullptr && mState->isBoundInput(index)) {
+        LOG(ERROR) << "ANeuralNetworksExecution_setInputFromMemory called on an input bound to a "
+                      "state";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
     if (!checkDimensionInfo(mModel->getInputOperand(index), type,
                             "ANeuralNetworksExecution_setInputFromMemory", false)) {
         return ANEURALNETWORKS_BAD_DATA;
     }
+    if (mInputTransforms[index].has_value()) {
+        LOG(ERROR) << "ANeuralNetworksExecution_setInputFromMemory called on an input with a "
+                      "transform";
+        return ANEURALNETWORKS_BAD_DATA;
+    }
     // Both offset & length must be zero for Non-BLOB format AHardwareBuffer.
     if (memory->getHidlMemory().name() == "hardware_buffer" && (offset != 0 || length != 0)) {
         LOG(ERROR) << "ANeuralNetworksExecution_setInputFromMemory has non-zero offset and length"
@@ -243,6 +291,10 @@ int ExecutionBuilder::setOutput(uint32_t index, const ANeuralNetworksOperandType
         LOG(ERROR) << "ANeuralNetworksExecution_setOutput bad index " << index << " " << count;
         return ANEURALNETWORKS_BAD_DATA;
     }
+    if (mState != nullptr && mState->isBoundOutput(index)) {
+        LOG(ERROR) << "ANeuralNetworksExecution_setOutput called on an output bound to a state";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
     if (!checkDimensionInfo(mModel->getOutputOperand(index), type,
                             "ANeuralNetworksExecution_setOutput", true)) {
         return ANEURALNETWORKS_BAD_DATA;
@@ -252,6 +304,11 @@ int ExecutionBuilder::setOutput(uint32_t index, const ANeuralNetworksOperandType
         return ANEURALNETWORKS_BAD_DATA;
     }
     uint32_t l = static_cast<uint32_t>(length);
+    if (mOutputTransforms[index].has_value() && buffer != nullptr) {
+        NN_RETURN_IF_ERROR(checkTransformedLength("ANeuralNetworksExecution_setOutput",
+                                                  *mOutputTransforms[index],
+                                                  mModel->getOutputOperand(index), type, &l));
+    }
     return mOutputs[index].setFromPointer(mModel->getOutputOperand(index), type, buffer, l);
 }
 
@@ -270,10 +327,20 @@ int ExecutionBuilder::setOutputFromMemory(uint32_t index, const ANeuralNetworksO
                    << count;
         return ANEURALNETWORKS_BAD_DATA;
     }
+    if (mState != nullptr && mState->isBoundOutput(index)) {
+        LOG(ERROR) << "ANeuralNetworksExecution_setOutputFromMemory called on an output bound "
+                      "to a state";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
     if (!checkDimensionInfo(mModel->getOutputOperand(index), type,
                             "ANeuralNetworksExecution_setOutputFromMemory", true)) {
         return ANEURALNETWORKS_BAD_DATA;
     }
+    if (mOutputTransforms[index].has_value()) {
+        LOG(ERROR) << "ANeuralNetworksExecution_setOutputFromMemory called on an output with a "
+                      "transform";
+        return ANEURALNETWORKS_BAD_DATA;
+    }
     // Both offset & length must be zero for Non-BLOB format AHardwareBuffer.
     if (memory->getHidlMemory().name() == "hardware_buffer" && (offset != 0 || length != 0)) {
         LOG(ERROR) << "ANeuralNetworksExecution_setOutputFromMemory has non-zero offset and length"
@@ -288,6 +355,77 @@ int ExecutionBuilder::setOutputFromMemory(uint32_t index, const ANeuralNetworksO
                                          length);
 }
 
+int ExecutionBuilder::setState(StateBuilder* state) {
+    if (mStarted) {
+        LOG(ERROR) << "ANeuralNetworksExecution_setState called after the execution has started.";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    if (state->getCompilation() != mCompilation) {
+        LOG(ERROR) << "ANeuralNetworksState and ANeuralNetworksExecution used in "
+                      "ANeuralNetworksExecution_setState must come from the same "
+                      "ANeuralNetworksCompilation";
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    if (!state->isFinished()) {
+        LOG(ERROR) << "ANeuralNetworksExecution_setState passed an unfinished state";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    for (const StateBuilder::Binding& binding : state->getBindings()) {
+        if (mInputs[binding.inputIndex].state != ModelArgumentInfo::UNSPECIFIED ||
+            mOutputs[binding.outputIndex].state != ModelArgumentInfo::UNSPECIFIED ||
+            mInputTransforms[binding.inputIndex] || mOutputTransforms[binding.outputIndex]) {
+            LOG(ERROR) << "ANeuralNetworksExecution_setState called after input "
+                       << binding.inputIndex << " or output " << binding.outputIndex
+                       << " was set or given a transform";
+            return ANEURALNETWORKS_BAD_STATE;
+        }
+    }
+    mState = state;
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
+int ExecutionBuilder::setInputTransform(uint32_t index, const ArgumentTransform& transform) {
+    if (mStarted) {
+        LOG(ERROR) << "setInputTransform called after the execution has started.";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    if (index >= mInputs.size()) {
+        LOG(ERROR) << "setInputTransform bad index " << index << " " << mInputs.size();
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    if (mState != nullptr && mState->isBoundInput(index)) {
+        LOG(ERROR) << "setInputTransform called on an input bound to a state";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    if (mInputs[index].state != ModelArgumentInfo::UNSPECIFIED) {
+        LOG(ERROR) << "setInputTransform called after the input was set.";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    mInputTransforms[index] = transform;
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
+int ExecutionBuilder::setOutputTransform(uint32_t index, const ArgumentTransform& transform) {
+    if (mStarted) {
+        LOG(ERROR) << "setOutputTransform called after the execution has started.";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    if (index >= mOutputs.size()) {
+        LOG(ERROR) << "setOutputTransform bad index " << index << " " << mOutputs.size();
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    if (mState != nullptr && mState->isBoundOutput(index)) {
+        LOG(ERROR) << "setOutputTransform called on an output bound to a state";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    if (mOutputs[index].state != ModelArgumentInfo::UNSPECIFIED) {
+        LOG(ERROR) << "setOutputTransform called after the output was set.";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    mOutputTransforms[index] = transform;
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
 int ExecutionBuilder::setMeasureTiming(bool measure) {
     if (!mCompilation->mExplicitDeviceList || (mCompilation->mDevices.size() != 1)) {
         LOG(ERROR) << "ANeuralNetworksExecution_setMeasureTiming called on "
@@ -337,6 +475,44 @@ int ExecutionBuilder::getDuration(int32_t durationCode, uint64_t* duration) cons
     return ANEURALNETWORKS_NO_ERROR;
 }
 
+int ExecutionBuilder::setCpuProfiling(bool profiling) {
+    if (mStarted) {
+        LOG(ERROR) << "setCpuProfiling called after the execution has started.";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    mCpuProfiling = profiling;
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
+int ExecutionBuilder::getCpuProfile(std::vector<CpuOperationProfile>* profile) const {
+    if (!mFinished) {
+        LOG(ERROR) << "getCpuProfile called before the execution has finished.";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    if (!mCpuProfiling) {
+        LOG(ERROR) << "getCpuProfile called on an execution without CPU profiling.";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    std::lock_guard<std::mutex> lock(mCpuProfileMutex);
+    *profile = mCpuProfile;
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
+void ExecutionBuilder::reportCpuProfile(const std::vector<CpuOperationProfile>& profile) {
+    std::lock_guard<std::mutex> lock(mCpuProfileMutex);
+    mCpuProfile.insert(mCpuProfile.end(), profile.begin(), profile.end());
+}
+
+int ExecutionBuilder::getMemoryUsage(MemoryUsage* peakUsage, uint64_t* peakTotal) const {
+    if (!mFinished) {
+        LOG(ERROR) << "getMemoryUsage called before the execution has finished.";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    *peakUsage = mMemoryAccount.getPeakUsage();
+    *peakTotal = mMemoryAccount.getPeakTotal();
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
 int ExecutionBuilder::getOutputOperandDimensions(uint32_t index, uint32_t* dimensions) {
     if (!mFinished) {
         LOG(ERROR) << "ANeuralNetworksExecution_getOutputOperandDimensions called before the "
@@ -387,6 +563,7 @@ static void cpuFallbackFull(ExecutionBuilder* executionBuilder,
                             const sp<ExecutionCallback>& executionCallback) {
     NNTRACE_RT(NNTRACE_PHASE_EXECUTION, "cpuFallbackFull");
     VLOG(EXECUTION) << "cpuFallbackFull";
+    executionBuilder->getStatistics()->increment(CompilationStatistics::Counter::CPU_FALLBACK_FULL);
     /// M: Profiler @{
     ANeuroPilotExecutionPrivate_setCurrentExecutionStep(
             reinterpret_cast<ANeuralNetworksExecution*>(
@@ -428,6 +605,10 @@ static bool cpuFallbackPartial(ExecutionBuilder* executionBuilder, const Executi
         cpuFallbackFull(executionBuilder, executionCallback);
         return false;
     }
+    // Only counted once the step is actually rerun on its own, rather than
+    // as part of a full fallback.
+    executionBuilder->getStatistics()->increment(
+            CompilationStatistics::Counter::CPU_FALLBACK_PARTIAL);
     sp<ExecutionCallback> fallbackCallback;
     if (executor->startComputeOnCpu(&fallbackCallback) != ANEURALNETWORKS_NO_ERROR) {
         cpuFallbackFull(executionBuilder, executionCallback);
@@ -457,6 +638,7 @@ static void asyncStartComputePartitioned(ExecutionBuilder* executionBuilder,
                                          bool allowFallback,
                                          const sp<ExecutionCallback>& executionCallback) {
     VLOG(EXECUTION) << "ExecutionBuilder::compute (from plan, iteratively)";
+    CompilationStatistics* statistics = executionBuilder->getStatistics();
     std::vector<OutputShape> outputShapes;
     Timing timing = kNoTiming;
     executionBuilder->initializeOutputShapes(&outputShapes);
@@ -484,6 +666,8 @@ static void asyncStartComputePartitioned(ExecutionBuilder* executionBuilder,
             return;
         }
 
+        statistics->increment(CompilationStatistics::Counter::STEPS);
+        const auto stepStartTime = std::chrono::steady_clock::now();
         sp<ExecutionCallback> stepCallback;
         n = executor->startCompute(&stepCallback, burstController);
         if (n != ANEURALNETWORKS_NO_ERROR) {
@@ -509,10 +693,14 @@ static void asyncStartComputePartitioned(ExecutionBuilder* executionBuilder,
             status = ErrorStatus::GENERAL_FAILURE;
         }
         if (status == ErrorStatus::NONE) {
+            plan->stepSucceeded(controller);
             // We only support collection of timing information in the case of a
             // single step, so it's safe to just keep track of the last step's
             // timing information.
             timing = stepCallback->getTiming();
+            statistics->recordStepLatency(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                  std::chrono::steady_clock::now() - stepStartTime)
+                                                  .count());
         } else {
             // OUTPUT_INSUFFICIENT_SIZE is not recoverable
             if (allowFallback && status != ErrorStatus::OUTPUT_INSUFFICIENT_SIZE) {
@@ -563,27 +751,64 @@ int ExecutionBuilder::compute(sp<ExecutionCallback>* synchronizationCallback,
                    << " called on an execution that has already started";
         return ANEURALNETWORKS_BAD_STATE;
     }
-    for (auto& p : mInputs) {
-        if (p.state == ModelArgumentInfo::UNSPECIFIED) {
+    for (uint32_t i = 0; i < mInputs.size(); i++) {
+        if (mInputs[i].state == ModelArgumentInfo::UNSPECIFIED &&
+            !(mState != nullptr && mState->isBoundInput(i))) {
             LOG(ERROR) << "ANeuralNetworksExecution_" << name() << " not all inputs specified";
             return ANEURALNETWORKS_BAD_DATA;
         }
     }
-    for (auto& p : mOutputs) {
-        if (p.state == ModelArgumentInfo::UNSPECIFIED) {
+    for (uint32_t i = 0; i < mOutputs.size(); i++) {
+        if (mOutputs[i].state == ModelArgumentInfo::UNSPECIFIED &&
+            !(mState != nullptr && mState->isBoundOutput(i))) {
             LOG(ERROR) << "ANeuralNetworksExecution_" << name() << " not all outputs specified";
             return ANEURALNETWORKS_BAD_DATA;
         }
     }
 
+    if (mMemoryAccount.getBudget() != 0) {
+        MemoryUsage usage;
+        mCompilation->getMemoryEstimate(&usage);
+        const uint64_t estimate = usage.total();
+        if (estimate > mMemoryAccount.getBudget()) {
+            LOG(ERROR) << "ANeuralNetworksExecution_" << name() << " needs an estimated "
+                       << estimate << " bytes, over the memory budget of "
+                       << mMemoryAccount.getBudget() << " bytes";
+            return ANEURALNETWORKS_OUT_OF_MEMORY;
+        }
+    }
+
+    if (mState != nullptr) {
+        // The buffers are only picked now, so that the execution reads the
+        // state the previous one left, however long ago it called setState.
+        if (!mState->tryLock()) {
+            LOG(ERROR) << "ANeuralNetworksExecution_" << name()
+                       << " called while another execution uses the ANeuralNetworksState";
+            return ANEURALNETWORKS_BAD_STATE;
+        }
+        bindState();
+    }
+    const int n = stageTransformedArguments();
+    if (n != ANEURALNETWORKS_NO_ERROR) {
+        if (mState != nullptr) {
+            mState->unlock();
+        }
+        return n;
+    }
+
     auto wrappedFinish = [this](ErrorStatus error, const std::vector<OutputShape>& outputShapes) {
-        return finish(error, outputShapes);
+        const ErrorStatus status = finish(error, outputShapes);
+        // ErrorStatus has no equivalent of ANEURALNETWORKS_OUT_OF_MEMORY, so going over the
+        // memory budget is reported through the result code of the callback.
+        return mMemoryAccount.isOverBudget() ? ANEURALNETWORKS_OUT_OF_MEMORY
+                                             : convertErrorStatusToResultCode(status);
     };
 
     // TODO: For asynchronous execution, entire plan-based-path should run in an
     // asynchronous thread -- take the asynchronous thread logic out of
     // startComputeOnCpu() and use it to wrap the plan-based-path.
     mStarted = true;
+    mStartTime = std::chrono::steady_clock::now();
     const bool allowFallback = DeviceManager::partitioningAllowsFallback(mPartitioning);
     std::shared_ptr<ExecutionPlan::Controller> controller =
             mPlan->makeController(this, burstBuilder);
@@ -597,7 +822,7 @@ int ExecutionBuilder::compute(sp<ExecutionCallback>* synchronizationCallback,
         if (mMeasureTiming) {
             mTiming = localSynchronizationCallback->getTiming();
         }
-        return convertErrorStatusToResultCode(localSynchronizationCallback->getStatus());
+        return localSynchronizationCallback->getResultCode();
     } else /* asynchronous */ {
         // TODO: use a thread pool
 
@@ -613,8 +838,13 @@ int ExecutionBuilder::compute(sp<ExecutionCallback>* synchronizationCallback,
             asyncStartComputePartitioned(this, mPlan, controller, allowFallback, executionCallback);
         } else {
             VLOG(EXECUTION) << "ExecutionBuilder::compute (asynchronous API)";
-            std::thread thread(asyncStartComputePartitioned, this, mPlan, controller, allowFallback,
-                               executionCallback);
+            const auto handOff = NNTRACE_HAND_OFF(NNTRACE_LAYER_RUNTIME, NNTRACE_PHASE_EXECUTION,
+                                                  "ExecutionBuilder::compute thread");
+            std::thread thread([this, controller, allowFallback, executionCallback, handOff] {
+                handOff.finish();
+                asyncStartComputePartitioned(this, mPlan, controller, allowFallback,
+                                             executionCallback);
+            });
             executionCallback->bindThread(std::move(thread));
         }
         *synchronizationCallback = executionCallback;
@@ -657,13 +887,160 @@ bool ExecutionBuilder::updateOutputShapes(const std::vector<OutputShape>& output
     return true;
 }
 
-ErrorStatus ExecutionBuilder::finish(ErrorStatus, const std::vector<OutputShape>& outputShapes) {
+CompilationStatistics* ExecutionBuilder::getStatistics() const {
+    return &mCompilation->mStatistics;
+}
+
+ErrorStatus ExecutionBuilder::finish(ErrorStatus error,
+                                     const std::vector<OutputShape>& outputShapes) {
     CHECK(!mFinished) << "ExecutionBuilder::finish is called twice";
     mFinished = true;
+    ErrorStatus status = ErrorStatus::NONE;
     if (!updateOutputShapes(outputShapes)) {
-        return ErrorStatus::GENERAL_FAILURE;
+        status = ErrorStatus::GENERAL_FAILURE;
+    } else if (mMemoryAccount.isOverBudget()) {
+        // A step that went over budget may have fallen back to the CPU and
+        // completed there.
+        status = ErrorStatus::GENERAL_FAILURE;
+    }
+
+    if (error == ErrorStatus::NONE && status == ErrorStatus::NONE) {
+        finishTransformedOutputs();
+    }
+    if (mTransformedArgumentsCharge != 0) {
+        mMemoryAccount.release(MemoryCategory::POINTER_ARGUMENTS, mTransformedArgumentsCharge);
+        mTransformedArgumentsCharge = 0;
+    }
+    if (mState != nullptr) {
+        if (error == ErrorStatus::NONE && status == ErrorStatus::NONE) {
+            mState->advance();
+        }
+        mState->unlock();
+    }
+
+    CompilationStatistics* statistics = getStatistics();
+    statistics->increment(CompilationStatistics::Counter::EXECUTIONS);
+    if (error != ErrorStatus::NONE || status != ErrorStatus::NONE) {
+        statistics->increment(CompilationStatistics::Counter::FAILED_EXECUTIONS);
+    }
+    statistics->recordExecutionLatency(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                               std::chrono::steady_clock::now() - mStartTime)
+                                               .count());
+    return status;
+}
+
+void ExecutionBuilder::bindState() {
+    for (const StateBuilder::Binding& binding : mState->getBindings()) {
+        const uint32_t inputPool = mMemories.add(mState->getInputBuffer(binding));
+        CHECK_EQ(mInputs[binding.inputIndex].setFromMemory(
+                         mModel->getInputOperand(binding.inputIndex), nullptr, inputPool, 0,
+                         binding.length),
+                 ANEURALNETWORKS_NO_ERROR);
+        const uint32_t outputPool = mMemories.add(mState->getOutputBuffer(binding));
+        CHECK_EQ(mOutputs[binding.outputIndex].setFromMemory(
+                         mModel->getOutputOperand(binding.outputIndex), nullptr, outputPool, 0,
+                         binding.length),
+                 ANEURALNETWORKS_NO_ERROR);
+    }
+}
+
+// The transformed arguments take the place of the pool StepExecutor would
+// otherwise copy them into for a driver: they are converted once, straight
+// into shared memory, which the driver steps receive as is and the CPU steps
+// read in place.
+int ExecutionBuilder::stageTransformedArguments() {
+    auto isTransformed = [](const std::optional<ArgumentTransform>& transform,
+                            const ModelArgumentInfo& info) {
+        return transform.has_value() && info.state == ModelArgumentInfo::POINTER;
+    };
+    uint64_t total = 0;
+    auto place = [&total](const ModelArgumentInfo& info) {
+        const uint32_t length = info.locationAndLength.length;
+        total += alignBytesNeeded(static_cast<uint32_t>(total), length);
+        const uint32_t offset = static_cast<uint32_t>(total);
+        total += length;
+        return offset;
+    };
+    std::vector<uint32_t> inputOffsets(mInputs.size());
+    for (uint32_t i = 0; i < mInputs.size(); i++) {
+        if (isTransformed(mInputTransforms[i], mInputs[i])) {
+            inputOffsets[i] = place(mInputs[i]);
+        }
+    }
+    std::vector<uint32_t> outputOffsets(mOutputs.size());
+    for (uint32_t i = 0; i < mOutputs.size(); i++) {
+        if (isTransformed(mOutputTransforms[i], mOutputs[i])) {
+            outputOffsets[i] = place(mOutputs[i]);
+        }
+    }
+    if (total == 0) {
+        return ANEURALNETWORKS_NO_ERROR;
+    }
+    if (total > 0xFFFFFFFF) {
+        LOG(ERROR) << "ExecutionBuilder::stageTransformedArguments: Size of all transformed "
+                      "arguments exceeds 2^32.";
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    if (!mMemoryAccount.allocate(MemoryCategory::POINTER_ARGUMENTS, total)) {
+        mMemoryAccount.release(MemoryCategory::POINTER_ARGUMENTS, total);
+        return ANEURALNETWORKS_OUT_OF_MEMORY;
+    }
+    uint8_t* data = nullptr;
+    int n = mTransformedArguments.create(static_cast<uint32_t>(total));
+    if (n == ANEURALNETWORKS_NO_ERROR) {
+        n = mTransformedArguments.getPointer(&data);
+    }
+    if (n != ANEURALNETWORKS_NO_ERROR) {
+        mMemoryAccount.release(MemoryCategory::POINTER_ARGUMENTS, total);
+        return n;
+    }
+    mTransformedArgumentsCharge = total;
+    const uint32_t poolIndex = mMemories.add(&mTransformedArguments);
+
+    CompilationStatistics* statistics = getStatistics();
+    for (uint32_t i = 0; i < mInputs.size(); i++) {
+        ModelArgumentInfo& info = mInputs[i];
+        if (!isTransformed(mInputTransforms[i], info)) {
+            continue;
+        }
+        transformInput(*mInputTransforms[i], mModel->getInputOperand(i), info.dimensions,
+                       info.buffer, data + inputOffsets[i]);
+        statistics->increment(CompilationStatistics::Counter::POINTER_ARGUMENT_BYTES_COPIED,
+                              info.locationAndLength.length);
+        info.state = ModelArgumentInfo::MEMORY;
+        info.locationAndLength.poolIndex = poolIndex;
+        info.locationAndLength.offset = inputOffsets[i];
+        info.buffer = nullptr;
+    }
+    for (uint32_t i = 0; i < mOutputs.size(); i++) {
+        ModelArgumentInfo& info = mOutputs[i];
+        if (!isTransformed(mOutputTransforms[i], info)) {
+            continue;
+        }
+        mTransformedOutputs.push_back(
+                {.index = i, .buffer = info.buffer, .offset = outputOffsets[i]});
+        info.state = ModelArgumentInfo::MEMORY;
+        info.locationAndLength.poolIndex = poolIndex;
+        info.locationAndLength.offset = outputOffsets[i];
+        info.buffer = nullptr;
+    }
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
+void ExecutionBuilder::finishTransformedOutputs() {
+    if (mTransformedOutputs.empty()) {
+        return;
+    }
+    uint8_t* data = nullptr;
+    CHECK_EQ(mTransformedArguments.getPointer(&data), ANEURALNETWORKS_NO_ERROR);
+    CompilationStatistics* statistics = getStatistics();
+    for (const TransformedOutput& output : mTransformedOutputs) {
+        const ModelArgumentInfo& info = mOutputs[output.index];
+        transformOutput(*mOutputTransforms[output.index], mModel->getOutputOperand(output.index),
+                        info.dimensions, data + output.offset, output.buffer);
+        statistics->increment(CompilationStatistics::Counter::POINTER_ARGUMENT_BYTES_COPIED,
+                              info.locationAndLength.length);
     }
-    return ErrorStatus::NONE;
 }
 
 bool StepExecutor::updateOutputShapes(const std::vector<OutputShape>& from,
@@ -735,11 +1112,13 @@ static void setRequestArgumentArray(const std::vector<ModelArgumentInfo>& argume
 
 StepExecutor::StepExecutor(ExecutionBuilder* executionBuilder, const ModelBuilder* model,
                            std::shared_ptr<Device> device,
-                           std::shared_ptr<VersionedIPreparedModel> preparedModel)
+                           std::shared_ptr<VersionedIPreparedModel> preparedModel,
+                           std::shared_ptr<CpuPreparedModel> cpuPreparedModel)
     : mExecutionBuilder(executionBuilder),
       mModel(model),
       mDevice(device),
       mPreparedModel(preparedModel),
+      mCpuPreparedModel(cpuPreparedModel),
       mInputs(model->inputCount()),
       mOutputs(model->outputCount()) {
     CHECK(mDevice != nullptr);
@@ -815,6 +1194,29 @@ bool StepExecutor::isCpu() const {
     return mDevice->getInterface() == nullptr;
 }
 
+void StepExecutor::reportCpuProfile(std::vector<CpuOperationProfile> profile) const {
+    if (profile.empty()) {
+        return;
+    }
+    // The executor ran mModel in its sorted run order. Without an ExecutionStep,
+    // mModel is the main model itself; otherwise, map through the submodel's
+    // order and then the step's own list of main model operations.
+    const std::vector<uint32_t>& mainOrder =
+            mExecutionBuilder->getModel()->getSortedOperationMapping();
+    const std::vector<uint32_t>& subModelOrder = mModel->getSortedOperationMapping();
+    for (CpuOperationProfile& entry : profile) {
+        uint32_t index = entry.operationIndex;
+        if (mExecutionStep != nullptr) {
+            if (!subModelOrder.empty()) {
+                index = subModelOrder[index];
+            }
+            index = mExecutionStep->getOperationIndexes()[index];
+        }
+        entry.operationIndex = mainOrder.empty() ? index : mainOrder[index];
+    }
+    mExecutionBuilder->reportCpuProfile(profile);
+}
+
 int StepExecutor::startCompute(sp<ExecutionCallback>* synchronizationCallback,
                                const std::shared_ptr<ExecutionBurstController>& burstController) {
     if (VLOG_IS_ON(EXECUTION)) {
@@ -878,9 +1280,17 @@ int StepExecutor::startComputeOnDevice(
     if (n != ANEURALNETWORKS_NO_ERROR) {
         return n;
     }
+    ScopedMemoryCharge pointerArgumentsCharge(mExecutionBuilder->getMemoryAccount(),
+                                              MemoryCategory::POINTER_ARGUMENTS,
+                                              inputPointerArguments.getHidlMemory().size() +
+                                                      outputPointerArguments.getHidlMemory().size());
+    if (!pointerArgumentsCharge.isWithinBudget()) {
+        return ANEURALNETWORKS_OUT_OF_MEMORY;
+    }
 
     // Copy the input data that was specified via a pointer.
     // inputPointerArguments.update();
+    CompilationStatistics* statistics = mExecutionBuilder->getStatistics();
     for (auto& info : mInputs) {
         if (info.state == ModelArgumentInfo::POINTER) {
             DataLocation& loc = info.locationAndLength;
@@ -890,6 +1300,8 @@ int StepExecutor::startComputeOnDevice(
                 return n;
             }
             memcpy(data + loc.offset, info.buffer, loc.length);
+            statistics->increment(CompilationStatistics::Counter::POINTER_ARGUMENT_BYTES_COPIED,
+                                  loc.length);
         }
     }
     // TODO: Add inputPointerArguments.commit() and .update() at all the right places
@@ -945,7 +1357,10 @@ int StepExecutor::startComputeOnDevice(
                 burstController->tryCompute(request, measureTiming(mExecutionBuilder), memoryIds);
 
         burstFallback = fallback;
-        if (!fallback) {
+        statistics->increment(CompilationStatistics::Counter::BURST_EXECUTIONS);
+        if (fallback) {
+            statistics->increment(CompilationStatistics::Counter::BURST_FALLBACKS);
+        } else {
             executionCallback->notify(status, outputShapes, timing);
         }
     }
@@ -1024,6 +1439,8 @@ int StepExecutor::startComputeOnDevice(
                 return n;
             }
             memcpy(info.buffer, data + loc.offset, loc.length);
+            statistics->increment(CompilationStatistics::Counter::POINTER_ARGUMENT_BYTES_COPIED,
+                                  loc.length);
         }
     }
     /// M: Profiler @{
@@ -1040,34 +1457,38 @@ int StepExecutor::startComputeOnDevice(
     return ANEURALNETWORKS_NO_ERROR;
 }
 
-static void computeOnCpu(const Model& model, const Request& request,
-                         const std::vector<RunTimePoolInfo>& modelPoolInfos,
+static void computeOnCpu(const CpuExecutorModel& model, const Request& request,
                          const std::vector<RunTimePoolInfo>& requestPoolInfos,
-                         const sp<IExecutionCallback>& executionCallback) {
+                         const sp<IExecutionCallback>& executionCallback,
+                         StepExecutor* stepExecutor) {
     NNTRACE_RT(NNTRACE_PHASE_EXECUTION, "computeOnCpu");
-    CpuExecutor executor;
-    int err = executor.run(model, request, modelPoolInfos, requestPoolInfos);
+    ScopedMemoryAccount memoryAccount(stepExecutor->getExecutionBuilder()->getMemoryAccount());
+    CpuExecutor executor(CpuOperationResolver::get());
+    executor.setProfiling(stepExecutor->getExecutionBuilder()->cpuProfiling());
+    int err = executor.run(model, request, requestPoolInfos);
+    stepExecutor->reportCpuProfile(executor.getProfile());
     const auto& outputShapes = executor.getOutputShapes();
     executionCallback->notify_1_2(convertResultCodeToErrorStatus(err), outputShapes, kNoTiming);
 }
 
-static void computeOnCpuExt(const Model& model, const Request& request,
-                         const std::vector<RunTimePoolInfo>& modelPoolInfos,
+static void computeOnCpuExt(const CpuExecutorModel& model, const Request& request,
                          const std::vector<RunTimePoolInfo>& requestPoolInfos,
                          const sp<IExecutionCallback>& executionCallback,
                          StepExecutor *stepExecutor) {
     if (!ANeuroPilotUtilsPrivate_isProfilerSupported()) {
-        return computeOnCpu(model, request, modelPoolInfos, requestPoolInfos, executionCallback);
+        return computeOnCpu(model, request, requestPoolInfos, executionCallback, stepExecutor);
     }
 
     NNTRACE_RT(NNTRACE_PHASE_EXECUTION, "computeOnCpuExt");
-    CpuExecutor executor;
+    ScopedMemoryAccount memoryAccount(stepExecutor->getExecutionBuilder()->getMemoryAccount());
+    CpuExecutor executor(CpuOperationResolver::get());
+    executor.setProfiling(stepExecutor->getExecutionBuilder()->cpuProfiling());
     /// M: Profiler @{
     int result = ANeuroPilotExecutionPrivate_startProfile(
             reinterpret_cast<ANeuralNetworksStepExecutor*>(stepExecutor),
             DeviceManager::getCpuDevice()->getName());
     /// @}
-    int err = executor.run(model, request, modelPoolInfos, requestPoolInfos);
+    int err = executor.run(model, request, requestPoolInfos);
     /// M: Profiler @{
     if (result == ANEURALNETWORKS_NO_ERROR) {
         ANeuroPilotExecutionPrivate_stopProfile(
@@ -1076,6 +1497,7 @@ static void computeOnCpuExt(const Model& model, const Request& request,
                 err);
     }
     /// @}
+    stepExecutor->reportCpuProfile(executor.getProfile());
     const auto& outputShapes = executor.getOutputShapes();
     executionCallback->notify_1_2(convertResultCodeToErrorStatus(err), outputShapes, kNoTiming);
 }
@@ -1085,9 +1507,6 @@ int StepExecutor::startComputeOnCpu(sp<ExecutionCallback>* synchronizationCallba
     // TODO(mikie): this could have NNTRACE so we could measure the overhead of
     //              spinning up a new thread.
 
-    Model model;
-    mModel->setHidlModel(&model);
-
     /// M: NeuroPilot @{
     // Sometimes we don't want using CPU to execute operation.
     if (ANeuroPilotUtilsPrivate_forbidCpuExecution()) {
@@ -1095,6 +1514,18 @@ int StepExecutor::startComputeOnCpu(sp<ExecutionCallback>* synchronizationCallba
     }
     /// M: @}
 
+    // Use the prepared form of the model if the compilation produced one (possibly restored
+    // from the compilation cache); otherwise, e.g. on CPU fallback, build it now.
+    std::shared_ptr<CpuPreparedModel> preparedModel = mCpuPreparedModel;
+    if (preparedModel == nullptr) {
+        Model model;
+        mModel->setHidlModel(&model);
+        preparedModel = CpuPreparedModel::create(std::move(model));
+        if (preparedModel == nullptr) {
+            return ANEURALNETWORKS_UNMAPPABLE;
+        }
+    }
+
     // Prepare the callback for asynchronous execution. sp<ExecutionCallback>
     // object is returned when the execution has been successfully launched,
     // otherwise a nullptr is returned. The executionCallback is abstracted in
@@ -1102,11 +1533,6 @@ int StepExecutor::startComputeOnCpu(sp<ExecutionCallback>* synchronizationCallba
     sp<ExecutionCallback> executionCallback = new ExecutionCallback();
     *synchronizationCallback = nullptr;
 
-    std::vector<RunTimePoolInfo> modelPoolInfos;
-    if (!setRunTimePoolInfosFromHidlMemories(&modelPoolInfos, model.pools)) {
-        return ANEURALNETWORKS_UNMAPPABLE;
-    }
-
     std::vector<RunTimePoolInfo> requestPoolInfos;
     requestPoolInfos.reserve(mMemories.size());
     for (const Memory* mem : mMemories) {
@@ -1138,11 +1564,19 @@ int StepExecutor::startComputeOnCpu(sp<ExecutionCallback>* synchronizationCallba
 
     /// M: Profiler @{
     if (DeviceManager::get()->syncExecCpu()) {
-        computeOnCpuExt(model, request, modelPoolInfos, requestPoolInfos, executionCallback, this);
+        computeOnCpuExt(preparedModel->getCpuExecutorModel(), request, requestPoolInfos,
+                        executionCallback, this);
     } else {
-        // TODO: should model be moved with a std::cref?
-        std::thread thread(computeOnCpuExt, model, std::move(request), std::move(modelPoolInfos),
-                           std::move(requestPoolInfos), executionCallback, this);
+        // The thread shares ownership of the prepared model instead of copying it.
+        const auto handOff = NNTRACE_HAND_OFF(NNTRACE_LAYER_RUNTIME, NNTRACE_PHASE_EXECUTION,
+                                              "StepExecutor::startComputeOnCpu thread");
+        std::thread thread([preparedModel, request = std::move(request),
+                            requestPoolInfos = std::move(requestPoolInfos), executionCallback,
+                            this, handOff] {
+            handOff.finish();
+            computeOnCpuExt(preparedModel->getCpuExecutorModel(), request, requestPoolInfos,
+                            executionCallback, this);
+        });
         executionCallback->bindThread(std::move(thread));
     }
     /// M: Profiler @}
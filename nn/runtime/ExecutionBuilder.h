@@ -17,14 +17,20 @@
 #ifndef ANDROID_ML_NN_RUNTIME_EXECUTION_BUILDER_H
 #define ANDROID_ML_NN_RUNTIME_EXECUTION_BUILDER_H
 
+#include "ArgumentTransform.h"
 #include "Callbacks.h"
+#include "CpuExecutor.h"
 #include "HalInterfaces.h"
 #include "Memory.h"
+#include "MemoryAccounting.h"
 #include "ModelBuilder.h"
 #include "NeuralNetworks.h"
 #include "VersionedInterfaces.h"
 
 #include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
 #include <unordered_map>
 #include <vector>
 
@@ -36,11 +42,14 @@ namespace nn {
 
 class BurstBuilder;
 class CompilationBuilder;
+class CompilationStatistics;
+class CpuPreparedModel;
 class ExecutionPlan;
 class ExecutionBurstController;
 class ExecutionStep;
 class Memory;
 class ModelBuilder;
+class StateBuilder;
 class StepExecutor;
 class Device;
 
@@ -94,10 +103,41 @@ public:
     int setOutputFromMemory(uint32_t index, const ANeuralNetworksOperandType* type,
                             const Memory* memory, size_t offset, size_t length);
 
+    // Converts the buffer of the input (or output) at index between the
+    // application's format and the operand's, see ArgumentTransform, as the
+    // runtime copies the argument. Must be called before setInput (or
+    // setOutput), which then takes the buffer in the application's format.
+    // Only applies to arguments set from a pointer, with fully specified
+    // dimensions.
+    int setInputTransform(uint32_t index, const ArgumentTransform& transform);
+    int setOutputTransform(uint32_t index, const ArgumentTransform& transform);
+
+    // Reads the inputs and writes the outputs bound in state from and to its
+    // buffers, so that the state carries over from the previous execution
+    // that used it to the next one; see StateBuilder. Must be called before
+    // the bound arguments are set, which then can't be set. state must
+    // outlive the execution.
+    int setState(StateBuilder* state);
+
     int setMeasureTiming(bool measure);
 
     int getDuration(int32_t durationCode, uint64_t* duration) const;
 
+    // Turns on per-operation profiling of the parts of this execution that
+    // run on the CPU, see CpuExecutor::setProfiling().
+    int setCpuProfiling(bool profiling);
+
+    // Returns the profile of the operations this execution ran on the CPU, in
+    // the order they ran. Operation indexes refer to the model as it was built
+    // by the application. Only available once the execution has finished.
+    int getCpuProfile(std::vector<CpuOperationProfile>* profile) const;
+
+    // Returns the high-water mark of the memory this execution allocated in
+    // the runtime and in the CpuExecutor, per MemoryCategory and in total.
+    // Memory allocated inside drivers is not included. Only available once the
+    // execution has finished.
+    int getMemoryUsage(MemoryUsage* peakUsage, uint64_t* peakTotal) const;
+
     int computeAsynchronously(sp<ExecutionCallback>* synchronizationCallback) {
         CHECK(synchronizationCallback != nullptr);
         return compute(synchronizationCallback);
@@ -114,6 +154,11 @@ public:
     // Handshake with lower-level execution support
     bool measureTiming() const { return mMeasureTiming; }
     void reportTiming(Timing timing) { mTiming = timing; }
+    bool cpuProfiling() const { return mCpuProfiling; }
+    void reportCpuProfile(const std::vector<CpuOperationProfile>& profile);
+    MemoryAccount* getMemoryAccount() { return &mMemoryAccount; }
+    // The statistics of the compilation, see CompilationBuilder::getStatistics().
+    CompilationStatistics* getStatistics() const;
 
     const CompilationBuilder* getCompilation() const { return mCompilation; }
     const ModelBuilder* getModel() const { return mModel; }
@@ -150,6 +195,15 @@ public:
     int compute(sp<ExecutionCallback>* synchronizationCallback,
                 BurstBuilder* burstBuilder = nullptr);
 
+    // Converts the transformed pointer arguments into mTransformedArguments,
+    // and makes them memory arguments, so that the steps use the converted
+    // data without copying it again.
+    int stageTransformedArguments();
+    // Sets the arguments bound in mState to its current buffers.
+    void bindState();
+    // Converts the transformed outputs back into the application's buffers.
+    void finishTransformedOutputs();
+
     const CompilationBuilder* mCompilation;
 
     // Update output dimensional information from OutputShape to ModelArgumentInfo.
@@ -176,15 +230,51 @@ public:
     std::vector<ModelArgumentInfo> mOutputs;
     MemoryTracker mMemories;
 
+    // Set with setInputTransform and setOutputTransform, by argument index.
+    std::vector<std::optional<ArgumentTransform>> mInputTransforms;
+    std::vector<std::optional<ArgumentTransform>> mOutputTransforms;
+
+    // The operand data of the transformed arguments, while the execution runs,
+    // and the bytes charged to mMemoryAccount for it.
+    Memory mTransformedArguments;
+    uint64_t mTransformedArgumentsCharge = 0;
+
+    // The application's buffers of the transformed outputs, and where their
+    // operand data is in mTransformedArguments.
+    struct TransformedOutput {
+        uint32_t index;
+        void* buffer;
+        uint32_t offset;
+    };
+    std::vector<TransformedOutput> mTransformedOutputs;
+
+    // Set with setState. Locked from compute until finish.
+    StateBuilder* mState = nullptr;
+
     // Do we ask the driver to measure timing?
     bool mMeasureTiming = false;
 
     // Timing reported from the driver
     Timing mTiming = {};
 
+    // Do we profile the operations run by the CpuExecutor?
+    bool mCpuProfiling = false;
+
+    // Profiles reported by the steps that ran on the CPU. Steps of a partitioned
+    // execution may report from different threads.
+    mutable std::mutex mCpuProfileMutex;
+    std::vector<CpuOperationProfile> mCpuProfile;
+
+    // What the execution allocates, limited by the memory budget of the
+    // compilation.
+    MemoryAccount mMemoryAccount;
+
     // Properties cannot be set once the execution has started.
     std::atomic_bool mStarted = false;
 
+    // When the execution started, for the execution latency statistics.
+    std::chrono::steady_clock::time_point mStartTime;
+
     // Timing and output shapes can only be queried after the execution is
     // finished.
     std::atomic_bool mFinished = false;
@@ -205,9 +295,12 @@ class StepExecutor {
     //     The device on which to execute the "step", and the prepared
     //     model to execute on that device.  (Both are nullptr in the
     //     case of CPU.)
+    // cpuPreparedModel, if not nullptr, is the CPU device's prepared form of model; without
+    // one, CPU execution rebuilds the HIDL model and maps its pools on every run.
     StepExecutor(ExecutionBuilder* executionBuilder, const ModelBuilder* model,
                  std::shared_ptr<Device> device,
-                 std::shared_ptr<VersionedIPreparedModel> preparedModel);
+                 std::shared_ptr<VersionedIPreparedModel> preparedModel,
+                 std::shared_ptr<CpuPreparedModel> cpuPreparedModel = nullptr);
 
     // Map inputs and outputs from ExecutionBuilder to StepExecutor,
     // in the case where we have a single-"step" execution (i.e., the executor
@@ -254,6 +347,10 @@ class StepExecutor {
 
     bool isCpu() const;
 
+    // Passes the profile of a CpuExecutor run of this step to the
+    // ExecutionBuilder, with the operation indexes mapped to the main model.
+    void reportCpuProfile(std::vector<CpuOperationProfile> profile) const;
+
     // ExecutionStep has the index mapping between ExecutionBuilder and StepExecutor.
     void setExecutionStep(const std::shared_ptr<const ExecutionStep>& step) {
         mExecutionStep = step;
@@ -298,6 +395,7 @@ class StepExecutor {
     std::shared_ptr<Device> mDevice;
     std::shared_ptr<VersionedIPreparedModel>
             mPreparedModel;  // nullptr if CPU execution or if bypassing ExecutionPlan
+    std::shared_ptr<CpuPreparedModel> mCpuPreparedModel;  // nullptr if not prepared for CPU
 
     // The information we'll send to the driver about the inputs and outputs.
     // Note that we build this in two steps:
@@ -19,8 +19,10 @@
 #include "ExecutionPlan.h"
 
 #include "BurstBuilder.h"
+#include "CachePrefetcher.h"
 #include "Callbacks.h"
 #include "CompilationBuilder.h"
+#include "CompilationStatistics.h"
 #include "ExecutionBuilder.h"
 #include "ExecutionBurstController.h"
 #include "GraphDump.h"
@@ -37,9 +39,14 @@
 #include <openssl/sha.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include <functional>
+#include <algorithm>
+#include <array>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <numeric>
 #include <queue>
 #include <strstream>
 #include <type_traits>
@@ -87,28 +94,31 @@ hidl_vec<hidl_handle> createCacheHandleVec(uint32_t numCacheFiles, const std::st
     return handles;
 }
 
-// Maps token to cache file names and sets the handle vectors to the opened fds. Returns false on
-// fail and leaves the vectors empty. Each vector is expected to come in as empty.
-bool getCacheHandles(const std::string& cacheDir, const uint8_t* token,
-                     const std::pair<uint32_t, uint32_t>& numCacheFiles, bool createIfNotExist,
-                     hidl_vec<hidl_handle>* modelCache, hidl_vec<hidl_handle>* dataCache) {
-    // The filename includes ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN * 2 characters for token,
-    // and 1 character for model/data cache identifier.
-    std::string filename(ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN * 2 + 1, '0');
+// Maps token to a cache file name. The filename includes
+// ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN * 2 characters for token, and 1 character for the
+// cache identifier: '1' for model cache, '2' for data cache and '3' for the partitioning cache.
+std::string getCacheFileName(const std::string& cacheDir, const uint8_t* token, char identifier) {
+    std::string filename(ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN * 2 + 1, identifier);
     for (uint32_t i = 0; i < ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN; i++) {
         filename[i * 2] = 'A' + (token[i] & 0x0F);
         filename[i * 2 + 1] = 'A' + (token[i] >> 4);
     }
     CHECK(cacheDir.empty() || cacheDir.back() == '/');
-    std::string cacheFileName = cacheDir + filename;
+    return cacheDir + filename;
+}
 
-    cacheFileName[ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN * 2] = '1';
-    *modelCache = createCacheHandleVec(numCacheFiles.first, cacheFileName, createIfNotExist);
+// Maps token to cache file names and sets the handle vectors to the opened fds. Returns false on
+// fail and leaves the vectors empty. Each vector is expected to come in as empty.
+bool getCacheHandles(const std::string& cacheDir, const uint8_t* token,
+                     const std::pair<uint32_t, uint32_t>& numCacheFiles, bool createIfNotExist,
+                     hidl_vec<hidl_handle>* modelCache, hidl_vec<hidl_handle>* dataCache) {
+    *modelCache = createCacheHandleVec(numCacheFiles.first, getCacheFileName(cacheDir, token, '1'),
+                                       createIfNotExist);
     if (modelCache->size() != numCacheFiles.first) {
         return false;
     }
-    cacheFileName[ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN * 2] = '2';
-    *dataCache = createCacheHandleVec(numCacheFiles.second, cacheFileName, createIfNotExist);
+    *dataCache = createCacheHandleVec(numCacheFiles.second, getCacheFileName(cacheDir, token, '2'),
+                                      createIfNotExist);
     if (dataCache->size() != numCacheFiles.second) {
         modelCache->resize(0);
         return false;
@@ -119,24 +129,29 @@ bool getCacheHandles(const std::string& cacheDir, const uint8_t* token,
 // Tries to compile directly from cache, returns false on fail.
 bool compileFromCache(const std::shared_ptr<Device>& device, const std::string& cacheDir,
                       const uint8_t* token,
-                      std::shared_ptr<VersionedIPreparedModel>* preparedModel) {
+                      std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                      std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) {
     CHECK(token != nullptr && device != nullptr);
     VLOG(COMPILATION) << "compileFromCache";
     *preparedModel = nullptr;
+    *cpuPreparedModel = nullptr;
     HidlToken cacheToken(token);
     hidl_vec<hidl_handle> modelCache, dataCache;
     NN_RET_CHECK(getCacheHandles(cacheDir, token, device->getNumberOfCacheFilesNeeded(),
                                  /*createIfNotExist=*/false, &modelCache, &dataCache));
-    int ret = device->prepareModelFromCache(modelCache, dataCache, cacheToken, preparedModel);
+    int ret = device->prepareModelFromCache(modelCache, dataCache, cacheToken, preparedModel,
+                                            cpuPreparedModel);
     return ret == ANEURALNETWORKS_NO_ERROR;
 }
 
 int compileModelAndCache(const std::shared_ptr<Device>& device, const ModelBuilder* model,
                          int32_t executionPreference, const std::string& cacheDir,
                          const uint8_t* token,
-                         std::shared_ptr<VersionedIPreparedModel>* preparedModel) {
+                         std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                         std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) {
     CHECK(device != nullptr);
     *preparedModel = nullptr;
+    *cpuPreparedModel = nullptr;
     uint8_t dummyToken[ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN] = {0};
     HidlToken cacheToken(token == nullptr ? dummyToken : token);
     hidl_vec<hidl_handle> modelCache, dataCache;
@@ -148,29 +163,215 @@ int compileModelAndCache(const std::shared_ptr<Device>& device, const ModelBuild
     Model hidlModel;
     model->setHidlModel(&hidlModel);
     return device->prepareModel(hidlModel, static_cast<ExecutionPreference>(executionPreference),
-                                modelCache, dataCache, cacheToken, preparedModel);
+                                modelCache, dataCache, cacheToken, preparedModel,
+                                cpuPreparedModel);
+}
+
+// Re-hashes token by the device name, device version string, and the execution preference, and
+// returns the resulting token of the model's cache entry on device. Returns nullptr if the device
+// does not support caching or if there is no token.
+const uint8_t* finishDeviceCacheToken(const std::shared_ptr<Device>& device,
+                                      int32_t executionPreference, TokenHasher* token) {
+    if (device->isCachingSupported() && token->ok() && token->updateFromString(device->getName()) &&
+        token->updateFromString(device->getVersionString()) &&
+        token->update(&executionPreference, sizeof(executionPreference)) && token->finish()) {
+        return token->getCacheToken();
+    }
+    return nullptr;
 }
 
 // Compiles the model on device.
 // If compilation caching is available, depending on ExecutionPlan::mState, the token may only have
 // been initialized by the user provided token (SIMPLE body), or is already re-hashed by the
 // operation indices to be executed (COMPOUND body). The token will be re-hashed further by the
-// device name, device version string, and the execution preference in this function.
+// device name, device version string, and the execution preference in this function. Cache
+// lookups are counted in statistics, if not nullptr.
 int compile(std::shared_ptr<Device> device, const ModelBuilder* model, int32_t executionPreference,
-            const std::string& cacheDir, TokenHasher* token,
-            std::shared_ptr<VersionedIPreparedModel>* preparedModel) {
+            const std::string& cacheDir, TokenHasher* token, CompilationStatistics* statistics,
+            std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+            std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) {
     CHECK(device != nullptr);
-    const uint8_t* tokenData = nullptr;
-    if (device->isCachingSupported() && token->ok() && token->updateFromString(device->getName()) &&
-        token->updateFromString(device->getVersionString()) &&
-        token->update(&executionPreference, sizeof(executionPreference)) && token->finish()) {
-        tokenData = token->getCacheToken();
-    }
-    if (tokenData != nullptr && compileFromCache(device, cacheDir, tokenData, preparedModel)) {
-        return ANEURALNETWORKS_NO_ERROR;
+    const uint8_t* tokenData = finishDeviceCacheToken(device, executionPreference, token);
+    if (tokenData != nullptr) {
+        const bool hit =
+                takePrefetchedModel(device, cacheDir, tokenData, preparedModel, cpuPreparedModel) ||
+                compileFromCache(device, cacheDir, tokenData, preparedModel, cpuPreparedModel);
+        if (statistics != nullptr) {
+            statistics->increment(hit ? CompilationStatistics::Counter::CACHE_HITS
+                                      : CompilationStatistics::Counter::CACHE_MISSES);
+        }
+        if (hit) {
+            return ANEURALNETWORKS_NO_ERROR;
+        }
     }
     return compileModelAndCache(device, model, executionPreference, cacheDir, tokenData,
-                                preparedModel);
+                                preparedModel, cpuPreparedModel);
+}
+
+// The partitioning of a model among devices: for each step, in execution order, the index of
+// its device in the device list and the indices of its operations in the order they were added.
+typedef std::vector<std::pair<uint32_t, std::vector<uint32_t>>> PartitioningSteps;
+
+// The fingerprint of the partitioned model (see ModelBuilder::getFingerprint), stored as words
+// of the partitioning cache file.
+typedef std::array<uint32_t, SHA256_DIGEST_LENGTH / sizeof(uint32_t)> ModelFingerprint;
+
+constexpr uint32_t kPartitioningCacheMagic = 0x504e4e41;  // "ANNP"
+constexpr uint32_t kPartitioningCacheVersion = 3;
+
+// Returns the name of the file recording how a model compiled with token is partitioned among
+// devices, or an empty string if there is no token. Besides the model, the partitioning depends
+// on the operations each device supports, which the devices' names, versions and feature levels
+// stand for, and on the execution preference, so the token is re-hashed by those. The file
+// records the fingerprint of the model, which the application may change without changing the
+// token.
+std::string getPartitioningCacheFileName(const std::string& cacheDir, const uint8_t* token,
+                                         const std::vector<std::shared_ptr<Device>>& devices,
+                                         uint32_t preference) {
+    TokenHasher hasher(token);
+    if (!hasher.ok() || !hasher.updateFromString("partitioning")) {
+        return "";
+    }
+    for (const auto& device : devices) {
+        const int64_t featureLevel = device->getFeatureLevel();
+        if (!hasher.updateFromString(device->getName()) ||
+            !hasher.updateFromString(device->getVersionString()) ||
+            !hasher.update(&featureLevel, sizeof(featureLevel))) {
+            return "";
+        }
+    }
+    if (!hasher.update(&preference, sizeof(preference)) || !hasher.finish()) {
+        return "";
+    }
+    return getCacheFileName(cacheDir, hasher.getCacheToken(), '3');
+}
+
+// Reads back a partitioning written by writePartitioningToCache, checking that it partitions
+// operationCount operations among deviceCount devices with every operation appearing exactly
+// once. Returns false if the file does not exist or fails any check.
+bool readPartitioningFile(const std::string& fileName, size_t deviceCount,
+                          ModelFingerprint* fingerprint, uint32_t* operationCount,
+                          PartitioningSteps* steps) {
+    steps->clear();
+    const int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    std::vector<uint32_t> words;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size % sizeof(uint32_t) == 0) {
+        words.resize(st.st_size / sizeof(uint32_t));
+        if (read(fd, words.data(), st.st_size) != st.st_size) {
+            words.clear();
+        }
+    }
+    close(fd);
+
+    size_t pos = 0;
+    auto next = [&words, &pos](uint32_t* value) {
+        if (pos >= words.size()) return false;
+        *value = words[pos++];
+        return true;
+    };
+    uint32_t magic = 0, version = 0, stepCount = 0;
+    NN_RET_CHECK(next(&magic) && next(&version));
+    NN_RET_CHECK(magic == kPartitioningCacheMagic && version == kPartitioningCacheVersion);
+    for (uint32_t& word : *fingerprint) {
+        NN_RET_CHECK(next(&word));
+    }
+    NN_RET_CHECK(next(operationCount) && next(&stepCount));
+    NN_RET_CHECK(stepCount > 0 && stepCount <= *operationCount);
+    NN_RET_CHECK_LE(*operationCount, words.size());
+
+    std::vector<bool> isOperationScheduled(*operationCount, false);
+    steps->resize(stepCount);
+    for (auto& [deviceIndex, stepOperations] : *steps) {
+        uint32_t stepOperationCount = 0;
+        NN_RET_CHECK(next(&deviceIndex) && next(&stepOperationCount));
+        NN_RET_CHECK_LT(deviceIndex, deviceCount);
+        NN_RET_CHECK(stepOperationCount > 0 && stepOperationCount <= words.size() - pos);
+        stepOperations.assign(words.begin() + pos, words.begin() + pos + stepOperationCount);
+        pos += stepOperationCount;
+        for (uint32_t operationIndex : stepOperations) {
+            NN_RET_CHECK_LT(operationIndex, *operationCount);
+            NN_RET_CHECK(!isOperationScheduled[operationIndex]);
+            isOperationScheduled[operationIndex] = true;
+        }
+    }
+    NN_RET_CHECK_EQ(pos, words.size());
+    // Every operation is scheduled exactly once, since the counts match and none repeats.
+    NN_RET_CHECK(std::all_of(isOperationScheduled.begin(), isOperationScheduled.end(),
+                             [](bool scheduled) { return scheduled; }));
+    return true;
+}
+
+// Reads back a partitioning written by writePartitioningToCache, checking that it was computed
+// for a model with the same fingerprint and that it is a valid partitioning of model among
+// deviceCount devices: every operation appears exactly once, and no operation is scheduled
+// before the operations producing its inputs. Returns false if the file does not exist or fails
+// any check.
+bool readPartitioningFromCache(const std::string& fileName, size_t deviceCount,
+                               const ModelBuilder* model, const ModelFingerprint& modelFingerprint,
+                               PartitioningSteps* steps) {
+    NNTRACE_RT(NNTRACE_PHASE_COMPILATION, "readPartitioningFromCache");
+    ModelFingerprint fingerprint;
+    uint32_t operationCount = 0;
+    if (!readPartitioningFile(fileName, deviceCount, &fingerprint, &operationCount, steps)) {
+        return false;
+    }
+    if (fingerprint != modelFingerprint) {
+        VLOG(COMPILATION) << "Cached partitioning is stale: the model has changed";
+        steps->clear();
+        return false;
+    }
+    const auto& operations = model->getOperations();
+    NN_RET_CHECK_EQ(operationCount, operations.size());
+    std::vector<bool> isOperandKnown(model->operandCount(), false);
+    for (const auto& step : *steps) {
+        for (uint32_t operationIndex : step.second) {
+            const Operation& operation = operations[operationIndex];
+            for (uint32_t operandIndex : operation.inputs) {
+                const auto lifetime = model->getOperand(operandIndex).lifetime;
+                NN_RET_CHECK(isOperandKnown[operandIndex] ||
+                             (lifetime != OperandLifeTime::TEMPORARY_VARIABLE &&
+                              lifetime != OperandLifeTime::MODEL_OUTPUT));
+            }
+            for (uint32_t operandIndex : operation.outputs) {
+                isOperandKnown[operandIndex] = true;
+            }
+        }
+    }
+    return true;
+}
+
+// Records the partitioning of model in fileName. Failing to do so only costs a full
+// partitioning the next time, so errors are logged and otherwise ignored.
+void writePartitioningToCache(const std::string& fileName, const ModelBuilder* model,
+                              const ModelFingerprint& modelFingerprint,
+                              const PartitioningSteps& steps) {
+    NNTRACE_RT(NNTRACE_PHASE_COMPILATION, "writePartitioningToCache");
+    std::vector<uint32_t> words = {kPartitioningCacheMagic, kPartitioningCacheVersion};
+    words.insert(words.end(), modelFingerprint.begin(), modelFingerprint.end());
+    words.push_back(model->operationCount());
+    words.push_back(steps.size());
+    for (const auto& [deviceIndex, stepOperations] : steps) {
+        words.push_back(deviceIndex);
+        words.push_back(stepOperations.size());
+        words.insert(words.end(), stepOperations.begin(), stepOperations.end());
+    }
+    const int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        LOG(WARNING) << "Failed to create partitioning cache " << fileName;
+        return;
+    }
+    const ssize_t size = words.size() * sizeof(uint32_t);
+    if (write(fd, words.data(), size) != size) {
+        LOG(WARNING) << "Failed to write partitioning cache " << fileName;
+        close(fd);
+        unlink(fileName.c_str());
+        return;
+    }
+    close(fd);
 }
 
 typedef std::function<void(uint32_t)> OperationReadyCallback;
@@ -219,13 +420,16 @@ public:
 
 private:
     const ModelBuilder* mModel;
-    std::multimap<uint32_t, uint32_t> mOperandToOperations;
+    // For each operand, the operations that consume it and that must wait for
+    // it to be computed.
+    std::vector<std::vector<uint32_t>> mOperandToOperations;
     std::vector<uint32_t> mUnknownInputCount;  // For each operation
 };
 
 OperandTracker::OperandTracker(const ModelBuilder* model, OperationReadyCallback cb) :
         mModel(model) {
     const auto& operations = mModel->getOperations();
+    mOperandToOperations.resize(mModel->operandCount());
     mUnknownInputCount.resize(operations.size());
     for (uint32_t operationIndex = 0; operationIndex < operations.size(); operationIndex++) {
         const Operation& operation = operations[operationIndex];
@@ -235,8 +439,7 @@ OperandTracker::OperandTracker(const ModelBuilder* model, OperationReadyCallback
             if (lifetime == OperandLifeTime::TEMPORARY_VARIABLE ||
                 lifetime == OperandLifeTime::MODEL_OUTPUT) {
                 count++;
-                mOperandToOperations.insert(
-                        std::pair<uint32_t, uint32_t>(operandIndex, operationIndex));
+                mOperandToOperations[operandIndex].push_back(operationIndex);
             }
         }
         if (count == 0) {
@@ -250,11 +453,10 @@ void OperandTracker::markProcessed(uint32_t operationIndex, OperationReadyCallba
     // Mark all its outputs as known.
     const Operation& operation = mModel->getOperations()[operationIndex];
     for (uint32_t operandIndex : operation.outputs) {
-        auto range = mOperandToOperations.equal_range(operandIndex);
-        for (auto i = range.first; i != range.second; i++) {
-            uint32_t& count = mUnknownInputCount[i->second];
+        for (uint32_t consumer : mOperandToOperations[operandIndex]) {
+            uint32_t& count = mUnknownInputCount[consumer];
             if (--count == 0) {
-                cb(i->second);
+                cb(consumer);
             }
         }
     }
@@ -262,6 +464,65 @@ void OperandTracker::markProcessed(uint32_t operationIndex, OperationReadyCallba
 
 }  // namespace
 
+// Mirrors the derivation of device cache tokens in ModelBuilder::partitionTheWork and compile().
+// If a partitioning of the model was recorded, each of its steps is prepared on its device;
+// otherwise a single-step plan is tried on every device, which fails quickly where no cache files
+// exist.
+std::vector<PrefetchedModel> prepareModelsFromCache(
+        const std::vector<std::shared_ptr<Device>>& devices, int32_t preference,
+        const std::string& cacheDir, const uint8_t* token) {
+    NNTRACE_RT(NNTRACE_PHASE_COMPILATION, "prepareModelsFromCache");
+    std::vector<std::pair<std::shared_ptr<Device>, std::unique_ptr<TokenHasher>>> targets;
+    const std::string partitioningCacheFile =
+            getPartitioningCacheFileName(cacheDir, token, devices, preference);
+    // Without the model, the fingerprint can't be checked here; it is recorded with the prepared
+    // models for waitForCompilationCachePrefetch to check.
+    ModelFingerprint fingerprint;
+    uint32_t operationCount = 0;
+    PartitioningSteps steps;
+    const bool hasPartitioning =
+            !partitioningCacheFile.empty() &&
+            readPartitioningFile(partitioningCacheFile, devices.size(), &fingerprint,
+                                 &operationCount, &steps);
+    if (hasPartitioning) {
+        for (const auto& [deviceIndex, stepOperations] : steps) {
+            auto hasher = std::make_unique<TokenHasher>(token);
+            // A single step becomes a SIMPLE body, whose token is not hashed by operations.
+            if (steps.size() > 1) {
+                for (int operationIndex : stepOperations) {
+                    hasher->update(&operationIndex, sizeof(operationIndex));
+                }
+            }
+            targets.emplace_back(devices[deviceIndex], std::move(hasher));
+        }
+    } else {
+        for (const auto& device : devices) {
+            targets.emplace_back(device, std::make_unique<TokenHasher>(token));
+        }
+    }
+
+    std::vector<PrefetchedModel> models;
+    for (auto& [device, hasher] : targets) {
+        const uint8_t* deviceToken = finishDeviceCacheToken(device, preference, hasher.get());
+        PrefetchedModel model = {.device = device,
+                                 .deviceName = device->getName(),
+                                 .deviceVersion = device->getVersionString()};
+        if (deviceToken != nullptr &&
+            compileFromCache(device, cacheDir, deviceToken, &model.preparedModel,
+                             &model.cpuPreparedModel)) {
+            VLOG(COMPILATION) << "Prefetched " << getCacheFileName(cacheDir, deviceToken, '1')
+                              << " on " << device->getName();
+            model.deviceToken = HidlToken(deviceToken);
+            if (hasPartitioning) {
+                const uint8_t* bytes = reinterpret_cast<const uint8_t*>(fingerprint.data());
+                model.modelFingerprint.assign(bytes, bytes + sizeof(fingerprint));
+            }
+            models.push_back(std::move(model));
+        }
+    }
+    return models;
+}
+
 ExecutionStep::ExecutionStep(ExecutionPlan* plan, uint32_t stepIndex,
                              std::shared_ptr<Device> device)
     : mPlan(plan), mIndex(stepIndex), mSubModel(), mDevice(device), mToken(plan->getCacheToken()) {}
@@ -406,6 +667,7 @@ int ExecutionStep::addOperation(int operationIndex, const ModelBuilder& fromMode
         return n;
     }
 
+    mOperationIndexes.push_back(operationIndex);
     return mSubModel.addOperation(static_cast<uint32_t>(operation.type), inputCount, inputs.data(),
                                    outputCount, outputs.data());
 }
@@ -479,6 +741,11 @@ static void convertModelInputsOrOutputs(
         std::vector<uint32_t>*                inputsOrOutputs,
         // OUT: submodel input-or-output index to original model input-or-output index
         std::vector<uint32_t>*                inputOrOutputIndexSubModelToFromModel) {
+    // Most steps of a large partitioned model use none of its inputs or
+    // outputs; don't build a map over them for each such step.
+    if (myModelInputsOrOutputs.empty()) {
+        return;
+    }
     std::map<uint32_t, uint32_t> fromModelIndexMap;  // operand index to input-or-output index
     for (uint32_t i = 0; i < fromModelInputOrOutputCount; i++) {
         fromModelIndexMap[fromModelGetInputOrOutputOperandIndex(i)] = i;
@@ -553,7 +820,7 @@ int ExecutionStep::finishSubModel(const ModelBuilder* fromModel, bool* hasOutput
         }
     }
 
-    {
+    if (!mOutputsAsSubModelInputs.empty()) {
         // Compute mOutputsAsSubModelInputsIndexToFromModel.
 
         std::map<uint32_t, uint32_t> fromModelOperandIndexToOutputIndex;
@@ -576,7 +843,7 @@ int ExecutionStep::finishSubModel(const ModelBuilder* fromModel, bool* hasOutput
     // TODO: Move compilation elsewhere?
     VLOG(COMPILATION) << "ExecutionStep::finishSubModel, compilation on " << mDevice->getName();
     return compile(mDevice, &mSubModel, executionPreference, *mPlan->getCacheDir(), &mToken,
-                   &mPreparedSubModel);
+                   mPlan->getStatistics(), &mPreparedSubModel, &mCpuPreparedSubModel);
 }
 
 void ExecutionStep::dump() const {
@@ -612,8 +879,8 @@ int ExecutionPlan::SimpleBody::finish([[maybe_unused]] const ModelBuilder* fromM
                                       int32_t executionPreference) {
     nnAssert(mDevice != nullptr);
     VLOG(COMPILATION) << "ExecutionPlan::SimpleBody::finish, compilation";
-    const int n =
-            compile(mDevice, mModel, executionPreference, *mCacheDir, &mToken, &mPreparedModel);
+    const int n = compile(mDevice, mModel, executionPreference, *mCacheDir, &mToken, mStatistics,
+                          &mPreparedModel, &mCpuPreparedModel);
     mSuccessfulFinish = (n == ANEURALNETWORKS_NO_ERROR);
     return n;
 }
@@ -637,6 +904,11 @@ ExecutionPlan::Controller::Controller(
         if (mTemporaries.create(totalSizeOfTemporaries) != ANEURALNETWORKS_NO_ERROR) {
             LOG(ERROR) << "ExecutionPlan::Controller failed to allocate temporaries";
             mNextStepIndex = kBadStepIndex;
+        } else if (!executionBuilder->getMemoryAccount()->allocate(
+                           MemoryCategory::PARTITION_TEMPORARIES, totalSizeOfTemporaries)) {
+            // The temporaries are held until the execution completes, so
+            // the charge is never released.
+            mNextStepIndex = kBadStepIndex;
         }
     }
 }
@@ -680,6 +952,7 @@ std::vector<std::shared_ptr<ExecutionBurstController>> ExecutionPlan::makeBursts
 
 std::shared_ptr<ExecutionPlan::Controller> ExecutionPlan::makeController(
         ExecutionBuilder* executionBuilder, const BurstBuilder* burstBuilder) const {
+    NNTRACE_RT(NNTRACE_PHASE_EXECUTION, "ExecutionPlan::makeController");
     nnAssert(isValid());
 
     // Create the layout for a Memory object big enough for to hold
@@ -734,6 +1007,125 @@ std::shared_ptr<ExecutionPlan::Controller> ExecutionPlan::makeController(
                                                       totalSizeOfTemporaries));
 }
 
+// The steps run one after the other, so the CPU memory of the plan is the
+// largest of its steps; only the partition temporaries are held throughout.
+MemoryUsage ExecutionPlan::estimateMemoryUsage(const ModelBuilder* fromModel) const {
+    nnAssert(isValid());
+    MemoryUsage usage;
+    bool hasDriverStep = false;
+    auto addStep = [&usage, &hasDriverStep](const std::shared_ptr<Device>& device,
+                                            const ModelBuilder* model,
+                                            const CpuPreparedModel* cpuPreparedModel) {
+        if (device != DeviceManager::getCpuDevice()) {
+            hasDriverStep = true;
+            return;
+        }
+        MemoryUsage cpuUsage;
+        if (cpuPreparedModel != nullptr) {
+            cpuUsage = estimateCpuMemoryUsage(cpuPreparedModel->getModel());
+        } else {
+            Model hidlModel;
+            model->setHidlModel(&hidlModel);
+            cpuUsage = estimateCpuMemoryUsage(hidlModel);
+        }
+        for (uint32_t i = 0; i < kNumberOfMemoryCategories; i++) {
+            usage.bytes[i] = std::max(usage.bytes[i], cpuUsage.bytes[i]);
+        }
+    };
+
+    if (mState == COMPOUND) {
+        uint32_t totalSizeOfTemporaries = 0;
+        for (const auto& step : compound()->mSteps) {
+            addStep(step->getDevice(), step->getSubModel(), step->getCpuPreparedSubModel().get());
+            for (const auto& output : step->getTempsAsSubModelOutputs()) {
+                const uint32_t size =
+                        TypeManager::get()->getSizeOfData(fromModel->getOperand(output.first));
+                totalSizeOfTemporaries += alignBytesNeeded(totalSizeOfTemporaries, size);
+                totalSizeOfTemporaries += size;
+            }
+        }
+        usage[MemoryCategory::PARTITION_TEMPORARIES] = totalSizeOfTemporaries;
+    } else {
+        const SimpleBody* simpleBody = static_cast<const SimpleBody*>(mBody);
+        addStep(simpleBody->mDevice, simpleBody->mModel, simpleBody->mCpuPreparedModel.get());
+    }
+
+    if (hasDriverStep) {
+        uint64_t pointerArguments = 0;
+        for (uint32_t i = 0; i < fromModel->inputCount(); i++) {
+            pointerArguments += TypeManager::get()->getSizeOfData(fromModel->getInputOperand(i));
+        }
+        for (uint32_t i = 0; i < fromModel->outputCount(); i++) {
+            pointerArguments += TypeManager::get()->getSizeOfData(fromModel->getOutputOperand(i));
+        }
+        usage[MemoryCategory::POINTER_ARGUMENTS] = pointerArguments;
+    }
+    return usage;
+}
+
+std::shared_ptr<Device> ExecutionPlan::getArgumentDevice(uint32_t fromModelIndex) const {
+    nnAssert(isValid());
+    if (mState != COMPOUND) {
+        return static_cast<const SimpleBody*>(mBody)->mDevice;
+    }
+    auto uses = [fromModelIndex](const ExecutionStep::RemapVectorType& operands) {
+        return std::any_of(operands.begin(), operands.end(),
+                           [fromModelIndex](const std::pair<uint32_t, uint32_t>& operand) {
+                               return operand.first == fromModelIndex;
+                           });
+    };
+    std::shared_ptr<Device> device;
+    for (const auto& step : compound()->mSteps) {
+        if (!uses(step->getModelInputs()) && !uses(step->getModelOutputs()) &&
+            !uses(step->getOutputsAsSubModelInputs())) {
+            continue;
+        }
+        if (device != nullptr && device != step->getDevice()) {
+            return nullptr;
+        }
+        device = step->getDevice();
+    }
+    return device;
+}
+
+GraphDumpAnnotations ExecutionPlan::getGraphDumpAnnotations(
+        const ModelBuilder* fromModel, const std::vector<CpuOperationProfile>& profile) const {
+    nnAssert(isValid());
+    GraphDumpAnnotations annotations;
+    const uint32_t operationCount = fromModel->operationCount();
+    if (mState == COMPOUND) {
+        annotations.operationSteps.resize(operationCount, GraphDumpAnnotations::kNoStep);
+        for (const auto& step : compound()->mSteps) {
+            const uint32_t stepIndex = annotations.stepDevices.size();
+            annotations.stepDevices.push_back(step->getDevice()->getName());
+            for (uint32_t operationIndex : step->getOperationIndexes()) {
+                annotations.operationSteps[operationIndex] = stepIndex;
+            }
+        }
+    } else {
+        const SimpleBody* simpleBody = static_cast<const SimpleBody*>(mBody);
+        annotations.stepDevices.push_back(simpleBody->mDevice->getName());
+        annotations.operationSteps.resize(operationCount, 0);
+    }
+
+    if (!profile.empty()) {
+        // The profile refers to the operations in the order they were added,
+        // the Model to the operations in run order.
+        const std::vector<uint32_t>& sortedToOriginal = fromModel->getSortedOperationMapping();
+        std::vector<uint32_t> originalToSorted(operationCount);
+        for (uint32_t i = 0; i < operationCount; i++) {
+            originalToSorted[sortedToOriginal.empty() ? i : sortedToOriginal[i]] = i;
+        }
+        annotations.operationTimesNs.resize(operationCount, 0);
+        for (const CpuOperationProfile& entry : profile) {
+            if (entry.operationIndex < operationCount) {
+                annotations.operationTimesNs[originalToSorted[entry.operationIndex]] +=
+                        entry.durationNs;
+            }
+        }
+    }
+    return annotations;
+}
 
 // TODO: Find a better way to provide this functionality.
 int ExecutionPlan::fallback(std::shared_ptr<Controller> controller,
@@ -754,12 +1146,82 @@ int ExecutionPlan::fallback(std::shared_ptr<Controller> controller,
     }
 
     --controller->mNextStepIndex;
-    return next(controller, executor);
+    return nextImpl(controller, executor, /*burstController=*/nullptr, /*fallingBack=*/true);
+}
+
+bool CpuFallbackState::recordDeviceFailure() {
+    if (mConsecutiveDeviceFailures.fetch_add(1) + 1 < kDeviceFailuresBeforeDemotion) {
+        return false;
+    }
+    // Concurrent executions may reach the count more than once.
+    return !mDemoted.exchange(true);
+}
+
+std::shared_ptr<CpuPreparedModel> CpuFallbackState::getCpuPreparedModel(const ModelBuilder* model) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mCpuPreparedModel == nullptr) {
+        Model hidlModel;
+        model->setHidlModel(&hidlModel);
+        mCpuPreparedModel = CpuPreparedModel::create(std::move(hidlModel));
+    }
+    return mCpuPreparedModel;
+}
+
+bool ExecutionPlan::applyCpuFallback(Controller* controller, CpuFallbackState* cpuFallback,
+                                     uint32_t stepIndex, const ModelBuilder* model,
+                                     bool fallingBack, std::shared_ptr<Device>* device,
+                                     std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                                     std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) const {
+    const std::shared_ptr<Device> cpuDevice = DeviceManager::getCpuDevice();
+    if (*device == cpuDevice) {
+        // A failure on the CPU has nothing to fall back to but cpuFallbackFull.
+        controller->mLastStepDemoted = false;
+        controller->mLastStepCpuFallback = nullptr;
+        return false;
+    }
+    bool demoted;
+    if (fallingBack) {
+        controller->mLastStepCpuFallback = nullptr;
+        demoted = controller->mLastStepDemoted;
+        if (!demoted && cpuFallback->recordDeviceFailure()) {
+            LOG(WARNING) << "Step " << stepIndex << " failed "
+                         << CpuFallbackState::kDeviceFailuresBeforeDemotion << " times in a row on "
+                         << (*device)->getName() << ", running it on the CPU from now on";
+            if (mStatistics != nullptr) {
+                mStatistics->increment(CompilationStatistics::Counter::DEMOTED_STEPS);
+            }
+        }
+    } else {
+        demoted = cpuFallback->isDemoted();
+        controller->mLastStepDemoted = demoted;
+        controller->mLastStepCpuFallback = demoted ? nullptr : cpuFallback;
+    }
+    if (demoted) {
+        *device = cpuDevice;
+        *preparedModel = nullptr;
+    }
+    if (demoted || fallingBack) {
+        *cpuPreparedModel = cpuFallback->getCpuPreparedModel(model);
+    }
+    return demoted;
+}
+
+void ExecutionPlan::stepSucceeded(std::shared_ptr<Controller> controller) const {
+    if (controller->mLastStepCpuFallback != nullptr) {
+        controller->mLastStepCpuFallback->recordDeviceSuccess();
+    }
 }
 
 int ExecutionPlan::next(std::shared_ptr<Controller> controller,
                         std::shared_ptr<StepExecutor>* executor,
                         std::shared_ptr<ExecutionBurstController>* burstController) const {
+    return nextImpl(controller, executor, burstController, /*fallingBack=*/false);
+}
+
+int ExecutionPlan::nextImpl(std::shared_ptr<Controller> controller,
+                            std::shared_ptr<StepExecutor>* executor,
+                            std::shared_ptr<ExecutionBurstController>* burstController,
+                            bool fallingBack) const {
     *executor = nullptr;
     if (burstController != nullptr) {
         *burstController = nullptr;
@@ -783,11 +1245,18 @@ int ExecutionPlan::next(std::shared_ptr<Controller> controller,
         if (controller->mNextStepIndex == 0) {
             // First (and only) step.
             auto simpleBody = static_cast<const SimpleBody*>(mBody);
+            std::shared_ptr<Device> device = simpleBody->mDevice;
+            std::shared_ptr<VersionedIPreparedModel> preparedModel = simpleBody->mPreparedModel;
+            std::shared_ptr<CpuPreparedModel> cpuPreparedModel = simpleBody->mCpuPreparedModel;
+            const bool demoted = applyCpuFallback(controller.get(), &simpleBody->mCpuFallback,
+                                                  /*stepIndex=*/0, simpleBody->mModel,
+                                                  fallingBack, &device, &preparedModel,
+                                                  &cpuPreparedModel);
             *executor = std::make_shared<StepExecutor>(controller->mExecutionBuilder,
-                                                       simpleBody->mModel, simpleBody->mDevice,
-                                                       simpleBody->mPreparedModel);
+                                                       simpleBody->mModel, device, preparedModel,
+                                                       cpuPreparedModel);
             (*executor)->mapInputsAndOutputsTrivially();
-            if (burstController != nullptr && controller->mBurstBuilder != nullptr) {
+            if (burstController != nullptr && controller->mBurstBuilder != nullptr && !demoted) {
                 *burstController = controller->mBurstBuilder->getControllerAt(0);
             }
             controller->mNextStepIndex = 1;
@@ -813,11 +1282,17 @@ int ExecutionPlan::next(std::shared_ptr<Controller> controller,
     // ExecutionStep::finishSubModel() establishes these orderings.
 
     const auto step = compoundBody->mSteps[controller->mNextStepIndex];
+    std::shared_ptr<Device> device = step->getDevice();
+    std::shared_ptr<VersionedIPreparedModel> preparedModel = step->getPreparedSubModel();
+    std::shared_ptr<CpuPreparedModel> cpuPreparedModel = step->getCpuPreparedSubModel();
+    const bool demoted = applyCpuFallback(controller.get(), step->getCpuFallback(),
+                                          controller->mNextStepIndex, step->getSubModel(),
+                                          fallingBack, &device, &preparedModel, &cpuPreparedModel);
     *executor = std::make_shared<StepExecutor>(controller->mExecutionBuilder, step->getSubModel(),
-                                               step->getDevice(), step->getPreparedSubModel());
+                                               device, preparedModel, cpuPreparedModel);
     (*executor)->setExecutionStep(step);
     step->mapInputsAndOutputs(*executor);
-    if (burstController != nullptr && controller->mBurstBuilder != nullptr) {
+    if (burstController != nullptr && controller->mBurstBuilder != nullptr && !demoted) {
         *burstController = controller->mBurstBuilder->getControllerAt(controller->mNextStepIndex);
     }
     if (controller->mSubModelInputsAndOutputs != nullptr) {
@@ -896,7 +1371,7 @@ std::shared_ptr<ExecutionStep> ExecutionPlan::createNewStep(const std::shared_pt
 void ExecutionPlan::becomeSingleStep(const std::shared_ptr<Device> device,
                                      const ModelBuilder* model) {
     nnAssert(mState == EMPTY);
-    mBody = new SimpleBody(device, model, mCacheDir, mToken);
+    mBody = new SimpleBody(device, model, mCacheDir, mToken, mStatistics);
     mState = SIMPLE;
 }
 
@@ -972,11 +1447,68 @@ int ModelBuilder::partitionTheWork(const std::vector<std::shared_ptr<Device>>& d
     VLOG(COMPILATION) << "ModelBuilder::partitionTheWork: deviceCount = " << deviceCount
                       << ", operationCount = " << operationCount;
 
+    // Builds the plan from a partitioning computed below or read from the partitioning cache.
+    auto applyPartitioning = [this, &devices, preference, plan](const PartitioningSteps& steps) {
+        if (steps.size() == 1) {
+            plan->becomeSingleStep(devices[steps[0].first], this);
+        } else {
+            for (const auto& [deviceIndex, stepOperations] : steps) {
+                std::shared_ptr<ExecutionStep> step = plan->createNewStep(devices[deviceIndex]);
+                for (uint32_t operationIndex : stepOperations) {
+                    int n = step->addOperation(operationIndex, *this);
+                    if (n != ANEURALNETWORKS_NO_ERROR) {
+                        LOG(ERROR) << "failed to add operation " << operationIndex << " to step";
+                        return n;
+                    }
+                }
+            }
+        }
+        return plan->finish(this, preference);
+    };
+
+    // If a previous compilation of the same model with the same token recorded how it
+    // partitioned the model among the same devices, reuse that, skipping both the queries of the
+    // supported operations, which slice the model for each device, and the search for the best
+    // device of each operation. There is nothing to decide, and so nothing to record, with a
+    // single device, and nothing to check a record against without a fingerprint.
+    const uint8_t* fingerprint = getFingerprint();
+    ModelFingerprint modelFingerprint = {};
+    if (fingerprint != nullptr) {
+        memcpy(modelFingerprint.data(), fingerprint, sizeof(modelFingerprint));
+    }
+    const std::string partitioningCacheFile =
+            plan->getCacheToken() == nullptr || deviceCount == 1 || fingerprint == nullptr
+                    ? ""
+                    : getPartitioningCacheFileName(*plan->getCacheDir(), plan->getCacheToken(),
+                                                   devices, preference);
+    PartitioningSteps partitioning;
+    const bool partitioningCacheHit =
+            !partitioningCacheFile.empty() &&
+            readPartitioningFromCache(partitioningCacheFile, deviceCount, this, modelFingerprint,
+                                      &partitioning);
+    if (!partitioningCacheFile.empty() && plan->getStatistics() != nullptr) {
+        plan->getStatistics()->increment(
+                partitioningCacheHit ? CompilationStatistics::Counter::PARTITIONING_CACHE_HITS
+                                     : CompilationStatistics::Counter::PARTITIONING_CACHE_MISSES);
+    }
+    if (partitioningCacheHit) {
+        VLOG(COMPILATION) << "ModelBuilder::partitionTheWork: using cached partitioning with "
+                          << partitioning.size() << " step(s)";
+        if (applyPartitioning(partitioning) == ANEURALNETWORKS_NO_ERROR) {
+            return ANEURALNETWORKS_NO_ERROR;
+        }
+        VLOG(COMPILATION) << "ModelBuilder::partitionTheWork: cached partitioning failed";
+        plan->reset();
+    }
+    partitioning.clear();
+
     // Figure out where each operation will best execute.
     // The value of the vector is the index in the devices vector.
+    const std::vector<hidl_vec<bool>> supportedOperations =
+            getSupportedOperationsByDevice(devices);
     std::vector<int> bestDeviceForOperation(operationCount);
-    NN_RETURN_IF_ERROR(
-            findBestDeviceForEachOperation(preference, devices, &bestDeviceForOperation));
+    NN_RETURN_IF_ERROR(findBestDeviceForEachOperation(preference, devices, supportedOperations,
+                                                      &bestDeviceForOperation));
 
     // If one device will run all the operations, we don't need to split the work.
     if (std::adjacent_find(bestDeviceForOperation.begin(), bestDeviceForOperation.end(),
@@ -984,8 +1516,15 @@ int ModelBuilder::partitionTheWork(const std::vector<std::shared_ptr<Device>>& d
         const int bestDeviceIndex = bestDeviceForOperation[0];
         VLOG(COMPILATION) << "ModelBuilder::partitionTheWork: only one best device: "
                           << bestDeviceIndex << " = " << devices[bestDeviceIndex]->getName();
-        plan->becomeSingleStep(devices[bestDeviceIndex], this);
-        return plan->finish(this, preference);
+        std::vector<uint32_t> allOperations(operationCount);
+        std::iota(allOperations.begin(), allOperations.end(), 0u);
+        partitioning.emplace_back(bestDeviceIndex, std::move(allOperations));
+        int n = applyPartitioning(partitioning);
+        if (n == ANEURALNETWORKS_NO_ERROR && !partitioningCacheFile.empty()) {
+            writePartitioningToCache(partitioningCacheFile, this, modelFingerprint,
+                                     partitioning);
+        }
+        return n;
     }
 
     // No easy solution, we need to split the work.
@@ -1016,7 +1555,7 @@ int ModelBuilder::partitionTheWork(const std::vector<std::shared_ptr<Device>>& d
     };
 
     OperandTracker tracker(this, enqueueOnAppropriateDevice);
-    // For each iteration of this loop, we'll create an execution step.
+    // For each iteration of this loop, we'll decide on an execution step.
     while (true) {
         // Find the device we'll do this step for.
         int deviceIndex = findNextDeviceToProcess();
@@ -1026,21 +1565,22 @@ int ModelBuilder::partitionTheWork(const std::vector<std::shared_ptr<Device>>& d
         }
 
         // Assign as much as possible to this device.
-        std::shared_ptr<ExecutionStep> step = plan->createNewStep(devices[deviceIndex]);
+        std::vector<uint32_t> stepOperations;
         auto& queue = perDeviceQueue[deviceIndex];
         while (!queue.empty()) {
             uint32_t operationIndex = queue.front();
             queue.pop();
-            int n = step->addOperation(operationIndex, *this);
-            if (n != ANEURALNETWORKS_NO_ERROR) {
-                LOG(ERROR) << "failed to add operation " << operationIndex << " to step";
-                return n;
-            }
+            stepOperations.push_back(operationIndex);
             tracker.markProcessed(operationIndex, enqueueOnAppropriateDevice);
         }
+        partitioning.emplace_back(deviceIndex, std::move(stepOperations));
     }
 
-    int n = plan->finish(this, preference);
+    int n = applyPartitioning(partitioning);
+    if (n == ANEURALNETWORKS_NO_ERROR && !partitioningCacheFile.empty()) {
+        writePartitioningToCache(partitioningCacheFile, this, modelFingerprint,
+                                 partitioning);
+    }
     if (VLOG_IS_ON(COMPILATION)) {
         Model model;
         setHidlModel(&model);
@@ -1080,18 +1620,22 @@ namespace {
 
 // Add an element to the end of the vector and return a pair consisting of the
 // index of the new element and a pointer to the new element.
+//
+// This takes a std::vector rather than a hidl_vec: hidl_vec::resize()
+// reallocates on every call, which made building a slice quadratic in the size
+// of the model.
 template <class T>
-std::pair<uint32_t, T*> extend(hidl_vec<T>* vec) {
+std::pair<uint32_t, T*> extend(std::vector<T>* vec) {
     size_t nextIndex = vec->size();
-    vec->resize(nextIndex + 1);
-    return {nextIndex, &(*vec)[nextIndex]};
+    vec->emplace_back();
+    return {nextIndex, &vec->back()};
 }
 
 // Add an element to the end of the vector, set it to the specified value, and
 // return a pair consisting of the index of the new element and a pointer to the
 // new element.
 template <class T>
-std::pair<uint32_t, T*> extend(hidl_vec<T>* vec, const T& val) {
+std::pair<uint32_t, T*> extend(std::vector<T>* vec, const T& val) {
     auto extended = extend(vec);
     *extended.second = val;
     return extended;
@@ -1253,16 +1797,27 @@ void PlanModelSlicer::initializeSlice(Slice<T_SlicedModel>* slice) {
 
     const auto& origOperands = mHidlModel.operands;
     const auto& origOperations = mHidlModel.operations;
-    auto& slicedOperands = slice->mHidlModel.operands;
-    auto& slicedOperations = slice->mHidlModel.operations;
+    // The slice is built in std::vectors, and copied into slice->mHidlModel
+    // once complete (see extend()).
+    std::vector<SlicedOperand> slicedOperands;
+    std::vector<SlicedOperation> slicedOperations;
+    std::vector<uint32_t> slicedInputIndexes;
+    std::vector<uint32_t> slicedOutputIndexes;
 
     // Indexes of elements of noncompliant origOperations
-    std::set<uint32_t> noncompliantOperations;
-    getNoncompliantOperations<T_SlicedModel>(mHidlModel, &noncompliantOperations);
+    std::vector<bool> isNoncompliantOperation(origOperations.size(), false);
+    {
+        std::set<uint32_t> noncompliantOperations;
+        getNoncompliantOperations<T_SlicedModel>(mHidlModel, &noncompliantOperations);
+        for (uint32_t origOperationIndex : noncompliantOperations) {
+            isNoncompliantOperation[origOperationIndex] = true;
+        }
+    }
 
     // Map from an operand index in origOperands to the corresponding operand index in
-    // slicedOperands
-    std::map<uint32_t, uint32_t> origOperandIndexToSlicedIndex;
+    // slicedOperands, or kNoSlicedIndex if there is none (yet)
+    constexpr uint32_t kNoSlicedIndex = ~uint32_t(0);
+    std::vector<uint32_t> origOperandIndexToSlicedIndex(origOperands.size(), kNoSlicedIndex);
 
     // Collect the operand indexes of every operand that is an input to a
     // compliant operation.  If the operand is a CONSTANT_* or a NO_VALUE, copy
@@ -1270,14 +1825,15 @@ void PlanModelSlicer::initializeSlice(Slice<T_SlicedModel>* slice) {
     // accordingly.  Otherwise, we'll deal with the operand in the subsequent
     // "Main loop", where we process operation outputs (intermediates and model
     // outputs).
-    std::set<uint32_t> inputOperandIndexesOfCompliantOperations;
+    std::vector<bool> isInputOperandOfCompliantOperation(origOperands.size(), false);
     for (uint32_t origOperationIndex = 0; origOperationIndex < origOperations.size();
          ++origOperationIndex) {
-        if (noncompliantOperations.count(origOperationIndex)) {
+        if (isNoncompliantOperation[origOperationIndex]) {
             continue;
         }
         for (uint32_t input : origOperations[origOperationIndex].inputs) {
-            if (inputOperandIndexesOfCompliantOperations.insert(input).second) {
+            if (!isInputOperandOfCompliantOperation[input]) {
+                isInputOperandOfCompliantOperation[input] = true;
                 const Operand& origOperand = origOperands[input];
                 switch (origOperand.lifetime) {
                     case OperandLifeTime::CONSTANT_COPY:
@@ -1327,8 +1883,8 @@ void PlanModelSlicer::initializeSlice(Slice<T_SlicedModel>* slice) {
     // operands and/or with original model temporary operands.
     class OrigOperandToSlicedInputOperandIndex {
        public:
-        OrigOperandToSlicedInputOperandIndex(hidl_vec<SlicedOperand>* slicedOperands,
-                                             hidl_vec<uint32_t>* slicedInputIndexes)
+        OrigOperandToSlicedInputOperandIndex(std::vector<SlicedOperand>* slicedOperands,
+                                             std::vector<uint32_t>* slicedInputIndexes)
             : mSlicedOperands(*slicedOperands), mSlicedInputIndexes(*slicedInputIndexes) {}
 
         // Given an operand from the original model, return the index of the
@@ -1406,16 +1962,16 @@ void PlanModelSlicer::initializeSlice(Slice<T_SlicedModel>* slice) {
             }
         };
         std::map<Operand, uint32_t, Compare> mMap;
-        hidl_vec<SlicedOperand>& mSlicedOperands;
-        hidl_vec<uint32_t>& mSlicedInputIndexes;
-    } origOperandToSlicedInputOperandIndex(&slicedOperands, &slice->mHidlModel.inputIndexes);
+        std::vector<SlicedOperand>& mSlicedOperands;
+        std::vector<uint32_t>& mSlicedInputIndexes;
+    } origOperandToSlicedInputOperandIndex(&slicedOperands, &slicedInputIndexes);
 
     // An input of the original model is an input of the sliced model if and
     // only if it is consumed by at least one compliant operation.  Note that in
     // the sliced model we share all model inputs of the same "type"; and that
     // we may later add model inputs to the sliced model.
     for (uint32_t origInputIndex : mHidlModel.inputIndexes) {
-        if (inputOperandIndexesOfCompliantOperations.count(origInputIndex)) {
+        if (isInputOperandOfCompliantOperation[origInputIndex]) {
             const uint32_t slicedIndex =
                     origOperandToSlicedInputOperandIndex.getIndex(origOperands[origInputIndex]);
             origOperandIndexToSlicedIndex[origInputIndex] = slicedIndex;
@@ -1430,9 +1986,9 @@ void PlanModelSlicer::initializeSlice(Slice<T_SlicedModel>* slice) {
          ++origOperationIndex) {
         const Operation& origOperation = origOperations[origOperationIndex];
 
-        if (noncompliantOperations.count(origOperationIndex)) {
+        if (isNoncompliantOperation[origOperationIndex]) {
             for (uint32_t output : origOperation.outputs) {
-                if (!inputOperandIndexesOfCompliantOperations.count(output)) {
+                if (!isInputOperandOfCompliantOperation[output]) {
                     continue;
                 }
                 const uint32_t slicedIndex =
@@ -1462,7 +2018,8 @@ void PlanModelSlicer::initializeSlice(Slice<T_SlicedModel>* slice) {
                     slicedOperation.inputs.begin(),
                     [&origOperandIndexToSlicedIndex, &slicedOperands](uint32_t origOperandIndex) {
                         uint32_t slicedOperandIndex =
-                                origOperandIndexToSlicedIndex.at(origOperandIndex);
+                                origOperandIndexToSlicedIndex[origOperandIndex];
+                        CHECK(slicedOperandIndex != kNoSlicedIndex);
                         slicedOperands[slicedOperandIndex].numberOfConsumers++;
                         VLOG(COMPILATION) << "origOperandIndexToSlicedIndex compliant input "
                                              "processing created "
@@ -1487,11 +2044,11 @@ void PlanModelSlicer::initializeSlice(Slice<T_SlicedModel>* slice) {
                 slicedOperand = convertTo<SlicedOperand>(origOperand);
                 slicedOperand.numberOfConsumers = 0;
 
-                CHECK(origOperandIndexToSlicedIndex.count(origOperandIndex) == 0);
+                CHECK(origOperandIndexToSlicedIndex[origOperandIndex] == kNoSlicedIndex);
                 origOperandIndexToSlicedIndex[origOperandIndex] = slicedOperandIndex;
                 slicedOperation.outputs[outputNum] = slicedOperandIndex;
 
-                if (!inputOperandIndexesOfCompliantOperations.count(origOperandIndex) &&
+                if (!isInputOperandOfCompliantOperation[origOperandIndex] &&
                     origOperand.numberOfConsumers) {
                     // Was consumed only by noncompliant operations; convert to
                     // an output of the sliced model.
@@ -1503,12 +2060,17 @@ void PlanModelSlicer::initializeSlice(Slice<T_SlicedModel>* slice) {
                                   << toString(slicedOperand);
 
                 if (slicedOperand.lifetime == OperandLifeTime::MODEL_OUTPUT) {
-                    extend(&slice->mHidlModel.outputIndexes, slicedOperandIndex);
+                    extend(&slicedOutputIndexes, slicedOperandIndex);
                 }
             }
         }
     }
 
+    slice->mHidlModel.operands = slicedOperands;
+    slice->mHidlModel.operations = slicedOperations;
+    slice->mHidlModel.inputIndexes = slicedInputIndexes;
+    slice->mHidlModel.outputIndexes = slicedOutputIndexes;
+
     // To keep things simple, we copy over these fields as-is.  We could instead
     // opt to regenerate them based on the operands present in the sliced model:
     // This would be more complex and probably take more computation time, but
@@ -1556,23 +2118,42 @@ public:
 
     bool check(size_t operationIndex) const { return mSupportsOperationByIndex[operationIndex]; }
 
+    const hidl_vec<bool>& getSupportedOperations() const { return mSupportsOperationByIndex; }
+
 private:
     hidl_vec<bool> mSupportsOperationByIndex;
 };
 
 };  // anonymous namespace
 
-int ModelBuilder::findBestDeviceForEachOperation(
-        uint32_t preference, const std::vector<std::shared_ptr<Device>>& devices,
-        std::vector<int>* bestDeviceForOperation) const {
+std::vector<hidl_vec<bool>> ModelBuilder::getSupportedOperationsByDevice(
+        const std::vector<std::shared_ptr<Device>>& devices) const {
     PlanModelSlicer slicer(this);
     const size_t deviceCount = devices.size();
-    std::vector<CanDo> canDo(deviceCount);
+    std::vector<hidl_vec<bool>> supportedOperations(deviceCount);
     for (size_t deviceIndex = 0; deviceIndex < deviceCount; deviceIndex++) {
+        CanDo canDo;
         /// M: NeuroPilot Performance @{
-        canDo[deviceIndex].initializeExt(&slicer, devices[deviceIndex], this);
+        canDo.initializeExt(&slicer, devices[deviceIndex], this);
         /// M: NeuroPilot Performance @}
+        supportedOperations[deviceIndex] = canDo.getSupportedOperations();
     }
+    return supportedOperations;
+}
+
+int ModelBuilder::findBestDeviceForEachOperation(
+        uint32_t preference, const std::vector<std::shared_ptr<Device>>& devices,
+        std::vector<int>* bestDeviceForOperation) const {
+    return findBestDeviceForEachOperation(preference, devices,
+                                          getSupportedOperationsByDevice(devices),
+                                          bestDeviceForOperation);
+}
+
+int ModelBuilder::findBestDeviceForEachOperation(
+        uint32_t preference, const std::vector<std::shared_ptr<Device>>& devices,
+        const std::vector<hidl_vec<bool>>& supportedOperations,
+        std::vector<int>* bestDeviceForOperation) const {
+    const size_t deviceCount = devices.size();
 
     // Figure out the best driver for each operation.
     const size_t operationCount = mOperations.size();
@@ -1582,7 +2163,7 @@ int ModelBuilder::findBestDeviceForEachOperation(
         float bestPerfVal = 0.0;  // Do not check bestPerfVal if bestChoice < 0.
         for (size_t deviceIndex = 0; deviceIndex < deviceCount; deviceIndex++) {
             const auto& device = devices[deviceIndex];
-            if (canDo[deviceIndex].check(operationIndex)) {
+            if (supportedOperations[deviceIndex][operationIndex]) {
                 const PerformanceInfo perf = getPerformanceInfo(device, operationIndex);
                 const float perfVal =
                             (preference == ANEURALNETWORKS_PREFER_LOW_POWER ? perf.powerUsage
@@ -19,8 +19,11 @@
 #ifndef ANDROID_ML_NN_RUNTIME_EXECUTION_PLAN_H
 #define ANDROID_ML_NN_RUNTIME_EXECUTION_PLAN_H
 
+#include "CpuExecutor.h"
+#include "GraphDump.h"
 #include "HalInterfaces.h"
 #include "Memory.h"
+#include "MemoryAccounting.h"
 #include "ModelBuilder.h"
 #include "NeuralNetworks.h"
 #include "TokenHasher.h"
@@ -29,6 +32,8 @@
 
 #include <openssl/sha.h>
 
+#include <atomic>
+#include <mutex>
 #include <set>
 #include <string>
 
@@ -37,6 +42,8 @@ namespace nn {
 
 class BurstBuilder;
 class CompilationBuilder;
+class CompilationStatistics;
+class CpuPreparedModel;
 class Device;
 class ExecutionBuilder;
 class ExecutionPlan;
@@ -44,6 +51,40 @@ class ExecutionBurstController;
 class Memory;
 class StepExecutor;
 
+// How one step of an execution plan (or the model of a plan with a single
+// step) falls back to the CPU when its device fails.
+//
+// Each failure retries the step on the CPU with a model prepared for the CPU
+// on the first failure and kept for the later ones. After
+// kDeviceFailuresBeforeDemotion consecutive failures, with no success on the
+// device in between, the step is demoted: the executions that follow run it
+// on the CPU directly, without trying its device first.
+//
+// Executions of a compilation may run concurrently, so this is thread-safe.
+class CpuFallbackState {
+   public:
+    static constexpr uint32_t kDeviceFailuresBeforeDemotion = 3;
+
+    bool isDemoted() const { return mDemoted.load(); }
+
+    // Records a failure of the step on its device. Returns true if this
+    // failure demoted the step.
+    bool recordDeviceFailure();
+    // Records a success of the step on its device, which starts the count of
+    // consecutive failures over.
+    void recordDeviceSuccess() { mConsecutiveDeviceFailures = 0; }
+
+    // Returns the model prepared for the CPU, preparing it on first use, or
+    // nullptr if it can't be prepared.
+    std::shared_ptr<CpuPreparedModel> getCpuPreparedModel(const ModelBuilder* model);
+
+   private:
+    std::atomic<uint32_t> mConsecutiveDeviceFailures{0};
+    std::atomic<bool> mDemoted{false};
+    std::mutex mMutex;
+    std::shared_ptr<CpuPreparedModel> mCpuPreparedModel;  // guarded by mMutex
+};
+
 class ExecutionStep {
 public:
     typedef std::vector<std::pair<uint32_t, uint32_t>> RemapVectorType;
@@ -78,6 +119,8 @@ public:
     const std::vector<uint32_t>& getOutputsAsSubModelInputsIndexToFromModel() const {
         return mOutputsAsSubModelInputsIndexToFromModel;
     }
+    // Converts operation indexes from the submodel to the main model.
+    const std::vector<uint32_t>& getOperationIndexes() const { return mOperationIndexes; }
 
     void recordTempAsSubModelOutput(uint32_t fromModelIndex) {
         const auto it = mOperandMap.find(fromModelIndex);
@@ -98,6 +141,10 @@ public:
     std::shared_ptr<VersionedIPreparedModel> getPreparedSubModel() const {
         return mPreparedSubModel;
     }
+    std::shared_ptr<CpuPreparedModel> getCpuPreparedSubModel() const {
+        return mCpuPreparedSubModel;
+    }
+    CpuFallbackState* getCpuFallback() const { return &mCpuFallback; }
 
     // Map inputs and outputs from ExecutionBuilder to StepExecutor.
     void mapInputsAndOutputs(std::shared_ptr<StepExecutor> stepExecutor) const;
@@ -119,6 +166,8 @@ public:
     ModelBuilder mSubModel;
     std::shared_ptr<Device> mDevice;
     std::shared_ptr<VersionedIPreparedModel> mPreparedSubModel;  // not used for CPU
+    std::shared_ptr<CpuPreparedModel> mCpuPreparedSubModel;      // only used for CPU
+    mutable CpuFallbackState mCpuFallback;
 
     // Inputs of original model that are also inputs of this submodel:
     //     (fromModel index, subModel index)
@@ -137,6 +186,9 @@ public:
     RemapVectorType mOutputsAsSubModelInputs;
     // Converts operand indexes from the main model to the submodel.
     std::unordered_map<uint32_t, uint32_t> mOperandMap;
+    // The main model operations that make up this submodel, in the order
+    // they were added.
+    std::vector<uint32_t> mOperationIndexes;
     // Converts input indexes from the submodel to the main model
     // (these are input indexes, not operand indexes).  This vector
     // only describes inputs of the submodel that are also inputs of
@@ -208,6 +260,12 @@ public:
         std::shared_ptr<const SubModelInputsAndOutputsType> mSubModelInputsAndOutputs;  // may be nullptr
         Memory mTemporaries;
         size_t mNextStepIndex;
+        // Whether the executor last created by next() runs a demoted step
+        // on the CPU, so that fallback() can create the same one.
+        bool mLastStepDemoted = false;
+        // The fallback state of the step of the executor last created by
+        // next(), or nullptr if that executor runs on the CPU.
+        CpuFallbackState* mLastStepCpuFallback = nullptr;
     };
 
     std::vector<std::shared_ptr<ExecutionBurstController>> makeBursts() const;
@@ -215,12 +273,36 @@ public:
     std::shared_ptr<Controller> makeController(ExecutionBuilder* executionBuilder,
                                                const BurstBuilder* burstBuilder) const;
 
+    // See CompilationBuilder::getMemoryEstimate().
+    MemoryUsage estimateMemoryUsage(const ModelBuilder* fromModel) const;
+
+    // Describes, for graphDump(), the device and step each operation of
+    // fromModel was assigned to and, from profile (see
+    // ExecutionBuilder::getCpuProfile()), how long it ran on the CPU.
+    // Operation indexes refer to the Model produced by
+    // fromModel->setHidlModel().
+    GraphDumpAnnotations getGraphDumpAnnotations(
+            const ModelBuilder* fromModel, const std::vector<CpuOperationProfile>& profile) const;
+
+    // Returns the device of the steps that read or write the operand at
+    // fromModelIndex, an input or output of the main model, or nullptr if
+    // they don't all run on the same device.
+    std::shared_ptr<Device> getArgumentDevice(uint32_t fromModelIndex) const;
+
     int next(std::shared_ptr<Controller> controller, std::shared_ptr<StepExecutor>* executor,
              std::shared_ptr<ExecutionBurstController>* burstController = nullptr) const;
 
-    // Create the same executor as the last one created by next().
+    // Create the same executor as the last one created by next(), after it
+    // failed. If it ran on the device of its step, the failure counts toward
+    // demoting the step (see CpuFallbackState), and the executor carries the
+    // model prepared for running the step on the CPU instead.
     int fallback(std::shared_ptr<Controller> controller, std::shared_ptr<StepExecutor>* executor) const;
 
+    // Records that the executor last created by next() succeeded. If it ran
+    // on the device of its step, the failures of the step on that device
+    // are no longer consecutive (see CpuFallbackState).
+    void stepSucceeded(std::shared_ptr<Controller> controller) const;
+
     std::shared_ptr<ExecutionStep> createNewStep(const std::shared_ptr<Device> device);
 
     void becomeSingleStep(const std::shared_ptr<Device> device, const ModelBuilder* model);
@@ -252,6 +334,10 @@ public:
     const std::string* getCacheDir() const { return mCacheDir; }
     const uint8_t* getCacheToken() const { return mToken; }
 
+    // Where the cache lookups of the compilation are counted.
+    void setStatistics(CompilationStatistics* statistics) { mStatistics = statistics; }
+    CompilationStatistics* getStatistics() const { return mStatistics; }
+
     // These functions are solely intended for use by unit tests of
     // the partitioning algorithm.
     enum class Kind { ERROR, EMPTY, SIMPLE, COMPOUND };
@@ -264,6 +350,21 @@ public:
    private:
     void findTempsAsSubModelOutputs();
 
+    // Implements next() and, with fallingBack, fallback().
+    int nextImpl(std::shared_ptr<Controller> controller, std::shared_ptr<StepExecutor>* executor,
+                 std::shared_ptr<ExecutionBurstController>* burstController,
+                 bool fallingBack) const;
+
+    // Chooses where the executor of a step runs, according to cpuFallback;
+    // see fallback(). Updates *device, *preparedModel and *cpuPreparedModel,
+    // which are initially those of the step. Returns true if the step runs
+    // on the CPU because it was demoted.
+    bool applyCpuFallback(Controller* controller, CpuFallbackState* cpuFallback, uint32_t stepIndex,
+                          const ModelBuilder* model, bool fallingBack,
+                          std::shared_ptr<Device>* device,
+                          std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                          std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) const;
+
     struct Body {
         virtual ~Body() {}
         virtual void dump() const = 0;
@@ -274,8 +375,13 @@ public:
 
     struct SimpleBody : Body {
         SimpleBody(std::shared_ptr<Device> device, const ModelBuilder* model,
-                   const std::string* cacheDir, const uint8_t* token)
-            : mDevice(device), mModel(model), mCacheDir(cacheDir), mToken(token) {}
+                   const std::string* cacheDir, const uint8_t* token,
+                   CompilationStatistics* statistics)
+            : mDevice(device),
+              mModel(model),
+              mCacheDir(cacheDir),
+              mToken(token),
+              mStatistics(statistics) {}
 
         void dump() const override;
         int finish(const ModelBuilder* fromModel, int32_t executionPreference) override;
@@ -284,9 +390,12 @@ public:
         std::shared_ptr<Device> mDevice;
         const ModelBuilder* mModel;
         std::shared_ptr<VersionedIPreparedModel> mPreparedModel;  // not used for CPU
+        std::shared_ptr<CpuPreparedModel> mCpuPreparedModel;      // only used for CPU
+        mutable CpuFallbackState mCpuFallback;
 
         const std::string* mCacheDir;
         TokenHasher mToken;
+        CompilationStatistics* mStatistics;
     };
 
     struct CompoundBody : Body {
@@ -325,6 +434,9 @@ public:
     // Pointers to compilation caching information in CompilationBuilder.
     const std::string* mCacheDir = nullptr;
     const uint8_t* mToken = nullptr;
+
+    // Pointer to the statistics in CompilationBuilder, may be nullptr.
+    CompilationStatistics* mStatistics = nullptr;
 };
 
 }  // namespace nn
@@ -19,7 +19,10 @@
 #include "Manager.h"
 #include "Callbacks.h"
 #include "HalInterfaces.h"
+#include "Memory.h"
+#include "ModelCache.h"
 #include "Tracing.h"
+#include "TypeManager.h"
 #include "Utils.h"
 
 #include <android/hidl/manager/1.0/IServiceManager.h>
@@ -42,6 +45,16 @@ bool Device::isCachingSupported() const {
     return pair.first > 0 || pair.second > 0;
 }
 
+static int allocateSharedMemoryObject(uint32_t size, std::unique_ptr<Memory>* memory) {
+    auto m = std::make_unique<Memory>();
+    const int n = m->create(size);
+    if (n != ANEURALNETWORKS_NO_ERROR) {
+        return n;
+    }
+    *memory = std::move(m);
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
 // A Device with actual underlying driver
 class DriverDevice : public Device {
     DISALLOW_IMPLICIT_CONSTRUCTORS(DriverDevice);
@@ -74,10 +87,13 @@ class DriverDevice : public Device {
     int prepareModel(const Model& hidlModel, ExecutionPreference executionPreference,
                      const hidl_vec<hidl_handle>& modelCache,
                      const hidl_vec<hidl_handle>& dataCache, const HidlToken& token,
-                     std::shared_ptr<VersionedIPreparedModel>* preparedModel) override;
+                     std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                     std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) override;
     int prepareModelFromCache(const hidl_vec<hidl_handle>& modelCache,
                               const hidl_vec<hidl_handle>& dataCache, const HidlToken& token,
-                              std::shared_ptr<VersionedIPreparedModel>* preparedModel) override;
+                              std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                              std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) override;
+    int allocateMemory(uint32_t size, std::unique_ptr<Memory>* memory) override;
 
    private:
     std::string mName;
@@ -249,9 +265,11 @@ static int prepareModelCheck(ErrorStatus status,
 int DriverDevice::prepareModel(const Model& hidlModel, ExecutionPreference executionPreference,
                                const hidl_vec<hidl_handle>& modelCache,
                                const hidl_vec<hidl_handle>& dataCache, const HidlToken& token,
-                               std::shared_ptr<VersionedIPreparedModel>* preparedModel) {
+                               std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                               std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) {
     // Note that some work within VersionedIDevice will be subtracted from the IPC layer
     NNTRACE_FULL(NNTRACE_LAYER_IPC, NNTRACE_PHASE_COMPILATION, "prepareModel");
+    *cpuPreparedModel = nullptr;
 
     const auto [status, localPreparedModel] =
             mInterface->prepareModel(hidlModel, executionPreference, modelCache, dataCache, token);
@@ -262,9 +280,11 @@ int DriverDevice::prepareModel(const Model& hidlModel, ExecutionPreference execu
 int DriverDevice::prepareModelFromCache(const hidl_vec<hidl_handle>& modelCache,
                                         const hidl_vec<hidl_handle>& dataCache,
                                         const HidlToken& token,
-                                        std::shared_ptr<VersionedIPreparedModel>* preparedModel) {
+                                        std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                                        std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) {
     // Note that some work within VersionedIDevice will be subtracted from the IPC layer
     NNTRACE_FULL(NNTRACE_LAYER_IPC, NNTRACE_PHASE_COMPILATION, "prepareModelFromCache");
+    *cpuPreparedModel = nullptr;
 
     const auto [status, localPreparedModel] =
             mInterface->prepareModelFromCache(modelCache, dataCache, token);
@@ -273,6 +293,26 @@ int DriverDevice::prepareModelFromCache(const hidl_vec<hidl_handle>& modelCache,
                              preparedModel);
 }
 
+// Drivers of HAL 1.2 and later accept BLOB mode AHardwareBuffers as memory
+// pools. The usage flags let the allocator place the buffer where accelerators
+// reach it best, as the CPU rarely accesses it. If the allocator can't, or for
+// older drivers, the memory is plain shared memory.
+int DriverDevice::allocateMemory(uint32_t size, std::unique_ptr<Memory>* memory) {
+    constexpr uint64_t kUsage = AHARDWAREBUFFER_USAGE_CPU_READ_RARELY |
+                                AHARDWAREBUFFER_USAGE_CPU_WRITE_RARELY |
+                                AHARDWAREBUFFER_USAGE_GPU_DATA_BUFFER;
+    if (getFeatureLevel() >= __ANDROID_API_Q__) {
+        auto m = std::make_unique<MemoryAHWBAllocated>();
+        if (m->allocate(size, kUsage) == ANEURALNETWORKS_NO_ERROR) {
+            *memory = std::move(m);
+            return ANEURALNETWORKS_NO_ERROR;
+        }
+        VLOG(MANAGER) << getName() << ": no AHardwareBuffer of " << size
+                      << " bytes, using shared memory";
+    }
+    return allocateSharedMemoryObject(size, memory);
+}
+
 // A special abstracted device for the CPU. Only one instance of this class will exist.
 // Use get() to retrieve it.
 class CpuDevice : public Device {
@@ -306,14 +346,14 @@ class CpuDevice : public Device {
 
     int prepareModel(const Model& hidlModel, ExecutionPreference executionPreference,
                      const hidl_vec<hidl_handle>& modelCache,
-                     const hidl_vec<hidl_handle>& dataCache, const HidlToken&,
-                     std::shared_ptr<VersionedIPreparedModel>* preparedModel) override;
-    int prepareModelFromCache(const hidl_vec<hidl_handle>&, const hidl_vec<hidl_handle>&,
-                              const HidlToken&,
-                              std::shared_ptr<VersionedIPreparedModel>*) override {
-        CHECK(false) << "Should never call prepareModelFromCache on CpuDevice";
-        return ANEURALNETWORKS_OP_FAILED;
-    }
+                     const hidl_vec<hidl_handle>& dataCache, const HidlToken& token,
+                     std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                     std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) override;
+    int prepareModelFromCache(const hidl_vec<hidl_handle>& modelCache,
+                              const hidl_vec<hidl_handle>& dataCache, const HidlToken& token,
+                              std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                              std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) override;
+    int allocateMemory(uint32_t size, std::unique_ptr<Memory>* memory) override;
 
    private:
     CpuDevice() = default;
@@ -323,9 +363,10 @@ class CpuDevice : public Device {
     // Since the performance is a ratio compared to the CPU performance,
     // by definition the performance of the CPU is 1.0.
     const PerformanceInfo kPerformance = {.execTime = 1.0f, .powerUsage = 1.0f};
-    // CPU device does not support compilation caching.
-    const std::pair<uint32_t, uint32_t> kNumCacheFiles = {/*numModelCache=*/0,
-                                                          /*numDataCache=*/0};
+    // The CPU device caches the HIDL model in one file and its constant pools in another;
+    // see ModelCache.h.
+    const std::pair<uint32_t, uint32_t> kNumCacheFiles = {/*numModelCache=*/1,
+                                                          /*numDataCache=*/1};
 };
 
 void CpuDevice::getSupportedOperations(const Model& hidlModel, IModelSlicer*,
@@ -336,26 +377,76 @@ void CpuDevice::getSupportedOperations(const Model& hidlModel, IModelSlicer*,
         // TODO(b/119870033): Decide whether and how post-P operations would be supported on CPU.
         //                    We may want to use the slicer for CpuDevice just as we do for
         //                    DriverDevice.
-        OperationType operationType = hidlModel.operations[i].type;
-        result[i] = !isExtensionOperationType(operationType) &&
-                    operationType != OperationType::OEM_OPERATION;
+        const Operation& operation = hidlModel.operations[i];
+        result[i] = isExtensionOperationType(operation.type)
+                            ? TypeManager::get()->isCpuOperationSupported(
+                                      operation, hidlModel.operands.data())
+                            : operation.type != OperationType::OEM_OPERATION;
     }
     *supportedOperations = std::move(result);
 }
 
 int CpuDevice::prepareModel(const Model& hidlModel, ExecutionPreference executionPreference,
                             const hidl_vec<hidl_handle>& modelCache,
-                            const hidl_vec<hidl_handle>& dataCache, const HidlToken&,
-                            std::shared_ptr<VersionedIPreparedModel>* preparedModel) {
-    CHECK(modelCache.size() == 0 && dataCache.size() == 0)
-            << "Should never call prepareModel with cache information on CpuDevice";
+                            const hidl_vec<hidl_handle>& dataCache, const HidlToken& token,
+                            std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                            std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) {
+    NNTRACE_FULL(NNTRACE_LAYER_CPU, NNTRACE_PHASE_COMPILATION, "CpuDevice::prepareModel");
+    CHECK((modelCache.size() == 0 && dataCache.size() == 0) ||
+          (modelCache.size() == kNumCacheFiles.first && dataCache.size() == kNumCacheFiles.second))
+            << "Unexpected number of cache files on CpuDevice";
     *preparedModel = nullptr;
-    if (!validateModel(hidlModel) || !validateExecutionPreference(executionPreference)) {
+    *cpuPreparedModel = nullptr;
+    // The model comes from a ModelBuilder of this process, which validated it in
+    // ModelBuilder::finish(); validating it again would only repeat that work.
+    DCHECK(validateModel(hidlModel));
+    if (!validateExecutionPreference(executionPreference)) {
         return ANEURALNETWORKS_OP_FAILED;
     }
+    std::shared_ptr<CpuPreparedModel> localPreparedModel = CpuPreparedModel::create(hidlModel);
+    if (localPreparedModel == nullptr) {
+        return ANEURALNETWORKS_UNMAPPABLE;
+    }
+    // Failing to save the cache only costs a full compilation next time.
+    if (modelCache.size() != 0 &&
+        !writeModelToCache(hidlModel, modelCache[0], dataCache[0], token)) {
+        LOG(WARNING) << "CpuDevice::prepareModel failed to save the compilation cache";
+    }
+    *cpuPreparedModel = std::move(localPreparedModel);
     return ANEURALNETWORKS_NO_ERROR;
 }
 
+int CpuDevice::prepareModelFromCache(const hidl_vec<hidl_handle>& modelCache,
+                                     const hidl_vec<hidl_handle>& dataCache,
+                                     const HidlToken& token,
+                                     std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                                     std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) {
+    NNTRACE_FULL(NNTRACE_LAYER_CPU, NNTRACE_PHASE_COMPILATION, "CpuDevice::prepareModelFromCache");
+    CHECK(modelCache.size() == kNumCacheFiles.first && dataCache.size() == kNumCacheFiles.second);
+    *preparedModel = nullptr;
+    *cpuPreparedModel = nullptr;
+    Model hidlModel;
+    if (!readModelFromCache(modelCache[0], dataCache[0], token, &hidlModel)) {
+        return ANEURALNETWORKS_OP_FAILED;
+    }
+    *cpuPreparedModel = CpuPreparedModel::create(std::move(hidlModel));
+    return *cpuPreparedModel != nullptr ? ANEURALNETWORKS_NO_ERROR : ANEURALNETWORKS_UNMAPPABLE;
+}
+
+// The CPU reads and writes the memory itself, so plain shared memory is best.
+int CpuDevice::allocateMemory(uint32_t size, std::unique_ptr<Memory>* memory) {
+    return allocateSharedMemoryObject(size, memory);
+}
+
+std::shared_ptr<CpuPreparedModel> CpuPreparedModel::create(Model hidlModel) {
+    std::vector<RunTimePoolInfo> poolInfos;
+    if (!setRunTimePoolInfosFromHidlMemories(&poolInfos, hidlModel.pools)) {
+        return nullptr;
+    }
+    return std::shared_ptr<CpuPreparedModel>(
+            new CpuPreparedModel(std::move(hidlModel), std::move(poolInfos)));
+}
+
 DeviceManager* DeviceManager::get() {
     static DeviceManager manager;
     return &manager;
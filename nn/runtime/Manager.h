@@ -17,18 +17,49 @@
 #ifndef ANDROID_ML_NN_RUNTIME_MANAGER_H
 #define ANDROID_ML_NN_RUNTIME_MANAGER_H
 
+#include "CpuExecutor.h"
 #include "HalInterfaces.h"
 #include "Utils.h"
 #include "VersionedInterfaces.h"
 
 #include <android-base/macros.h>
 #include <map>
+#include <memory>
 #include <unordered_set>
 #include <vector>
 
 namespace android {
 namespace nn {
 
+class Memory;
+
+// The CPU device has no driver-side prepared model. Preparing a model for it
+// instead produces a CpuPreparedModel: the HIDL form of the model with its
+// memory pools already mapped, shared by every execution of the compilation
+// rather than rebuilt by each one.
+class CpuPreparedModel {
+    DISALLOW_IMPLICIT_CONSTRUCTORS(CpuPreparedModel);
+
+   public:
+    // Returns nullptr if the memory pools of hidlModel can't be mapped.
+    static std::shared_ptr<CpuPreparedModel> create(Model hidlModel);
+
+    const Model& getModel() const { return mModel; }
+    const std::vector<RunTimePoolInfo>& getModelPoolInfos() const { return mModelPoolInfos; }
+    // Shared by all the executions of the prepared model.
+    const CpuExecutorModel& getCpuExecutorModel() const { return mCpuExecutorModel; }
+
+   private:
+    CpuPreparedModel(Model model, std::vector<RunTimePoolInfo> modelPoolInfos)
+        : mModel(std::move(model)),
+          mModelPoolInfos(std::move(modelPoolInfos)),
+          mCpuExecutorModel(mModel, mModelPoolInfos) {}
+
+    const Model mModel;
+    const std::vector<RunTimePoolInfo> mModelPoolInfos;
+    const CpuExecutorModel mCpuExecutorModel;
+};
+
 // A unified interface for actual driver devices as well as the CPU
 class Device {
    public:
@@ -66,15 +97,24 @@ class Device {
     virtual std::pair<uint32_t, uint32_t> getNumberOfCacheFilesNeeded() const = 0;
     bool isCachingSupported() const;
 
+    // A driver device sets *preparedModel and leaves *cpuPreparedModel as nullptr;
+    // the CPU device does the opposite.
     virtual int prepareModel(
             const Model& hidlModel, ExecutionPreference executionPreference,
             const hidl_vec<hidl_handle>& modelCache, const hidl_vec<hidl_handle>& dataCache,
             const hidl_array<uint8_t, ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN>& token,
-            std::shared_ptr<VersionedIPreparedModel>* preparedModel) = 0;
+            std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+            std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) = 0;
     virtual int prepareModelFromCache(
             const hidl_vec<hidl_handle>& modelCache, const hidl_vec<hidl_handle>& dataCache,
             const hidl_array<uint8_t, ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN>& token,
-            std::shared_ptr<VersionedIPreparedModel>* preparedModel) = 0;
+            std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+            std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) = 0;
+
+    // Allocates size bytes for an input or output of a model prepared for this
+    // device, in the kind of memory the device accesses best, which the CPU
+    // may only be able to reach slowly.
+    virtual int allocateMemory(uint32_t size, std::unique_ptr<Memory>* memory) = 0;
 };
 
 // Manages the NN HAL devices.  Only one instance of this class will exist.
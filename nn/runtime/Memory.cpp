@@ -138,6 +138,29 @@ int MemoryFd::getPointer(uint8_t** buffer) const {
     }
 }
 
+MemoryAHWBAllocated::~MemoryAHWBAllocated() {
+    if (mBuffer != nullptr) {
+        AHardwareBuffer_release(mBuffer);
+    }
+}
+
+int MemoryAHWBAllocated::allocate(uint32_t size, uint64_t usage) {
+    CHECK(mBuffer == nullptr);
+    const AHardwareBuffer_Desc desc = {
+            .width = size,
+            .height = 1,
+            .layers = 1,
+            .format = AHARDWAREBUFFER_FORMAT_BLOB,
+            .usage = usage,
+    };
+    if (AHardwareBuffer_allocate(&desc, &mBuffer) != 0) {
+        mBuffer = nullptr;
+        LOG(ERROR) << "MemoryAHWBAllocated::allocate failed";
+        return ANEURALNETWORKS_OUT_OF_MEMORY;
+    }
+    return set(mBuffer);
+}
+
 uint32_t MemoryTracker::add(const Memory* memory) {
     VLOG(MODEL) << __func__ << "(" << SHOW_IF_DEBUG(memory) << ")";
     // See if we already have this memory. If so,
@@ -169,6 +169,23 @@ class MemoryAHWB : public Memory {
     AHardwareBuffer_Desc mBufferDesc;
 };
 
+// A BLOB mode AHardwareBuffer the runtime allocated for an input or output of
+// a compilation, see Device::allocateMemory. Unlike MemoryAHWB, it owns the
+// buffer. Drivers receive it as is; the runtime itself only maps it, through
+// RunTimePoolInfo, when a step running on the CPU reads or writes it.
+class MemoryAHWBAllocated : public MemoryAHWB {
+   public:
+    MemoryAHWBAllocated() {}
+    ~MemoryAHWBAllocated() override;
+
+    // Allocates a buffer of size bytes with the AHARDWAREBUFFER_USAGE_* flags
+    // in usage.
+    int allocate(uint32_t size, uint64_t usage);
+
+   private:
+    AHardwareBuffer* mBuffer = nullptr;
+};
+
 // A utility class to accumulate mulitple Memory objects and assign each
 // a distinct index number, starting with 0.
 //
@@ -21,11 +21,17 @@
 #include "CompilationBuilder.h"
 #include "GraphDump.h"
 #include "Manager.h"
+#include "Tracing.h"
 #include "TypeManager.h"
 #include "Utils.h"
 #include "ValidateHal.h"
 
+#include <openssl/sha.h>
+
+#include <algorithm>
+#include <atomic>
 #include <map>
+#include <thread>
 #include <utility>
 
 namespace android {
@@ -479,6 +485,155 @@ int ModelBuilder::finish() {
     return ANEURALNETWORKS_NO_ERROR;
 }
 
+const uint8_t* ModelBuilder::getFingerprint() const {
+    if (!mCompletedModel) {
+        return nullptr;
+    }
+    std::call_once(mFingerprintOnce, [this] {
+        std::vector<uint8_t> fingerprint(SHA256_DIGEST_LENGTH);
+        if (computeFingerprint(fingerprint.data())) {
+            mFingerprint = std::move(fingerprint);
+        }
+    });
+    return mFingerprint.empty() ? nullptr : mFingerprint.data();
+}
+
+bool ModelBuilder::computeFingerprint(uint8_t* fingerprint) const {
+    NNTRACE_RT(NNTRACE_PHASE_PREPARATION, "ModelBuilder::computeFingerprint");
+    static_assert(SHA256_DIGEST_LENGTH == ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN,
+                  "fingerprint and cache token sizes differ");
+    // Constant values in memory pools are hashed in chunks, each into its own digest, so that
+    // large weights can be hashed by several threads. The model digest then covers the chunk
+    // digests in order, which makes it independent of the number of threads.
+    constexpr size_t kChunkSize = 1 << 20;
+    constexpr size_t kMinBytesPerThread = 4 * kChunkSize;
+    constexpr unsigned kMaxThreads = 4;
+
+    struct Chunk {
+        const uint8_t* data;
+        size_t length;
+        uint8_t digest[SHA256_DIGEST_LENGTH];
+    };
+    std::vector<Chunk> chunks;
+    // The index in chunks of the first chunk of each CONSTANT_REFERENCE operand.
+    std::vector<size_t> firstChunk(mOperands.size(), 0);
+    size_t totalBytes = 0;
+    for (uint32_t i = 0; i < mOperands.size(); i++) {
+        const Operand& operand = mOperands[i];
+        if (operand.lifetime != OperandLifeTime::CONSTANT_REFERENCE) {
+            continue;
+        }
+        uint8_t* pool = nullptr;
+        if (mMemories[operand.location.poolIndex]->getPointer(&pool) != ANEURALNETWORKS_NO_ERROR) {
+            VLOG(MODEL) << "No fingerprint for a model with constants in non-mappable memory";
+            return false;
+        }
+        firstChunk[i] = chunks.size();
+        const uint8_t* data = pool + operand.location.offset;
+        for (size_t offset = 0; offset < operand.location.length; offset += kChunkSize) {
+            chunks.push_back({.data = data + offset,
+                              .length = std::min<size_t>(kChunkSize,
+                                                         operand.location.length - offset)});
+        }
+        totalBytes += operand.location.length;
+    }
+
+    std::atomic<size_t> nextChunk(0);
+    auto hashChunks = [&chunks, &nextChunk] {
+        for (size_t i = nextChunk++; i < chunks.size(); i = nextChunk++) {
+            SHA256(chunks[i].data, chunks[i].length, chunks[i].digest);
+        }
+    };
+    const size_t threadCount = std::min<size_t>(
+            {std::max(1u, std::thread::hardware_concurrency()), kMaxThreads,
+             std::max<size_t>(1, totalBytes / kMinBytesPerThread)});
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadCount; i++) {
+        threads.emplace_back(hashChunks);
+    }
+    hashChunks();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    SHA256_CTX hasher;
+    SHA256_Init(&hasher);
+    auto update = [&hasher](const void* data, size_t length) {
+        SHA256_Update(&hasher, data, length);
+    };
+    auto updateVector = [&update](const auto& values) {
+        const uint32_t count = values.size();
+        update(&count, sizeof(count));
+        update(values.data(), values.size() * sizeof(values[0]));
+    };
+    // The prefix of an extension type depends on the order in which the process registered
+    // extensions, so extension types are hashed as the extension name and the type within the
+    // extension instead.
+    constexpr uint8_t kLowBitsType =
+            static_cast<uint8_t>(Model::ExtensionTypeEncoding::LOW_BITS_TYPE);
+    auto updateType = [&update](uint32_t type, bool isExtension) {
+        update(&isExtension, sizeof(isExtension));
+        if (!isExtension) {
+            update(&type, sizeof(type));
+            return;
+        }
+        const Extension* extension;
+        CHECK(TypeManager::get()->getExtensionInfo(type >> kLowBitsType, &extension));
+        const uint16_t typeWithinExtension = type & ((1 << kLowBitsType) - 1);
+        update(extension->name.c_str(), extension->name.size() + 1);
+        update(&typeWithinExtension, sizeof(typeWithinExtension));
+    };
+    // Changing what is hashed below must change this tag, so that fingerprints from different
+    // layouts never collide.
+    static const char kTag[] = "ModelBuilder fingerprint v2";
+    update(kTag, sizeof(kTag));
+    update(&mRelaxComputationFloat32toFloat16, sizeof(mRelaxComputationFloat32toFloat16));
+    const uint32_t operandCount = mOperands.size();
+    update(&operandCount, sizeof(operandCount));
+    for (uint32_t i = 0; i < operandCount; i++) {
+        const Operand& operand = mOperands[i];
+        // Where a constant value is stored does not matter, only the value does.
+        const bool isConstant = operand.lifetime == OperandLifeTime::CONSTANT_COPY ||
+                                operand.lifetime == OperandLifeTime::CONSTANT_REFERENCE;
+        const OperandLifeTime lifetime = isConstant ? OperandLifeTime::CONSTANT_COPY
+                                                    : operand.lifetime;
+        updateType(static_cast<uint32_t>(operand.type), isExtensionOperandType(operand.type));
+        updateVector(operand.dimensions);
+        update(&operand.scale, sizeof(operand.scale));
+        update(&operand.zeroPoint, sizeof(operand.zeroPoint));
+        update(&lifetime, sizeof(lifetime));
+        const auto discriminator = operand.extraParams.getDiscriminator();
+        update(&discriminator, sizeof(discriminator));
+        if (discriminator == Operand::ExtraParams::hidl_discriminator::channelQuant) {
+            update(&operand.extraParams.channelQuant().channelDim,
+                   sizeof(operand.extraParams.channelQuant().channelDim));
+            updateVector(operand.extraParams.channelQuant().scales);
+        } else if (discriminator == Operand::ExtraParams::hidl_discriminator::extension) {
+            updateVector(operand.extraParams.extension());
+        }
+        if (operand.lifetime == OperandLifeTime::CONSTANT_COPY) {
+            update(&operand.location.length, sizeof(operand.location.length));
+            update(mSmallOperandValues.data() + operand.location.offset, operand.location.length);
+        } else if (operand.lifetime == OperandLifeTime::CONSTANT_REFERENCE) {
+            update(&operand.location.length, sizeof(operand.location.length));
+            const size_t chunkCount = (operand.location.length + kChunkSize - 1) / kChunkSize;
+            for (size_t c = firstChunk[i]; c < firstChunk[i] + chunkCount; c++) {
+                update(chunks[c].digest, sizeof(chunks[c].digest));
+            }
+        }
+    }
+    for (const Operation& operation : mOperations) {
+        updateType(static_cast<uint32_t>(operation.type),
+                   isExtensionOperationType(operation.type));
+        updateVector(operation.inputs);
+        updateVector(operation.outputs);
+    }
+    updateVector(mInputIndexes);
+    updateVector(mOutputIndexes);
+    SHA256_Final(fingerprint, &hasher);
+    return true;
+}
+
 void ModelBuilder::sortIntoRunOrder() {
     if (!mSortedOperationIndexMap.empty()) {
         LOG(ERROR) << "Operations already in run order.";
@@ -487,9 +642,10 @@ void ModelBuilder::sortIntoRunOrder() {
     // Tracks the operations that can be executed.
     std::vector<uint32_t> opsReadyToRun;
     std::vector<Operation> runOrder;
+    runOrder.reserve(operationCount());
 
     // Tracks how many inputs are needed for each operation to be ready to run.
-    std::multimap<uint32_t, uint32_t> operandToOperations;
+    std::vector<std::vector<uint32_t>> operandToOperations(operandCount());
     std::vector<uint32_t> unknownInputCount(operationCount());
     for (uint32_t operationIndex = 0; operationIndex < operationCount(); operationIndex++) {
         uint32_t& count = unknownInputCount[operationIndex];
@@ -499,8 +655,7 @@ void ModelBuilder::sortIntoRunOrder() {
             if (lifetime == OperandLifeTime::TEMPORARY_VARIABLE ||
                 lifetime == OperandLifeTime::MODEL_OUTPUT) {
                 count++;
-                operandToOperations.insert(
-                        std::pair<uint32_t, uint32_t>(operandIndex, operationIndex));
+                operandToOperations[operandIndex].push_back(operationIndex);
             }
         }
         if (count == 0) {
@@ -519,16 +674,15 @@ void ModelBuilder::sortIntoRunOrder() {
 
         // Mark all its outputs as known.
         for (uint32_t operandIndex : operation.outputs) {
-            auto range = operandToOperations.equal_range(operandIndex);
-            for (auto i = range.first; i != range.second; i++) {
-                uint32_t& count = unknownInputCount[i->second];
+            for (uint32_t consumer : operandToOperations[operandIndex]) {
+                uint32_t& count = unknownInputCount[consumer];
                 if (--count == 0) {
-                    opsReadyToRun.push_back(i->second);
+                    opsReadyToRun.push_back(consumer);
                 }
             }
         }
     }
-    mOperations = runOrder;
+    mOperations = std::move(runOrder);
 }
 
 void ModelBuilder::setHidlModel(Model* model) const {
@@ -547,6 +701,13 @@ void ModelBuilder::setHidlModel(Model* model) const {
     }
 }
 
+bool ModelBuilder::extensionOperationsRunOnCpu() const {
+    return std::all_of(mOperations.begin(), mOperations.end(), [this](const Operation& operation) {
+        return !isExtensionOperationType(operation.type) ||
+               TypeManager::get()->isCpuOperationSupported(operation, mOperands.data());
+    });
+}
+
 std::vector<Model::ExtensionNameAndPrefix> ModelBuilder::getExtensionNameToPrefixMap() const {
     std::vector<Model::ExtensionNameAndPrefix> extensionNameToPrefix;
     std::set<uint16_t> prefixSet;
@@ -25,6 +25,8 @@
 #include "NeuralNetworks.h"
 #include "Utils.h"
 
+#include <mutex>
+
 namespace android {
 namespace nn {
 
@@ -63,8 +65,20 @@ class ModelBuilder {
     bool isFinished() const { return mCompletedModel; }
     bool isValid() const { return !mInvalidModel; }
 
+    // Returns a SHA-256 digest of everything that defines the finished model: its operands,
+    // operations, inputs, outputs and extensions, and the values of its constant operands,
+    // whichever memory they were provided in. Models built by the same sequence of calls have
+    // the same fingerprint, so it can serve as the base of cache tokens or as a key to recognize
+    // a model compiled before. The digest is ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN bytes
+    // long. Returns nullptr if the model is not finished, or if it has constant values in
+    // memory that is not CPU accessible. Computed on first use only.
+    const uint8_t* getFingerprint() const;
+
     bool hasOEMOperation() const { return mHasOEMOperation; }
     bool hasExtensionOperation() const { return mHasExtensionOperation; }
+    // Whether every extension operation has a CPU implementation registered
+    // with TypeManager, so that the model can fall back to the CPU.
+    bool extensionOperationsRunOnCpu() const;
 
     /// M: NeuroPilot add on @{
     // explicitDeviceList is true if the list of devices was provided explicitly
@@ -129,6 +143,14 @@ class ModelBuilder {
                                        const std::vector<std::shared_ptr<Device>>& devices,
                                        std::vector<int>* bestDeviceForOperation) const;
     // @}
+    // As above, but with the result of getSupportedOperationsByDevice(devices).
+    int findBestDeviceForEachOperation(uint32_t preference,
+                                       const std::vector<std::shared_ptr<Device>>& devices,
+                                       const std::vector<hidl_vec<bool>>& supportedOperations,
+                                       std::vector<int>* bestDeviceForOperation) const;
+    // Returns, for each device, which of the model's operations it supports.
+    std::vector<hidl_vec<bool>> getSupportedOperationsByDevice(
+            const std::vector<std::shared_ptr<Device>>& devices) const;
 
     /// M: Performance enhancement @{
     PerformanceInfo getPerformanceInfo(const std::shared_ptr<Device> device,
@@ -187,6 +209,9 @@ class ModelBuilder {
     // Copies the large values to a shared memory, if we have any.
     int copyLargeValuesToSharedMemory();
 
+    // Computes the digest returned by getFingerprint(). Returns false on failure.
+    bool computeFingerprint(uint8_t* fingerprint) const;
+
     // Returns the list of extension names and corresponding numeric "prefixes"
     // of operand and operation type values used in the model.
     //
@@ -239,6 +264,10 @@ class ModelBuilder {
     // 'false' indicates TENSOR_FLOAT32 must be calculated using at least the
     // range and precision of the IEEE 754 32-bit floating-point format.
     bool mRelaxComputationFloat32toFloat16 = false;
+
+    // The result of computeFingerprint(), or empty if it failed.
+    mutable std::once_flag mFingerprintOnce;
+    mutable std::vector<uint8_t> mFingerprint;
 };
 
 }  // namespace nn
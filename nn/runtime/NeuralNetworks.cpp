@@ -23,19 +23,23 @@
 #include "NeuralNetworks.h"
 
 #include "BurstBuilder.h"
+#include "CachePrefetcher.h"
 #include "Callbacks.h"
 #include "CompilationBuilder.h"
 #include "ExecutionBuilder.h"
+#include "ExecutionPlan.h"
 #include "Manager.h"
 #include "Memory.h"
 #include "ModelBuilder.h"
 #include "NeuralNetworksExtensions.h"
 #include "NeuralNetworksOEM.h"
+#include "StateBuilder.h"
 #include "Tracing.h"
 #include "Utils.h"
 
 #include "vndk/hardware_buffer.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <memory>
 #include <vector>
@@ -821,6 +825,71 @@ int ANeuralNetworksExecution_burstCompute(ANeuralNetworksExecution* execution,
     return n;
 }
 
+int ANeuralNetworksState_create(ANeuralNetworksCompilation* compilation,
+                                ANeuralNetworksState** state) {
+    NNTRACE_RT(NNTRACE_PHASE_PREPARATION, "ANeuralNetworksState_create");
+    if (!compilation || !state) {
+        LOG(ERROR) << "ANeuralNetworksState_create passed a nullptr";
+        return ANEURALNETWORKS_UNEXPECTED_NULL;
+    }
+
+    CompilationBuilder* c = reinterpret_cast<CompilationBuilder*>(compilation);
+    StateBuilder* s = nullptr;
+    int result = c->createState(&s);
+    *state = reinterpret_cast<ANeuralNetworksState*>(s);
+    return result;
+}
+
+int ANeuralNetworksState_bind(ANeuralNetworksState* state, int32_t outputIndex,
+                              int32_t inputIndex) {
+    NNTRACE_RT(NNTRACE_PHASE_PREPARATION, "ANeuralNetworksState_bind");
+    if (!state) {
+        LOG(ERROR) << "ANeuralNetworksState_bind passed a nullptr";
+        return ANEURALNETWORKS_UNEXPECTED_NULL;
+    }
+    StateBuilder* s = reinterpret_cast<StateBuilder*>(state);
+    return s->bind(outputIndex, inputIndex);
+}
+
+int ANeuralNetworksState_finish(ANeuralNetworksState* state) {
+    NNTRACE_RT(NNTRACE_PHASE_PREPARATION, "ANeuralNetworksState_finish");
+    if (!state) {
+        LOG(ERROR) << "ANeuralNetworksState_finish passed a nullptr";
+        return ANEURALNETWORKS_UNEXPECTED_NULL;
+    }
+    StateBuilder* s = reinterpret_cast<StateBuilder*>(state);
+    return s->finish();
+}
+
+int ANeuralNetworksState_reset(ANeuralNetworksState* state) {
+    NNTRACE_RT(NNTRACE_PHASE_EXECUTION, "ANeuralNetworksState_reset");
+    if (!state) {
+        LOG(ERROR) << "ANeuralNetworksState_reset passed a nullptr";
+        return ANEURALNETWORKS_UNEXPECTED_NULL;
+    }
+    StateBuilder* s = reinterpret_cast<StateBuilder*>(state);
+    return s->reset();
+}
+
+void ANeuralNetworksState_free(ANeuralNetworksState* state) {
+    NNTRACE_RT(NNTRACE_PHASE_TERMINATION, "ANeuralNetworksState_free");
+    // No validation.  Free of nullptr is valid.
+    StateBuilder* s = reinterpret_cast<StateBuilder*>(state);
+    delete s;
+}
+
+int ANeuralNetworksExecution_setState(ANeuralNetworksExecution* execution,
+                                      ANeuralNetworksState* state) {
+    NNTRACE_RT(NNTRACE_PHASE_INPUTS_AND_OUTPUTS, "ANeuralNetworksExecution_setState");
+    if (!execution || !state) {
+        LOG(ERROR) << "ANeuralNetworksExecution_setState passed a nullptr";
+        return ANEURALNETWORKS_UNEXPECTED_NULL;
+    }
+    ExecutionBuilder* r = reinterpret_cast<ExecutionBuilder*>(execution);
+    StateBuilder* s = reinterpret_cast<StateBuilder*>(state);
+    return r->setState(s);
+}
+
 int ANeuralNetworksMemory_createFromFd(size_t size, int prot, int fd, size_t offset,
                                        ANeuralNetworksMemory** memory) {
     NNTRACE_RT(NNTRACE_PHASE_PREPARATION, "ANeuralNetworksMemory_createFromFd");
@@ -853,6 +922,36 @@ int ANeuralNetworksMemory_createFromAHardwareBuffer(const AHardwareBuffer* ahwb,
     return ANEURALNETWORKS_NO_ERROR;
 }
 
+int ANeuralNetworksMemory_createForCompilationInput(const ANeuralNetworksCompilation* compilation,
+                                                    int32_t index,
+                                                    ANeuralNetworksMemory** memory) {
+    NNTRACE_RT(NNTRACE_PHASE_PREPARATION, "ANeuralNetworksMemory_createForCompilationInput");
+    if (!compilation || !memory) {
+        LOG(ERROR) << "ANeuralNetworksMemory_createForCompilationInput passed a nullptr";
+        return ANEURALNETWORKS_UNEXPECTED_NULL;
+    }
+    const CompilationBuilder* c = reinterpret_cast<const CompilationBuilder*>(compilation);
+    Memory* m = nullptr;
+    const int n = c->createMemoryForInput(index, &m);
+    *memory = reinterpret_cast<ANeuralNetworksMemory*>(m);
+    return n;
+}
+
+int ANeuralNetworksMemory_createForCompilationOutput(const ANeuralNetworksCompilation* compilation,
+                                                     int32_t index,
+                                                     ANeuralNetworksMemory** memory) {
+    NNTRACE_RT(NNTRACE_PHASE_PREPARATION, "ANeuralNetworksMemory_createForCompilationOutput");
+    if (!compilation || !memory) {
+        LOG(ERROR) << "ANeuralNetworksMemory_createForCompilationOutput passed a nullptr";
+        return ANEURALNETWORKS_UNEXPECTED_NULL;
+    }
+    const CompilationBuilder* c = reinterpret_cast<const CompilationBuilder*>(compilation);
+    Memory* m = nullptr;
+    const int n = c->createMemoryForOutput(index, &m);
+    *memory = reinterpret_cast<ANeuralNetworksMemory*>(m);
+    return n;
+}
+
 void ANeuralNetworksMemory_free(ANeuralNetworksMemory* memory) {
     NNTRACE_RT(NNTRACE_PHASE_TERMINATION, "ANeuralNetworksMemory_free");
     // No validation.  Free of nullptr is valid.
@@ -901,6 +1000,26 @@ int ANeuralNetworksModel_finish(ANeuralNetworksModel* model) {
     return m->finish();
 }
 
+int ANeuralNetworksModel_getFingerprint(const ANeuralNetworksModel* model, uint8_t* fingerprint) {
+    NNTRACE_RT(NNTRACE_PHASE_PREPARATION, "ANeuralNetworksModel_getFingerprint");
+    if (!model || !fingerprint) {
+        LOG(ERROR) << "ANeuralNetworksModel_getFingerprint passed a nullptr";
+        return ANEURALNETWORKS_UNEXPECTED_NULL;
+    }
+    const ModelBuilder* m = reinterpret_cast<const ModelBuilder*>(model);
+    if (!m->isFinished()) {
+        LOG(ERROR) << "ANeuralNetworksModel_getFingerprint passed an unfinished model";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    const uint8_t* modelFingerprint = m->getFingerprint();
+    if (modelFingerprint == nullptr) {
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    std::copy(modelFingerprint, modelFingerprint + ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN,
+              fingerprint);
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
 int ANeuralNetworksModel_addOperand(ANeuralNetworksModel* model,
                                     const ANeuralNetworksOperandType* type) {
     NNTRACE_RT(NNTRACE_PHASE_PREPARATION, "ANeuralNetworksModel_addOperand");
@@ -1029,6 +1148,56 @@ int ANeuralNetworksCompilation_setCaching(ANeuralNetworksCompilation* compilatio
     return c->setCaching(cacheDir, token);
 }
 
+int ANeuralNetworks_prefetchCompilationCache(const char* cacheDir, const uint8_t* const* tokens,
+                                             uint32_t numTokens,
+                                             const ANeuralNetworksDevice* const* devices,
+                                             uint32_t numDevices, int32_t preference) {
+    NNTRACE_RT(NNTRACE_PHASE_COMPILATION, "ANeuralNetworks_prefetchCompilationCache");
+    if (!cacheDir || (numTokens != 0 && !tokens) || (numDevices != 0 && !devices)) {
+        LOG(ERROR) << "ANeuralNetworks_prefetchCompilationCache passed a nullptr";
+        return ANEURALNETWORKS_UNEXPECTED_NULL;
+    }
+    if (preference < 0 || preference >= kNumberOfPreferences) {
+        LOG(ERROR) << "ANeuralNetworks_prefetchCompilationCache invalid preference " << preference;
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    for (uint32_t i = 0; i < numTokens; i++) {
+        if (tokens[i] == nullptr) {
+            LOG(ERROR) << "ANeuralNetworks_prefetchCompilationCache passed a nullptr as a token";
+            return ANEURALNETWORKS_UNEXPECTED_NULL;
+        }
+    }
+
+    const std::vector<std::shared_ptr<Device>>& allDevices = DeviceManager::get()->getDrivers();
+    std::vector<std::shared_ptr<Device>> selectedDevices;
+    for (uint32_t i = 0; i < numDevices; i++) {
+        for (auto& device : allDevices) {
+            if (device.get() == reinterpret_cast<const Device*>(devices[i])) {
+                selectedDevices.push_back(device);
+                break;
+            }
+        }
+    }
+    if (selectedDevices.size() != numDevices) {
+        LOG(ERROR) << "ANeuralNetworks_prefetchCompilationCache passed an invalid device set";
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    if (numDevices == 0) {
+        selectedDevices = allDevices;
+    }
+
+    // Make sure the cache dir can concat with the filename, as in
+    // ANeuralNetworksCompilation_setCaching.
+    std::string dir = cacheDir;
+    if (!dir.empty() && dir.back() != '/') {
+        dir.push_back('/');
+    }
+    for (uint32_t i = 0; i < numTokens; i++) {
+        prefetchCompilationCache(selectedDevices, preference, dir, tokens[i]);
+    }
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
 int ANeuralNetworksCompilation_finish(ANeuralNetworksCompilation* compilation) {
     NNTRACE_RT(NNTRACE_PHASE_COMPILATION, "ANeuralNetworksCompilation_finish");
     if (!compilation) {
@@ -1175,7 +1344,7 @@ int ANeuralNetworksEvent_wait(ANeuralNetworksEvent* event) {
 
     sp<ExecutionCallback>* e = reinterpret_cast<sp<ExecutionCallback>*>(event);
     (*e)->wait();
-    return convertErrorStatusToResultCode((*e)->getStatus());
+    return (*e)->getResultCode();
 }
 
 void ANeuralNetworksEvent_free(ANeuralNetworksEvent* event) {
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "StateBuilder"
+
+#include "StateBuilder.h"
+
+#include "CompilationBuilder.h"
+#include "ModelBuilder.h"
+#include "TypeManager.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace android {
+namespace nn {
+
+StateBuilder::StateBuilder(const CompilationBuilder* compilation, const ModelBuilder* model)
+    : mCompilation(compilation), mModel(model) {}
+
+bool StateBuilder::isBoundInput(uint32_t index) const {
+    return std::any_of(mBindings.begin(), mBindings.end(),
+                       [index](const Binding& binding) { return binding.inputIndex == index; });
+}
+
+bool StateBuilder::isBoundOutput(uint32_t index) const {
+    return std::any_of(mBindings.begin(), mBindings.end(),
+                       [index](const Binding& binding) { return binding.outputIndex == index; });
+}
+
+int StateBuilder::bind(uint32_t outputIndex, uint32_t inputIndex) {
+    if (mFinished) {
+        LOG(ERROR) << "ANeuralNetworksState_bind can't modify after state finished";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    if (outputIndex >= mModel->outputCount() || inputIndex >= mModel->inputCount()) {
+        LOG(ERROR) << "ANeuralNetworksState_bind bad index " << outputIndex << " "
+                   << mModel->outputCount() << ", " << inputIndex << " " << mModel->inputCount();
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    if (isBoundOutput(outputIndex) || isBoundInput(inputIndex)) {
+        LOG(ERROR) << "ANeuralNetworksState_bind output " << outputIndex << " or input "
+                   << inputIndex << " is already bound";
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    const Operand& output = mModel->getOutputOperand(outputIndex);
+    const Operand& input = mModel->getInputOperand(inputIndex);
+    if (output.type != input.type || output.dimensions != input.dimensions ||
+        output.scale != input.scale || output.zeroPoint != input.zeroPoint) {
+        LOG(ERROR) << "ANeuralNetworksState_bind output " << outputIndex << " and input "
+                   << inputIndex << " have different types";
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    const uint32_t length = TypeManager::get()->getSizeOfData(input);
+    if (length == 0) {
+        LOG(ERROR) << "ANeuralNetworksState_bind input " << inputIndex
+                   << " has unspecified dimensions";
+        return ANEURALNETWORKS_BAD_DATA;
+    }
+    mBindings.push_back({.outputIndex = outputIndex, .inputIndex = inputIndex, .length = length});
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
+int StateBuilder::finish() {
+    if (mFinished) {
+        LOG(ERROR) << "ANeuralNetworksState_finish called more than once";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    for (Binding& binding : mBindings) {
+        for (std::unique_ptr<Memory>& buffer : binding.buffers) {
+            buffer = std::make_unique<Memory>();
+            NN_RETURN_IF_ERROR(buffer->create(binding.length));
+        }
+        VLOG(EXECUTION) << "StateBuilder::finish: output " << binding.outputIndex
+                        << " bound to input " << binding.inputIndex << ", " << binding.length
+                        << " bytes";
+    }
+    mFinished = true;
+    return reset();
+}
+
+int StateBuilder::reset() {
+    if (!mFinished) {
+        LOG(ERROR) << "ANeuralNetworksState_reset passed an unfinished state";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    if (!tryLock()) {
+        LOG(ERROR) << "ANeuralNetworksState_reset called while an execution uses the state";
+        return ANEURALNETWORKS_BAD_STATE;
+    }
+    int n = ANEURALNETWORKS_NO_ERROR;
+    for (const Binding& binding : mBindings) {
+        uint8_t* data = nullptr;
+        n = binding.buffers[mCurrent]->getPointer(&data);
+        if (n != ANEURALNETWORKS_NO_ERROR) {
+            break;
+        }
+        memset(data, 0, binding.length);
+    }
+    unlock();
+    return n;
+}
+
+bool StateBuilder::tryLock() {
+    const bool alreadyRunning = mCurrentlyRunning.test_and_set();
+    return !alreadyRunning;
+}
+
+void StateBuilder::unlock() {
+    mCurrentlyRunning.clear();
+}
+
+}  // namespace nn
+}  // namespace android
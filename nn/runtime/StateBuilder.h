@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_RUNTIME_STATE_BUILDER_H
+#define ANDROID_ML_NN_RUNTIME_STATE_BUILDER_H
+
+#include "Memory.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace android {
+namespace nn {
+
+class CompilationBuilder;
+class ModelBuilder;
+
+// The state a sequence model, such as an LSTM, carries from one execution of
+// a compilation to the next, as pairs of an output and an input of the model
+// (for example output_state_out and output_state_in).
+//
+// Each pair has two shared memory buffers that take turns: an execution
+// reads the input from one and writes the output to the other, and once it
+// succeeds the next execution reads from where this one wrote. The state
+// thus never leaves the runtime's memory, and the drivers and the CPU read
+// and write it in place; a driver can't be asked to read and write the same
+// buffer in one execution. A failed execution leaves the state as it was.
+class StateBuilder {
+   public:
+    StateBuilder(const CompilationBuilder* compilation, const ModelBuilder* model);
+
+    // Binds the output at outputIndex to the input at inputIndex. Both must
+    // have the same type and fully specified dimensions.
+    int bind(uint32_t outputIndex, uint32_t inputIndex);
+
+    // Allocates the buffers, with a state of all zeros.
+    int finish();
+
+    // Sets the state back to all zeros, for example at the start of a new
+    // sequence. Fails if an execution is using the state.
+    int reset();
+
+    bool isFinished() const { return mFinished; }
+    const CompilationBuilder* getCompilation() const { return mCompilation; }
+
+    // At most one execution uses the state at any given time, from compute
+    // until finish.
+    bool tryLock();
+    void unlock();
+
+    struct Binding {
+        uint32_t outputIndex;
+        uint32_t inputIndex;
+        uint32_t length;
+        std::unique_ptr<Memory> buffers[2];
+    };
+    const std::vector<Binding>& getBindings() const { return mBindings; }
+    bool isBoundInput(uint32_t index) const;
+    bool isBoundOutput(uint32_t index) const;
+
+    // The buffers the next execution reads the input from and writes the
+    // output to.
+    const Memory* getInputBuffer(const Binding& binding) const {
+        return binding.buffers[mCurrent].get();
+    }
+    const Memory* getOutputBuffer(const Binding& binding) const {
+        return binding.buffers[1 - mCurrent].get();
+    }
+
+    // Makes the outputs of the execution that just succeeded the inputs of
+    // the next one.
+    void advance() { mCurrent = 1 - mCurrent; }
+
+   private:
+    std::atomic_flag mCurrentlyRunning = ATOMIC_FLAG_INIT;
+    const CompilationBuilder* mCompilation;
+    const ModelBuilder* mModel;
+    std::vector<Binding> mBindings;
+    uint32_t mCurrent = 0;
+    bool mFinished = false;
+};
+
+}  // namespace nn
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_RUNTIME_STATE_BUILDER_H
@@ -22,10 +22,14 @@
 
 #include <android-base/file.h>
 #include <android-base/properties.h>
+#include <android-base/strings.h>
 #include <android/content/pm/IPackageManagerNative.h>
 #include <binder/IServiceManager.h>
+#include <dlfcn.h>
 #include <procpartition/procpartition.h>
 #include <algorithm>
+#include <map>
+#include <mutex>
 #include <string_view>
 
 namespace android {
@@ -63,6 +67,10 @@ bool isNNAPIVendorExtensionsUseAllowedInProductImage() {
     return vExtProductDeny.empty();
 }
 
+// Property listing the shared libraries providing CPU implementations of
+// extension operations, separated by commas (see ExtensionCpuKernels).
+const char kCpuKernelsProperty[] = "ro.nnapi.extensions.cpu_kernels";
+
 // The file containing the list of Android apps and binaries allowed to use vendor extensions.
 // Each line of the file contains new entry. If entry is prefixed by
 // '/' slash, then it's a native binary path (e.g. '/data/foo'). If not, it's a name
@@ -164,6 +172,7 @@ TypeManager::TypeManager() {
     mExtensionsAllowed = isNNAPIVendorExtensionsUseAllowed(getVendorExtensionAllowlistedApps());
     VLOG(MANAGER) << "NNAPI Vendor extensions enabled: " << mExtensionsAllowed;
     findAvailableExtensions();
+    loadCpuKernelLibraries();
 }
 
 bool TypeManager::isExtensionsUseAllowed(const AppPackageInfo& appPackageInfo,
@@ -236,6 +245,82 @@ bool TypeManager::registerExtension(Extension extension, const std::string& devi
     return true;
 }
 
+void TypeManager::loadCpuKernelLibraries() {
+    if (!mExtensionsAllowed) {
+        return;
+    }
+    const std::string libraries = android::base::GetProperty(kCpuKernelsProperty, "");
+    for (const std::string& path : android::base::Split(libraries, ",")) {
+        if (!path.empty()) {
+            loadCpuKernelLibrary(path);
+        }
+    }
+}
+
+bool TypeManager::loadCpuKernelLibrary(const std::string& path) {
+    static std::mutex loadedLibrariesMutex;
+    static std::map<std::string, const ExtensionCpuKernels*> loadedLibraries;
+    std::lock_guard<std::mutex> lock(loadedLibrariesMutex);
+    auto it = loadedLibraries.find(path);
+    if (it == loadedLibraries.end()) {
+        void* library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (library == nullptr) {
+            LOG(ERROR) << "Failed to load extension CPU kernels " << path << ": " << dlerror();
+            return false;
+        }
+        auto getCpuKernels = reinterpret_cast<GetExtensionCpuKernelsFn>(
+                dlsym(library, kGetExtensionCpuKernelsSymbol));
+        const ExtensionCpuKernels* kernels = getCpuKernels ? getCpuKernels() : nullptr;
+        if (kernels == nullptr) {
+            LOG(ERROR) << "No extension CPU kernels in " << path;
+            dlclose(library);
+            return false;
+        }
+        it = loadedLibraries.emplace(path, kernels).first;
+    }
+    if (!registerCpuKernels(*it->second, path)) {
+        LOG(ERROR) << "No extension CPU kernels registered from " << path;
+        return false;
+    }
+    return true;
+}
+
+bool TypeManager::registerCpuKernels(const ExtensionCpuKernels& kernels,
+                                     const std::string& source) {
+    const std::string& name = kernels.extension.name;
+    NN_RET_CHECK(kernels.resolver != nullptr) << "No operation resolver in " << source;
+    NN_RET_CHECK(mExtensionNameToCpuResolver.count(name) == 0)
+            << "Extension " << name << " already has CPU kernels";
+    NN_RET_CHECK(registerExtension(kernels.extension, source));
+    mExtensionNameToCpuResolver.emplace(name, kernels.resolver);
+    VLOG(MANAGER) << "Registered CPU kernels for extension " << name << " from " << source;
+    return true;
+}
+
+const OperationRegistration* TypeManager::findCpuOperation(OperationType type) const {
+    if (!isExtensionOperationType(type)) {
+        return nullptr;
+    }
+    const uint16_t prefix = static_cast<uint32_t>(type) >> kLowBitsType;
+    // Not getExtensionInfo(), which logs an error for an unknown prefix.
+    if (prefix >= mPrefixToExtension.size()) {
+        return nullptr;
+    }
+    auto it = mExtensionNameToCpuResolver.find(mPrefixToExtension[prefix]->name);
+    if (it == mExtensionNameToCpuResolver.end()) {
+        return nullptr;
+    }
+    return it->second->findOperation(type);
+}
+
+bool TypeManager::isCpuOperationSupported(const Operation& operation,
+                                          const Operand* operands) const {
+    const OperationRegistration* registration = findCpuOperation(operation.type);
+    return registration != nullptr &&
+           validateOperationWithRegistration(*registration, operation, operands,
+                                             HalVersion::LATEST);
+}
+
 bool TypeManager::getExtensionPrefix(const std::string& extensionName, uint16_t* prefix) {
     auto it = mExtensionNameToPrefix.find(extensionName);
     if (it != mExtensionNameToPrefix.end()) {
@@ -318,5 +403,13 @@ uint32_t TypeManager::getSizeOfData(OperandType type,
     return size;
 }
 
+const OperationRegistration* CpuOperationResolver::findOperation(
+        OperationType operationType) const {
+    if (isExtensionOperationType(operationType)) {
+        return TypeManager::get()->findCpuOperation(operationType);
+    }
+    return BuiltinOperationResolver::get()->findOperation(operationType);
+}
+
 }  // namespace nn
 }  // namespace android
@@ -19,6 +19,7 @@
 
 #include "HalInterfaces.h"
 #include "Manager.h"
+#include "OperationResolver.h"
 
 #include <map>
 #include <set>
@@ -79,6 +80,28 @@ class TypeManager {
     // Returns true if extensions usage is allowed in current process.
     bool areExtensionsAllowed() const { return mExtensionsAllowed; }
 
+    // Looks up the CPU implementation of an extension operation.
+    //
+    // Returns nullptr if the operation is not an extension operation, or if
+    // no CPU implementation of it was registered.
+    const OperationRegistration* findCpuOperation(OperationType type) const;
+
+    // Returns true if a CPU implementation of the extension operation was
+    // registered and its validate function accepts the operation, whose
+    // operand indexes refer to operands. An implementation without a validate
+    // function is never used.
+    bool isCpuOperationSupported(const Operation& operation, const Operand* operands) const;
+
+    // This method is intended for use only by internal unit tests.
+    //
+    // Registers CPU implementations of the operations of an extension, as if
+    // loaded from a library listed in ro.nnapi.extensions.cpu_kernels.
+    //
+    // Returns true if the registration was successful.
+    bool forTest_registerCpuKernels(const ExtensionCpuKernels& kernels) {
+        return registerCpuKernels(kernels, "INTERNAL TEST");
+    }
+
     // This method is intended for use only by internal unit tests.
     //
     // Registers an extension.
@@ -128,6 +151,17 @@ class TypeManager {
     void findAvailableExtensions();
     bool registerExtension(Extension extension, const std::string& deviceName);
 
+    // Loads the CPU implementations of extension operations from the
+    // libraries listed in ro.nnapi.extensions.cpu_kernels. Each library is
+    // loaded once per process and never unloaded, since executions may be
+    // running its kernels; forTest_reset() registers its kernels again.
+    void loadCpuKernelLibraries();
+    bool loadCpuKernelLibrary(const std::string& path);
+    // Registers the extension of the kernels, as a device providing it would,
+    // and the kernels themselves. source names where they come from, for
+    // error reporting.
+    bool registerCpuKernels(const ExtensionCpuKernels& kernels, const std::string& source);
+
     // Returns the numeric "prefix" value corresponding to an extension.
     //
     // Returns false when assigning a new prefix would overflow uint16_t.
@@ -155,6 +189,28 @@ class TypeManager {
 
     // True if Extensions can be used in current process.
     bool mExtensionsAllowed = false;
+
+    // The CPU implementations of the operations of each extension that has
+    // them. The libraries providing them are never unloaded.
+    std::map<std::string, const IOperationResolver*> mExtensionNameToCpuResolver;
+};
+
+// Resolves the operations the runtime runs on the CPU: the builtin operations,
+// and the extension operations whose CPU implementations are registered with
+// TypeManager.
+class CpuOperationResolver : public IOperationResolver {
+    DISALLOW_COPY_AND_ASSIGN(CpuOperationResolver);
+
+   public:
+    static const CpuOperationResolver* get() {
+        static CpuOperationResolver instance;
+        return &instance;
+    }
+
+    const OperationRegistration* findOperation(OperationType operationType) const override;
+
+   private:
+    CpuOperationResolver() {}
 };
 
 }  // namespace nn
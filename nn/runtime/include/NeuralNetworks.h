@@ -5222,6 +5222,50 @@ typedef struct ANeuralNetworksSymmPerChannelQuantParams {
 typedef struct ANeuralNetworksBurst ANeuralNetworksBurst;
 #endif  //  __ANDROID_API__ >= __ANDROID_API_Q__
 
+#if __ANDROID_API__ >= 30
+/**
+ * ANeuralNetworksState is an opaque type that holds the state a sequence model,
+ * such as an LSTM or an RNN, carries from one execution to the next.
+ *
+ * Such models take their state as inputs and return the updated state as
+ * outputs, for example output_state_in and output_state_out. An
+ * ANeuralNetworksState binds each such output to its input: an
+ * {@link ANeuralNetworksExecution} set to use the state with
+ * {@link ANeuralNetworksExecution_setState} reads the bound inputs from what
+ * the previous successful execution using the state wrote to the bound outputs.
+ * The state stays in memory the runtime manages and the devices read and write
+ * in place; the application doesn't copy it between executions. An
+ * ANeuralNetworksState object and the {@link ANeuralNetworksExecution} objects
+ * used with it must all have been created from the same
+ * {@link ANeuralNetworksCompilation} object.
+ *
+ * <p>To use:<ul>
+ *    <li>Create a new state object by calling the
+ *        {@link ANeuralNetworksState_create} function.</li>
+ *    <li>Bind outputs to inputs with {@link ANeuralNetworksState_bind}.</li>
+ *    <li>Allocate the state, all zeros, with
+ *        {@link ANeuralNetworksState_finish}.</li>
+ *    <li>For each execution:</li><ul>
+ *        <li>Create {@link ANeuralNetworksExecution}, call
+ *            {@link ANeuralNetworksExecution_setState} and set the other
+ *            inputs and outputs.</li>
+ *        <li>Apply the model.</li>
+ *        <li>Use and free the {@link ANeuralNetworksExecution}.</li></ul>
+ *    <li>Optionally, set the state back to all zeros with
+ *        {@link ANeuralNetworksState_reset}, for example at the start of a new
+ *        sequence.</li>
+ *    <li>Destroy the state with {@link ANeuralNetworksState_free}.</li></ul></p>
+ *
+ * <p>At most one execution can use a state at any given time; an execution
+ * started while another one using the same state hasn't finished fails with
+ * ANEURALNETWORKS_BAD_STATE. An execution that fails leaves the state as it
+ * was.</p>
+ *
+ * Available since API level 30.
+ */
+typedef struct ANeuralNetworksState ANeuralNetworksState;
+#endif  // __ANDROID_API__ >= 30
+
 /**
  * ANeuralNetworksOperandType describes the type of an operand.
  *
@@ -5669,6 +5713,47 @@ int ANeuralNetworksMemory_createFromAHardwareBuffer(const AHardwareBuffer* ahwb,
                                                     ANeuralNetworksMemory** memory)
         __INTRODUCED_IN(29);
 
+/**
+ * Set the state back to all zeros.
+ *
+ * Available since API level 29.
+ *
+ * @param state The state object. It must have been finished.
+ *
+ * @return ANEURALNETWORKS_NO_ERROR if successful, ANEURALNETWORKS_BAD_STATE if
+ *         the state is not finished or an execution is using it.
+ */
+int ANeuralNetworksState_reset(ANeuralNetworksState* state) __INTRODUCED_IN(29);
+
+/**
+ * Destroys the state object.
+ *
+ * Available since API level 29.
+ *
+ * @param state The state object to be destroyed. Passing NULL is acceptable and
+ *              results in no operation.
+ */
+void ANeuralNetworksState_free(ANeuralNetworksState* state) __INTRODUCED_IN(29);
+
+/**
+ * Specifies that the execution reads and writes the inputs and outputs bound
+ * in the given state from and to the state, see {@link ANeuralNetworksState}.
+ *
+ * The bound inputs and outputs must not have been set, and can't be set
+ * afterwards. Evaluation of the execution must not have been scheduled. The
+ * state must outlive the execution.
+ *
+ * Available since API level 29.
+ *
+ * @param execution The execution to be modified.
+ * @param state The state object. It must have been finished, and created from
+ *              the same {@link ANeuralNetworksCompilation} as the execution.
+ *
+ * @return ANEURALNETWORKS_NO_ERROR if successful.
+ */
+int ANeuralNetworksExecution_setState(ANeuralNetworksExecution* execution,
+                                      ANeuralNetworksState* state) __INTRODUCED_IN(29);
+
 /**
 
  * Specifies whether duration of the {@link ANeuralNetworksExecution} is to be
@@ -5728,6 +5813,192 @@ int ANeuralNetworksExecution_getDuration(const ANeuralNetworksExecution* executi
 
 #endif  // __ANDROID_API__ >= __ANDROID_API_Q__
 
+#if __ANDROID_API__ >= 30
+
+/**
+ * Starts restoring compilations from the compilation cache in the background.
+ *
+ * An application that knows which models it is going to compile shortly can
+ * call this function with their caching information, so that the runtime
+ * opens the cache files and asks the drivers to prepare the models while the
+ * application does other work. A later {@link ANeuralNetworksCompilation_finish}
+ * on a compilation with the same cache directory, token, set of devices and
+ * execution preference uses the prepared models, waiting for them if they are
+ * still being prepared. Each prefetched compilation is used at most once.
+ *
+ * Prefetching is only a hint: a token without a matching cache entry is
+ * ignored, and the compilation of a prefetched model behaves exactly as it
+ * would without prefetching, apart from taking less time.
+ *
+ * This function returns without waiting for the models to be prepared.
+ *
+ * @param cacheDir The cache directory, as passed to
+ *                 {@link ANeuralNetworksCompilation_setCaching}.
+ * @param tokens The tokens of the compilations to prefetch, each of length
+ *               ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN.
+ * @param numTokens The number of tokens.
+ * @param devices The set of devices the compilations will be created for with
+ *                {@link ANeuralNetworksCompilation_createForDevices}, or NULL
+ *                for compilations created with {@link ANeuralNetworksCompilation_create}.
+ * @param numDevices The number of devices in the set, or 0 if devices is NULL.
+ * @param preference The execution preference the compilations will be set to with
+ *                   {@link ANeuralNetworksCompilation_setPreference}.
+ *
+ * @return ANEURALNETWORKS_NO_ERROR if successful.
+ *
+ * Available since API level 30.
+ */
+int ANeuralNetworks_prefetchCompilationCache(const char* cacheDir, const uint8_t* const* tokens,
+                                             uint32_t numTokens,
+                                             const ANeuralNetworksDevice* const* devices,
+                                             uint32_t numDevices, int32_t preference)
+        __INTRODUCED_IN(30);
+
+/**
+ * Creates a memory object for an input of a compilation.
+ *
+ * The memory has the size of the input operand, and is allocated in the kind
+ * of memory the device the compilation runs the input on accesses best; this
+ * may be memory that the CPU can only reach slowly. Unlike the memory from
+ * {@link ANeuralNetworksMemory_createFromFd}, the application can't access its
+ * contents directly. Use it to pass a result from one execution to another
+ * without a round trip through the application, for example by setting it as
+ * an output of one compilation with
+ * {@link ANeuralNetworksExecution_setOutputFromMemory} and as an input of
+ * another with {@link ANeuralNetworksExecution_setInputFromMemory}. The
+ * runtime passes it to the devices as is; it only copies the contents out
+ * when a part of the model running on the CPU reads them.
+ *
+ * The input must have fully specified dimensions. The memory can be used with
+ * any compilation, with an offset of zero and a length of at most the size of
+ * the input; it is only allocated for this one. If the input is used on
+ * several devices, the memory is shared memory.
+ *
+ * See {@link ANeuralNetworksCompilation} for information on multithreaded usage.
+ *
+ * Available since API level 30.
+ *
+ * @param compilation The compilation. It must have been finished.
+ * @param index The index of the input argument, in the same sense as for
+ *              {@link ANeuralNetworksExecution_setInputFromMemory}.
+ * @param memory The memory object to be created.
+ *               Set to NULL if unsuccessful.
+ *
+ * @return ANEURALNETWORKS_NO_ERROR if successful, ANEURALNETWORKS_BAD_STATE if
+ *         the compilation is not finished, ANEURALNETWORKS_BAD_DATA if the
+ *         index is out of range or the input has unspecified dimensions.
+ */
+int ANeuralNetworksMemory_createForCompilationInput(const ANeuralNetworksCompilation* compilation,
+                                                    int32_t index, ANeuralNetworksMemory** memory)
+        __INTRODUCED_IN(30);
+
+/**
+ * Creates a memory object for an output of a compilation.
+ *
+ * This is the same as {@link ANeuralNetworksMemory_createForCompilationInput},
+ * for the output at index, in the same sense as for
+ * {@link ANeuralNetworksExecution_setOutputFromMemory}.
+ *
+ * Available since API level 30.
+ *
+ * @param compilation The compilation. It must have been finished.
+ * @param index The index of the output argument.
+ * @param memory The memory object to be created.
+ *               Set to NULL if unsuccessful.
+ *
+ * @return ANEURALNETWORKS_NO_ERROR if successful, ANEURALNETWORKS_BAD_STATE if
+ *         the compilation is not finished, ANEURALNETWORKS_BAD_DATA if the
+ *         index is out of range or the output has unspecified dimensions.
+ */
+int ANeuralNetworksMemory_createForCompilationOutput(const ANeuralNetworksCompilation* compilation,
+                                                     int32_t index, ANeuralNetworksMemory** memory)
+        __INTRODUCED_IN(30);
+
+/**
+ * Create a {@link ANeuralNetworksState} for the executions of the given
+ * compilation.
+ *
+ * <p>The provided compilation must outlive the state object.</p>
+ *
+ * Available since API level 30.
+ *
+ * @param compilation The {@link ANeuralNetworksCompilation}. It must have been
+ *                    finished.
+ * @param state The newly created object or NULL if unsuccessful.
+ *
+ * @return ANEURALNETWORKS_NO_ERROR if successful, ANEURALNETWORKS_BAD_STATE
+ *         if the compilation is not finished or is invalid.
+ */
+int ANeuralNetworksState_create(ANeuralNetworksCompilation* compilation,
+                                ANeuralNetworksState** state) __INTRODUCED_IN(30);
+
+/**
+ * Binds an output of the model to an input, so that each execution using the
+ * state reads the input from the output of the previous one.
+ *
+ * The output and the input must have the same operand type, with fully
+ * specified dimensions. Each output and each input can be bound at most once.
+ *
+ * Available since API level 30.
+ *
+ * @param state The state object. It must not have been finished.
+ * @param outputIndex The index of the output argument, in the same sense as
+ *                    for {@link ANeuralNetworksExecution_setOutput}.
+ * @param inputIndex The index of the input argument, in the same sense as for
+ *                   {@link ANeuralNetworksExecution_setInput}.
+ *
+ * @return ANEURALNETWORKS_NO_ERROR if successful, ANEURALNETWORKS_BAD_STATE if
+ *         the state is finished, ANEURALNETWORKS_BAD_DATA if an index is out
+ *         of range or already bound, or the operand types differ.
+ */
+int ANeuralNetworksState_bind(ANeuralNetworksState* state, int32_t outputIndex,
+                              int32_t inputIndex) __INTRODUCED_IN(30);
+
+/**
+ * Indicate that we have finished binding the state, and allocate it. The
+ * state is initially all zeros.
+ *
+ * Available since API level 30.
+ *
+ * @param state The state object to finish.
+ *
+ * @return ANEURALNETWORKS_NO_ERROR if successful.
+ */
+int ANeuralNetworksState_finish(ANeuralNetworksState* state) __INTRODUCED_IN(30);
+
+/**
+ * Gets the fingerprint of a finished model.
+ *
+ * The fingerprint is a digest of everything that defines the model: its
+ * operands, operations, inputs and outputs, and the values of its constant
+ * operands, whichever way these values were provided. Models built by the
+ * same sequence of calls with the same constant values have the same
+ * fingerprint. Its length is ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN, so
+ * that it can be passed as the token to
+ * {@link ANeuralNetworksCompilation_setCaching} instead of a token the
+ * application derives by hashing the model's weights itself.
+ *
+ * The fingerprint is computed on the first call for a given model, which
+ * reads all the constant values of the model; later calls are cheap.
+ * Fingerprints are not guaranteed to be stable across platform releases.
+ *
+ * See {@link ANeuralNetworksModel} for information on multithreaded usage.
+ *
+ * @param model The model. It must have been finished.
+ * @param fingerprint The buffer receiving the fingerprint, of length
+ *                    ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN.
+ *
+ * @return ANEURALNETWORKS_NO_ERROR if successful, ANEURALNETWORKS_BAD_STATE if
+ *         the model is not finished, ANEURALNETWORKS_BAD_DATA if the model has
+ *         constant values in memory the runtime cannot read.
+ *
+ * Available since API level 30.
+ */
+int ANeuralNetworksModel_getFingerprint(const ANeuralNetworksModel* model, uint8_t* fingerprint)
+        __INTRODUCED_IN(30);
+
+#endif  // __ANDROID_API__ >= 30
+
 #if __ANDROID_API__ >= 27
 
 /**
@@ -152,6 +152,10 @@ class Memory {
                  ANEURALNETWORKS_NO_ERROR;
     }
 
+    // Takes ownership of a memory object the runtime created, for example with
+    // ANeuralNetworksMemory_createForCompilationInput.
+    explicit Memory(ANeuralNetworksMemory* memory) : mMemory(memory), mValid(memory != nullptr) {}
+
     ~Memory() { ANeuralNetworksMemory_free(mMemory); }
 
     // Disallow copy semantics to ensure the runtime object can only be freed
@@ -434,6 +438,10 @@ class Execution {
                 mExecution, index, type, memory->get(), offset, length));
     }
 
+    Result setState(ANeuralNetworksState* state) {
+        return static_cast<Result>(ANeuralNetworksExecution_setState(mExecution, state));
+    }
+
     Result startCompute(Event* event) {
         ANeuralNetworksEvent* ev = nullptr;
         Result result = static_cast<Result>(ANeuralNetworksExecution_startCompute(mExecution, &ev));
@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks of the fixed cost of an execution, on models small enough for the
+// computation itself to be negligible: a single ADD, and a multilayer
+// perceptron of two FULLY_CONNECTED layers of width 8.
+//
+// Each iteration is one inference as an application would run it, from
+// ANeuralNetworksExecution_create to ANeuralNetworksExecution_free, along
+// every path:
+// - compute: ANeuralNetworksExecution_compute;
+// - startCompute: ANeuralNetworksExecution_startCompute and
+//   ANeuralNetworksEvent_wait;
+// - burst: ANeuralNetworksExecution_burstCompute on a burst created once;
+// - memory: compute, with the inputs and outputs in an ANeuralNetworksMemory
+//   (setInputFromMemory) rather than in application buffers (setInput);
+// on each device:
+// - cpu: the CPU reference device;
+// - sample_sync, sample_async: a SampleDriverFull registered inside this
+//   process, called through executeSynchronously() or execute_1_2()
+//   respectively (DeviceManager::setSyncExecHal()).
+//
+// Besides the time per iteration, each benchmark reports the mean time per
+// iteration spent in each NNTRACE tracepoint, in microseconds, as counters
+// named "<phase> <tracepoint>" (see Tracing.h for the phases): e.g.
+// "PIO ANeuralNetworksExecution_setInput" for the setup of the execution,
+// "PE ExecutionPlan::makeController", "PIO StepExecutor::startComputeOnDevice"
+// for the marshaling of the Request, "PIO SampleDriver::executeSynchronously"
+// for the mapping of its pools, "PE ExecutionBuilder::compute thread" for a
+// thread hand-off, or "PR ExecutionCallback::notify". The tracepoints nest, so
+// the counters do not add up to the total.
+
+#include "Manager.h"
+#include "NeuralNetworks.h"
+#include "SampleDriverFull.h"
+#include "TestNeuralNetworksWrapper.h"
+#include "TraceSink.h"
+#include "Utils.h"
+
+#include <android-base/logging.h>
+#include <android/sharedmem.h>
+#include <benchmark/benchmark.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace nn {
+namespace {
+
+using test_wrapper::OperandType;
+using test_wrapper::Result;
+using test_wrapper::Type;
+using WrapperModel = test_wrapper::Model;
+
+enum class TinyModel { ADD, MLP };
+enum class Target { CPU, SAMPLE_SYNC, SAMPLE_ASYNC };
+enum class Path { COMPUTE, START_COMPUTE, BURST, MEMORY };
+
+constexpr char kSampleDeviceName[] = "overhead-benchmark-sample";
+constexpr uint32_t kWidth = 8;
+
+// The trace events are drained every kDrainIterations iterations, with the
+// timing paused, so that no thread's buffer fills up: an execution completes a
+// few dozen tracepoints per thread, and a buffer holds 1024 (see TraceSink.cpp).
+constexpr int64_t kDrainIterations = 8;
+
+// The total time per tracepoint received from the TraceSink.
+class PhaseTimes {
+   public:
+    void add(const std::vector<TraceEvent>& events) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const TraceEvent& event : events) {
+            TraceEventName name;
+            if (parseTraceEventName(event.name, &name)) {
+                mTotalNs[name.phase + " " + name.detail] += event.durationNs;
+            }
+        }
+    }
+
+    void reset() {
+        drainTraceEvents();
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTotalNs.clear();
+    }
+
+    void report(benchmark::State& state) {
+        drainTraceEvents();
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const auto& [name, totalNs] : mTotalNs) {
+            state.counters[name] = totalNs / 1000.0 / state.iterations();
+        }
+    }
+
+   private:
+    std::mutex mMutex;
+    std::map<std::string, uint64_t> mTotalNs;
+};
+
+PhaseTimes* getPhaseTimes() {
+    static PhaseTimes* phaseTimes = new PhaseTimes;
+    return phaseTimes;
+}
+
+WrapperModel* makeModel(TinyModel tinyModel) {
+    auto model = new WrapperModel;
+    OperandType vectorType(Type::TENSOR_FLOAT32, {1, kWidth});
+    OperandType activationType(Type::INT32, {});
+    auto addActivation = [model, &activationType](int32_t value) {
+        auto activation = model->addOperand(&activationType);
+        model->setOperandValue(activation, &value, sizeof(value));
+        return activation;
+    };
+    auto input0 = model->addOperand(&vectorType);
+    auto output = model->addOperand(&vectorType);
+    if (tinyModel == TinyModel::ADD) {
+        auto input1 = model->addOperand(&vectorType);
+        model->addOperation(ANEURALNETWORKS_ADD,
+                            {input0, input1, addActivation(ANEURALNETWORKS_FUSED_NONE)}, {output});
+        model->identifyInputsAndOutputs({input0, input1}, {output});
+    } else {
+        OperandType weightsType(Type::TENSOR_FLOAT32, {kWidth, kWidth});
+        OperandType biasType(Type::TENSOR_FLOAT32, {kWidth});
+        static const std::vector<float> kWeights(kWidth * kWidth, 0.125f);
+        static const std::vector<float> kBias(kWidth, 0.5f);
+        auto addLayer = [&](uint32_t input, uint32_t layerOutput, int32_t activation) {
+            auto weights = model->addOperand(&weightsType);
+            model->setOperandValue(weights, kWeights.data(), kWeights.size() * sizeof(float));
+            auto bias = model->addOperand(&biasType);
+            model->setOperandValue(bias, kBias.data(), kBias.size() * sizeof(float));
+            model->addOperation(ANEURALNETWORKS_FULLY_CONNECTED,
+                                {input, weights, bias, addActivation(activation)}, {layerOutput});
+        };
+        auto hidden = model->addOperand(&vectorType);
+        addLayer(input0, hidden, ANEURALNETWORKS_FUSED_RELU);
+        addLayer(hidden, output, ANEURALNETWORKS_FUSED_NONE);
+        model->identifyInputsAndOutputs({input0}, {output});
+    }
+    CHECK(model->finish() == Result::NO_ERROR);
+    return model;
+}
+
+ANeuralNetworksDevice* getDevice(Target target) {
+    std::shared_ptr<Device> device;
+    if (target == Target::CPU) {
+        device = DeviceManager::getCpuDevice();
+    } else {
+        for (const auto& registered : DeviceManager::get()->getDrivers()) {
+            if (registered->getName() == std::string(kSampleDeviceName)) {
+                device = registered;
+            }
+        }
+    }
+    CHECK(device != nullptr);
+    return reinterpret_cast<ANeuralNetworksDevice*>(device.get());
+}
+
+void BM_Execution(benchmark::State& state, TinyModel tinyModel, Target target, Path path) {
+    if (target != Target::CPU) {
+        DeviceManager::get()->setSyncExecHal(target == Target::SAMPLE_SYNC);
+    }
+    std::unique_ptr<WrapperModel> model(makeModel(tinyModel));
+    const uint32_t inputCount = (tinyModel == TinyModel::ADD ? 2 : 1);
+    const size_t vectorSize = kWidth * sizeof(float);
+
+    ANeuralNetworksDevice* device = getDevice(target);
+    ANeuralNetworksCompilation* compilation = nullptr;
+    CHECK_EQ(ANeuralNetworksCompilation_createForDevices(model->getHandle(), &device, 1,
+                                                         &compilation),
+             ANEURALNETWORKS_NO_ERROR);
+    CHECK_EQ(ANeuralNetworksCompilation_finish(compilation), ANEURALNETWORKS_NO_ERROR);
+
+    ANeuralNetworksBurst* burst = nullptr;
+    if (path == Path::BURST) {
+        CHECK_EQ(ANeuralNetworksBurst_create(compilation, &burst), ANEURALNETWORKS_NO_ERROR);
+    }
+
+    // The arguments, one vector per input and then the output, either in
+    // buffers or at consecutive offsets of a memory.
+    std::vector<std::vector<float>> buffers(inputCount + 1, std::vector<float>(kWidth, 1.0f));
+    int fd = -1;
+    ANeuralNetworksMemory* memory = nullptr;
+    if (path == Path::MEMORY) {
+        fd = ASharedMemory_create("overhead", (inputCount + 1) * vectorSize);
+        CHECK_GE(fd, 0);
+        CHECK_EQ(ANeuralNetworksMemory_createFromFd((inputCount + 1) * vectorSize,
+                                                    PROT_READ | PROT_WRITE, fd, 0, &memory),
+                 ANEURALNETWORKS_NO_ERROR);
+    }
+
+    auto runOnce = [&] {
+        ANeuralNetworksExecution* execution = nullptr;
+        CHECK_EQ(ANeuralNetworksExecution_create(compilation, &execution),
+                 ANEURALNETWORKS_NO_ERROR);
+        for (uint32_t i = 0; i < inputCount; i++) {
+            if (memory != nullptr) {
+                CHECK_EQ(ANeuralNetworksExecution_setInputFromMemory(execution, i, nullptr, memory,
+                                                                     i * vectorSize, vectorSize),
+                         ANEURALNETWORKS_NO_ERROR);
+            } else {
+                CHECK_EQ(ANeuralNetworksExecution_setInput(execution, i, nullptr,
+                                                           buffers[i].data(), vectorSize),
+                         ANEURALNETWORKS_NO_ERROR);
+            }
+        }
+        if (memory != nullptr) {
+            CHECK_EQ(ANeuralNetworksExecution_setOutputFromMemory(
+                             execution, 0, nullptr, memory, inputCount * vectorSize, vectorSize),
+                     ANEURALNETWORKS_NO_ERROR);
+        } else {
+            CHECK_EQ(ANeuralNetworksExecution_setOutput(execution, 0, nullptr,
+                                                        buffers[inputCount].data(), vectorSize),
+                     ANEURALNETWORKS_NO_ERROR);
+        }
+        switch (path) {
+            case Path::COMPUTE:
+            case Path::MEMORY:
+                CHECK_EQ(ANeuralNetworksExecution_compute(execution), ANEURALNETWORKS_NO_ERROR);
+                break;
+            case Path::START_COMPUTE: {
+                ANeuralNetworksEvent* event = nullptr;
+                CHECK_EQ(ANeuralNetworksExecution_startCompute(execution, &event),
+                         ANEURALNETWORKS_NO_ERROR);
+                CHECK_EQ(ANeuralNetworksEvent_wait(event), ANEURALNETWORKS_NO_ERROR);
+                ANeuralNetworksEvent_free(event);
+                break;
+            }
+            case Path::BURST:
+                CHECK_EQ(ANeuralNetworksExecution_burstCompute(execution, burst),
+                         ANEURALNETWORKS_NO_ERROR);
+                break;
+        }
+        ANeuralNetworksExecution_free(execution);
+    };
+
+    // The first execution maps the memories and warms up the caches; keep it
+    // out of the breakdown.
+    runOnce();
+    getPhaseTimes()->reset();
+    const uint64_t droppedTraceEventCount = getDroppedTraceEventCount();
+    int64_t iteration = 0;
+    for ([[maybe_unused]] auto _ : state) {
+        runOnce();
+        if (++iteration % kDrainIterations == 0) {
+            state.PauseTiming();
+            drainTraceEvents();
+            state.ResumeTiming();
+        }
+    }
+    getPhaseTimes()->report(state);
+    if (getDroppedTraceEventCount() != droppedTraceEventCount) {
+        state.SkipWithError("Trace events were dropped, the breakdown is incomplete");
+    }
+
+    ANeuralNetworksMemory_free(memory);
+    if (fd >= 0) {
+        close(fd);
+    }
+    ANeuralNetworksBurst_free(burst);
+    ANeuralNetworksCompilation_free(compilation);
+}
+
+void registerBenchmarks() {
+    const std::pair<const char*, TinyModel> models[] = {{"add", TinyModel::ADD},
+                                                        {"mlp", TinyModel::MLP}};
+    const std::pair<const char*, Target> targets[] = {{"cpu", Target::CPU},
+                                                      {"sample_sync", Target::SAMPLE_SYNC},
+                                                      {"sample_async", Target::SAMPLE_ASYNC}};
+    const std::pair<const char*, Path> paths[] = {{"compute", Path::COMPUTE},
+                                                  {"startCompute", Path::START_COMPUTE},
+                                                  {"burst", Path::BURST},
+                                                  {"memory", Path::MEMORY}};
+    for (const auto& [modelName, tinyModel] : models) {
+        for (const auto& [targetName, target] : targets) {
+            for (const auto& [pathName, path] : paths) {
+                const std::string name = std::string("BM_Execution/") + modelName + "/" +
+                                         targetName + "/" + pathName;
+                benchmark::RegisterBenchmark(name.c_str(), BM_Execution, tinyModel, target, path)
+                        ->Unit(benchmark::kMicrosecond);
+            }
+        }
+    }
+}
+
+}  // namespace
+}  // namespace nn
+}  // namespace android
+
+int main(int argc, char** argv) {
+    using namespace android::nn;
+    ::benchmark::Initialize(&argc, argv);
+    initVLogMask();
+    DeviceManager::get()->forTest_registerDevice(
+            kSampleDeviceName, new sample_driver::SampleDriverFull(
+                                       kSampleDeviceName, {.execTime = 1.0f, .powerUsage = 1.0f}));
+    // Drained explicitly, see kDrainIterations and PhaseTimes.
+    setTraceSink(createCallbackTraceSink([](const std::vector<TraceEvent>& events) {
+                     getPhaseTimes()->add(events);
+                 }),
+                 std::chrono::hours(1));
+    registerBenchmarks();
+    ::benchmark::RunSpecifiedBenchmarks();
+    setTraceSink(nullptr);
+    return 0;
+}
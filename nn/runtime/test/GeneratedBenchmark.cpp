@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmark driver for the generated test models.
+//
+// Usage:
+//   NeuralNetworksTest_benchmark [gtest flags] [--device=<name>] [--warmup=<n>]
+//                                [--iterations=<n>] [--output=<file>]
+//
+// --device selects where the models are compiled: "cpu" (the default) for
+// the CPU reference device, "sample" for a SampleDriverFull registered inside
+// this process, or the name of any other device known to the runtime. Models
+// the device cannot compile are skipped.
+//
+// The results are one JSON array per run, written on a single line and
+// appended to the output file (or written to stdout), so that several runs
+// can be aggregated by tools/parse_benchmark.py. Each entry has the fields of
+// the parse_benchmark.py statistics ("benchmark", "mean", "stddev", "min",
+// "max" and "n", in milliseconds) plus latency percentiles, throughput,
+// compilation time and the peak resident set size of the process.
+
+#include "GeneratedBenchmark.h"
+
+#include "Manager.h"
+#include "SampleDriverFull.h"
+#include "Utils.h"
+
+#include <android-base/logging.h>
+#include <gtest/gtest.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+namespace generated_tests {
+
+using namespace android::nn;
+using namespace android::nn::test_wrapper;
+using namespace test_helper;
+
+namespace {
+
+constexpr char kSampleDeviceName[] = "benchmark-sample";
+
+struct BenchmarkOptions {
+    std::string device = "cpu";
+    uint32_t warmupIterations = 10;
+    uint32_t iterations = 100;
+    std::string outputFile;
+};
+
+struct BenchmarkResult {
+    std::string name;
+    double compileMs;
+    // Latencies of the timed executions, in milliseconds, sorted.
+    std::vector<double> latenciesMs;
+    double throughput;  // executions per second
+    long peakRssKb;
+};
+
+BenchmarkOptions gOptions;
+std::vector<BenchmarkResult> gResults;
+
+// A compilation for exactly one device.
+class DeviceCompilation : public Compilation {
+   public:
+    DeviceCompilation(const Model* model, const ANeuralNetworksDevice* device) {
+        if (ANeuralNetworksCompilation_createForDevices(model->getHandle(), &device, 1,
+                                                        &mCompilation) !=
+            ANEURALNETWORKS_NO_ERROR) {
+            mCompilation = nullptr;
+        }
+    }
+    bool isValid() const { return mCompilation != nullptr; }
+};
+
+const ANeuralNetworksDevice* findDevice(const std::string& name) {
+    if (name == "cpu") {
+        return reinterpret_cast<const ANeuralNetworksDevice*>(
+                DeviceManager::getCpuDevice().get());
+    }
+    uint32_t numDevices = 0;
+    ANeuralNetworks_getDeviceCount(&numDevices);
+    for (uint32_t i = 0; i < numDevices; i++) {
+        ANeuralNetworksDevice* device = nullptr;
+        ANeuralNetworks_getDevice(i, &device);
+        const char* deviceName = nullptr;
+        if (ANeuralNetworksDevice_getName(device, &deviceName) == ANEURALNETWORKS_NO_ERROR &&
+            name == deviceName) {
+            return device;
+        }
+    }
+    return nullptr;
+}
+
+// Runs one execution of example, and returns whether it succeeded.
+bool executeExample(const Compilation* compilation, const MixedTypedExample& example,
+                    MixedTyped* outputs) {
+    Execution execution(compilation);
+    bool ok = true;
+    for_all(example.operands.first, [&execution, &ok](int idx, const void* p, size_t s) {
+        ok &= execution.setInput(idx, s == 0 ? nullptr : p, s) == Result::NO_ERROR;
+    });
+    for_all(*outputs, [&execution, &ok](int idx, void* p, size_t s) {
+        ok &= execution.setOutput(idx, s == 0 ? nullptr : p, s) == Result::NO_ERROR;
+    });
+    return ok && execution.compute() == Result::NO_ERROR;
+}
+
+// Nearest-rank percentile of sorted values.
+double percentile(const std::vector<double>& sorted, double p) {
+    const size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+std::string toJson(const std::vector<BenchmarkResult>& results) {
+    std::ostringstream out;
+    out << "[";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult& result = results[i];
+        const std::vector<double>& latencies = result.latenciesMs;
+        const double n = latencies.size();
+        const double mean = std::accumulate(latencies.begin(), latencies.end(), 0.0) / n;
+        double variance = 0;
+        for (double latency : latencies) {
+            variance += (latency - mean) * (latency - mean);
+        }
+        variance = n > 1 ? variance / (n - 1) : 0;
+        out << (i == 0 ? "" : ", ") << "{\"benchmark\": \"" << result.name << "\""
+            << ", \"device\": \"" << gOptions.device << "\""
+            << ", \"mean\": " << mean << ", \"stddev\": " << std::sqrt(variance)
+            << ", \"min\": " << latencies.front() << ", \"max\": " << latencies.back()
+            << ", \"n\": " << latencies.size() << ", \"p50\": " << percentile(latencies, 0.5)
+            << ", \"p90\": " << percentile(latencies, 0.9)
+            << ", \"p99\": " << percentile(latencies, 0.99)
+            << ", \"throughput\": " << result.throughput
+            << ", \"compile_ms\": " << result.compileMs
+            << ", \"peak_rss_kb\": " << result.peakRssKb << "}";
+    }
+    out << "]";
+    return out.str();
+}
+
+bool parseOptions(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto value = [&arg](const char* flag) -> const char* {
+            const size_t length = strlen(flag);
+            return arg.compare(0, length, flag) == 0 ? arg.c_str() + length : nullptr;
+        };
+        if (const char* device = value("--device=")) {
+            gOptions.device = device;
+        } else if (const char* warmup = value("--warmup=")) {
+            gOptions.warmupIterations = std::stoul(warmup);
+        } else if (const char* iterations = value("--iterations=")) {
+            gOptions.iterations = std::stoul(iterations);
+        } else if (const char* output = value("--output=")) {
+            gOptions.outputFile = output;
+        } else {
+            std::cerr << "Unexpected argument: " << arg << std::endl;
+            return false;
+        }
+    }
+    if (gOptions.iterations == 0) {
+        std::cerr << "--iterations must be positive" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+void benchmarkModel(const Model* model, const std::vector<MixedTypedExample>& examples,
+                    const std::string& name) {
+    if (examples.empty()) {
+        GTEST_SKIP();
+    }
+    const ANeuralNetworksDevice* device = findDevice(gOptions.device);
+    ASSERT_NE(device, nullptr) << "Unknown device " << gOptions.device;
+
+    const auto compileStart = std::chrono::steady_clock::now();
+    DeviceCompilation compilation(model, device);
+    if (!compilation.isValid() || compilation.finish() != Result::NO_ERROR) {
+        std::cout << "[  SKIPPED ] " << name << " cannot be compiled for " << gOptions.device
+                  << std::endl;
+        return;
+    }
+    const auto compileEnd = std::chrono::steady_clock::now();
+
+    std::vector<MixedTyped> outputs(examples.size());
+    for (size_t i = 0; i < examples.size(); i++) {
+        resize_accordingly(examples[i].operands.second, outputs[i]);
+    }
+    for (uint32_t i = 0; i < gOptions.warmupIterations; i++) {
+        const size_t index = i % examples.size();
+        if (!executeExample(&compilation, examples[index], &outputs[index])) {
+            std::cout << "[  SKIPPED ] " << name << " cannot be executed on " << gOptions.device
+                      << std::endl;
+            return;
+        }
+    }
+
+    BenchmarkResult result;
+    result.name = name;
+    result.compileMs =
+            std::chrono::duration<double, std::milli>(compileEnd - compileStart).count();
+    result.latenciesMs.reserve(gOptions.iterations);
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < gOptions.iterations; i++) {
+        const size_t index = i % examples.size();
+        const auto executionStart = std::chrono::steady_clock::now();
+        ASSERT_TRUE(executeExample(&compilation, examples[index], &outputs[index]));
+        const auto executionEnd = std::chrono::steady_clock::now();
+        result.latenciesMs.push_back(
+                std::chrono::duration<double, std::milli>(executionEnd - executionStart).count());
+    }
+    const auto end = std::chrono::steady_clock::now();
+    result.throughput =
+            gOptions.iterations / std::chrono::duration<double>(end - start).count();
+    std::sort(result.latenciesMs.begin(), result.latenciesMs.end());
+
+    // ru_maxrss is the high-water mark of the whole process so far, so it only
+    // grows from one model to the next. Run a single model (--gtest_filter) to
+    // attribute it to that model.
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    result.peakRssKb = usage.ru_maxrss;
+    gResults.push_back(std::move(result));
+}
+
+}  // namespace generated_tests
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (!generated_tests::parseOptions(argc, argv)) {
+        return 1;
+    }
+    // The dynamic output shape tests run the same models again.
+    if (::testing::GTEST_FLAG(filter) == "*") {
+        ::testing::GTEST_FLAG(filter) = "GeneratedTests.*";
+    }
+    android::nn::initVLogMask();
+
+    if (generated_tests::gOptions.device == "sample") {
+        using android::nn::sample_driver::SampleDriverFull;
+        generated_tests::gOptions.device = generated_tests::kSampleDeviceName;
+        android::nn::DeviceManager::get()->forTest_registerDevice(
+                generated_tests::kSampleDeviceName,
+                new SampleDriverFull(generated_tests::kSampleDeviceName,
+                                     {.execTime = 1.0f, .powerUsage = 1.0f}));
+    }
+
+    const int n = RUN_ALL_TESTS();
+
+    const std::string json = generated_tests::toJson(generated_tests::gResults);
+    if (generated_tests::gOptions.outputFile.empty()) {
+        std::cout << json << std::endl;
+    } else {
+        std::ofstream out(generated_tests::gOptions.outputFile, std::ofstream::app);
+        out << json << std::endl;
+        if (!out) {
+            std::cerr << "Failed to write " << generated_tests::gOptions.outputFile << std::endl;
+            return 1;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_FRAMEWORK_ML_NN_RUNTIME_TEST_GENERATED_BENCHMARK_H
+#define ANDROID_FRAMEWORK_ML_NN_RUNTIME_TEST_GENERATED_BENCHMARK_H
+
+#include "TestHarness.h"
+#include "TestNeuralNetworksWrapper.h"
+
+#include <string>
+#include <vector>
+
+namespace generated_tests {
+
+// When the generated tests are built with NNTEST_BENCHMARK, each test times
+// its model instead of checking it: the model is compiled once on the device
+// selected on the command line, and then executed repeatedly on the inputs of
+// its examples. The results of all the models are written out as JSON at the
+// end of the run, see GeneratedBenchmark.cpp.
+void benchmarkModel(const android::nn::test_wrapper::Model* model,
+                    const std::vector<test_helper::MixedTypedExample>& examples,
+                    const std::string& name);
+
+}  // namespace generated_tests
+
+#endif  // ANDROID_FRAMEWORK_ML_NN_RUNTIME_TEST_GENERATED_BENCHMARK_H
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Scalability benchmarks for the compilation of large models, to check that
+// the runtime stays close to linear in the number of operations.
+//
+// Each benchmark builds a synthetic model: a chain of 1k to 50k ADD and MUL
+// operations, each consuming the outputs of the previous two. Two fake drivers
+// split the work, one supporting only ADD and the other only MUL, so that the
+// pattern of operation types decides the partitioning:
+// - uniform: ADD only, so a single device runs the whole model;
+// - blocks: runs of kBlockSize ADD then kBlockSize MUL, one step per run;
+// - alternating: ADD and MUL alternate, one step per operation.
+//
+// The phases of compilation are timed separately:
+// - ModelFinish: ANeuralNetworksModel_finish, i.e. validation and the sort of
+//   the operations into run order;
+// - ValidateModel: validation only, so the sort is the difference of the two;
+// - Partition: partitionTheWork with 1.2 drivers, including the compilation of
+//   every step by the (fake) drivers;
+// - PartitionSliced: the same with 1.1 drivers, which also slices the model
+//   into a 1.1 model for getSupportedOperations; slicing is the difference.
+//
+// Each benchmark is registered once per pattern, so that it reports its
+// complexity over the number of operations for that pattern.
+
+#include "ExecutionPlan.h"
+#include "HalInterfaces.h"
+#include "Manager.h"
+#include "ModelBuilder.h"
+#include "NeuralNetworks.h"
+#include "SampleDriver.h"
+#include "Utils.h"
+#include "ValidateHal.h"
+
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <vector>
+
+namespace android {
+namespace nn {
+namespace {
+
+using sample_driver::SampleDriver;
+
+enum class Pattern { UNIFORM, BLOCKS, ALTERNATING };
+
+constexpr uint32_t kBlockSize = 64;
+
+OperationType getOperationType(Pattern pattern, uint32_t operationIndex) {
+    switch (pattern) {
+        case Pattern::UNIFORM:
+            return OperationType::ADD;
+        case Pattern::BLOCKS:
+            return (operationIndex / kBlockSize) % 2 ? OperationType::MUL : OperationType::ADD;
+        case Pattern::ALTERNATING:
+            return operationIndex % 2 ? OperationType::MUL : OperationType::ADD;
+    }
+    return OperationType::ADD;
+}
+
+// Builds the model described at the top of this file, without finishing it.
+std::unique_ptr<ModelBuilder> makeModel(uint32_t operationCount, Pattern pattern) {
+    auto model = std::make_unique<ModelBuilder>();
+    const uint32_t dimensions[] = {1};
+    const ANeuralNetworksOperandType tensorType = {.type = ANEURALNETWORKS_TENSOR_FLOAT32,
+                                                   .dimensionCount = 1,
+                                                   .dimensions = dimensions};
+    const ANeuralNetworksOperandType scalarType = {.type = ANEURALNETWORKS_INT32};
+
+    uint32_t operandCount = 0;
+    auto addOperand = [&model, &operandCount](const ANeuralNetworksOperandType& type) {
+        CHECK_EQ(model->addOperand(type), ANEURALNETWORKS_NO_ERROR);
+        return operandCount++;
+    };
+    const uint32_t modelInputs[] = {addOperand(tensorType), addOperand(tensorType)};
+    const uint32_t activation = addOperand(scalarType);
+    const int32_t activationValue = ANEURALNETWORKS_FUSED_NONE;
+    CHECK_EQ(model->setOperandValue(activation, &activationValue, sizeof(activationValue)),
+             ANEURALNETWORKS_NO_ERROR);
+
+    uint32_t secondLast = modelInputs[0];
+    uint32_t last = modelInputs[1];
+    for (uint32_t i = 0; i < operationCount; i++) {
+        const uint32_t inputs[] = {last, secondLast, activation};
+        const uint32_t output = addOperand(tensorType);
+        CHECK_EQ(model->addOperation(static_cast<int32_t>(getOperationType(pattern, i)), 3, inputs,
+                                     1, &output),
+                 ANEURALNETWORKS_NO_ERROR);
+        secondLast = last;
+        last = output;
+    }
+    CHECK_EQ(model->identifyInputsAndOutputs(2, modelInputs, 1, &last), ANEURALNETWORKS_NO_ERROR);
+    return model;
+}
+
+// A driver that supports the operations of a single type, and only those.
+class OneOperationDriver : public SampleDriver {
+   public:
+    OneOperationDriver(const char* name, OperationType supportedOperationType)
+        : SampleDriver(name), mSupportedOperationType(supportedOperationType) {}
+
+    Return<void> getCapabilities_1_2(getCapabilities_1_2_cb cb) override {
+        const PerformanceInfo perfInfo = {.execTime = 0.5f, .powerUsage = 0.5f};
+        cb(ErrorStatus::NONE, {.relaxedFloat32toFloat16PerformanceScalar = perfInfo,
+                               .relaxedFloat32toFloat16PerformanceTensor = perfInfo,
+                               .operandPerformance = nonExtensionOperandPerformance(perfInfo)});
+        return Void();
+    }
+
+    Return<void> getSupportedOperations_1_2(const Model& model,
+                                            getSupportedOperations_1_2_cb cb) override {
+        if (!validateModel(model)) {
+            cb(ErrorStatus::INVALID_ARGUMENT, {});
+            return Void();
+        }
+        std::vector<bool> supported(model.operations.size());
+        for (size_t i = 0; i < supported.size(); i++) {
+            supported[i] = (model.operations[i].type == mSupportedOperationType);
+        }
+        cb(ErrorStatus::NONE, supported);
+        return Void();
+    }
+
+   private:
+    const OperationType mSupportedOperationType;
+};
+
+// Hides the 1.2 interface of a OneOperationDriver, so that the runtime slices
+// the models it queries the driver with.
+class OneOperationDriverV1_1 : public V1_1::IDevice {
+   public:
+    OneOperationDriverV1_1(const char* name, OperationType supportedOperationType)
+        : mDriverV1_2(new OneOperationDriver(name, supportedOperationType)) {}
+    Return<void> getCapabilities_1_1(getCapabilities_1_1_cb cb) override {
+        return mDriverV1_2->getCapabilities_1_1(cb);
+    }
+    Return<void> getSupportedOperations_1_1(const V1_1::Model& model,
+                                            getSupportedOperations_1_1_cb cb) override {
+        return mDriverV1_2->getSupportedOperations_1_1(model, cb);
+    }
+    Return<ErrorStatus> prepareModel_1_1(const V1_1::Model& model, ExecutionPreference preference,
+                                         const sp<V1_0::IPreparedModelCallback>& cb) override {
+        return mDriverV1_2->prepareModel_1_1(model, preference, cb);
+    }
+    Return<DeviceStatus> getStatus() override { return mDriverV1_2->getStatus(); }
+    Return<void> getCapabilities(getCapabilities_cb cb) override {
+        return mDriverV1_2->getCapabilities(cb);
+    }
+    Return<void> getSupportedOperations(const V1_0::Model& model,
+                                        getSupportedOperations_cb cb) override {
+        return mDriverV1_2->getSupportedOperations(model, cb);
+    }
+    Return<ErrorStatus> prepareModel(const V1_0::Model& model,
+                                     const sp<V1_0::IPreparedModelCallback>& cb) override {
+        return mDriverV1_2->prepareModel(model, cb);
+    }
+
+   private:
+    const sp<V1_2::IDevice> mDriverV1_2;
+};
+
+std::vector<std::shared_ptr<Device>> makeDevices(HalVersion halVersion) {
+    std::vector<std::shared_ptr<Device>> devices;
+    for (const auto& [name, type] : {std::make_pair("add", OperationType::ADD),
+                                     std::make_pair("mul", OperationType::MUL)}) {
+        sp<V1_0::IDevice> driver;
+        if (halVersion == HalVersion::V1_1) {
+            driver = new OneOperationDriverV1_1(name, type);
+        } else {
+            driver = new OneOperationDriver(name, type);
+        }
+        devices.push_back(DeviceManager::forTest_makeDriverDevice(name, driver));
+    }
+    devices.push_back(DeviceManager::getCpuDevice());
+    return devices;
+}
+
+void BM_ModelFinish(benchmark::State& state, Pattern pattern) {
+    const uint32_t operationCount = state.range(0);
+    for ([[maybe_unused]] auto _ : state) {
+        state.PauseTiming();
+        std::unique_ptr<ModelBuilder> model = makeModel(operationCount, pattern);
+        state.ResumeTiming();
+        CHECK_EQ(model->finish(), ANEURALNETWORKS_NO_ERROR);
+        state.PauseTiming();
+        model.reset();
+        state.ResumeTiming();
+    }
+    state.SetComplexityN(operationCount);
+}
+
+void BM_ValidateModel(benchmark::State& state, Pattern pattern) {
+    const uint32_t operationCount = state.range(0);
+    std::unique_ptr<ModelBuilder> model = makeModel(operationCount, pattern);
+    Model hidlModel;
+    model->setHidlModel(&hidlModel);
+    for ([[maybe_unused]] auto _ : state) {
+        CHECK(validateModel(hidlModel));
+    }
+    state.SetComplexityN(operationCount);
+}
+
+void partition(benchmark::State& state, Pattern pattern, HalVersion halVersion) {
+    const uint32_t operationCount = state.range(0);
+    std::unique_ptr<ModelBuilder> model = makeModel(operationCount, pattern);
+    CHECK_EQ(model->finish(), ANEURALNETWORKS_NO_ERROR);
+    const std::vector<std::shared_ptr<Device>> devices = makeDevices(halVersion);
+    size_t stepCount = 0;
+    for ([[maybe_unused]] auto _ : state) {
+        ExecutionPlan plan;
+        CHECK_EQ(model->partitionTheWork(devices, ANEURALNETWORKS_PREFER_SUSTAINED_SPEED, &plan),
+                 ANEURALNETWORKS_NO_ERROR);
+        stepCount = plan.forTest_getKind() == ExecutionPlan::Kind::COMPOUND
+                            ? plan.forTest_compoundGetSteps().size()
+                            : 1;
+        state.PauseTiming();
+        plan.reset();
+        state.ResumeTiming();
+    }
+    state.counters["steps"] = stepCount;
+    state.SetComplexityN(operationCount);
+}
+
+void BM_Partition(benchmark::State& state, Pattern pattern) {
+    partition(state, pattern, HalVersion::V1_2);
+}
+
+void BM_PartitionSliced(benchmark::State& state, Pattern pattern) {
+    partition(state, pattern, HalVersion::V1_1);
+}
+
+void addArguments(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgName("operations")
+            ->Arg(1000)
+            ->Arg(5000)
+            ->Arg(10000)
+            ->Arg(50000)
+            ->Unit(benchmark::kMillisecond)
+            ->Complexity();
+}
+
+#define BENCHMARK_PATTERNS(function)                                               \
+    BENCHMARK_CAPTURE(function, uniform, Pattern::UNIFORM)->Apply(addArguments);   \
+    BENCHMARK_CAPTURE(function, blocks, Pattern::BLOCKS)->Apply(addArguments);     \
+    BENCHMARK_CAPTURE(function, alternating, Pattern::ALTERNATING)->Apply(addArguments)
+
+BENCHMARK_PATTERNS(BM_ModelFinish);
+BENCHMARK_PATTERNS(BM_ValidateModel);
+BENCHMARK_PATTERNS(BM_Partition);
+BENCHMARK_PATTERNS(BM_PartitionSliced);
+
+#undef BENCHMARK_PATTERNS
+
+}  // namespace
+}  // namespace nn
+}  // namespace android
+
+BENCHMARK_MAIN();
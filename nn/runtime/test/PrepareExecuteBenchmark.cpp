@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks of what the sample driver does once per prepared model against
+// what it does once per execution.
+//
+// The model is a chain of ADD operations on small tensors, each adding a
+// constant to the result of the previous one, so that the cost per operand and
+// per operation dominates the cost of the kernels. The benchmarks are:
+// - CpuPrepare: building a CpuExecutorModel, the part of a run that depends
+//   only on the model;
+// - CpuRun: CpuExecutor::run on the model itself, which builds the
+//   CpuExecutorModel every time, as the runtime's CPU path does;
+// - CpuRunPrepared: CpuExecutor::run on a CpuExecutorModel built beforehand;
+//   the difference with CpuRun is what preparation saves each execution;
+// - DriverPrepare and DriverExecute: prepareModel_1_2 and executeSynchronously
+//   of SampleDriverFull, which prepares once and shares the result.
+
+#include "Callbacks.h"
+#include "CpuExecutor.h"
+#include "HalInterfaces.h"
+#include "ModelBuilder.h"
+#include "NeuralNetworks.h"
+#include "SampleDriverFull.h"
+#include "Utils.h"
+
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <vector>
+
+namespace android {
+namespace nn {
+namespace {
+
+using sample_driver::HidlToken;
+using sample_driver::SampleDriverFull;
+
+constexpr uint32_t kLength = 256;
+
+// The model described at the top of this file, with its pools mapped, and a
+// request for it.
+struct Workload {
+    explicit Workload(uint32_t operationCount);
+
+    Model model;
+    std::vector<RunTimePoolInfo> modelPoolInfos;
+    Request request;
+    std::vector<RunTimePoolInfo> requestPoolInfos;
+};
+
+Workload::Workload(uint32_t operationCount) {
+    ModelBuilder builder;
+    const uint32_t dimensions[] = {kLength};
+    const ANeuralNetworksOperandType tensorType = {.type = ANEURALNETWORKS_TENSOR_FLOAT32,
+                                                   .dimensionCount = 1,
+                                                   .dimensions = dimensions};
+    const ANeuralNetworksOperandType scalarType = {.type = ANEURALNETWORKS_INT32};
+
+    uint32_t operandCount = 0;
+    auto addOperand = [&builder, &operandCount](const ANeuralNetworksOperandType& type) {
+        CHECK_EQ(builder.addOperand(type), ANEURALNETWORKS_NO_ERROR);
+        return operandCount++;
+    };
+    const uint32_t input = addOperand(tensorType);
+    const uint32_t constant = addOperand(tensorType);
+    const std::vector<float> constantValue(kLength, 1.0f);
+    CHECK_EQ(builder.setOperandValue(constant, constantValue.data(),
+                                     constantValue.size() * sizeof(float)),
+             ANEURALNETWORKS_NO_ERROR);
+    const uint32_t activation = addOperand(scalarType);
+    const int32_t activationValue = ANEURALNETWORKS_FUSED_NONE;
+    CHECK_EQ(builder.setOperandValue(activation, &activationValue, sizeof(activationValue)),
+             ANEURALNETWORKS_NO_ERROR);
+
+    uint32_t last = input;
+    for (uint32_t i = 0; i < operationCount; i++) {
+        const uint32_t inputs[] = {last, constant, activation};
+        const uint32_t output = addOperand(tensorType);
+        CHECK_EQ(builder.addOperation(ANEURALNETWORKS_ADD, 3, inputs, 1, &output),
+                 ANEURALNETWORKS_NO_ERROR);
+        last = output;
+    }
+    CHECK_EQ(builder.identifyInputsAndOutputs(1, &input, 1, &last), ANEURALNETWORKS_NO_ERROR);
+    CHECK_EQ(builder.finish(), ANEURALNETWORKS_NO_ERROR);
+    builder.setHidlModel(&model);
+    CHECK(setRunTimePoolInfosFromHidlMemories(&modelPoolInfos, model.pools));
+
+    const uint32_t size = kLength * sizeof(float);
+    request.inputs = {{.location = {.poolIndex = 0, .offset = 0, .length = size}}};
+    request.outputs = {{.location = {.poolIndex = 1, .offset = 0, .length = size}}};
+    request.pools = {allocateSharedMemory(size), allocateSharedMemory(size)};
+    CHECK(setRunTimePoolInfosFromHidlMemories(&requestPoolInfos, request.pools));
+}
+
+sp<V1_2::IPreparedModel> prepare(const sp<SampleDriverFull>& driver, const Model& model) {
+    const sp<PreparedModelCallback> callback = new PreparedModelCallback();
+    const HidlToken token;
+    CHECK(driver->prepareModel_1_2(model, ExecutionPreference::FAST_SINGLE_ANSWER, {}, {}, token,
+                                   callback)
+                  .isOk());
+    callback->wait();
+    CHECK(callback->getStatus() == ErrorStatus::NONE);
+    return V1_2::IPreparedModel::castFrom(callback->getPreparedModel()).withDefault(nullptr);
+}
+
+void BM_CpuPrepare(benchmark::State& state) {
+    const Workload workload(state.range(0));
+    for ([[maybe_unused]] auto _ : state) {
+        CpuExecutorModel preparedModel(workload.model, workload.modelPoolInfos);
+        benchmark::DoNotOptimize(preparedModel.getOperands().data());
+    }
+}
+
+void BM_CpuRun(benchmark::State& state) {
+    const Workload workload(state.range(0));
+    for ([[maybe_unused]] auto _ : state) {
+        CpuExecutor executor;
+        CHECK_EQ(executor.run(workload.model, workload.request, workload.modelPoolInfos,
+                              workload.requestPoolInfos),
+                 ANEURALNETWORKS_NO_ERROR);
+    }
+}
+
+void BM_CpuRunPrepared(benchmark::State& state) {
+    const Workload workload(state.range(0));
+    const CpuExecutorModel preparedModel(workload.model, workload.modelPoolInfos);
+    for ([[maybe_unused]] auto _ : state) {
+        CpuExecutor executor;
+        CHECK_EQ(executor.run(preparedModel, workload.request, workload.requestPoolInfos),
+                 ANEURALNETWORKS_NO_ERROR);
+    }
+}
+
+void BM_DriverPrepare(benchmark::State& state) {
+    const Workload workload(state.range(0));
+    const sp<SampleDriverFull> driver =
+            new SampleDriverFull("sample-prepare", {.execTime = 1.0f, .powerUsage = 1.0f});
+    for ([[maybe_unused]] auto _ : state) {
+        benchmark::DoNotOptimize(prepare(driver, workload.model).get());
+    }
+}
+
+void BM_DriverExecute(benchmark::State& state) {
+    const Workload workload(state.range(0));
+    const sp<SampleDriverFull> driver =
+            new SampleDriverFull("sample-prepare", {.execTime = 1.0f, .powerUsage = 1.0f});
+    const sp<V1_2::IPreparedModel> preparedModel = prepare(driver, workload.model);
+    CHECK(preparedModel != nullptr);
+    for ([[maybe_unused]] auto _ : state) {
+        ErrorStatus status = ErrorStatus::GENERAL_FAILURE;
+        preparedModel->executeSynchronously(
+                workload.request, MeasureTiming::NO,
+                [&status](ErrorStatus error, const hidl_vec<OutputShape>&, const Timing&) {
+                    status = error;
+                });
+        CHECK(status == ErrorStatus::NONE);
+    }
+}
+
+void addArguments(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgName("operations")->Arg(1)->Arg(10)->Arg(100)->Arg(1000);
+}
+
+BENCHMARK(BM_CpuPrepare)->Apply(addArguments);
+BENCHMARK(BM_CpuRun)->Apply(addArguments);
+BENCHMARK(BM_CpuRunPrepared)->Apply(addArguments);
+BENCHMARK(BM_DriverPrepare)->Apply(addArguments);
+BENCHMARK(BM_DriverExecute)->Apply(addArguments);
+
+}  // namespace
+}  // namespace nn
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ArgumentTransform.h"
+#include "ExecutionBuilder.h"
+#include "Manager.h"
+#include "TestNeuralNetworksWrapper.h"
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+
+using namespace android::nn;
+using Result = test_wrapper::Result;
+using Type = test_wrapper::Type;
+
+namespace {
+
+constexpr uint32_t kChannels = 3;
+constexpr uint32_t kPixels = 4;
+
+// Builds c = a + b on NCHW tensors of 3 channels of 2x2 elements.
+void CreateAddModel(test_wrapper::Model* model) {
+    test_wrapper::OperandType tensorType(Type::TENSOR_FLOAT32, {1, kChannels, 2, 2});
+    test_wrapper::OperandType scalarType(Type::INT32, {});
+    int32_t activation(ANEURALNETWORKS_FUSED_NONE);
+    auto a = model->addOperand(&tensorType);
+    auto b = model->addOperand(&tensorType);
+    auto c = model->addOperand(&tensorType);
+    auto d = model->addOperand(&scalarType);
+    model->setOperandValue(d, &activation, sizeof(activation));
+    model->addOperation(ANEURALNETWORKS_ADD, {a, b, d}, {c});
+    model->identifyInputsAndOutputs({a, b}, {c});
+    ASSERT_TRUE(model->isValid());
+    ASSERT_EQ(model->finish(), Result::NO_ERROR);
+}
+
+// Builds c = a + b on TENSOR_QUANT8_ASYMM operands of 2 channels of 2
+// elements, with a scale of 0.5 and a zero point of 128.
+void CreateQuantAddModel(test_wrapper::Model* model) {
+    test_wrapper::OperandType tensorType(Type::TENSOR_QUANT8_ASYMM, {2, 2}, 0.5f, 128);
+    test_wrapper::OperandType scalarType(Type::INT32, {});
+    int32_t activation(ANEURALNETWORKS_FUSED_NONE);
+    auto a = model->addOperand(&tensorType);
+    auto b = model->addOperand(&tensorType);
+    auto c = model->addOperand(&tensorType);
+    auto d = model->addOperand(&scalarType);
+    model->setOperandValue(d, &activation, sizeof(activation));
+    model->addOperation(ANEURALNETWORKS_ADD, {a, b, d}, {c});
+    model->identifyInputsAndOutputs({a, b}, {c});
+    ASSERT_TRUE(model->isValid());
+    ASSERT_EQ(model->finish(), Result::NO_ERROR);
+}
+
+// Input a is an RGBA uint8 image normalized to [-1, 1), output c is in NHWC
+// order.
+ArgumentTransform imageInputTransform() {
+    ArgumentTransform transform;
+    transform.bufferType = OperandType::TENSOR_QUANT8_ASYMM;
+    transform.bufferChannels = 4;
+    transform.channelMap = {0, 1, 2};
+    transform.mean = {128.0f};
+    transform.stddev = {128.0f};
+    transform.nchw = true;
+    return transform;
+}
+
+ArgumentTransform nhwcOutputTransform() {
+    ArgumentTransform transform;
+    transform.nchw = true;
+    return transform;
+}
+
+class ArgumentTransformTest : public ::testing::Test {
+   protected:
+    virtual void SetUp() override {
+        CreateAddModel(&mModel);
+        compile();
+    }
+
+    virtual void TearDown() override {
+        ANeuralNetworksExecution_free(mExecution);
+        ANeuralNetworksCompilation_free(mCompilation);
+    }
+
+    // Compiles mModel for the CPU and creates mExecution.
+    void compile() {
+        ANeuralNetworksDevice* device =
+                reinterpret_cast<ANeuralNetworksDevice*>(DeviceManager::getCpuDevice().get());
+        ASSERT_EQ(ANeuralNetworksCompilation_createForDevices(mModel.getHandle(), &device, 1,
+                                                              &mCompilation),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksCompilation_finish(mCompilation), ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksExecution_create(mCompilation, &mExecution),
+                  ANEURALNETWORKS_NO_ERROR);
+    }
+
+    ExecutionBuilder* executionBuilder() const {
+        return reinterpret_cast<ExecutionBuilder*>(mExecution);
+    }
+
+    test_wrapper::Model mModel;
+    ANeuralNetworksCompilation* mCompilation = nullptr;
+    ANeuralNetworksExecution* mExecution = nullptr;
+};
+
+TEST_F(ArgumentTransformTest, ImageInNhwcOut) {
+    ASSERT_EQ(executionBuilder()->setInputTransform(0, imageInputTransform()),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(executionBuilder()->setOutputTransform(0, nhwcOutputTransform()),
+              ANEURALNETWORKS_NO_ERROR);
+
+    // Pixel p has channels {64 * p, 64 * p + 32, 64 * p + 16, 255}.
+    std::vector<uint8_t> image(kPixels * 4);
+    for (uint32_t p = 0; p < kPixels; p++) {
+        image[p * 4 + 0] = 64 * p;
+        image[p * 4 + 1] = 64 * p + 32;
+        image[p * 4 + 2] = 64 * p + 16;
+        image[p * 4 + 3] = 255;
+    }
+    // b, in NCHW order, adds the channel index.
+    std::vector<float> b(kChannels * kPixels);
+    for (uint32_t c = 0; c < kChannels; c++) {
+        for (uint32_t p = 0; p < kPixels; p++) {
+            b[c * kPixels + p] = c;
+        }
+    }
+    std::vector<float> output(kPixels * kChannels);
+    ASSERT_EQ(ANeuralNetworksExecution_setInput(mExecution, 0, nullptr, image.data(),
+                                                image.size()),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(ANeuralNetworksExecution_setInput(mExecution, 1, nullptr, b.data(),
+                                                b.size() * sizeof(float)),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(ANeuralNetworksExecution_setOutput(mExecution, 0, nullptr, output.data(),
+                                                 output.size() * sizeof(float)),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(ANeuralNetworksExecution_compute(mExecution), ANEURALNETWORKS_NO_ERROR);
+
+    for (uint32_t p = 0; p < kPixels; p++) {
+        for (uint32_t c = 0; c < kChannels; c++) {
+            const float expected = (image[p * 4 + c] - 128.0f) / 128.0f + c;
+            EXPECT_FLOAT_EQ(output[p * kChannels + c], expected) << "pixel " << p << " channel "
+                                                                 << c;
+        }
+    }
+}
+
+// A float output written to a uint8 buffer saturates, and NaN becomes 0.
+TEST_F(ArgumentTransformTest, FloatToUint8Output) {
+    ArgumentTransform transform;
+    transform.bufferType = OperandType::TENSOR_QUANT8_ASYMM;
+    transform.mean = {128.0f};
+    transform.stddev = {128.0f};
+    ASSERT_EQ(executionBuilder()->setOutputTransform(0, transform), ANEURALNETWORKS_NO_ERROR);
+
+    std::vector<float> a(kChannels * kPixels, 0.0f);
+    a[0] = -0.5f;
+    a[1] = 0.25f;
+    a[2] = 5.0f;
+    a[3] = -5.0f;
+    a[4] = NAN;
+    const std::vector<float> b(kChannels * kPixels, 0.0f);
+    std::vector<uint8_t> output(kChannels * kPixels, 42);
+    ASSERT_EQ(ANeuralNetworksExecution_setInput(mExecution, 0, nullptr, a.data(),
+                                                a.size() * sizeof(float)),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(ANeuralNetworksExecution_setInput(mExecution, 1, nullptr, b.data(),
+                                                b.size() * sizeof(float)),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(ANeuralNetworksExecution_setOutput(mExecution, 0, nullptr, output.data(),
+                                                 output.size()),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(ANeuralNetworksExecution_compute(mExecution), ANEURALNETWORKS_NO_ERROR);
+
+    EXPECT_EQ(output[0], 64);
+    EXPECT_EQ(output[1], 160);
+    EXPECT_EQ(output[2], 255);
+    EXPECT_EQ(output[3], 0);
+    EXPECT_EQ(output[4], 0);
+    for (size_t i = 5; i < output.size(); i++) {
+        EXPECT_EQ(output[i], 128) << "element " << i;
+    }
+}
+
+// Float buffers are quantized into a TENSOR_QUANT8_ASYMM input and
+// dequantized from a TENSOR_QUANT8_ASYMM output.
+TEST_F(ArgumentTransformTest, Quant8Operands) {
+    ANeuralNetworksExecution_free(mExecution);
+    ANeuralNetworksCompilation_free(mCompilation);
+    mModel = test_wrapper::Model();
+    CreateQuantAddModel(&mModel);
+    compile();
+
+    ASSERT_EQ(executionBuilder()->setInputTransform(0, ArgumentTransform()),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(executionBuilder()->setOutputTransform(0, ArgumentTransform()),
+              ANEURALNETWORKS_NO_ERROR);
+
+    // Out of range values saturate, and NaN becomes the lowest value.
+    const std::vector<float> a = {1.5f, -2.0f, 1000.0f, NAN};
+    // Adds 1.
+    const std::vector<uint8_t> b(4, 130);
+    std::vector<float> output(4);
+    ASSERT_EQ(ANeuralNetworksExecution_setInput(mExecution, 0, nullptr, a.data(),
+                                                a.size() * sizeof(float)),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(ANeuralNetworksExecution_setInput(mExecution, 1, nullptr, b.data(), b.size()),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(ANeuralNetworksExecution_setOutput(mExecution, 0, nullptr, output.data(),
+                                                 output.size() * sizeof(float)),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(ANeuralNetworksExecution_compute(mExecution), ANEURALNETWORKS_NO_ERROR);
+
+    EXPECT_FLOAT_EQ(output[0], 2.5f);
+    EXPECT_FLOAT_EQ(output[1], -1.0f);
+    EXPECT_FLOAT_EQ(output[2], 63.5f);
+    EXPECT_FLOAT_EQ(output[3], -63.0f);
+}
+
+// The arguments bound to a state are copied from and to the state, so they
+// can't have a transform.
+TEST_F(ArgumentTransformTest, BoundToState) {
+    ANeuralNetworksState* state = nullptr;
+    ASSERT_EQ(ANeuralNetworksState_create(mCompilation, &state), ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(ANeuralNetworksState_bind(state, 0, 0), ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(ANeuralNetworksState_finish(state), ANEURALNETWORKS_NO_ERROR);
+
+    ASSERT_EQ(ANeuralNetworksExecution_setState(mExecution, state), ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(executionBuilder()->setInputTransform(0, ArgumentTransform()),
+              ANEURALNETWORKS_BAD_STATE);
+    EXPECT_EQ(executionBuilder()->setOutputTransform(0, nhwcOutputTransform()),
+              ANEURALNETWORKS_BAD_STATE);
+    EXPECT_EQ(executionBuilder()->setInputTransform(1, ArgumentTransform()),
+              ANEURALNETWORKS_NO_ERROR);
+
+    // Nor can the state be set once a bound argument has a transform.
+    ANeuralNetworksExecution* execution = nullptr;
+    ASSERT_EQ(ANeuralNetworksExecution_create(mCompilation, &execution),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(reinterpret_cast<ExecutionBuilder*>(execution)->setOutputTransform(
+                      0, nhwcOutputTransform()),
+              ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(ANeuralNetworksExecution_setState(execution, state), ANEURALNETWORKS_BAD_STATE);
+    ANeuralNetworksExecution_free(execution);
+    ANeuralNetworksState_free(state);
+}
+
+TEST_F(ArgumentTransformTest, Validation) {
+    // The transform must come before the buffer.
+    std::vector<float> b(kChannels * kPixels);
+    ASSERT_EQ(ANeuralNetworksExecution_setInput(mExecution, 1, nullptr, b.data(),
+                                                b.size() * sizeof(float)),
+              ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(executionBuilder()->setInputTransform(1, imageInputTransform()),
+              ANEURALNETWORKS_BAD_STATE);
+    EXPECT_EQ(executionBuilder()->setInputTransform(2, imageInputTransform()),
+              ANEURALNETWORKS_BAD_DATA);
+
+    // The buffer has the length of the application's format, not the operand's.
+    ASSERT_EQ(executionBuilder()->setInputTransform(0, imageInputTransform()),
+              ANEURALNETWORKS_NO_ERROR);
+    std::vector<uint8_t> image(kPixels * 4);
+    EXPECT_EQ(ANeuralNetworksExecution_setInput(mExecution, 0, nullptr, b.data(),
+                                                b.size() * sizeof(float)),
+              ANEURALNETWORKS_BAD_DATA);
+    EXPECT_EQ(ANeuralNetworksExecution_setInput(mExecution, 0, nullptr, image.data(),
+                                                image.size()),
+              ANEURALNETWORKS_NO_ERROR);
+
+    // A channel map that doesn't fit the buffer channels.
+    ArgumentTransform transform = nhwcOutputTransform();
+    transform.channelMap = {0, 1, 3};
+    ASSERT_EQ(executionBuilder()->setOutputTransform(0, transform), ANEURALNETWORKS_NO_ERROR);
+    std::vector<float> output(kPixels * kChannels);
+    EXPECT_EQ(ANeuralNetworksExecution_setOutput(mExecution, 0, nullptr, output.data(),
+                                                 output.size() * sizeof(float)),
+              ANEURALNETWORKS_BAD_DATA);
+}
+
+}  // namespace
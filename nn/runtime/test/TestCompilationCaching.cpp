@@ -14,13 +14,17 @@
  * limitations under the License.
  */
 
+#include "CompilationBuilder.h"
 #include "Manager.h"
+#include "ModelBuilder.h"
 #include "SampleDriver.h"
 #include "TestNeuralNetworksWrapper.h"
 
 #include <gtest/gtest.h>
+#include <atomic>
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
 #include <numeric>
 
 using namespace android::nn;
@@ -376,6 +380,312 @@ TEST_P(CompilationCachingTest, TokenNotProvided) {
     EXPECT_EQ(driver->hasCalledPrepareModel(), HasCalledPrepareModel::WITHOUT_CACHING);
 }
 
+// A sample driver that keeps SampleDriver's own compilation caching, and records whether the
+// runtime asked it to save or restore a prepared model.
+class SampleCachingDriver : public sample_driver::SampleDriver {
+   public:
+    SampleCachingDriver(const char* name) : SampleDriver(name) {}
+
+    // Reports faster than cpu.
+    Return<void> getCapabilities_1_2(getCapabilities_1_2_cb cb) override {
+        android::nn::initVLogMask();
+        const PerformanceInfo kPerf = {.execTime = 0.1, .powerUsage = 0.1};
+        Capabilities capabilities = {
+                .relaxedFloat32toFloat16PerformanceScalar = kPerf,
+                .relaxedFloat32toFloat16PerformanceTensor = kPerf,
+                .operandPerformance = android::nn::nonExtensionOperandPerformance(kPerf)};
+        cb(ErrorStatus::NONE, capabilities);
+        return Void();
+    }
+
+    // Reports supporting all operations.
+    Return<void> getSupportedOperations_1_2(const Model& model,
+                                            getSupportedOperations_cb cb) override {
+        std::vector<bool> supported(model.operations.size(), true);
+        cb(ErrorStatus::NONE, supported);
+        return Void();
+    }
+
+    Return<ErrorStatus> prepareModel_1_2(const Model& model, ExecutionPreference preference,
+                                         const hidl_vec<hidl_handle>& modelCache,
+                                         const hidl_vec<hidl_handle>& dataCache,
+                                         const HidlToken& token,
+                                         const sp<IPreparedModelCallback>& cb) override {
+        mHasCalledPrepareModel = modelCache.size() != 0 || dataCache.size() != 0
+                                         ? HasCalledPrepareModel::WITH_CACHING
+                                         : HasCalledPrepareModel::WITHOUT_CACHING;
+        return SampleDriver::prepareModel_1_2(model, preference, modelCache, dataCache, token,
+                                              cb);
+    }
+
+    Return<ErrorStatus> prepareModelFromCache(
+            const hidl_vec<hidl_handle>& modelCache, const hidl_vec<hidl_handle>& dataCache,
+            const HidlToken& token, const sp<V1_2::IPreparedModelCallback>& callback) override {
+        mNumPrepareModelFromCacheCalls++;
+        return SampleDriver::prepareModelFromCache(modelCache, dataCache, token, callback);
+    }
+
+    uint32_t numPrepareModelFromCacheCalls() const { return mNumPrepareModelFromCacheCalls; }
+    HasCalledPrepareModel hasCalledPrepareModel() const { return mHasCalledPrepareModel; }
+
+   private:
+    // Prefetching calls prepareModelFromCache on a background thread.
+    std::atomic<uint32_t> mNumPrepareModelFromCacheCalls{0};
+    HasCalledPrepareModel mHasCalledPrepareModel = HasCalledPrepareModel::NO;
+};
+
+// Forwards to the CPU reference device, counting the models it prepares with and without the
+// compilation cache. Its executions run on the CPU, as the device has no driver interface.
+class CountingCpuDevice : public Device {
+   public:
+    VersionedIDevice* getInterface() override { return mCpuDevice->getInterface(); }
+    const char* getName() const override { return mCpuDevice->getName(); }
+    const char* getVersionString() const override { return mCpuDevice->getVersionString(); }
+    int64_t getFeatureLevel() override { return mCpuDevice->getFeatureLevel(); }
+    int32_t getType() const override { return mCpuDevice->getType(); }
+    hidl_vec<Extension> getSupportedExtensions() const override {
+        return mCpuDevice->getSupportedExtensions();
+    }
+    void getSupportedOperations(const Model& hidlModel, IModelSlicer* slicer,
+                                hidl_vec<bool>* supportedOperations) override {
+        mCpuDevice->getSupportedOperations(hidlModel, slicer, supportedOperations);
+    }
+    PerformanceInfo getPerformance(OperandType type) const override {
+        return mCpuDevice->getPerformance(type);
+    }
+    PerformanceInfo getRelaxedFloat32toFloat16PerformanceScalar() const override {
+        return mCpuDevice->getRelaxedFloat32toFloat16PerformanceScalar();
+    }
+    PerformanceInfo getRelaxedFloat32toFloat16PerformanceTensor() const override {
+        return mCpuDevice->getRelaxedFloat32toFloat16PerformanceTensor();
+    }
+    std::pair<uint32_t, uint32_t> getNumberOfCacheFilesNeeded() const override {
+        return mCpuDevice->getNumberOfCacheFilesNeeded();
+    }
+    int prepareModel(const Model& hidlModel, ExecutionPreference executionPreference,
+                     const hidl_vec<hidl_handle>& modelCache,
+                     const hidl_vec<hidl_handle>& dataCache, const HidlToken& token,
+                     std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                     std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) override {
+        mNumPrepareModelCalls++;
+        return mCpuDevice->prepareModel(hidlModel, executionPreference, modelCache, dataCache,
+                                        token, preparedModel, cpuPreparedModel);
+    }
+    int prepareModelFromCache(const hidl_vec<hidl_handle>& modelCache,
+                              const hidl_vec<hidl_handle>& dataCache, const HidlToken& token,
+                              std::shared_ptr<VersionedIPreparedModel>* preparedModel,
+                              std::shared_ptr<CpuPreparedModel>* cpuPreparedModel) override {
+        mNumPrepareModelFromCacheCalls++;
+        return mCpuDevice->prepareModelFromCache(modelCache, dataCache, token, preparedModel,
+                                                 cpuPreparedModel);
+    }
+    int allocateMemory(uint32_t size, std::unique_ptr<Memory>* memory) override {
+        return mCpuDevice->allocateMemory(size, memory);
+    }
+
+    uint32_t numPrepareModelCalls() const { return mNumPrepareModelCalls; }
+    uint32_t numPrepareModelFromCacheCalls() const { return mNumPrepareModelFromCacheCalls; }
+
+   private:
+    const std::shared_ptr<Device> mCpuDevice = DeviceManager::getCpuDevice();
+    uint32_t mNumPrepareModelCalls = 0;
+    uint32_t mNumPrepareModelFromCacheCalls = 0;
+};
+
+// The CPU reference device and SampleDriver cache their prepared models for real. Compile the
+// same model twice with the same token on a single such device, and check that the cache is
+// written by the first compilation and that the compilation restored from it computes the same
+// result.
+class RealCompilationCachingTest : public ::testing::Test {
+   protected:
+    virtual void SetUp() override {
+        char cacheDirTemp[] = "/data/local/tmp/TestRealCompilationCachingXXXXXX";
+        char* cacheDir = mkdtemp(cacheDirTemp);
+        ASSERT_NE(cacheDir, nullptr);
+        mCacheDir = cacheDir;
+        CreateBroadcastAddModel(&mModel);
+        mToken = std::vector<uint8_t>(ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN, 0);
+    }
+
+    virtual void TearDown() override {
+        if (!::testing::Test::HasFailure()) {
+            std::filesystem::remove_all(mCacheDir);
+        }
+    }
+
+    void compileAndCompute(ANeuralNetworksDevice* device) {
+        ANeuralNetworksCompilation* compilation = nullptr;
+        ASSERT_EQ(ANeuralNetworksCompilation_createForDevices(mModel.getHandle(), &device, 1,
+                                                              &compilation),
+                  ANEURALNETWORKS_NO_ERROR);
+        finishAndCompute(compilation);
+    }
+
+    // Like the above, for a device the DeviceManager doesn't know.
+    void compileAndCompute(const std::shared_ptr<Device>& device) {
+        CompilationBuilder* compilation = nullptr;
+        ASSERT_EQ(reinterpret_cast<ModelBuilder*>(mModel.getHandle())
+                          ->createCompilation(&compilation, {device}, /*explicitDeviceList=*/true),
+                  ANEURALNETWORKS_NO_ERROR);
+        finishAndCompute(reinterpret_cast<ANeuralNetworksCompilation*>(compilation));
+    }
+
+    // Sets up caching for compilation, finishes it, checks that an execution computes the
+    // expected result, and frees the compilation.
+    void finishAndCompute(ANeuralNetworksCompilation* compilation) {
+        ASSERT_EQ(ANeuralNetworksCompilation_setCaching(compilation, mCacheDir.c_str(),
+                                                        mToken.data()),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksCompilation_finish(compilation), ANEURALNETWORKS_NO_ERROR);
+
+        const float a[] = {1.0f, 2.0f, 3.0f, 4.0f};
+        const float b[] = {10.0f, 20.0f};
+        float c[4] = {};
+        ANeuralNetworksExecution* execution = nullptr;
+        ASSERT_EQ(ANeuralNetworksExecution_create(compilation, &execution),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksExecution_setInput(execution, 0, nullptr, a, sizeof(a)),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksExecution_setInput(execution, 1, nullptr, b, sizeof(b)),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksExecution_setOutput(execution, 0, nullptr, c, sizeof(c)),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksExecution_compute(execution), ANEURALNETWORKS_NO_ERROR);
+        EXPECT_EQ(std::vector<float>(c, c + 4), std::vector<float>({11.0f, 22.0f, 13.0f, 24.0f}));
+
+        ANeuralNetworksExecution_free(execution);
+        ANeuralNetworksCompilation_free(compilation);
+    }
+
+    ANeuralNetworksDevice* findDevice(const char* name) {
+        uint32_t numDevices = 0;
+        EXPECT_EQ(ANeuralNetworks_getDeviceCount(&numDevices), ANEURALNETWORKS_NO_ERROR);
+        for (uint32_t i = 0; i < numDevices; i++) {
+            ANeuralNetworksDevice* device = nullptr;
+            EXPECT_EQ(ANeuralNetworks_getDevice(i, &device), ANEURALNETWORKS_NO_ERROR);
+            const char* buffer = nullptr;
+            int result = ANeuralNetworksDevice_getName(device, &buffer);
+            if (result == ANEURALNETWORKS_NO_ERROR && strcmp(buffer, name) == 0) {
+                return device;
+            }
+        }
+        return nullptr;
+    }
+
+    size_t countCacheFiles() const {
+        return std::distance(std::filesystem::directory_iterator(mCacheDir),
+                             std::filesystem::directory_iterator{});
+    }
+
+    test_wrapper::Model mModel;
+    std::string mCacheDir;
+    std::vector<uint8_t> mToken;
+};
+
+TEST_F(RealCompilationCachingTest, CpuDevice) {
+    auto device = std::make_shared<CountingCpuDevice>();
+    EXPECT_TRUE(device->isCachingSupported());
+    EXPECT_EQ(countCacheFiles(), 0u);
+    compileAndCompute(device);
+    // One model cache file and one data cache file.
+    EXPECT_EQ(countCacheFiles(), 2u);
+    EXPECT_EQ(device->numPrepareModelCalls(), 1u);
+    compileAndCompute(device);
+    EXPECT_EQ(countCacheFiles(), 2u);
+    // The second compilation restored the model from the cache instead of preparing it again.
+    EXPECT_EQ(device->numPrepareModelCalls(), 1u);
+    EXPECT_EQ(device->numPrepareModelFromCacheCalls(), 1u);
+}
+
+TEST_F(RealCompilationCachingTest, CpuDeviceCorruptedModelCache) {
+    std::shared_ptr<Device> cpuDevice = DeviceManager::getCpuDevice();
+    ANeuralNetworksDevice* device = reinterpret_cast<ANeuralNetworksDevice*>(cpuDevice.get());
+    compileAndCompute(device);
+
+    // The model cache file starts with the magic "NNMC", and ends with the constant activation of
+    // the ADD, followed by the empty pool lists, the relaxed flag and the empty extension list.
+    // Turning the activation from NONE into RELU6 leaves a valid model that computes something
+    // else, which the digest of the model cache must catch.
+    bool corrupted = false;
+    for (const auto& entry : std::filesystem::directory_iterator(mCacheDir)) {
+        std::fstream file(entry.path(), std::ios::in | std::ios::out | std::ios::binary);
+        char magic[4] = {};
+        file.read(magic, sizeof(magic));
+        if (!file || memcmp(magic, "NNMC", sizeof(magic)) != 0) {
+            continue;
+        }
+        const auto size = std::filesystem::file_size(entry.path());
+        const size_t activationFromEnd = sizeof(int32_t) + 2 * sizeof(uint32_t) + sizeof(uint8_t) +
+                                         sizeof(uint32_t);
+        file.seekp(size - activationFromEnd);
+        file.put(static_cast<char>(ANEURALNETWORKS_FUSED_RELU6));
+        ASSERT_TRUE(file.good());
+        corrupted = true;
+    }
+    ASSERT_TRUE(corrupted);
+    // A cache miss: the model is compiled again and computes the right result.
+    compileAndCompute(device);
+}
+
+TEST_F(RealCompilationCachingTest, SampleDriver) {
+    if (DeviceManager::get()->getUseCpuOnly()) {
+        return;
+    }
+    static constexpr char kDeviceName[] = "deviceTestSampleCompilationCaching";
+
+    sp<SampleCachingDriver> driver = new SampleCachingDriver(kDeviceName);
+    DeviceManager::get()->forTest_registerDevice(kDeviceName, driver);
+    ANeuralNetworksDevice* device = findDevice(kDeviceName);
+    ASSERT_NE(device, nullptr);
+    compileAndCompute(device);
+    EXPECT_EQ(driver->numPrepareModelFromCacheCalls(), 0u);
+    EXPECT_EQ(driver->hasCalledPrepareModel(), HasCalledPrepareModel::WITH_CACHING);
+    DeviceManager::get()->forTest_reInitializeDeviceList();
+
+    driver = new SampleCachingDriver(kDeviceName);
+    DeviceManager::get()->forTest_registerDevice(kDeviceName, driver);
+    device = findDevice(kDeviceName);
+    ASSERT_NE(device, nullptr);
+    compileAndCompute(device);
+    // The model restored from the cache by prepareModelFromCache is used as is.
+    EXPECT_EQ(driver->numPrepareModelFromCacheCalls(), 1u);
+    EXPECT_EQ(driver->hasCalledPrepareModel(), HasCalledPrepareModel::NO);
+    DeviceManager::get()->forTest_reInitializeDeviceList();
+}
+
+TEST_F(RealCompilationCachingTest, Prefetch) {
+    if (DeviceManager::get()->getUseCpuOnly()) {
+        return;
+    }
+    static constexpr char kDeviceName[] = "deviceTestSampleCompilationCachingPrefetch";
+
+    sp<SampleCachingDriver> driver = new SampleCachingDriver(kDeviceName);
+    DeviceManager::get()->forTest_registerDevice(kDeviceName, driver);
+    ANeuralNetworksDevice* device = findDevice(kDeviceName);
+    ASSERT_NE(device, nullptr);
+    compileAndCompute(device);
+    DeviceManager::get()->forTest_reInitializeDeviceList();
+
+    driver = new SampleCachingDriver(kDeviceName);
+    DeviceManager::get()->forTest_registerDevice(kDeviceName, driver);
+    device = findDevice(kDeviceName);
+    ASSERT_NE(device, nullptr);
+    const uint8_t* tokens[] = {mToken.data()};
+    ASSERT_EQ(ANeuralNetworks_prefetchCompilationCache(mCacheDir.c_str(), tokens, 1, &device, 1,
+                                                       ANEURALNETWORKS_PREFER_FAST_SINGLE_ANSWER),
+              ANEURALNETWORKS_NO_ERROR);
+    compileAndCompute(device);
+    // The compilation waits for the prefetch and uses its prepared model, rather than restoring
+    // the model from the cache a second time.
+    EXPECT_EQ(driver->numPrepareModelFromCacheCalls(), 1u);
+    EXPECT_EQ(driver->hasCalledPrepareModel(), HasCalledPrepareModel::NO);
+
+    // A prefetched model is only handed out once.
+    compileAndCompute(device);
+    EXPECT_EQ(driver->numPrepareModelFromCacheCalls(), 2u);
+    DeviceManager::get()->forTest_reInitializeDeviceList();
+}
+
 static const auto kErrorStatusGetNumCacheFilesChoices =
         testing::Values(ErrorStatus::NONE, ErrorStatus::DEVICE_UNAVAILABLE);
 static const auto kNumCacheChoices =
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CompilationBuilder.h"
+#include "CompilationStatistics.h"
+#include "Manager.h"
+#include "TestNeuralNetworksWrapper.h"
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+
+using namespace android::nn;
+using Counter = CompilationStatistics::Counter;
+using Result = test_wrapper::Result;
+using Type = test_wrapper::Type;
+
+namespace {
+
+TEST(LatencyHistogramTest, Buckets) {
+    EXPECT_EQ(LatencyHistogram::getBucketLowerBoundNs(0), 0u);
+    EXPECT_EQ(LatencyHistogram::getBucketLowerBoundNs(1), 1000u);
+    EXPECT_EQ(LatencyHistogram::getBucketLowerBoundNs(11), 1024000u);
+
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.getSnapshot().getPercentileNs(50), 0u);
+    histogram.record(500);      // bucket 0
+    histogram.record(1500);     // bucket 1
+    histogram.record(3000);     // bucket 2
+    histogram.record(3500);     // bucket 2
+    histogram.record(9000000);  // bucket 14, [8192us, 16384us)
+
+    const LatencyHistogram::Snapshot snapshot = histogram.getSnapshot();
+    EXPECT_EQ(snapshot.count, 5u);
+    EXPECT_EQ(snapshot.buckets[0], 1u);
+    EXPECT_EQ(snapshot.buckets[1], 1u);
+    EXPECT_EQ(snapshot.buckets[2], 2u);
+    EXPECT_EQ(snapshot.buckets[14], 1u);
+    EXPECT_EQ(snapshot.maxNs, 9000000u);
+    EXPECT_EQ(snapshot.getMeanNs(), 9008500u / 5);
+    EXPECT_EQ(snapshot.getPercentileNs(20), 1000u);
+    EXPECT_EQ(snapshot.getPercentileNs(50), 4000u);
+    EXPECT_EQ(snapshot.getPercentileNs(80), 4000u);
+    // Capped by the maximum rather than the bucket bound of 16384us.
+    EXPECT_EQ(snapshot.getPercentileNs(99), 9000000u);
+}
+
+TEST(LatencyHistogramTest, Overflow) {
+    LatencyHistogram histogram;
+    histogram.record(~uint64_t(0) / 2);
+    EXPECT_EQ(histogram.getSnapshot().buckets[LatencyHistogram::kNumberOfBuckets - 1], 1u);
+}
+
+class CompilationStatisticsTest : public ::testing::Test {
+   protected:
+    virtual void SetUp() override {
+        test_wrapper::OperandType matrixType(Type::TENSOR_FLOAT32, {2, 2});
+        // The output shape is left to the execution, so that it can fail for
+        // want of a large enough output buffer.
+        test_wrapper::OperandType outputType(Type::TENSOR_FLOAT32, {0, 0});
+        test_wrapper::OperandType scalarType(Type::INT32, {});
+        int32_t activation(ANEURALNETWORKS_FUSED_NONE);
+        auto a = mModel.addOperand(&matrixType);
+        auto b = mModel.addOperand(&matrixType);
+        auto c = mModel.addOperand(&outputType);
+        auto d = mModel.addOperand(&scalarType);
+        mModel.setOperandValue(d, &activation, sizeof(activation));
+        mModel.addOperation(ANEURALNETWORKS_ADD, {a, b, d}, {c});
+        mModel.identifyInputsAndOutputs({a, b}, {c});
+        ASSERT_TRUE(mModel.isValid());
+        ASSERT_EQ(mModel.finish(), Result::NO_ERROR);
+
+        ANeuralNetworksDevice* device =
+                reinterpret_cast<ANeuralNetworksDevice*>(DeviceManager::getCpuDevice().get());
+        ASSERT_EQ(ANeuralNetworksCompilation_createForDevices(mModel.getHandle(), &device, 1,
+                                                              &mCompilation),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksCompilation_finish(mCompilation), ANEURALNETWORKS_NO_ERROR);
+    }
+
+    virtual void TearDown() override { ANeuralNetworksCompilation_free(mCompilation); }
+
+    const CompilationStatistics& statistics() const {
+        return reinterpret_cast<CompilationBuilder*>(mCompilation)->getStatistics();
+    }
+
+    int compute(size_t outputLength) {
+        ANeuralNetworksExecution* execution = nullptr;
+        EXPECT_EQ(ANeuralNetworksExecution_create(mCompilation, &execution),
+                  ANEURALNETWORKS_NO_ERROR);
+        const float a[] = {1.0f, 2.0f, 3.0f, 4.0f};
+        const float b[] = {10.0f, 20.0f, 30.0f, 40.0f};
+        float c[4];
+        EXPECT_EQ(ANeuralNetworksExecution_setInput(execution, 0, nullptr, a, sizeof(a)),
+                  ANEURALNETWORKS_NO_ERROR);
+        EXPECT_EQ(ANeuralNetworksExecution_setInput(execution, 1, nullptr, b, sizeof(b)),
+                  ANEURALNETWORKS_NO_ERROR);
+        EXPECT_EQ(ANeuralNetworksExecution_setOutput(execution, 0, nullptr, c, outputLength),
+                  ANEURALNETWORKS_NO_ERROR);
+        const int n = ANeuralNetworksExecution_compute(execution);
+        ANeuralNetworksExecution_free(execution);
+        return n;
+    }
+
+    test_wrapper::Model mModel;
+    ANeuralNetworksCompilation* mCompilation = nullptr;
+};
+
+TEST_F(CompilationStatisticsTest, Executions) {
+    EXPECT_EQ(statistics().getSnapshot()[Counter::EXECUTIONS], 0u);
+    ASSERT_EQ(compute(4 * sizeof(float)), ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(compute(4 * sizeof(float)), ANEURALNETWORKS_NO_ERROR);
+
+    const CompilationStatistics::Snapshot snapshot = statistics().getSnapshot();
+    EXPECT_EQ(snapshot[Counter::EXECUTIONS], 2u);
+    EXPECT_EQ(snapshot[Counter::FAILED_EXECUTIONS], 0u);
+    EXPECT_EQ(snapshot[Counter::STEPS], 2u);
+    EXPECT_EQ(snapshot[Counter::CPU_FALLBACK_FULL], 0u);
+    // The CPU reads and writes the pointer arguments in place.
+    EXPECT_EQ(snapshot[Counter::POINTER_ARGUMENT_BYTES_COPIED], 0u);
+    // No cache was set up.
+    EXPECT_EQ(snapshot[Counter::CACHE_HITS] + snapshot[Counter::CACHE_MISSES], 0u);
+    EXPECT_EQ(snapshot.executionLatency.count, 2u);
+    EXPECT_EQ(snapshot.stepLatency.count, 2u);
+    EXPECT_GE(snapshot.executionLatency.maxNs, snapshot.stepLatency.maxNs);
+}
+
+TEST_F(CompilationStatisticsTest, FailedExecution) {
+    ASSERT_EQ(compute(sizeof(float)), ANEURALNETWORKS_OUTPUT_INSUFFICIENT_SIZE);
+    const CompilationStatistics::Snapshot snapshot = statistics().getSnapshot();
+    EXPECT_EQ(snapshot[Counter::EXECUTIONS], 1u);
+    EXPECT_EQ(snapshot[Counter::FAILED_EXECUTIONS], 1u);
+    EXPECT_EQ(snapshot.stepLatency.count, 0u);
+}
+
+TEST_F(CompilationStatisticsTest, Dump) {
+    ASSERT_EQ(compute(4 * sizeof(float)), ANEURALNETWORKS_NO_ERROR);
+    std::ostringstream out;
+    statistics().dump(&out);
+    EXPECT_NE(out.str().find("executions: 1\n"), std::string::npos);
+    EXPECT_NE(out.str().find("execution latency: count 1"), std::string::npos);
+}
+
+}  // end namespace
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CpuExecutor.h"
+#include "ModelBuilder.h"
+#include "TestNeuralNetworksWrapper.h"
+
+#include <gtest/gtest.h>
+#include <utility>
+#include <vector>
+
+using namespace android::nn;
+using Result = test_wrapper::Result;
+using Type = test_wrapper::Type;
+
+namespace {
+
+// Builds a sparse LSH_PROJECTION of an input of unspecified dimensions, with
+// the optional weight a model input. The weight is omitted when the model
+// runs.
+void CreateLshProjectionModel(test_wrapper::Model* model) {
+    test_wrapper::OperandType hashType(Type::TENSOR_FLOAT32, {2, 1});
+    test_wrapper::OperandType inputType(Type::TENSOR_INT32, {0});
+    test_wrapper::OperandType weightType(Type::TENSOR_FLOAT32, {0});
+    test_wrapper::OperandType scalarType(Type::INT32, {});
+    test_wrapper::OperandType outputType(Type::TENSOR_INT32, {2});
+    const float hashValues[] = {0.123f, 0.456f};
+    const int32_t lshType = 3;  // LSHProjectionType_SPARSE
+    auto hash = model->addOperand(&hashType);
+    auto input = model->addOperand(&inputType);
+    auto weight = model->addOperand(&weightType);
+    auto type = model->addOperand(&scalarType);
+    auto output = model->addOperand(&outputType);
+    model->setOperandValue(hash, hashValues, sizeof(hashValues));
+    model->setOperandValue(type, &lshType, sizeof(lshType));
+    model->addOperation(ANEURALNETWORKS_LSH_PROJECTION, {hash, input, weight, type}, {output});
+    model->identifyInputsAndOutputs({input, weight}, {output});
+    ASSERT_TRUE(model->isValid());
+    ASSERT_EQ(model->finish(), Result::NO_ERROR);
+}
+
+class CpuExecutorModelTest : public ::testing::Test {
+   protected:
+    virtual void SetUp() override {
+        test_wrapper::Model model;
+        CreateLshProjectionModel(&model);
+        reinterpret_cast<ModelBuilder*>(model.getHandle())->setHidlModel(&mModel);
+        ASSERT_TRUE(setRunTimePoolInfosFromHidlMemories(&mModelPoolInfos, mModel.pools));
+    }
+
+    // Returns the request that projects input, of the given dimensions, into
+    // output, and sets requestPoolInfos to its pools.
+    static Request createRequest(std::vector<int32_t>* input, std::vector<uint32_t> dimensions,
+                                 std::vector<int32_t>* output,
+                                 std::vector<RunTimePoolInfo>* requestPoolInfos) {
+        Request request;
+        request.inputs = {{.location = {.poolIndex = 0,
+                                        .offset = 0,
+                                        .length = static_cast<uint32_t>(input->size() *
+                                                                        sizeof(int32_t))},
+                           .dimensions = dimensions},
+                          {.hasNoValue = true}};
+        request.outputs = {
+                {.location = {.poolIndex = 1,
+                              .offset = 0,
+                              .length = static_cast<uint32_t>(output->size() * sizeof(int32_t))}}};
+        *requestPoolInfos = {
+                RunTimePoolInfo::createFromExistingBuffer(
+                        reinterpret_cast<uint8_t*>(input->data())),
+                RunTimePoolInfo::createFromExistingBuffer(
+                        reinterpret_cast<uint8_t*>(output->data()))};
+        return request;
+    }
+
+    Model mModel;
+    std::vector<RunTimePoolInfo> mModelPoolInfos;
+};
+
+// Runs that borrow the operand table of the same prepared model see neither
+// the dimensions nor the omitted input of the previous run, and compute what a
+// run without a prepared model computes.
+TEST_F(CpuExecutorModelTest, RunTwice) {
+    const CpuExecutorModel preparedModel(mModel, mModelPoolInfos);
+    const std::vector<RunTimeOperandInfo>& operands = preparedModel.getOperands();
+
+    std::vector<int32_t> input1 = {1, 2, 3};
+    std::vector<int32_t> input2 = {4, 5, 6, 7};
+    for (auto [input, dimensions] : {std::make_pair(&input1, std::vector<uint32_t>{3}),
+                                     std::make_pair(&input2, std::vector<uint32_t>{4})}) {
+        SCOPED_TRACE(input->size());
+        std::vector<int32_t> output(2, 0);
+        std::vector<RunTimePoolInfo> requestPoolInfos;
+        const Request request = createRequest(input, dimensions, &output, &requestPoolInfos);
+        CpuExecutor executor;
+        ASSERT_EQ(executor.run(preparedModel, request, requestPoolInfos),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(executor.getOutputShapes().size(), 1u);
+        EXPECT_EQ(executor.getOutputShapes()[0].dimensions, hidl_vec<uint32_t>({2}));
+
+        std::vector<int32_t> expectedOutput(2, 0);
+        std::vector<RunTimePoolInfo> expectedRequestPoolInfos;
+        const Request expectedRequest =
+                createRequest(input, dimensions, &expectedOutput, &expectedRequestPoolInfos);
+        CpuExecutor expectedExecutor;
+        ASSERT_EQ(expectedExecutor.run(mModel, expectedRequest, mModelPoolInfos,
+                                       expectedRequestPoolInfos),
+                  ANEURALNETWORKS_NO_ERROR);
+        EXPECT_EQ(output, expectedOutput);
+    }
+
+    // A table borrowed now reuses the one the runs gave back, and is the one
+    // the prepared model was built with.
+    std::vector<RunTimeOperandInfo> borrowed = preparedModel.borrowOperands();
+    ASSERT_EQ(borrowed.size(), operands.size());
+    for (size_t i = 0; i < operands.size(); i++) {
+        SCOPED_TRACE(i);
+        EXPECT_EQ(borrowed[i].dimensions, operands[i].dimensions);
+        EXPECT_EQ(borrowed[i].lifetime, operands[i].lifetime);
+        EXPECT_EQ(borrowed[i].buffer, operands[i].buffer);
+        EXPECT_EQ(borrowed[i].length, operands[i].length);
+        EXPECT_EQ(borrowed[i].numberOfUsesLeft, operands[i].numberOfUsesLeft);
+    }
+    EXPECT_EQ(operands[2].lifetime, OperandLifeTime::MODEL_INPUT);
+    EXPECT_EQ(operands[1].dimensions, std::vector<uint32_t>({0}));
+    preparedModel.returnOperands(std::move(borrowed));
+}
+
+}  // end namespace
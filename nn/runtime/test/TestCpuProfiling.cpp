@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CompilationBuilder.h"
+#include "CpuExecutor.h"
+#include "ExecutionBuilder.h"
+#include "Manager.h"
+#include "TestNeuralNetworksWrapper.h"
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace android::nn;
+using Result = test_wrapper::Result;
+using Type = test_wrapper::Type;
+
+namespace {
+
+// Builds c = (a + a) + b, adding the second ADD to the model first so that the
+// run order differs from the order in which the application built the model.
+void CreateTwoAddModel(test_wrapper::Model* model) {
+    test_wrapper::OperandType matrixType(Type::TENSOR_FLOAT32, {2, 2});
+    test_wrapper::OperandType scalarType(Type::INT32, {});
+    int32_t activation(ANEURALNETWORKS_FUSED_NONE);
+    auto a = model->addOperand(&matrixType);
+    auto b = model->addOperand(&matrixType);
+    auto t = model->addOperand(&matrixType);
+    auto c = model->addOperand(&matrixType);
+    auto d = model->addOperand(&scalarType);
+    model->setOperandValue(d, &activation, sizeof(activation));
+    model->addOperation(ANEURALNETWORKS_ADD, {t, b, d}, {c});
+    model->addOperation(ANEURALNETWORKS_ADD, {a, a, d}, {t});
+    model->identifyInputsAndOutputs({a, b}, {c});
+    ASSERT_TRUE(model->isValid());
+    ASSERT_EQ(model->finish(), Result::NO_ERROR);
+}
+
+class CpuProfilingTest : public ::testing::Test {
+   protected:
+    virtual void SetUp() override {
+        CreateTwoAddModel(&mModel);
+        ANeuralNetworksDevice* device =
+                reinterpret_cast<ANeuralNetworksDevice*>(DeviceManager::getCpuDevice().get());
+        ASSERT_EQ(ANeuralNetworksCompilation_createForDevices(mModel.getHandle(), &device, 1,
+                                                              &mCompilation),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksCompilation_finish(mCompilation), ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksExecution_create(mCompilation, &mExecution),
+                  ANEURALNETWORKS_NO_ERROR);
+    }
+
+    virtual void TearDown() override {
+        ANeuralNetworksExecution_free(mExecution);
+        ANeuralNetworksCompilation_free(mCompilation);
+    }
+
+    ExecutionBuilder* executionBuilder() const {
+        return reinterpret_cast<ExecutionBuilder*>(mExecution);
+    }
+
+    void compute() {
+        const float a[] = {1.0f, 2.0f, 3.0f, 4.0f};
+        const float b[] = {10.0f, 20.0f, 30.0f, 40.0f};
+        float c[4] = {};
+        ASSERT_EQ(ANeuralNetworksExecution_setInput(mExecution, 0, nullptr, a, sizeof(a)),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksExecution_setInput(mExecution, 1, nullptr, b, sizeof(b)),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksExecution_setOutput(mExecution, 0, nullptr, c, sizeof(c)),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksExecution_compute(mExecution), ANEURALNETWORKS_NO_ERROR);
+        EXPECT_EQ(std::vector<float>(c, c + 4), std::vector<float>({12.0f, 24.0f, 36.0f, 48.0f}));
+    }
+
+    test_wrapper::Model mModel;
+    ANeuralNetworksCompilation* mCompilation = nullptr;
+    ANeuralNetworksExecution* mExecution = nullptr;
+};
+
+TEST_F(CpuProfilingTest, Profile) {
+    ASSERT_EQ(executionBuilder()->setCpuProfiling(true), ANEURALNETWORKS_NO_ERROR);
+    std::vector<CpuOperationProfile> profile;
+    EXPECT_EQ(executionBuilder()->getCpuProfile(&profile), ANEURALNETWORKS_BAD_STATE);
+    compute();
+    EXPECT_EQ(executionBuilder()->setCpuProfiling(false), ANEURALNETWORKS_BAD_STATE);
+    ASSERT_EQ(executionBuilder()->getCpuProfile(&profile), ANEURALNETWORKS_NO_ERROR);
+
+    // The operations ran in dependency order, and are reported with the indexes
+    // the application gave them.
+    ASSERT_EQ(profile.size(), 2u);
+    EXPECT_EQ(profile[0].operationIndex, 1u);
+    EXPECT_EQ(profile[1].operationIndex, 0u);
+    for (const CpuOperationProfile& entry : profile) {
+        EXPECT_EQ(entry.type, OperationType::ADD);
+        EXPECT_EQ(entry.outputBytes, 4 * sizeof(float));
+        ASSERT_NE(entry.kernel, nullptr);
+        EXPECT_STREQ(entry.kernel, "optimized_ops::Add");
+    }
+    EXPECT_LE(profile[0].startNs + profile[0].durationNs, profile[1].startNs);
+    // Only the first operation writes a temporary.
+    EXPECT_EQ(profile[0].temporaryBytes, 4 * sizeof(float));
+    EXPECT_EQ(profile[1].temporaryBytes, 0u);
+
+    const std::string trace = cpuProfileToChromeTrace(profile);
+    EXPECT_EQ(trace.find("{\"traceEvents\":["), 0u);
+    EXPECT_NE(trace.find("\"name\":\"ADD\""), std::string::npos);
+    EXPECT_NE(trace.find("\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(trace.find("\"kernel\":\"optimized_ops::Add\""), std::string::npos);
+}
+
+TEST_F(CpuProfilingTest, AnnotatedGraph) {
+    ASSERT_EQ(executionBuilder()->setCpuProfiling(true), ANEURALNETWORKS_NO_ERROR);
+    compute();
+    std::vector<CpuOperationProfile> profile;
+    ASSERT_EQ(executionBuilder()->getCpuProfile(&profile), ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(profile.size(), 2u);
+
+    const CompilationBuilder* compilation = reinterpret_cast<CompilationBuilder*>(mCompilation);
+    const GraphDumpAnnotations annotations =
+            compilation->forTest_getExecutionPlan().getGraphDumpAnnotations(
+                    executionBuilder()->getModel(), profile);
+    ASSERT_EQ(annotations.stepDevices.size(), 1u);
+    EXPECT_EQ(annotations.stepDevices[0], DeviceManager::getCpuDevice()->getName());
+    EXPECT_EQ(annotations.operationSteps, std::vector<uint32_t>({0, 0}));
+    // Annotations follow the run order, like the dumped Model.
+    EXPECT_EQ(annotations.operationTimesNs,
+              std::vector<uint64_t>({profile[0].durationNs, profile[1].durationNs}));
+
+    std::ostringstream dot;
+    ASSERT_EQ(compilation->dumpAnnotatedGraph(profile, /*json=*/false, &dot),
+              ANEURALNETWORKS_NO_ERROR);
+    EXPECT_NE(dot.str().find("subgraph cluster_step0"), std::string::npos);
+    EXPECT_NE(dot.str().find("fillcolor=\"0.000"), std::string::npos);
+
+    std::ostringstream json;
+    ASSERT_EQ(compilation->dumpAnnotatedGraph(profile, /*json=*/true, &json),
+              ANEURALNETWORKS_NO_ERROR);
+    EXPECT_NE(json.str().find("\"step\": 0, \"timeNs\": "), std::string::npos);
+    EXPECT_NE(json.str().find("\"bytes\": 16}"), std::string::npos);
+}
+
+TEST_F(CpuProfilingTest, NotProfiled) {
+    compute();
+    std::vector<CpuOperationProfile> profile;
+    EXPECT_EQ(executionBuilder()->getCpuProfile(&profile), ANEURALNETWORKS_BAD_STATE);
+}
+
+TEST(CpuProfileToChromeTraceTest, Empty) {
+    EXPECT_EQ(cpuProfileToChromeTrace({}), "{\"traceEvents\":[\n]}\n");
+}
+
+TEST(CpuProfileToChromeTraceTest, EscapesStrings) {
+    const CpuOperationProfile entry = {.operationIndex = 0,
+                                       .type = OperationType::ADD,
+                                       .startNs = 0,
+                                       .durationNs = 1000,
+                                       .outputBytes = 0,
+                                       .temporaryBytes = 0,
+                                       .kernel = "a\"b\\c\n\x01"};
+    const std::string trace = cpuProfileToChromeTrace({entry});
+    EXPECT_NE(trace.find("\"kernel\":\"a\\\"b\\\\c\\u000a\\u0001\","), std::string::npos)
+            << trace;
+}
+
+}  // end namespace
@@ -17,6 +17,10 @@
 #include "TestGenerated.h"
 #include "TestHarness.h"
 
+#ifdef NNTEST_BENCHMARK
+#include "GeneratedBenchmark.h"
+#endif
+
 #include <gtest/gtest.h>
 
 #include <ftw.h>
@@ -227,6 +231,10 @@ void GeneratedTests::execute(std::function<void(Model*)> createModel,
     Model model;
     createModel(&model);
     model.finish();
+#ifdef NNTEST_BENCHMARK
+    benchmarkModel(&model, examples,
+                   ::testing::UnitTest::GetInstance()->current_test_info()->name());
+#else   // !defined(NNTEST_BENCHMARK)
     auto executeInternal = [&model, &isIgnored, &examples,
                             this]([[maybe_unused]] std::string dumpFile) {
         SCOPED_TRACE("TestCompilationCaching = " + std::to_string(mTestCompilationCaching));
@@ -241,6 +249,7 @@ void GeneratedTests::execute(std::function<void(Model*)> createModel,
     executeInternal(dumpFile);
     mTestCompilationCaching = true;
     executeInternal("");
+#endif  // NNTEST_BENCHMARK
 }
 
 void GeneratedTests::SetUp() {
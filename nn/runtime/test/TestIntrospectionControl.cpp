@@ -15,7 +15,9 @@
  */
 
 #include "CompilationBuilder.h"
+#include "CompilationStatistics.h"
 #include "ExecutionBurstServer.h"
+#include "ExecutionPlan.h"
 #include "HalInterfaces.h"
 #include "Manager.h"
 #include "NeuralNetworks.h"
@@ -27,6 +29,7 @@
 
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <iterator>
 #include <map>
 #include <queue>
@@ -719,6 +722,241 @@ INSTANTIATE_TEST_CASE_P(Flavor, TimingTest, kTimingTestValues);
 
 /*-- End   timing tests -------------------------------------------------------------------------*/
 
+/*-- Begin CPU demotion tests -------------------------------------------------------------------*/
+
+namespace demotion_tests {
+
+// Fails every execution while *failing is set, counting them all.
+class FailingPreparedModel : public SamplePreparedModel {
+   public:
+    FailingPreparedModel(const HidlModel& model, const SampleDriver* driver,
+                         const std::atomic<bool>* failing, std::atomic<uint32_t>* executions)
+        : SamplePreparedModel(model, driver), mFailing(failing), mExecutions(executions) {}
+
+    Return<ErrorStatus> execute(const Request& request,
+                                const sp<V1_0::IExecutionCallback>& callback) override {
+        ++*mExecutions;
+        if (!*mFailing) {
+            return SamplePreparedModel::execute(request, callback);
+        }
+        callback->notify(ErrorStatus::GENERAL_FAILURE);
+        return ErrorStatus::GENERAL_FAILURE;
+    }
+
+    Return<ErrorStatus> execute_1_2(const Request& request, MeasureTiming measure,
+                                    const sp<V1_2::IExecutionCallback>& callback) override {
+        ++*mExecutions;
+        if (!*mFailing) {
+            return SamplePreparedModel::execute_1_2(request, measure, callback);
+        }
+        callback->notify_1_2(ErrorStatus::GENERAL_FAILURE, {}, kBadTiming);
+        return ErrorStatus::GENERAL_FAILURE;
+    }
+
+    Return<void> executeSynchronously(const Request& request, MeasureTiming measure,
+                                      executeSynchronously_cb cb) override {
+        ++*mExecutions;
+        if (!*mFailing) {
+            return SamplePreparedModel::executeSynchronously(request, measure, cb);
+        }
+        cb(ErrorStatus::GENERAL_FAILURE, {}, kBadTiming);
+        return Void();
+    }
+
+    // Bursts go through executeSynchronously(), see TestPreparedModel12.
+    Return<void> configureExecutionBurst(
+            const sp<V1_2::IBurstCallback>& callback,
+            const MQDescriptorSync<V1_2::FmqRequestDatum>& requestChannel,
+            const MQDescriptorSync<V1_2::FmqResultDatum>& resultChannel,
+            configureExecutionBurst_cb cb) override {
+        const sp<V1_2::IBurstContext> burst =
+                ExecutionBurstServer::create(callback, requestChannel, resultChannel, this);
+        cb(burst == nullptr ? ErrorStatus::GENERAL_FAILURE : ErrorStatus::NONE, burst);
+        return Void();
+    }
+
+   private:
+    const std::atomic<bool>* mFailing;
+    std::atomic<uint32_t>* mExecutions;
+};
+
+// Supports every operation, faster than the CPU, but fails every execution
+// unless told otherwise with setFailing().
+class FailingDriver : public SampleDriver {
+   public:
+    FailingDriver(const char* name) : SampleDriver(name) {}
+
+    Return<void> getCapabilities_1_2(getCapabilities_1_2_cb cb) override {
+        const PerformanceInfo kPerf = {.execTime = 0.1f, .powerUsage = 0.1f};
+        Capabilities capabilities = {
+                .relaxedFloat32toFloat16PerformanceScalar = kPerf,
+                .relaxedFloat32toFloat16PerformanceTensor = kPerf,
+                .operandPerformance = nn::nonExtensionOperandPerformance(kPerf)};
+        cb(ErrorStatus::NONE, capabilities);
+        return Void();
+    }
+
+    Return<void> getSupportedOperations_1_2(const HidlModel& model,
+                                            getSupportedOperations_1_2_cb cb) override {
+        std::vector<bool> supported(model.operations.size(), true);
+        cb(ErrorStatus::NONE, supported);
+        return Void();
+    }
+
+    Return<ErrorStatus> prepareModel_1_2(const HidlModel& model, ExecutionPreference,
+                                         const hidl_vec<hidl_handle>&, const hidl_vec<hidl_handle>&,
+                                         const HidlToken&,
+                                         const sp<IPreparedModelCallback>& callback) override {
+        sp<FailingPreparedModel> preparedModel =
+                new FailingPreparedModel(model, this, &mFailing, &mExecutions);
+        if (!preparedModel->initialize()) {
+            callback->notify_1_2(ErrorStatus::INVALID_ARGUMENT, nullptr);
+            return ErrorStatus::INVALID_ARGUMENT;
+        }
+        callback->notify_1_2(ErrorStatus::NONE, preparedModel);
+        return ErrorStatus::NONE;
+    }
+
+    void setFailing(bool failing) { mFailing = failing; }
+    uint32_t getExecutions() const { return mExecutions.load(); }
+
+   private:
+    std::atomic<bool> mFailing{true};
+    std::atomic<uint32_t> mExecutions{0};
+};
+
+constexpr uint32_t kFailuresBeforeDemotion = nn::CpuFallbackState::kDeviceFailuresBeforeDemotion;
+
+// Compiles the ADD model for a FailingDriver, allowing CPU fallback, which
+// compilations for an explicit device list otherwise don't.
+class DemotionTest : public IntrospectionControlTest {
+   protected:
+    void SetUp() override {
+        if (DeviceManager::get()->getUseCpuOnly()) {
+            GTEST_SKIP();
+        }
+        createSimpleAddModel(&mModel);
+        static const char name[] = "failing";
+        mDriver = new FailingDriver(name);
+        DeviceManager::get()->forTest_registerDevice(name, mDriver);
+        ASSERT_TRUE(selectDeviceByName(name));
+        ASSERT_EQ(ANeuralNetworksCompilation_createForDevices(mModel.getHandle(), mDevices.data(),
+                                                              mDevices.size(), &mCompilation),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(compilationBuilder()->setPartitioning(DeviceManager::kPartitioningWithFallback),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksCompilation_finish(mCompilation), ANEURALNETWORKS_NO_ERROR);
+    }
+
+    CompilationBuilder* compilationBuilder() {
+        return reinterpret_cast<CompilationBuilder*>(mCompilation);
+    }
+
+    uint64_t getCounter(nn::CompilationStatistics::Counter counter) {
+        return compilationBuilder()->getStatistics().getSnapshot()[counter];
+    }
+
+    // Runs an execution, through burst if it isn't nullptr, and checks that
+    // it succeeds whether or not the driver was tried first.
+    void compute(ANeuralNetworksBurst* burst = nullptr) {
+        ANeuralNetworksExecution* execution = nullptr;
+        ASSERT_EQ(ANeuralNetworksExecution_create(mCompilation, &execution),
+                  ANEURALNETWORKS_NO_ERROR);
+        float input1[2] = {1.0f, 2.0f};
+        float input2[2] = {3.0f, 4.0f};
+        float output[2] = {};
+        EXPECT_EQ(ANeuralNetworksExecution_setInput(execution, 0, nullptr, input1, sizeof(input1)),
+                  ANEURALNETWORKS_NO_ERROR);
+        EXPECT_EQ(ANeuralNetworksExecution_setInput(execution, 1, nullptr, input2, sizeof(input2)),
+                  ANEURALNETWORKS_NO_ERROR);
+        EXPECT_EQ(ANeuralNetworksExecution_setOutput(execution, 0, nullptr, output, sizeof(output)),
+                  ANEURALNETWORKS_NO_ERROR);
+        if (burst == nullptr) {
+            EXPECT_EQ(ANeuralNetworksExecution_compute(execution), ANEURALNETWORKS_NO_ERROR);
+        } else {
+            EXPECT_EQ(ANeuralNetworksExecution_burstCompute(execution, burst),
+                      ANEURALNETWORKS_NO_ERROR);
+        }
+        EXPECT_EQ(output[0], 4.0f);
+        EXPECT_EQ(output[1], 6.0f);
+        ANeuralNetworksExecution_free(execution);
+    }
+
+    sp<FailingDriver> mDriver;
+};
+
+TEST_F(DemotionTest, FewerFailuresDoNotDemote) {
+    for (uint32_t i = 0; i < kFailuresBeforeDemotion - 1; i++) {
+        compute();
+    }
+    EXPECT_EQ(mDriver->getExecutions(), kFailuresBeforeDemotion - 1);
+    EXPECT_EQ(getCounter(nn::CompilationStatistics::Counter::DEMOTED_STEPS), 0u);
+
+    // Not demoted yet, so the driver is still tried first.
+    compute();
+    EXPECT_EQ(mDriver->getExecutions(), kFailuresBeforeDemotion);
+}
+
+TEST_F(DemotionTest, SuccessStartsCountOver) {
+    for (uint32_t i = 0; i < kFailuresBeforeDemotion - 1; i++) {
+        compute();
+    }
+    mDriver->setFailing(false);
+    compute();
+    mDriver->setFailing(true);
+    for (uint32_t i = 0; i < kFailuresBeforeDemotion - 1; i++) {
+        compute();
+    }
+    EXPECT_EQ(mDriver->getExecutions(), 2 * (kFailuresBeforeDemotion - 1) + 1);
+    EXPECT_EQ(getCounter(nn::CompilationStatistics::Counter::DEMOTED_STEPS), 0u);
+
+    // Only failures in a row count toward demotion.
+    compute();
+    EXPECT_EQ(getCounter(nn::CompilationStatistics::Counter::DEMOTED_STEPS), 1u);
+    compute();
+    EXPECT_EQ(mDriver->getExecutions(), 2 * kFailuresBeforeDemotion);
+}
+
+TEST_F(DemotionTest, DemotesOnce) {
+    for (uint32_t i = 0; i < kFailuresBeforeDemotion; i++) {
+        compute();
+    }
+    EXPECT_EQ(mDriver->getExecutions(), kFailuresBeforeDemotion);
+    EXPECT_EQ(getCounter(nn::CompilationStatistics::Counter::DEMOTED_STEPS), 1u);
+    EXPECT_EQ(getCounter(nn::CompilationStatistics::Counter::CPU_FALLBACK_PARTIAL),
+              kFailuresBeforeDemotion);
+
+    // A demoted step runs on the CPU directly, so neither the driver nor a
+    // fallback is involved.
+    compute();
+    compute();
+    EXPECT_EQ(mDriver->getExecutions(), kFailuresBeforeDemotion);
+    EXPECT_EQ(getCounter(nn::CompilationStatistics::Counter::DEMOTED_STEPS), 1u);
+    EXPECT_EQ(getCounter(nn::CompilationStatistics::Counter::CPU_FALLBACK_PARTIAL),
+              kFailuresBeforeDemotion);
+    EXPECT_EQ(getCounter(nn::CompilationStatistics::Counter::CPU_FALLBACK_FULL), 0u);
+}
+
+TEST_F(DemotionTest, DemotedStepSkipsBurst) {
+    ANeuralNetworksBurst* burst = nullptr;
+    ASSERT_EQ(ANeuralNetworksBurst_create(mCompilation, &burst), ANEURALNETWORKS_NO_ERROR);
+    for (uint32_t i = 0; i < kFailuresBeforeDemotion; i++) {
+        compute(burst);
+    }
+    const uint32_t executions = mDriver->getExecutions();
+    EXPECT_GE(executions, kFailuresBeforeDemotion);
+    EXPECT_EQ(getCounter(nn::CompilationStatistics::Counter::DEMOTED_STEPS), 1u);
+
+    compute(burst);
+    EXPECT_EQ(mDriver->getExecutions(), executions);
+    EXPECT_EQ(getCounter(nn::CompilationStatistics::Counter::DEMOTED_STEPS), 1u);
+    ANeuralNetworksBurst_free(burst);
+}
+
+}  // namespace demotion_tests
+
+/*-- End   CPU demotion tests -------------------------------------------------------------------*/
+
 const float kSimpleMultiplier = 2.0f;
 
 void createAddMulModel(WrapperModel* model, bool reverseOrder) {
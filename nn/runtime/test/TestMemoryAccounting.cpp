@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CompilationBuilder.h"
+#include "CompilationStatistics.h"
+#include "ExecutionBuilder.h"
+#include "Manager.h"
+#include "MemoryAccounting.h"
+#include "TestNeuralNetworksWrapper.h"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace android::nn;
+using Result = test_wrapper::Result;
+using Type = test_wrapper::Type;
+
+namespace {
+
+constexpr uint64_t kMatrixBytes = 4 * sizeof(float);
+
+TEST(MemoryAccountTest, Peak) {
+    MemoryAccount account;
+    EXPECT_TRUE(account.allocate(MemoryCategory::CPU_TEMPORARIES, 100));
+    EXPECT_TRUE(account.allocateOperationScratch(MemoryCategory::KERNEL_SCRATCH, 50));
+    EXPECT_TRUE(account.allocateOperationScratch(MemoryCategory::FP16_CONVERSION, 20));
+    account.releaseOperationScratch();
+    account.release(MemoryCategory::CPU_TEMPORARIES, 100);
+    EXPECT_TRUE(account.allocate(MemoryCategory::CPU_TEMPORARIES, 30));
+
+    const MemoryUsage peak = account.getPeakUsage();
+    EXPECT_EQ(peak[MemoryCategory::CPU_TEMPORARIES], 100u);
+    EXPECT_EQ(peak[MemoryCategory::KERNEL_SCRATCH], 50u);
+    EXPECT_EQ(peak[MemoryCategory::FP16_CONVERSION], 20u);
+    EXPECT_EQ(peak[MemoryCategory::POINTER_ARGUMENTS], 0u);
+    EXPECT_EQ(peak.total(), 170u);
+    EXPECT_EQ(account.getPeakTotal(), 170u);
+    EXPECT_FALSE(account.isOverBudget());
+}
+
+TEST(MemoryAccountTest, Budget) {
+    MemoryAccount account(100);
+    EXPECT_TRUE(account.allocate(MemoryCategory::CPU_TEMPORARIES, 60));
+    EXPECT_FALSE(account.allocateOperationScratch(MemoryCategory::KERNEL_SCRATCH, 60));
+    account.releaseOperationScratch();
+    // Once over budget, the account stays over budget.
+    EXPECT_TRUE(account.isOverBudget());
+    EXPECT_FALSE(account.allocate(MemoryCategory::CPU_TEMPORARIES, 1));
+}
+
+TEST(MemoryAccountTest, ScopedCharges) {
+    MemoryAccount account;
+    {
+        ScopedMemoryAccount scopedAccount(&account);
+        chargeOperationScratch(MemoryCategory::FP16_CONVERSION, 8);
+        ScopedMemoryCharge charge(&account, MemoryCategory::POINTER_ARGUMENTS, 16);
+        EXPECT_TRUE(charge.isWithinBudget());
+    }
+    EXPECT_EQ(gCurrentMemoryAccount, nullptr);
+    // Not charged to any account.
+    chargeOperationScratch(MemoryCategory::FP16_CONVERSION, 8);
+    EXPECT_EQ(account.getPeakUsage()[MemoryCategory::FP16_CONVERSION], 8u);
+    EXPECT_EQ(account.getPeakTotal(), 24u);
+}
+
+// Builds c = (a + a) + b, with a temporary between the two ADDs.
+void CreateTwoAddModel(test_wrapper::Model* model) {
+    test_wrapper::OperandType matrixType(Type::TENSOR_FLOAT32, {2, 2});
+    test_wrapper::OperandType scalarType(Type::INT32, {});
+    int32_t activation(ANEURALNETWORKS_FUSED_NONE);
+    auto a = model->addOperand(&matrixType);
+    auto b = model->addOperand(&matrixType);
+    auto t = model->addOperand(&matrixType);
+    auto c = model->addOperand(&matrixType);
+    auto d = model->addOperand(&scalarType);
+    model->setOperandValue(d, &activation, sizeof(activation));
+    model->addOperation(ANEURALNETWORKS_ADD, {a, a, d}, {t});
+    model->addOperation(ANEURALNETWORKS_ADD, {t, b, d}, {c});
+    model->identifyInputsAndOutputs({a, b}, {c});
+    ASSERT_TRUE(model->isValid());
+    ASSERT_EQ(model->finish(), Result::NO_ERROR);
+}
+
+class MemoryAccountingTest : public ::testing::Test {
+   protected:
+    virtual void SetUp() override {
+        CreateTwoAddModel(&mModel);
+        ANeuralNetworksDevice* device =
+                reinterpret_cast<ANeuralNetworksDevice*>(DeviceManager::getCpuDevice().get());
+        ASSERT_EQ(ANeuralNetworksCompilation_createForDevices(mModel.getHandle(), &device, 1,
+                                                              &mCompilation),
+                  ANEURALNETWORKS_NO_ERROR);
+    }
+
+    virtual void TearDown() override {
+        ANeuralNetworksExecution_free(mExecution);
+        ANeuralNetworksCompilation_free(mCompilation);
+    }
+
+    CompilationBuilder* compilationBuilder() const {
+        return reinterpret_cast<CompilationBuilder*>(mCompilation);
+    }
+    ExecutionBuilder* executionBuilder() const {
+        return reinterpret_cast<ExecutionBuilder*>(mExecution);
+    }
+
+    void createExecution() {
+        ASSERT_EQ(ANeuralNetworksExecution_create(mCompilation, &mExecution),
+                  ANEURALNETWORKS_NO_ERROR);
+        EXPECT_EQ(ANeuralNetworksExecution_setInput(mExecution, 0, nullptr, mA, sizeof(mA)),
+                  ANEURALNETWORKS_NO_ERROR);
+        EXPECT_EQ(ANeuralNetworksExecution_setInput(mExecution, 1, nullptr, mB, sizeof(mB)),
+                  ANEURALNETWORKS_NO_ERROR);
+        EXPECT_EQ(ANeuralNetworksExecution_setOutput(mExecution, 0, nullptr, mOutput,
+                                                     sizeof(mOutput)),
+                  ANEURALNETWORKS_NO_ERROR);
+    }
+
+    int compute() {
+        createExecution();
+        return ANeuralNetworksExecution_compute(mExecution);
+    }
+
+    int startComputeAndWait() {
+        ANeuralNetworksEvent* event = nullptr;
+        int n = ANeuralNetworksExecution_startCompute(mExecution, &event);
+        if (n == ANEURALNETWORKS_NO_ERROR) {
+            n = ANeuralNetworksEvent_wait(event);
+        }
+        ANeuralNetworksEvent_free(event);
+        return n;
+    }
+
+    float mA[4] = {1.0f, 2.0f, 3.0f, 4.0f};
+    float mB[4] = {10.0f, 20.0f, 30.0f, 40.0f};
+
+    test_wrapper::Model mModel;
+    ANeuralNetworksCompilation* mCompilation = nullptr;
+    ANeuralNetworksExecution* mExecution = nullptr;
+    float mOutput[4] = {};
+};
+
+TEST_F(MemoryAccountingTest, EstimateAndPeak) {
+    MemoryUsage estimate;
+    EXPECT_EQ(compilationBuilder()->getMemoryEstimate(&estimate), ANEURALNETWORKS_BAD_STATE);
+    ASSERT_EQ(ANeuralNetworksCompilation_finish(mCompilation), ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(compilationBuilder()->getMemoryEstimate(&estimate), ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(estimate[MemoryCategory::CPU_TEMPORARIES], kMatrixBytes);
+    EXPECT_EQ(estimate.total(), kMatrixBytes);
+
+    ASSERT_EQ(compute(), ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(std::vector<float>(mOutput, mOutput + 4),
+              std::vector<float>({12.0f, 24.0f, 36.0f, 48.0f}));
+    MemoryUsage peak;
+    uint64_t peakTotal = 0;
+    ASSERT_EQ(executionBuilder()->getMemoryUsage(&peak, &peakTotal), ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(peak[MemoryCategory::CPU_TEMPORARIES], kMatrixBytes);
+    EXPECT_EQ(peakTotal, kMatrixBytes);
+}
+
+TEST_F(MemoryAccountingTest, WithinBudget) {
+    ASSERT_EQ(compilationBuilder()->setMemoryBudget(kMatrixBytes), ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(ANeuralNetworksCompilation_finish(mCompilation), ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(compilationBuilder()->setMemoryBudget(0), ANEURALNETWORKS_BAD_STATE);
+    EXPECT_EQ(compute(), ANEURALNETWORKS_NO_ERROR);
+}
+
+TEST_F(MemoryAccountingTest, OverBudget) {
+    ASSERT_EQ(compilationBuilder()->setMemoryBudget(kMatrixBytes - 1), ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(ANeuralNetworksCompilation_finish(mCompilation), ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(compute(), ANEURALNETWORKS_OUT_OF_MEMORY);
+}
+
+// The estimate fits the budget, but an extra charge makes the CpuExecutor's
+// temporary go over it while running. Both the synchronous and the
+// asynchronous API report that as OUT_OF_MEMORY.
+TEST_F(MemoryAccountingTest, OverBudgetWhileRunning) {
+    ASSERT_EQ(compilationBuilder()->setMemoryBudget(kMatrixBytes), ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(ANeuralNetworksCompilation_finish(mCompilation), ANEURALNETWORKS_NO_ERROR);
+
+    createExecution();
+    executionBuilder()->getMemoryAccount()->allocate(MemoryCategory::KERNEL_SCRATCH, 1);
+    EXPECT_EQ(ANeuralNetworksExecution_compute(mExecution), ANEURALNETWORKS_OUT_OF_MEMORY);
+    ANeuralNetworksExecution_free(mExecution);
+
+    createExecution();
+    executionBuilder()->getMemoryAccount()->allocate(MemoryCategory::KERNEL_SCRATCH, 1);
+    EXPECT_EQ(startComputeAndWait(), ANEURALNETWORKS_OUT_OF_MEMORY);
+}
+
+// With fallback allowed, the failing step already ran on the CPU, so the
+// execution goes straight to a full CPU fallback. That is not counted as a
+// partial fallback.
+TEST_F(MemoryAccountingTest, OverBudgetWithFallback) {
+    ASSERT_EQ(compilationBuilder()->setPartitioning(DeviceManager::kPartitioningWithFallback),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(compilationBuilder()->setMemoryBudget(kMatrixBytes), ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(ANeuralNetworksCompilation_finish(mCompilation), ANEURALNETWORKS_NO_ERROR);
+
+    createExecution();
+    executionBuilder()->getMemoryAccount()->allocate(MemoryCategory::KERNEL_SCRATCH, 1);
+    EXPECT_EQ(ANeuralNetworksExecution_compute(mExecution), ANEURALNETWORKS_OUT_OF_MEMORY);
+    const CompilationStatistics::Snapshot snapshot =
+            compilationBuilder()->getStatistics().getSnapshot();
+    EXPECT_EQ(snapshot[CompilationStatistics::Counter::CPU_FALLBACK_FULL], 1u);
+    EXPECT_EQ(snapshot[CompilationStatistics::Counter::CPU_FALLBACK_PARTIAL], 0u);
+}
+
+}  // end namespace
@@ -154,6 +154,10 @@ class Execution {
                 mExecution, index, type, memory->get(), offset, length));
     }
 
+    Result setState(ANeuralNetworksState* state) {
+        return static_cast<Result>(ANeuralNetworksExecution_setState(mExecution, state));
+    }
+
     Result startCompute(Event* event) {
         ANeuralNetworksEvent* ev = nullptr;
         Result result = static_cast<Result>(ANeuralNetworksExecution_startCompute(mExecution, &ev));
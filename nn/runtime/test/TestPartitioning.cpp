@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include "CachePrefetcher.h"
 #include "CompilationBuilder.h"
 #include "ExecutionPlan.h"
 #include "HalInterfaces.h"
@@ -28,6 +29,7 @@
 
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <filesystem>
 #include <functional>
 #include <map>
@@ -363,6 +365,7 @@ public:
 
     Return<void> getSupportedOperations_1_2(const Model& model,
                                             getSupportedOperations_cb cb) override {
+        getSupportedOperationsCallCount++;
         if (!android::nn::validateModel(model)) {
             cb(ErrorStatus::INVALID_ARGUMENT, std::vector<bool>());
             return Void();
@@ -390,9 +393,15 @@ public:
         return Void();
     }
 
+    // The number of calls to getSupportedOperations_1_2 and prepareModelFromCache on any
+    // PartitioningDriver, so that tests can check whether a compilation queried the drivers.
+    static inline std::atomic<uint32_t> getSupportedOperationsCallCount = 0;
+    static inline std::atomic<uint32_t> prepareModelFromCacheCallCount = 0;
+
     Return<ErrorStatus> prepareModelFromCache(
             const hidl_vec<hidl_handle>&, const hidl_vec<hidl_handle>&, const HidlToken&,
             const sp<V1_2::IPreparedModelCallback>& callback) override {
+        prepareModelFromCacheCallCount++;
         callback->notify_1_2(ErrorStatus::NONE, new PartitioningPreparedModel);
         return ErrorStatus::NONE;
     }
@@ -1760,6 +1769,26 @@ class CacheTest : public PartitioningTest {
         PartitioningTest::TearDown();
     }
 
+    // Removes all cache files, including the recorded partitionings.
+    void clearCacheDir() {
+        for (const auto& entry : std::filesystem::directory_iterator(mCacheDir)) {
+            std::filesystem::remove_all(entry.path());
+        }
+    }
+
+    // Returns the number of partitioning cache files (those with the '3' identifier).
+    size_t countPartitioningCacheFiles() const {
+        size_t count = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(mCacheDir)) {
+            const std::string name = entry.path().filename();
+            if (name.size() == ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN * 2 + 1 &&
+                name.back() == '3') {
+                count++;
+            }
+        }
+        return count;
+    }
+
     void expectUniqueTokens(const std::vector<std::vector<uint8_t>>& tokens) {
         for (uint32_t i = 0; i < tokens.size(); i++) {
             SCOPED_TRACE(i);
@@ -2048,12 +2077,14 @@ TEST_F(CacheTest, CacheTokenDifferentPartitionsCompoundBody) {
     PartitioningModel model;
     CreateModelForCachingTests(&model);
 
+    // A driver supporting different operations is a different version of it; the recorded
+    // partitioning is only reused for the same versions.
     // DeviceA executes the whole model.
-    const auto devices1 = makeDevices({{"deviceA", 0.8, ~0U}, {"deviceB", 0.5, 0U}});
+    const auto devices1 = makeDevices({{"deviceA", 0.8, ~0U}, {"deviceB", "1", 0.5, 0U}});
     // DeviceA executes the first operation only.
-    const auto devices2 = makeDevices({{"deviceA", 0.8, ~0U}, {"deviceB", 0.5, 1 << 1}});
+    const auto devices2 = makeDevices({{"deviceA", 0.8, ~0U}, {"deviceB", "2", 0.5, 1 << 1}});
     // DeviceA executes the second operation only.
-    const auto devices3 = makeDevices({{"deviceA", 0.8, ~0U}, {"deviceB", 0.5, 1 << 0}});
+    const auto devices3 = makeDevices({{"deviceA", 0.8, ~0U}, {"deviceB", "3", 0.5, 1 << 0}});
 
     std::vector<uint8_t> tokenIn(ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN, 0);
     std::vector<uint8_t> tokenOut1, tokenOut2, tokenOut3;
@@ -2066,6 +2097,120 @@ TEST_F(CacheTest, CacheTokenDifferentPartitionsCompoundBody) {
     expectUniqueTokens({tokenOut1, tokenOut2, tokenOut3});
 }
 
+// Test that the partitioning is recorded under the token, and that compilations reusing it end
+// up with the same steps (and therefore the same per-step cache tokens) as the first one.
+TEST_F(CacheTest, CachedPartitioningCompoundBody) {
+    PartitioningModel model;
+    CreateModelForCachingTests(&model);
+
+    // DeviceA executes the first operation only.
+    const auto devices = makeDevices({{"deviceA", 0.8, ~0U}, {"deviceB", 0.5, 1 << 1}});
+
+    std::vector<uint8_t> tokenIn(ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN, 0);
+    std::vector<uint8_t> tokenOutA, tokenOutB;
+    EXPECT_EQ(countPartitioningCacheFiles(), 0u);
+    // getTransformedCacheToken compiles repeatedly and checks for consistent tokens; all but the
+    // first compilation use the recorded partitioning.
+    getTransformedCacheToken(model, devices, "deviceA", tokenIn,
+                             ExecutePreference::PREFER_FAST_SINGLE_ANSWER, &tokenOutA);
+    getTransformedCacheToken(model, devices, "deviceB", tokenIn,
+                             ExecutePreference::PREFER_FAST_SINGLE_ANSWER, &tokenOutB);
+    EXPECT_EQ(countPartitioningCacheFiles(), 1u);
+    expectUniqueTokens({tokenOutA, tokenOutB});
+
+    // Without a token, nothing is recorded.
+    clearCacheDir();
+    std::vector<uint8_t> noToken, tokenOut;
+    getTransformedCacheToken(model, devices, "deviceA", noToken,
+                             ExecutePreference::PREFER_FAST_SINGLE_ANSWER, &tokenOut);
+    EXPECT_EQ(countPartitioningCacheFiles(), 0u);
+}
+
+// Test that a compilation reusing the recorded partitioning does not query the drivers for the
+// operations they support, and that a new version of a driver doesn't reuse it.
+TEST_F(CacheTest, CachedPartitioningSkipsSupportedOperations) {
+    PartitioningModel model;
+    CreateModelForCachingTests(&model);
+    const std::vector<uint8_t> token(ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN, 0);
+    auto compile = [this, &model, &token](const std::vector<std::shared_ptr<Device>>& devices) {
+        PartitioningCompilation compilation(&model, devices);
+        compilation.setCaching(mCacheDir.c_str(), token);
+        ASSERT_EQ(compilation.finish(), Result::NO_ERROR);
+        ASSERT_EQ(compilation.getExecutionPlan().forTest_getKind(),
+                  ExecutionPlan::Kind::COMPOUND);
+    };
+    auto& callCount = PartitioningDriver::getSupportedOperationsCallCount;
+
+    // DeviceA executes the first operation only.
+    const auto devices = makeDevices({{"deviceA", 0.8, ~0U}, {"deviceB", "1", 0.5, 1 << 1}});
+    callCount = 0;
+    compile(devices);
+    EXPECT_GT(callCount, 0u);
+    EXPECT_EQ(countPartitioningCacheFiles(), 1u);
+
+    callCount = 0;
+    compile(devices);
+    EXPECT_EQ(callCount, 0u);
+    EXPECT_EQ(countPartitioningCacheFiles(), 1u);
+
+    // A new version of deviceB may support different operations.
+    const auto newDevices = makeDevices({{"deviceA", 0.8, ~0U}, {"deviceB", "2", 0.5, 1 << 1}});
+    callCount = 0;
+    compile(newDevices);
+    EXPECT_GT(callCount, 0u);
+    EXPECT_EQ(countPartitioningCacheFiles(), 2u);
+
+    callCount = 0;
+    compile(newDevices);
+    EXPECT_EQ(callCount, 0u);
+}
+
+// Test that the models prefetched from a recorded partitioning are only used by a compilation of
+// the model it was recorded for.
+TEST_F(CacheTest, PrefetchedPartitioningOfAnotherModel) {
+    PartitioningModel model;
+    CreateModelForCachingTests(&model);
+    // The same operations as model, with the first one fused with a RELU1.
+    PartitioningModel otherModel;
+    uint32_t opnd0 = otherModel.addFloatOperand();
+    uint32_t opnd1 = otherModel.addFloatOperand();
+    uint32_t opnd2 = otherModel.addOperation2To1V1_0(2, opnd0, opnd1);
+    uint32_t opnd3 = otherModel.addFloatOperand();
+    uint32_t opnd4 = otherModel.addOperation2To1V1_0(1, opnd2, opnd3);
+    otherModel.identifyInputsAndOutputs({opnd0, opnd1, opnd3}, {opnd4});
+    otherModel.finish();
+    ASSERT_TRUE(otherModel.isValid());
+
+    const std::vector<uint8_t> token(ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN, 0);
+    const std::string cacheDir = mCacheDir + "/";
+    // DeviceA executes the first operation only.
+    const auto devices = makeDevices({{"deviceA", 0.8, ~0U}, {"deviceB", 0.5, 1 << 1}});
+    auto compile = [this, &devices, &token](const PartitioningModel& modelToCompile) {
+        PartitioningCompilation compilation(&modelToCompile, devices);
+        compilation.setCaching(mCacheDir.c_str(), token);
+        ASSERT_EQ(compilation.finish(), Result::NO_ERROR);
+        ASSERT_EQ(compilation.getExecutionPlan().forTest_getKind(),
+                  ExecutionPlan::Kind::COMPOUND);
+    };
+    auto& callCount = PartitioningDriver::prepareModelFromCacheCallCount;
+    compile(model);
+
+    // Both steps are prefetched, and the compilation takes them.
+    callCount = 0;
+    prefetchCompilationCache(devices, ANEURALNETWORKS_PREFER_FAST_SINGLE_ANSWER, cacheDir,
+                             token.data());
+    compile(model);
+    EXPECT_EQ(callCount, 2u);
+
+    // The compilation of another model with the same token and the same partitioning releases
+    // the prefetched steps, and restores them from the cache itself.
+    callCount = 0;
+    prefetchCompilationCache(devices, ANEURALNETWORKS_PREFER_FAST_SINGLE_ANSWER, cacheDir,
+                             token.data());
+    compile(otherModel);
+    EXPECT_EQ(callCount, 4u);
+}
+
 // Very basic tests of some of the PerformanceInfo functionality.
 // Placed in this file because partitioning is the consumer of this functionality.
 class PerfTest : public ::testing::Test {};
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "HalInterfaces.h"
+#include "Utils.h"
+#include "ValidateHal.h"
+
+#include <gtest/gtest.h>
+
+using namespace android::nn;
+
+namespace {
+
+constexpr uint32_t kSize = 2 * sizeof(float);
+
+class RequestValidationCacheTest : public ::testing::Test {
+   protected:
+    virtual void SetUp() override {
+        const Operand tensor = {.type = OperandType::TENSOR_FLOAT32,
+                                .dimensions = {2},
+                                .numberOfConsumers = 1,
+                                .lifetime = OperandLifeTime::MODEL_INPUT};
+        Operand output = tensor;
+        output.numberOfConsumers = 0;
+        output.lifetime = OperandLifeTime::MODEL_OUTPUT;
+        const int32_t activation = ANEURALNETWORKS_FUSED_NONE;
+        const Operand scalar = {.type = OperandType::INT32,
+                                .numberOfConsumers = 1,
+                                .lifetime = OperandLifeTime::CONSTANT_COPY,
+                                .location = {.offset = 0, .length = sizeof(activation)}};
+        mModel.operands = {tensor, tensor, scalar, output};
+        mModel.operations = {{.type = OperationType::ADD, .inputs = {0, 1, 2}, .outputs = {3}}};
+        mModel.inputIndexes = {0, 1};
+        mModel.outputIndexes = {3};
+        mModel.operandValues = std::vector<uint8_t>(sizeof(activation));
+        ASSERT_TRUE(validateModel(mModel));
+        mRequest = makeRequest(kSize);
+    }
+
+    // A request with one pool of poolSize bytes holding all the arguments.
+    static Request makeRequest(uint32_t poolSize) {
+        Request request;
+        request.inputs = {{.location = {.poolIndex = 0, .offset = 0, .length = kSize}},
+                          {.location = {.poolIndex = 0, .offset = 0, .length = kSize}}};
+        request.outputs = {{.location = {.poolIndex = 0, .offset = 0, .length = kSize}}};
+        request.pools = {allocateSharedMemory(poolSize)};
+        return request;
+    }
+
+    Model mModel;
+    Request mRequest;
+    RequestValidationCache mCache;
+};
+
+TEST_F(RequestValidationCacheTest, Repeated) {
+    EXPECT_TRUE(mCache.validate(mRequest, mModel));
+    EXPECT_TRUE(mCache.validate(mRequest, mModel));
+    // New memory with the same description matches.
+    EXPECT_TRUE(mCache.validate(makeRequest(kSize), mModel));
+}
+
+TEST_F(RequestValidationCacheTest, ChangedArgument) {
+    EXPECT_TRUE(mCache.validate(mRequest, mModel));
+    Request request = mRequest;
+    request.inputs[1].location.offset = kSize;
+    EXPECT_FALSE(mCache.validate(request, mModel));
+    request.inputs[1].location.offset = 0;
+    request.outputs[0].dimensions = {3};
+    EXPECT_FALSE(mCache.validate(request, mModel));
+    // The last valid request is still remembered.
+    EXPECT_TRUE(mCache.validate(mRequest, mModel));
+}
+
+TEST_F(RequestValidationCacheTest, ChangedPool) {
+    EXPECT_TRUE(mCache.validate(mRequest, mModel));
+    // Too small for the arguments.
+    EXPECT_FALSE(mCache.validate(makeRequest(kSize / 2), mModel));
+    Request request = mRequest;
+    request.pools[0] = hidl_memory("unknown", request.pools[0].handle(), request.pools[0].size());
+    EXPECT_FALSE(mCache.validate(request, mModel));
+    // A larger pool is valid, and validated in full.
+    EXPECT_TRUE(mCache.validate(makeRequest(2 * kSize), mModel));
+}
+
+}  // namespace
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "HalInterfaces.h"
+#include "SampleDriverCalibration.h"
+#include "SampleDriverFull.h"
+#include "Utils.h"
+
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace android::nn;
+using namespace android::nn::sample_driver;
+using android::sp;
+
+namespace {
+
+// A SampleDriverFull that only supports operations on TENSOR_FLOAT32 operands.
+class SampleDriverFloat32Only : public SampleDriverFull {
+   public:
+    SampleDriverFloat32Only(const char* name, PerformanceInfo perf)
+        : SampleDriverFull(name, perf) {}
+
+    Return<void> getSupportedOperations_1_2(const V1_2::Model& model,
+                                            getSupportedOperations_1_2_cb cb) override {
+        std::vector<bool> supported(model.operations.size());
+        for (size_t i = 0; i < model.operations.size(); i++) {
+            const uint32_t input = model.operations[i].inputs[0];
+            supported[i] = model.operands[input].type == OperandType::TENSOR_FLOAT32;
+        }
+        cb(ErrorStatus::NONE, supported);
+        return Void();
+    }
+};
+
+class SampleDriverCalibrationTest : public ::testing::Test {
+   protected:
+    virtual void SetUp() override {
+        char cacheDirTemp[] = "/data/local/tmp/TestSampleDriverCalibrationXXXXXX";
+        char* cacheDir = mkdtemp(cacheDirTemp);
+        ASSERT_NE(cacheDir, nullptr);
+        mCacheDir = cacheDir;
+        mCacheFile = mCacheDir + "/calibration";
+    }
+
+    virtual void TearDown() override {
+        if (!::testing::Test::HasFailure()) {
+            std::filesystem::remove_all(mCacheDir);
+        }
+    }
+
+    static Capabilities getCapabilities(const sp<SampleDriverFull>& driver) {
+        Capabilities capabilities;
+        driver->getCapabilities_1_2([&capabilities](ErrorStatus status, const Capabilities& c) {
+            EXPECT_EQ(status, ErrorStatus::NONE);
+            capabilities = c;
+        });
+        return capabilities;
+    }
+
+    size_t countCacheFiles() const {
+        return std::distance(std::filesystem::directory_iterator(mCacheDir),
+                             std::filesystem::directory_iterator{});
+    }
+
+    std::string mCacheDir;
+    std::string mCacheFile;
+};
+
+TEST_F(SampleDriverCalibrationTest, Measure) {
+    sp<SampleDriverFull> driver =
+            new SampleDriverFull("calibration", {.execTime = 1.0f, .powerUsage = 1.0f});
+    const Calibration calibration = Calibration::measure(*driver);
+    for (OperandType type : {OperandType::TENSOR_FLOAT32, OperandType::FLOAT32,
+                             OperandType::TENSOR_FLOAT16, OperandType::TENSOR_QUANT8_ASYMM}) {
+        SCOPED_TRACE(toString(type));
+        const auto ratio = calibration.getRatio(type);
+        ASSERT_TRUE(ratio.has_value());
+        EXPECT_GT(*ratio, 0.0f);
+    }
+    // Not measured.
+    EXPECT_FALSE(calibration.getRatio(OperandType::TENSOR_INT32).has_value());
+}
+
+TEST_F(SampleDriverCalibrationTest, MeasureSupportedOnly) {
+    sp<SampleDriverFull> driver =
+            new SampleDriverFloat32Only("calibration", {.execTime = 1.0f, .powerUsage = 1.0f});
+    const Calibration calibration = Calibration::measure(*driver);
+    EXPECT_TRUE(calibration.getRatio(OperandType::TENSOR_FLOAT32).has_value());
+    EXPECT_FALSE(calibration.getRatio(OperandType::TENSOR_FLOAT16).has_value());
+    EXPECT_FALSE(calibration.getRatio(OperandType::TENSOR_QUANT8_ASYMM).has_value());
+}
+
+TEST_F(SampleDriverCalibrationTest, Capabilities) {
+    const PerformanceInfo nominal = {.execTime = 123.0f, .powerUsage = 456.0f};
+    sp<SampleDriverFull> driver = new SampleDriverFull("calibration", nominal);
+    EXPECT_EQ(lookup(getCapabilities(driver).operandPerformance, OperandType::TENSOR_FLOAT32),
+              nominal);
+
+    driver->calibrate(mCacheDir);
+    EXPECT_EQ(countCacheFiles(), 1u);
+    const auto saved = Calibration::load(mCacheDir + "/calibration.calibration");
+    ASSERT_TRUE(saved.has_value());
+    const auto ratio = saved->getRatio(OperandType::TENSOR_FLOAT32);
+    ASSERT_TRUE(ratio.has_value());
+
+    // The nominal numbers are scaled, not replaced.
+    const Capabilities capabilities = getCapabilities(driver);
+    const PerformanceInfo float32 = lookup(capabilities.operandPerformance,
+                                           OperandType::TENSOR_FLOAT32);
+    // The file holds the ratio with six significant digits.
+    EXPECT_NEAR(float32.execTime / nominal.execTime, *ratio, *ratio * 1e-5f);
+    EXPECT_NEAR(float32.powerUsage / nominal.powerUsage, *ratio, *ratio * 1e-5f);
+    EXPECT_EQ(capabilities.relaxedFloat32toFloat16PerformanceTensor, float32);
+    EXPECT_EQ(lookup(capabilities.operandPerformance, OperandType::TENSOR_INT32), nominal);
+
+    // A second driver of the same name reads the cached calibration instead
+    // of measuring.
+    sp<SampleDriverFull> cachedDriver = new SampleDriverFull("calibration", nominal);
+    cachedDriver->calibrate(mCacheDir);
+    const PerformanceInfo cached = lookup(getCapabilities(cachedDriver).operandPerformance,
+                                          OperandType::TENSOR_FLOAT32);
+    EXPECT_NEAR(cached.execTime, float32.execTime, float32.execTime * 1e-5f);
+    EXPECT_NEAR(cached.powerUsage, float32.powerUsage, float32.powerUsage * 1e-5f);
+    EXPECT_EQ(countCacheFiles(), 1u);
+
+    // A driver of another name measures its own execution path.
+    sp<SampleDriverFull> otherDriver = new SampleDriverFloat32Only("other", nominal);
+    otherDriver->calibrate(mCacheDir);
+    EXPECT_EQ(countCacheFiles(), 2u);
+    EXPECT_EQ(lookup(getCapabilities(otherDriver).operandPerformance,
+                     OperandType::TENSOR_QUANT8_ASYMM),
+              nominal);
+}
+
+TEST_F(SampleDriverCalibrationTest, MalformedFile) {
+    EXPECT_FALSE(Calibration::load(mCacheFile).has_value());
+    std::ofstream(mCacheFile) << "nn-sample-calibration 1\ntype 3 0.5 0.25\n";
+    EXPECT_FALSE(Calibration::load(mCacheFile).has_value());
+    std::ofstream(mCacheFile) << "nn-sample-calibration 2\ntype 1000 1.0\n";
+    EXPECT_FALSE(Calibration::load(mCacheFile).has_value());
+    std::ofstream(mCacheFile) << "nn-sample-calibration 2\ntype 3 -1.0\n";
+    EXPECT_FALSE(Calibration::load(mCacheFile).has_value());
+    std::ofstream(mCacheFile) << "nn-sample-calibration 2\ntype 3 0.5\n";
+    const auto calibration = Calibration::load(mCacheFile);
+    ASSERT_TRUE(calibration.has_value());
+    const auto ratio = calibration->getRatio(OperandType::TENSOR_FLOAT32);
+    ASSERT_TRUE(ratio.has_value());
+    EXPECT_EQ(*ratio, 0.5f);
+}
+
+}  // namespace
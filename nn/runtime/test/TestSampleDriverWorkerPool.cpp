@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SampleDriverWorkerPool.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using android::nn::sample_driver::WorkerPool;
+
+namespace {
+
+TEST(SampleDriverWorkerPoolTest, Order) {
+    std::vector<int> order;
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    {
+        WorkerPool pool(1);
+        // Occupies the only thread until the other tasks are queued.
+        pool.enqueue([released] { released.wait(); }, 0, nullptr);
+        for (const auto& [id, priority] : {std::make_pair(1, 0), std::make_pair(2, 2),
+                                           std::make_pair(3, 1), std::make_pair(4, 2)}) {
+            pool.enqueue([&order, id = id] { order.push_back(id); }, priority, nullptr);
+        }
+        release.set_value();
+        // The destructor runs the queued tasks.
+    }
+    EXPECT_EQ(order, std::vector<int>({2, 4, 3, 1}));
+}
+
+TEST(SampleDriverWorkerPoolTest, GroupBound) {
+    constexpr int kTasks = 16;
+    std::mutex mutex;
+    int running = 0;
+    int maxRunning = 0;
+    std::atomic<int> ungroupedRuns{0};
+    {
+        WorkerPool pool(4);
+        const auto group = std::make_shared<WorkerPool::Group>(2);
+        for (int i = 0; i < kTasks; i++) {
+            pool.enqueue(
+                    [&] {
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            maxRunning = std::max(maxRunning, ++running);
+                        }
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                        std::lock_guard<std::mutex> lock(mutex);
+                        running--;
+                    },
+                    0, group);
+            // Tasks outside the group are not held back by it.
+            pool.enqueue([&ungroupedRuns] { ungroupedRuns++; }, 0, nullptr);
+        }
+    }
+    EXPECT_LE(maxRunning, 2);
+    EXPECT_GE(maxRunning, 1);
+    EXPECT_EQ(ungroupedRuns, kTasks);
+}
+
+TEST(SampleDriverWorkerPoolTest, Statistics) {
+    WorkerPool pool(1);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::promise<void> done;
+    pool.enqueue([released] { released.wait(); }, 0, nullptr);
+    pool.enqueue([] {}, 0, nullptr);
+    pool.enqueue([&done] { done.set_value(); }, 0, nullptr);
+    release.set_value();
+    done.get_future().wait();
+
+    const WorkerPool::Statistics statistics = pool.getStatistics();
+    EXPECT_EQ(statistics.threadCount, 1u);
+    EXPECT_GE(statistics.maxQueueDepth, 2u);
+    EXPECT_GE(statistics.executedTasks, 2u);
+    EXPECT_GE(statistics.totalWaitNs, statistics.maxWaitNs);
+}
+
+}  // namespace
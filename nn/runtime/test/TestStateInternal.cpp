@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// These tests check the contract of ANeuralNetworksState in the cases that
+// need access to the runtime's internals: a state in use by an execution, and
+// an execution that fails.
+
+#include "CompilationBuilder.h"
+#include "ExecutionBuilder.h"
+#include "Manager.h"
+#include "MemoryAccounting.h"
+#include "StateBuilder.h"
+#include "TestNeuralNetworksWrapper.h"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace android::nn;
+using Result = test_wrapper::Result;
+using Type = test_wrapper::Type;
+
+namespace {
+
+// Large enough for the estimate of the model below.
+constexpr uint64_t kMemoryBudget = 1 << 20;
+
+// Accumulates its input x in its state: it has inputs {stateIn, x} and
+// outputs {stateOut, y}, both stateIn + x.
+void CreateAccumulatorModel(test_wrapper::Model* model) {
+    test_wrapper::OperandType matrixType(Type::TENSOR_FLOAT32, {2, 2});
+    test_wrapper::OperandType scalarType(Type::INT32, {});
+    int32_t activation(ANEURALNETWORKS_FUSED_NONE);
+    auto stateIn = model->addOperand(&matrixType);
+    auto x = model->addOperand(&matrixType);
+    auto stateOut = model->addOperand(&matrixType);
+    auto y = model->addOperand(&matrixType);
+    auto d = model->addOperand(&scalarType);
+    model->setOperandValue(d, &activation, sizeof(activation));
+    model->addOperation(ANEURALNETWORKS_ADD, {stateIn, x, d}, {stateOut});
+    model->addOperation(ANEURALNETWORKS_ADD, {stateIn, x, d}, {y});
+    model->identifyInputsAndOutputs({stateIn, x}, {stateOut, y});
+    ASSERT_TRUE(model->isValid());
+    ASSERT_EQ(model->finish(), Result::NO_ERROR);
+}
+
+class StateTest : public ::testing::Test {
+   protected:
+    virtual void SetUp() override {
+        CreateAccumulatorModel(&mModel);
+        mCompilation = createCompilation();
+        ASSERT_NE(mCompilation, nullptr);
+        ASSERT_EQ(ANeuralNetworksState_create(mCompilation, &mState), ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksState_bind(mState, 0, 0), ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(ANeuralNetworksState_finish(mState), ANEURALNETWORKS_NO_ERROR);
+    }
+
+    virtual void TearDown() override {
+        ANeuralNetworksState_free(mState);
+        ANeuralNetworksCompilation_free(mCompilation);
+    }
+
+    // Compiles mModel for the CPU, with a memory budget.
+    ANeuralNetworksCompilation* createCompilation() {
+        ANeuralNetworksDevice* device =
+                reinterpret_cast<ANeuralNetworksDevice*>(DeviceManager::getCpuDevice().get());
+        ANeuralNetworksCompilation* compilation = nullptr;
+        if (ANeuralNetworksCompilation_createForDevices(mModel.getHandle(), &device, 1,
+                                                        &compilation) != ANEURALNETWORKS_NO_ERROR) {
+            return nullptr;
+        }
+        EXPECT_EQ(reinterpret_cast<CompilationBuilder*>(compilation)->setMemoryBudget(
+                          kMemoryBudget),
+                  ANEURALNETWORKS_NO_ERROR);
+        EXPECT_EQ(ANeuralNetworksCompilation_finish(compilation), ANEURALNETWORKS_NO_ERROR);
+        return compilation;
+    }
+
+    StateBuilder* stateBuilder() const { return reinterpret_cast<StateBuilder*>(mState); }
+
+    // Runs an execution with the state that adds x to it, and returns the
+    // result code. With overBudget, the execution goes over its memory
+    // budget, and so fails after it has run.
+    int run(const std::vector<float>& x, std::vector<float>* y, bool overBudget = false) {
+        ANeuralNetworksExecution* execution = nullptr;
+        EXPECT_EQ(ANeuralNetworksExecution_create(mCompilation, &execution),
+                  ANEURALNETWORKS_NO_ERROR);
+        EXPECT_EQ(ANeuralNetworksExecution_setState(execution, mState), ANEURALNETWORKS_NO_ERROR);
+        EXPECT_EQ(ANeuralNetworksExecution_setInput(execution, 1, nullptr, x.data(),
+                                                    x.size() * sizeof(float)),
+                  ANEURALNETWORKS_NO_ERROR);
+        y->assign(4, 0.0f);
+        EXPECT_EQ(ANeuralNetworksExecution_setOutput(execution, 1, nullptr, y->data(),
+                                                     y->size() * sizeof(float)),
+                  ANEURALNETWORKS_NO_ERROR);
+        if (overBudget) {
+            reinterpret_cast<ExecutionBuilder*>(execution)->getMemoryAccount()->allocate(
+                    MemoryCategory::KERNEL_SCRATCH, kMemoryBudget + 1);
+        }
+        const int n = ANeuralNetworksExecution_compute(execution);
+        ANeuralNetworksExecution_free(execution);
+        return n;
+    }
+
+    const std::vector<float> mX1 = {1.0f, 2.0f, 3.0f, 4.0f};
+    const std::vector<float> mX2 = {10.0f, 20.0f, 30.0f, 40.0f};
+
+    test_wrapper::Model mModel;
+    ANeuralNetworksCompilation* mCompilation = nullptr;
+    ANeuralNetworksState* mState = nullptr;
+};
+
+// While an execution uses the state, here stood in for by locking it, other
+// executions and reset are rejected, and leave the lock alone.
+TEST_F(StateTest, InUse) {
+    std::vector<float> y;
+    ASSERT_EQ(run(mX1, &y), ANEURALNETWORKS_NO_ERROR);
+
+    ASSERT_TRUE(stateBuilder()->tryLock());
+    EXPECT_EQ(run(mX2, &y), ANEURALNETWORKS_BAD_STATE);
+    EXPECT_EQ(ANeuralNetworksState_reset(mState), ANEURALNETWORKS_BAD_STATE);
+    EXPECT_FALSE(stateBuilder()->tryLock());
+    stateBuilder()->unlock();
+
+    // Neither the rejected execution nor the rejected reset changed the state.
+    ASSERT_EQ(run(mX2, &y), ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(y, std::vector<float>({11.0f, 22.0f, 33.0f, 44.0f}));
+}
+
+TEST_F(StateTest, FailedExecution) {
+    std::vector<float> y;
+    ASSERT_EQ(run(mX1, &y), ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(run(mX2, &y, /*overBudget=*/true), ANEURALNETWORKS_OUT_OF_MEMORY);
+
+    // The next execution reads the state the first one left.
+    ASSERT_EQ(run(mX2, &y), ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(y, std::vector<float>({11.0f, 22.0f, 33.0f, 44.0f}));
+}
+
+TEST_F(StateTest, OtherCompilation) {
+    ANeuralNetworksCompilation* other = createCompilation();
+    ASSERT_NE(other, nullptr);
+    ANeuralNetworksExecution* execution = nullptr;
+    ASSERT_EQ(ANeuralNetworksExecution_create(other, &execution), ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(ANeuralNetworksExecution_setState(execution, mState), ANEURALNETWORKS_BAD_DATA);
+    ANeuralNetworksExecution_free(execution);
+    ANeuralNetworksCompilation_free(other);
+}
+
+}  // namespace
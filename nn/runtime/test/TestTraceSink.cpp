@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TraceSink.h"
+#include "Tracing.h"
+
+#include <gtest/gtest.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace android::nn;
+
+namespace {
+
+class TraceSinkTest : public ::testing::Test {
+   protected:
+    virtual void SetUp() override {
+        setTraceSink(createCallbackTraceSink([this](const std::vector<TraceEvent>& events) {
+                         std::lock_guard<std::mutex> lock(mMutex);
+                         mEvents.insert(mEvents.end(), events.begin(), events.end());
+                     }),
+                     std::chrono::hours(1));
+    }
+
+    virtual void TearDown() override { setTraceSink(nullptr); }
+
+    // The events for the given tracepoint that the sink has received.
+    std::vector<TraceEvent> eventsNamed(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::vector<TraceEvent> events;
+        for (const TraceEvent& event : mEvents) {
+            if (name == event.name) events.push_back(event);
+        }
+        return events;
+    }
+
+    std::mutex mMutex;
+    std::vector<TraceEvent> mEvents;
+};
+
+TEST_F(TraceSinkTest, Scopes) {
+    {
+        NNTRACE_RT(NNTRACE_PHASE_EXECUTION, "TraceSinkTest::outer");
+        NNTRACE_RT_SWITCH(NNTRACE_PHASE_RESULTS, "TraceSinkTest::switch");
+    }
+    drainTraceEvents();
+
+    const auto outer = eventsNamed("[NN_LR_PE]TraceSinkTest::outer");
+    const auto inner = eventsNamed("[SW][NN_LR_PR]TraceSinkTest::switch");
+    ASSERT_EQ(outer.size(), 1u);
+    ASSERT_EQ(inner.size(), 1u);
+    EXPECT_EQ(outer[0].tid, inner[0].tid);
+    EXPECT_LE(outer[0].startNs, inner[0].startNs);
+    EXPECT_GE(outer[0].startNs + outer[0].durationNs, inner[0].startNs + inner[0].durationNs);
+}
+
+TEST_F(TraceSinkTest, Threads) {
+    auto traced = [] { NNTRACE_CPU(NNTRACE_PHASE_EXECUTION, "TraceSinkTest::thread"); };
+    std::thread first(traced);
+    std::thread second(traced);
+    first.join();
+    second.join();
+    drainTraceEvents();
+
+    // Each thread drains from its own buffer, which is discarded once the
+    // thread has exited.
+    EXPECT_EQ(eventsNamed("[NN_LC_PE]TraceSinkTest::thread").size(), 2u);
+}
+
+TEST_F(TraceSinkTest, HandOff) {
+    const uint64_t beforeNs = traceNowNs();
+    const auto handOff = NNTRACE_HAND_OFF(NNTRACE_LAYER_RUNTIME, NNTRACE_PHASE_EXECUTION,
+                                          "TraceSinkTest::handOff");
+    std::thread thread([handOff] {
+        handOff.finish();
+        NNTRACE_RT(NNTRACE_PHASE_EXECUTION, "TraceSinkTest::handedOff");
+    });
+    thread.join();
+    drainTraceEvents();
+
+    // Recorded by the thread picking up the work, from the time it was handed off.
+    const auto handOffEvents = eventsNamed("[NN_LR_PE]TraceSinkTest::handOff");
+    const auto handedOffEvents = eventsNamed("[NN_LR_PE]TraceSinkTest::handedOff");
+    ASSERT_EQ(handOffEvents.size(), 1u);
+    ASSERT_EQ(handedOffEvents.size(), 1u);
+    EXPECT_EQ(handOffEvents[0].tid, handedOffEvents[0].tid);
+    EXPECT_GE(handOffEvents[0].startNs, beforeNs);
+    EXPECT_LE(handOffEvents[0].startNs + handOffEvents[0].durationNs, handedOffEvents[0].startNs);
+}
+
+TEST_F(TraceSinkTest, Uninstalled) {
+    setTraceSink(nullptr);
+    { NNTRACE_RT(NNTRACE_PHASE_EXECUTION, "TraceSinkTest::uninstalled"); }
+    drainTraceEvents();
+    EXPECT_TRUE(eventsNamed("[NN_LR_PE]TraceSinkTest::uninstalled").empty());
+}
+
+TEST_F(TraceSinkTest, DroppedWhenFull) {
+    const uint64_t dropped = getDroppedTraceEventCount();
+    for (int i = 0; i < 2000; i++) {
+        NNTRACE_RT(NNTRACE_PHASE_EXECUTION, "TraceSinkTest::full");
+    }
+    drainTraceEvents();
+    const size_t received = eventsNamed("[NN_LR_PE]TraceSinkTest::full").size();
+    EXPECT_LT(received, 2000u);
+    EXPECT_EQ(getDroppedTraceEventCount() - dropped, 2000u - received);
+}
+
+TEST(ParseTraceEventNameTest, Names) {
+    TraceEventName name;
+    ASSERT_TRUE(parseTraceEventName("[NN_LR_PE]ANeuralNetworksExecution_compute", &name));
+    EXPECT_EQ(name.layer, NNTRACE_LAYER_RUNTIME);
+    EXPECT_EQ(name.phase, NNTRACE_PHASE_EXECUTION);
+    EXPECT_EQ(name.detail, "ANeuralNetworksExecution_compute");
+    EXPECT_FALSE(name.isSwitch);
+    EXPECT_FALSE(name.isSubtract);
+
+    ASSERT_TRUE(parseTraceEventName("[SW][NN_LC_PCO]optimized_ops::Add", &name));
+    EXPECT_EQ(name.layer, NNTRACE_LAYER_CPU);
+    EXPECT_EQ(name.phase, NNTRACE_PHASE_COMPUTATION);
+    EXPECT_EQ(name.detail, "optimized_ops::Add");
+    EXPECT_TRUE(name.isSwitch);
+
+    ASSERT_TRUE(parseTraceEventName("[SUB][NN_LR_PC]VersionedIDevice::prepareModel", &name));
+    EXPECT_TRUE(name.isSubtract);
+    EXPECT_EQ(name.phase, NNTRACE_PHASE_COMPILATION);
+
+    EXPECT_FALSE(parseTraceEventName("ANeuralNetworksExecution_compute", &name));
+    EXPECT_FALSE(parseTraceEventName("[NN_LR]detail", &name));
+}
+
+}  // end namespace
@@ -154,6 +154,117 @@ TEST_F(TrivialTest, AddThree) {
     ASSERT_EQ(CompareMatrices(expected3b, actual), 0);
 }
 
+TEST_F(TrivialTest, ChainThroughCompilationMemory) {
+    Model modelAdd2;
+    CreateAddTwoTensorModel(&modelAdd2);
+    Compilation first(&modelAdd2);
+    ASSERT_EQ(first.finish(), Result::NO_ERROR);
+    Compilation second(&modelAdd2);
+    ASSERT_EQ(second.finish(), Result::NO_ERROR);
+
+    ANeuralNetworksMemory* memoryHandle = nullptr;
+    ASSERT_EQ(ANeuralNetworksMemory_createForCompilationOutput(first.getHandle(), 0, &memoryHandle),
+              ANEURALNETWORKS_NO_ERROR);
+    const Memory memory(memoryHandle);
+
+    // The first execution leaves its sum in the memory, and the second one
+    // adds matrix3 to it, without the application ever reading the memory.
+    Execution execution1(&first);
+    ASSERT_EQ(execution1.setInput(0, matrix1, sizeof(Matrix3x4)), Result::NO_ERROR);
+    ASSERT_EQ(execution1.setInput(1, matrix2, sizeof(Matrix3x4)), Result::NO_ERROR);
+    ASSERT_EQ(execution1.setOutputFromMemory(0, &memory, 0, sizeof(Matrix3x4)), Result::NO_ERROR);
+    ASSERT_EQ(execution1.compute(), Result::NO_ERROR);
+
+    Matrix3x4 actual;
+    memset(&actual, 0, sizeof(actual));
+    Execution execution2(&second);
+    ASSERT_EQ(execution2.setInputFromMemory(0, &memory, 0, sizeof(Matrix3x4)), Result::NO_ERROR);
+    ASSERT_EQ(execution2.setInput(1, matrix3, sizeof(Matrix3x4)), Result::NO_ERROR);
+    ASSERT_EQ(execution2.setOutput(0, actual, sizeof(Matrix3x4)), Result::NO_ERROR);
+    ASSERT_EQ(execution2.compute(), Result::NO_ERROR);
+    ASSERT_EQ(CompareMatrices(expected3, actual), 0);
+}
+
+// Create a model that accumulates its input x in its state: it has inputs
+// {stateIn, x} and outputs {stateOut, y}, both stateIn + x.
+void CreateAccumulatorModel(Model* model) {
+    OperandType matrixType(Type::TENSOR_FLOAT32, {3, 4});
+    OperandType scalarType(Type::INT32, {});
+    int32_t activation(ANEURALNETWORKS_FUSED_NONE);
+    auto stateIn = model->addOperand(&matrixType);
+    auto x = model->addOperand(&matrixType);
+    auto stateOut = model->addOperand(&matrixType);
+    auto y = model->addOperand(&matrixType);
+    auto d = model->addOperand(&scalarType);
+    model->setOperandValue(d, &activation, sizeof(activation));
+    model->addOperation(ANEURALNETWORKS_ADD, {stateIn, x, d}, {stateOut});
+    model->addOperation(ANEURALNETWORKS_ADD, {stateIn, x, d}, {y});
+    model->identifyInputsAndOutputs({stateIn, x}, {stateOut, y});
+    ASSERT_TRUE(model->isValid());
+    model->finish();
+}
+
+TEST_F(TrivialTest, StatefulExecutions) {
+    Model modelAccumulator;
+    CreateAccumulatorModel(&modelAccumulator);
+    Compilation compilation(&modelAccumulator);
+    ASSERT_EQ(compilation.finish(), Result::NO_ERROR);
+
+    ANeuralNetworksState* state = nullptr;
+    ASSERT_EQ(ANeuralNetworksState_create(compilation.getHandle(), &state),
+              ANEURALNETWORKS_NO_ERROR);
+    // Indices out of range, and arguments already bound, are rejected.
+    EXPECT_EQ(ANeuralNetworksState_bind(state, 0, 2), ANEURALNETWORKS_BAD_DATA);
+    ASSERT_EQ(ANeuralNetworksState_bind(state, 0, 0), ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(ANeuralNetworksState_bind(state, 1, 0), ANEURALNETWORKS_BAD_DATA);
+    ASSERT_EQ(ANeuralNetworksState_finish(state), ANEURALNETWORKS_NO_ERROR);
+
+    // Each execution reads the state the previous one left, starting from
+    // zeros, so y is the sum of all the x so far.
+    auto run = [&compilation, state](const Matrix3x4& x, Matrix3x4* y) {
+        Execution execution(&compilation);
+        ASSERT_EQ(execution.setState(state), Result::NO_ERROR);
+        EXPECT_EQ(execution.setInput(0, x, sizeof(Matrix3x4)), Result::BAD_STATE);
+        ASSERT_EQ(execution.setInput(1, x, sizeof(Matrix3x4)), Result::NO_ERROR);
+        ASSERT_EQ(execution.setOutput(1, *y, sizeof(Matrix3x4)), Result::NO_ERROR);
+        ASSERT_EQ(execution.compute(), Result::NO_ERROR);
+    };
+    Matrix3x4 actual;
+    run(matrix1, &actual);
+    EXPECT_EQ(CompareMatrices(matrix1, actual), 0);
+    run(matrix2, &actual);
+    EXPECT_EQ(CompareMatrices(expected2, actual), 0);
+    run(matrix3, &actual);
+    EXPECT_EQ(CompareMatrices(expected3, actual), 0);
+
+    ASSERT_EQ(ANeuralNetworksState_reset(state), ANEURALNETWORKS_NO_ERROR);
+    run(matrix3, &actual);
+    EXPECT_EQ(CompareMatrices(matrix3, actual), 0);
+
+    ANeuralNetworksState_free(state);
+}
+
+TEST_F(TrivialTest, Fingerprint) {
+    auto getFingerprint = [](const Model& model) {
+        std::vector<uint8_t> fingerprint(ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN);
+        EXPECT_EQ(ANeuralNetworksModel_getFingerprint(model.getHandle(), fingerprint.data()),
+                  ANEURALNETWORKS_NO_ERROR);
+        return fingerprint;
+    };
+    Model modelAdd3, sameModelAdd3, otherBiasModelAdd3, modelAdd2;
+    CreateAddThreeTensorModel(&modelAdd3, matrix3);
+    CreateAddThreeTensorModel(&sameModelAdd3, matrix3);
+    CreateAddThreeTensorModel(&otherBiasModelAdd3, matrix2);
+    CreateAddTwoTensorModel(&modelAdd2);
+
+    const std::vector<uint8_t> fingerprint = getFingerprint(modelAdd3);
+    // Computed once, so stable across calls.
+    EXPECT_EQ(getFingerprint(modelAdd3), fingerprint);
+    EXPECT_EQ(getFingerprint(sameModelAdd3), fingerprint);
+    EXPECT_NE(getFingerprint(otherBiasModelAdd3), fingerprint);
+    EXPECT_NE(getFingerprint(modelAdd2), fingerprint);
+}
+
 TEST_F(TrivialTest, BroadcastAddTwo) {
     Model modelBroadcastAdd2;
     // activation: NONE.
@@ -504,8 +504,9 @@ TEST(OperationValidationTest, QUANTIZED_16BIT_LSTM) {
     test.testOpsValidations();
 }
 
-void splitTest(int32_t inputOperandType) {
+void splitTest(int32_t inputOperandType, uint32_t outputCount = 2) {
     SCOPED_TRACE(inputOperandType);
+    SCOPED_TRACE(outputCount);
     uint32_t inputDimensions[4] = {2, 2, 2, 2};
     ANeuralNetworksOperandType input0 = getOpType(inputOperandType, 4, inputDimensions);
     ANeuralNetworksOperandType axis = {
@@ -519,9 +520,9 @@ void splitTest(int32_t inputOperandType) {
             .dimensions = nullptr,
     };
     uint32_t outputDimensions[2] = {2, 2};
-    ANeuralNetworksOperandType output0 = getOpType(inputOperandType, 2, outputDimensions);
-    ANeuralNetworksOperandType output1 = getOpType(inputOperandType, 2, outputDimensions);
-    OperationTestBase test(ANEURALNETWORKS_SPLIT, {input0, axis, count}, {output0, output1});
+    std::vector<ANeuralNetworksOperandType> outputs(
+            outputCount, getOpType(inputOperandType, 2, outputDimensions));
+    OperationTestBase test(ANEURALNETWORKS_SPLIT, {input0, axis, count}, outputs);
     test.testOpsValidations();
 }
 
@@ -532,6 +533,15 @@ TEST(OperationValidationTest, SPLIT) {
     splitTest(ANEURALNETWORKS_TENSOR_QUANT8_ASYMM);
 }
 
+// The expected output types of a SPLIT are kept inline for up to 64 outputs
+// and on the heap beyond that.
+TEST(OperationValidationTest, SPLIT_manyOutputs) {
+    splitTest(ANEURALNETWORKS_TENSOR_FLOAT32, 64);
+    splitTest(ANEURALNETWORKS_TENSOR_FLOAT32, 65);
+    splitTest(ANEURALNETWORKS_TENSOR_QUANT8_ASYMM, 64);
+    splitTest(ANEURALNETWORKS_TENSOR_QUANT8_ASYMM, 100);
+}
+
 void tileTest(int32_t inputOperandType) {
     SCOPED_TRACE(inputOperandType);
     uint32_t inputDimensions[4] = {2, 2, 2, 2};
@@ -606,6 +606,18 @@ TEST_F(ValidationTestModel, Finish) {
     EXPECT_EQ(ANeuralNetworksModel_finish(mModel), ANEURALNETWORKS_BAD_STATE);
 }
 
+TEST_F(ValidationTestModel, GetFingerprint) {
+    uint8_t fingerprint[ANEURALNETWORKS_BYTE_SIZE_OF_CACHE_TOKEN];
+    EXPECT_EQ(ANeuralNetworksModel_getFingerprint(nullptr, fingerprint),
+              ANEURALNETWORKS_UNEXPECTED_NULL);
+    EXPECT_EQ(ANeuralNetworksModel_getFingerprint(mModel, nullptr),
+              ANEURALNETWORKS_UNEXPECTED_NULL);
+    // The model is not finished yet.
+    EXPECT_EQ(ANeuralNetworksModel_getFingerprint(mModel, fingerprint), ANEURALNETWORKS_BAD_STATE);
+    createModel();
+    EXPECT_EQ(ANeuralNetworksModel_getFingerprint(mModel, fingerprint), ANEURALNETWORKS_NO_ERROR);
+}
+
 TEST_F(ValidationTestModel, EmptyModel) {
     // An empty model is invalid
     EXPECT_EQ(ANeuralNetworksModel_finish(mModel), ANEURALNETWORKS_BAD_DATA);
@@ -773,6 +785,30 @@ TEST_F(ValidationTestCompilation, CreateExecution) {
     EXPECT_EQ(ANeuralNetworksExecution_create(mCompilation, &execution), ANEURALNETWORKS_BAD_STATE);
 }
 
+TEST_F(ValidationTestCompilation, CreateMemory) {
+    ANeuralNetworksMemory* memory = nullptr;
+    EXPECT_EQ(ANeuralNetworksMemory_createForCompilationInput(nullptr, 0, &memory),
+              ANEURALNETWORKS_UNEXPECTED_NULL);
+    EXPECT_EQ(ANeuralNetworksMemory_createForCompilationOutput(mCompilation, 0, nullptr),
+              ANEURALNETWORKS_UNEXPECTED_NULL);
+    // The compilation is not finished yet.
+    EXPECT_EQ(ANeuralNetworksMemory_createForCompilationInput(mCompilation, 0, &memory),
+              ANEURALNETWORKS_BAD_STATE);
+    EXPECT_EQ(memory, nullptr);
+    ASSERT_EQ(ANeuralNetworksCompilation_finish(mCompilation), ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(ANeuralNetworksMemory_createForCompilationInput(mCompilation, 3, &memory),
+              ANEURALNETWORKS_BAD_DATA);
+    EXPECT_EQ(ANeuralNetworksMemory_createForCompilationOutput(mCompilation, 1, &memory),
+              ANEURALNETWORKS_BAD_DATA);
+    EXPECT_EQ(ANeuralNetworksMemory_createForCompilationInput(mCompilation, -1, &memory),
+              ANEURALNETWORKS_BAD_DATA);
+    EXPECT_EQ(memory, nullptr);
+    EXPECT_EQ(ANeuralNetworksMemory_createForCompilationOutput(mCompilation, 0, &memory),
+              ANEURALNETWORKS_NO_ERROR);
+    EXPECT_NE(memory, nullptr);
+    ANeuralNetworksMemory_free(memory);
+}
+
 // Also see TEST_F(ValidationTestCompilationForDevices_1, Finish)
 TEST_F(ValidationTestCompilation, Finish) {
     EXPECT_EQ(ANeuralNetworksCompilation_finish(nullptr), ANEURALNETWORKS_UNEXPECTED_NULL);
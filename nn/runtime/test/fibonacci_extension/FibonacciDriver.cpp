@@ -75,6 +75,24 @@ bool validate(const Operation& operation, const Model& model) {
     return true;
 }
 
+// Validates the operation for its CPU implementation. The context only has the operand types,
+// so the extension types are checked by their type within the extension.
+bool validateWithContext(const IOperationValidationContext* context) {
+    NN_RET_CHECK_EQ(context->getNumInputs(), kNumInputs);
+    NN_RET_CHECK_EQ(context->getNumOutputs(), kNumOutputs);
+    auto isExtensionType = [](OperandType type, uint16_t typeWithinExtension) {
+        return isExtensionOperandType(type) &&
+               (static_cast<int32_t>(type) & kTypeWithinExtensionMask) == typeWithinExtension;
+    };
+    const OperandType inputType = context->getInputType(kInputN);
+    const OperandType outputType = context->getOutputType(kOutputTensor);
+    NN_RET_CHECK(isExtensionType(inputType, TEST_VENDOR_INT64) ||
+                 inputType == OperandType::TENSOR_FLOAT32);
+    NN_RET_CHECK(isExtensionType(outputType, TEST_VENDOR_TENSOR_QUANT64_ASYMM) ||
+                 outputType == OperandType::TENSOR_FLOAT32);
+    return true;
+}
+
 bool prepare(IOperationExecutionContext* context) {
     int64_t n;
     if (context->getInputType(kInputN) == OperandType::TENSOR_FLOAT32) {
@@ -135,10 +153,11 @@ bool execute(IOperationExecutionContext* context) {
 
 const OperationRegistration* FibonacciOperationResolver::findOperation(
         OperationType operationType) const {
-    // .validate is omitted because it's not used by the extension driver.
-    static OperationRegistration operationRegistration(operationType, fibonacci_op::kOperationName,
-                                                       nullptr, fibonacci_op::prepare,
-                                                       fibonacci_op::execute, {});
+    // The extension driver validates with the model instead, but the runtime requires .validate
+    // to run the operation on the CPU.
+    static OperationRegistration operationRegistration(
+            operationType, fibonacci_op::kOperationName, fibonacci_op::validateWithContext,
+            fibonacci_op::prepare, fibonacci_op::execute, {});
     uint16_t prefix = static_cast<int32_t>(operationType) >> kLowBitsType;
     uint16_t typeWithinExtension = static_cast<int32_t>(operationType) & kTypeWithinExtensionMask;
     // Assumes no other extensions in use.
@@ -90,6 +90,21 @@ class FibonacciExtensionTest : public ::testing::Test {
         TypeManager::get()->forTest_reset();
     }
 
+    // Registers the kernels a vendor would provide in a library listed in
+    // ro.nnapi.extensions.cpu_kernels.
+    void registerCpuKernels() {
+        const ExtensionCpuKernels kernels = {
+                .extension = {.name = TEST_VENDOR_FIBONACCI_EXTENSION_NAME,
+                              .operandTypes = {{.type = TEST_VENDOR_INT64,
+                                                .isTensor = false,
+                                                .byteSize = 8},
+                                               {.type = TEST_VENDOR_TENSOR_QUANT64_ASYMM,
+                                                .isTensor = true,
+                                                .byteSize = 8}}},
+                .resolver = sample_driver::FibonacciOperationResolver::get()};
+        ASSERT_TRUE(TypeManager::get()->forTest_registerCpuKernels(kernels));
+    }
+
     void checkSupportedOperations(const std::vector<bool>& expected) {
         const uint32_t kMaxNumberOperations = 256;
         EXPECT_LE(expected.size(), kMaxNumberOperations);
@@ -236,6 +251,46 @@ TEST_F(FibonacciExtensionTest, ModelWithTemporaries) {
     EXPECT_EQ(output[9], 55);
 }
 
+TEST_F(FibonacciExtensionTest, CpuKernels) {
+    registerCpuKernels();
+    // Only the CPU.
+    mDevices = {mDevices[1]};
+
+    constexpr uint32_t N = 10;
+    ExtensionOperandType inputType(Type::TENSOR_FLOAT32, {1});
+    ExtensionOperandType outputType(Type::TENSOR_FLOAT32, {N});
+    createModel(&mModel, inputType, outputType, /*addNopOperations=*/true);
+    checkSupportedOperations({true, true, true});
+    prepareForExecution();
+
+    float input[] = {N};
+    EXPECT_EQ(ANeuralNetworksExecution_setInput(mExecution, 0, nullptr, &input, sizeof(input)),
+              ANEURALNETWORKS_NO_ERROR);
+
+    float output[N] = {};
+    EXPECT_EQ(ANeuralNetworksExecution_setOutput(mExecution, 0, nullptr, &output, sizeof(output)),
+              ANEURALNETWORKS_NO_ERROR);
+
+    ASSERT_EQ(ANeuralNetworksExecution_compute(mExecution), ANEURALNETWORKS_NO_ERROR);
+
+    EXPECT_EQ(output[0], 1);
+    EXPECT_EQ(output[1], 1);
+    EXPECT_EQ(output[2], 2);
+    EXPECT_EQ(output[9], 55);
+}
+
+TEST_F(FibonacciExtensionTest, CpuKernelsInvalidInputType) {
+    registerCpuKernels();
+    // Only the CPU.
+    mDevices = {mDevices[1]};
+
+    ExtensionOperandType inputType(Type::TENSOR_INT32, {1});  // Unsupported type.
+    ExtensionOperandType outputType(Type::TENSOR_FLOAT32, {1});
+    createModel(&mModel, inputType, outputType, /*addNopOperations=*/false);
+    // The CPU kernel's validate function rejects the operation.
+    checkSupportedOperations({false});
+}
+
 TEST_F(FibonacciExtensionTest, InvalidInputType) {
     ExtensionOperandType inputType(Type::TENSOR_INT32, {1});  // Unsupported type.
     ExtensionOperandType outputType(Type::TENSOR_FLOAT32, {1});
@@ -25,7 +25,12 @@
 #include "fuzzing/RandomGraphGeneratorUtils.h"
 
 #ifndef NNTEST_CTS
+#include <android-base/parsedouble.h>
 #include <android-base/properties.h>
+#include <android-base/strings.h>
+#include <chrono>
+#include <fstream>
+#include <map>
 #include <vector>
 #include "Manager.h"
 #include "SampleDriverFull.h"
@@ -127,6 +132,8 @@ class CompilationForDevice : public test_wrapper::Compilation {
                                                               &mCompilation);
         return ret == ANEURALNETWORKS_NO_ERROR;
     }
+
+    ANeuralNetworksCompilation** getHandlePointer() { return &mCompilation; }
 };
 
 // NN API fuzzer logging setting comes from system property debug.nn.fuzzer.log and
@@ -635,6 +642,154 @@ TEST_RANDOM_GRAPH_WITH_DATA_TYPE_AND_RANK(TENSOR_BOOL8, 3);
 TEST_RANDOM_GRAPH_WITH_DATA_TYPE_AND_RANK(TENSOR_BOOL8, 2);
 TEST_RANDOM_GRAPH_WITH_DATA_TYPE_AND_RANK(TENSOR_BOOL8, 1);
 
+#ifndef NNTEST_CTS
+// Performance regression mode, enabled by setprop debug.nn.fuzzer.perf 1.
+//
+// Generates large random graphs and measures, for each of them, the time to finish the model, and
+// the time to compile and execute it in three configurations: on the reference device only, on a
+// single synthetic driver, and partitioned across the three synthetic drivers. Scaling problems in
+// model validation, partitioning, driver preparation or the CpuExecutor show up as measurements
+// beyond the baseline.
+//
+// * setprop debug.nn.fuzzer.perf.numops 100,1000 : graph sizes to measure (the default).
+// * setprop debug.nn.fuzzer.perf.baseline <file> : baseline file, by default
+//   /data/local/tmp/TestRandomGraph_perf_baseline.txt. Each line is "<measurement> <ms>".
+// * setprop debug.nn.fuzzer.perf.tolerance 0.5 : allowed relative slowdown (the default).
+// * setprop debug.nn.fuzzer.perf.update 1 : record the measurements as the new baseline instead
+//   of checking them. Measurements missing from the baseline are always recorded.
+class RandomGraphPerfTest : public RandomGraphTest {
+   protected:
+    // Measurements below this many milliseconds are too noisy to compare relatively.
+    static constexpr double kAbsoluteToleranceMs = 2.0;
+    static constexpr uint32_t kNumTimedExecutions = 5;
+
+    using Clock = std::chrono::steady_clock;
+    static double elapsedMs(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // Compiles the model, for the given device or by letting the runtime distribute it across the
+    // current device list if device is nullptr, and executes it. Records the compilation time and
+    // the median execution time.
+    void measureCompileAndExecute(const test_wrapper::Model* model,
+                                  const ANeuralNetworksDevice* device, const std::string& key) {
+        SCOPED_TRACE(key);
+        CompilationForDevice compilation;
+        const auto compileStart = Clock::now();
+        if (device != nullptr) {
+            ASSERT_TRUE(compilation.initialize(model, device));
+        } else {
+            ASSERT_EQ(ANeuralNetworksCompilation_create(model->getHandle(),
+                                                        compilation.getHandlePointer()),
+                      ANEURALNETWORKS_NO_ERROR);
+        }
+        ASSERT_EQ(compilation.finish(), Result::NO_ERROR);
+        mMeasurements[key + ".compile"] = elapsedMs(compileStart);
+
+        std::vector<double> executeMs;
+        // The first execution is a warm up.
+        for (uint32_t i = 0; i <= kNumTimedExecutions; i++) {
+            test_wrapper::Execution execution(&compilation);
+            std::vector<OperandBuffer> outputs;
+            mGraph.createRequest(&execution, &outputs);
+            const auto executeStart = Clock::now();
+            ASSERT_EQ(execution.compute(), Result::NO_ERROR);
+            if (i > 0) executeMs.push_back(elapsedMs(executeStart));
+        }
+        std::sort(executeMs.begin(), executeMs.end());
+        mMeasurements[key + ".execute"] = executeMs[executeMs.size() / 2];
+    }
+
+    void measureRandomGraph(uint32_t numOperations) {
+        const std::string key = mTestName + "." + std::to_string(numOperations);
+        ASSERT_TRUE(mGraph.generate(kSeed, numOperations, DimensionRange::NARROW));
+
+        test_wrapper::Model model;
+        const auto finishStart = Clock::now();
+        mGraph.createModel(&model);
+        ASSERT_TRUE(model.isValid());
+        ASSERT_EQ(model.finish(), Result::NO_ERROR);
+        mMeasurements[key + ".finish"] = elapsedMs(finishStart);
+
+        measureCompileAndExecute(&model, mDevices[kRefDeviceName], key + ".cpu");
+        DeviceManager::get()->forTest_setDevices({mSyntheticDevices.front()});
+        measureCompileAndExecute(&model, nullptr, key + ".sample");
+        DeviceManager::get()->forTest_setDevices(mSyntheticDevices);
+        measureCompileAndExecute(&model, nullptr, key + ".partitioned");
+        DeviceManager::get()->forTest_setDevices(mStandardDevices);
+    }
+
+    static std::map<std::string, double> readBaseline(const std::string& filename) {
+        std::map<std::string, double> baseline;
+        std::ifstream in(filename);
+        std::string name;
+        double ms;
+        while (in >> name >> ms) {
+            baseline[name] = ms;
+        }
+        return baseline;
+    }
+
+    static void writeBaseline(const std::string& filename,
+                              const std::map<std::string, double>& baseline) {
+        std::ofstream out(filename, std::ofstream::trunc);
+        for (const auto& [name, ms] : baseline) {
+            out << name << " " << ms << "\n";
+        }
+    }
+
+    void testRandomGraphPerf() {
+        if (::android::base::GetProperty("debug.nn.fuzzer.perf", "") != "1") {
+            GTEST_SKIP();
+        }
+        const std::string numOpsList =
+                ::android::base::GetProperty("debug.nn.fuzzer.perf.numops", "100,1000");
+        const std::string baselineFile = ::android::base::GetProperty(
+                "debug.nn.fuzzer.perf.baseline",
+                "/data/local/tmp/TestRandomGraph_perf_baseline.txt");
+        double tolerance = 0.5;
+        ::android::base::ParseDouble(
+                ::android::base::GetProperty("debug.nn.fuzzer.perf.tolerance", "0.5").c_str(),
+                &tolerance);
+        const bool update = ::android::base::GetProperty("debug.nn.fuzzer.perf.update", "") == "1";
+
+        for (const std::string& numOps : ::android::base::Split(numOpsList, ",")) {
+            measureRandomGraph(std::stoul(numOps));
+            if (::testing::Test::HasFatalFailure()) return;
+        }
+
+        std::map<std::string, double> baseline = readBaseline(baselineFile);
+        bool changed = false;
+        for (const auto& [name, ms] : mMeasurements) {
+            std::cout << "[          ]   " << name << ": " << ms << " ms\n";
+            const auto it = baseline.find(name);
+            if (update || it == baseline.end()) {
+                baseline[name] = ms;
+                changed = true;
+            } else {
+                EXPECT_LE(ms, it->second * (1.0 + tolerance) + kAbsoluteToleranceMs)
+                        << name << " regressed from a baseline of " << it->second << " ms";
+            }
+        }
+        if (changed) {
+            writeBaseline(baselineFile, baseline);
+        }
+    }
+
+    std::map<std::string, double> mMeasurements;
+};
+
+// As for the large random graph tests, operations are restricted to one data type and rank to
+// keep the graph connected.
+TEST_P(RandomGraphPerfTest, Graph_TENSOR_FLOAT32_Rank4) {
+    OperationFilter filter = {.dataTypes = {Type::TENSOR_FLOAT32}, .ranks = {4}};
+    OperationManager::get()->applyFilter(filter);
+    testRandomGraphPerf();
+}
+
+INSTANTIATE_TEST_CASE_P(TestRandomGraph, RandomGraphPerfTest, ::testing::Range(0u, 3u));
+#endif
+
 #ifdef NNTEST_CTS
 INSTANTIATE_TEST_CASE_P(TestRandomGraph, SingleOperationTest, ::testing::Range(0u, 50u));
 INSTANTIATE_TEST_CASE_P(TestRandomGraph, RandomGraphTest, ::testing::Range(0u, 50u));
@@ -7,6 +7,10 @@ Reads a file with output from multiple runs of
 
 and provides either raw measurements or aggregated statistics of the runs.
 
+Also reads the output of NeuralNetworksTest_benchmark --output=<file>, which
+holds one JSON array per run; the mean latency of each benchmark in a run is
+taken as one sample.
+
 Usage:
   parse_benchmark --format=[json|table] --output=[full|stats] [adb output filename]
 
@@ -47,7 +51,11 @@ def read_data(input_filename):
 
   with open(input_filename) as f:
     for line in f:
-      if "INSTRUMENTATION_STATUS:" in line and "_avg" in line:
+      if line.startswith("["):
+        for result in json.loads(line):
+          name = result["benchmark"]
+          data[name] = data.get(name, []) + [float(result["mean"])]
+      elif "INSTRUMENTATION_STATUS:" in line and "_avg" in line:
         sample = line.split(": ")[1]
         name, value = sample.split("=")
         name = name[:-4]